@@ -1,11 +1,26 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stddef.h> 
+#include <stdint.h>
 #include "adc.h"
-#include "ina.h"
+#include "snapshot.h"
 #include "solar_tracker.h"
+#include "telemetry_batch.h"
 
 
 void mqtt_app_start(void);
 
-int mqtt_send_telemetry(ina219_data_t *panel, ina219_data_t *bat, float soc, ldr_data_t *ldrs, tracker_data_t *tracker);
\ No newline at end of file
+// Publica los canales INA válidos del snapshot como "<rol>Voltage/Current/Power"
+int mqtt_send_telemetry(const ina_snapshot_t *ina, float soc, ldr_data_t *ldrs, tracker_data_t *tracker);
+
+// Telemetría por lotes: desconecta el cliente mientras la radio está apagada y lo reconecta
+void mqtt_app_suspend(void);
+void mqtt_app_resume(void);
+bool mqtt_wait_connected(uint32_t timeout_ms);
+// Espera a que el broker confirme (QoS 1) todo lo publicado
+bool mqtt_wait_delivered(uint32_t timeout_ms);
+
+// Publica las muestras con su hora ([{"ts":..,"values":{..}}]) más el documento completo actual
+int mqtt_send_batch(const telemetry_sample_t *samples, size_t n,
+                    const ina_snapshot_t *ina, float soc, ldr_data_t *ldrs, tracker_data_t *tracker);
\ No newline at end of file
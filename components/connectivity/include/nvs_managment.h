@@ -1,7 +1,13 @@
 #pragma once
 
 #include <esp_log.h>
+#include "adc.h"
 
 void save_wifi_credentials(const char* ssid, const char* pass);
 bool load_wifi_credentials(char *ssid, size_t ssid_size, char* pass, size_t pass_size);
-void init_nvs(void);
\ No newline at end of file
+void init_nvs(void);
+
+// Calibración por canal de los LDR (blob junto a las credenciales WiFi)
+bool save_ldr_calibration(const ldr_cal_t *cal);
+bool load_ldr_calibration(ldr_cal_t *cal);
+bool erase_ldr_calibration(void);
\ No newline at end of file
@@ -1,4 +1,6 @@
 #pragma once
 
 void telegram_bot_start(void);
+
+// Se puede llamar desde cualquier tarea: los envíos concurrentes se serializan
 void telegram_send_text(const char *format, ...);
\ No newline at end of file
@@ -0,0 +1,37 @@
+// Telemetría por lotes: muestras en memoria RTC y radio encendida sólo para subirlas
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "ina.h"
+#include "snapshot.h"
+#include "sdkconfig.h"
+
+// Muestra reducida (~56 bytes): lo imprescindible para las gráficas
+typedef struct {
+	int64_t ts_ms;					// Hora Unix en ms (formato de ThingsBoard)
+	float voltage_V[INA_ROLE_MAX];
+	float current_A[INA_ROLE_MAX];
+	float soc;
+	float servo_h, servo_v;
+	uint16_t irradiance_wm2;
+	uint8_t valid_mask;				// Bit r = canal INA r válido
+} telemetry_sample_t;
+
+#if CONFIG_TELEMETRY_BATCH
+
+// Crea la tarea de subida. La primera subida es inmediata (la WiFi ya está conectada).
+void telemetry_batch_start(void);
+
+/*
+ * Desde el bucle principal en cada ciclo con datos: guarda una muestra cada
+ * CONFIG_TELEMETRY_BATCH_SAMPLE_S y pide la subida si toca, si el buffer se
+ * llena o si salta una alarma (batería baja, fallo de un sensor).
+ */
+void telemetry_batch_add(const ina_snapshot_t *ina, const ldr_snapshot_t *ldr, const tracker_snapshot_t *tracker);
+
+// Muestras pendientes de subir
+size_t telemetry_batch_pending(void);
+
+#endif
@@ -8,6 +8,9 @@
 
 void register_ota_handlers(httpd_handle_t server);
 
+// /ldr_cal?point=dark|light|reset (sin parámetro: coeficientes actuales)
+void register_ldr_cal_handlers(httpd_handle_t server);
+
 httpd_handle_t start_webserver(void);
 
 void url_decode(char *src, char *dest);
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "freertos/event_groups.h"
+#include <stdbool.h>
 #include <stdint.h>
 
 // Configuración por defecto del AP del ESP32
@@ -20,4 +21,18 @@ extern EventGroupHandle_t s_wifi_event_group;
 void wifi_init_system(void);
 void wifi_start_ap(void);
 void wifi_start_sta(const char* ssid, const char* pass);
+// La última conexión STA usó el canal/BSSID guardados en RTC (sin escaneo)
+bool wifi_fast_reconnect_used(void);
+// Tras la primera telemetría: si se reutilizó la IP guardada, el DHCP vuelve a gestionarla
+void wifi_fast_ip_release(void);
+// Antes del deep sleep: actualiza el vencimiento de la concesión guardada en RTC
+void wifi_prepare_sleep(void);
+
+// Telemetría por lotes: enciende la radio y espera a tener IP (false si no llega a tiempo)
+bool wifi_radio_on(uint32_t timeout_ms);
+// Apaga la radio sin reintentos de conexión
+void wifi_radio_off(void);
+bool wifi_radio_is_on(void);
+// Segundos con la radio encendida en la última hora
+uint32_t wifi_radio_on_s_per_hour(void);
 uint16_t wifi_scan_networks(wifi_ap_record_t *ap_info, uint16_t max_aps);
\ No newline at end of file
@@ -2,6 +2,7 @@
 #include <stdint.h> 
 #include <stddef.h> 
 #include <string.h>
+#include <sys/time.h>
 #include "esp_err.h"
 
 #include "freertos/FreeRTOS.h" 
@@ -11,6 +12,12 @@
 #include "mqtt_client.h" 
 #include "cJSON.h"
 #include "mqtt_protocol.h"
+#include "battery_state.h"
+#include "pipeline.h"
+#include "sleep_schedule.h"
+#include "boot_profile.h"
+#include "energy_mode.h"
+#include "wifi_managment.h"
 
 
 #define BROKER_URL_MQTT CONFIG_BROKER_URL_MQTT
@@ -34,8 +41,9 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
 
     switch ((esp_mqtt_event_id_t)event_id) {
     case MQTT_EVENT_CONNECTED:
-        ESP_LOGI(TAG, "MQTT Conectado");
+        ESP_LOGI(TAG, "MQTT Conectado%s", event->session_present ? " (sesión recuperada)" : "");
         s_mqtt_connected = true;
+        boot_profile_mark(BOOT_PHASE_MQTT);
         break;
     case MQTT_EVENT_DISCONNECTED:
         ESP_LOGI(TAG, "MQTT Desconectado");
@@ -61,6 +69,10 @@ void mqtt_app_start(void)
     esp_mqtt_client_config_t mqtt_cfg = {
         .broker.address.uri = CONFIG_BROKER_URL_MQTT,
         .credentials.username = CONFIG_MQTT_TOKEN, // Token para ThingsBoard
+#if CONFIG_MQTT_PERSISTENT_SESSION
+        // El broker guarda la sesión del cliente (id fijo por MAC) entre deep sleeps
+        .session.disable_clean_session = true,
+#endif
     };
 
     client = esp_mqtt_client_init(&mqtt_cfg);
@@ -68,25 +80,105 @@ void mqtt_app_start(void)
     esp_mqtt_client_start(client);
 }
 
-int mqtt_send_telemetry(ina219_data_t *panel, ina219_data_t *bat, float soc, ldr_data_t *ldrs, tracker_data_t *tracker)
+// Añade "<prefix>Min", "<prefix>Max", ... con las estadísticas de una ráfaga
+static void add_signal_stats(cJSON *root, const char *prefix, const signal_stats_t *st)
 {
-    if (!client || !s_mqtt_connected) {
-        ESP_LOGW(TAG, "No se puede publicar: Cliente no conectado");
-        return -1;
+    static const char *suffix[] = { "Min", "Max", "Mean", "Rms", "P5", "P50", "P95" };
+    const float value[] = { st->min, st->max, st->mean, st->rms, st->p5, st->p50, st->p95 };
+    char label[40];
+
+    for (size_t i = 0; i < sizeof(value) / sizeof(value[0]); i++) {
+        snprintf(label, sizeof(label), "%s%s", prefix, suffix[i]);
+        cJSON_AddNumberToObject(root, label, value[i]);
+    }
+}
+
+void mqtt_app_suspend(void)
+{
+    if (client == NULL) return;
+    esp_mqtt_client_stop(client);
+    s_mqtt_connected = false;
+}
+
+void mqtt_app_resume(void)
+{
+    if (client == NULL) {
+        mqtt_app_start();   // La WiFi no conectó en el arranque
+        return;
+    }
+    esp_mqtt_client_start(client);
+}
+
+bool mqtt_wait_connected(uint32_t timeout_ms)
+{
+    for (uint32_t t = 0; !s_mqtt_connected; t += 50) {
+        if (t >= timeout_ms) return false;
+        vTaskDelay(pdMS_TO_TICKS(50));
+    }
+    return true;
+}
+
+bool mqtt_wait_delivered(uint32_t timeout_ms)
+{
+    // QoS 1: los mensajes salen de la outbox con el PUBACK del broker
+    for (uint32_t t = 0; client != NULL && esp_mqtt_client_get_outbox_size(client) > 0; t += 50) {
+        if (t >= timeout_ms || !s_mqtt_connected) return false;
+        vTaskDelay(pdMS_TO_TICKS(50));
     }
+    return client != NULL;
+}
 
+// Documento completo de telemetría: el de cada publicación y el último elemento de un lote
+static cJSON *telemetry_values(const ina_snapshot_t *ina, float soc, ldr_data_t *ldrs, tracker_data_t *tracker)
+{
     cJSON *root = cJSON_CreateObject();
     
-    // Datos Panel Solar
-    cJSON_AddNumberToObject(root, "solarVoltage", panel->bus_voltage_V);
-    cJSON_AddNumberToObject(root, "solarCurrent", panel->current_A);
-    cJSON_AddNumberToObject(root, "solarPower", panel->power_W);
-
-    // Datos Batería
-    cJSON_AddNumberToObject(root, "batteryVoltage", bat->bus_voltage_V);
-    cJSON_AddNumberToObject(root, "batteryCurrent", bat->current_A);
-    cJSON_AddNumberToObject(root, "batteryPower", bat->power_W);
+    // Datos de cada canal INA (solarVoltage, batteryCurrent, loadPower...)
+    for (int r = 0; r < INA_ROLE_MAX; r++) {
+        if (!ina->valid[r]) continue;
+
+        char label[32];
+        const char *key = ina_role_key((ina_role_t)r);
+
+        snprintf(label, sizeof(label), "%sVoltage", key);
+        cJSON_AddNumberToObject(root, label, ina->ch[r].bus_voltage_V);
+        snprintf(label, sizeof(label), "%sCurrent", key);
+        cJSON_AddNumberToObject(root, label, ina->ch[r].current_A);
+        snprintf(label, sizeof(label), "%sPower", key);
+        cJSON_AddNumberToObject(root, label, ina->ch[r].power_W);
+    }
     cJSON_AddNumberToObject(root, "batteryChargeLvl", soc);
+    if (ina->battery_soc_sigma > 0.0f) cJSON_AddNumberToObject(root, "batterySocSigma", ina->battery_soc_sigma);
+
+    // Servicio de batería: carga acumulada (sobrevive al deep sleep), capacidad y previsiones
+    battery_state_t bat;
+    battery_state_get(&bat);
+    cJSON_AddNumberToObject(root, "batteryAhOut", bat.ah_out);
+    cJSON_AddNumberToObject(root, "batteryAhIn", bat.ah_in);
+    cJSON_AddNumberToObject(root, "batteryCapacityAh", bat.capacity_Ah);
+    cJSON_AddNumberToObject(root, "batterySoh", bat.soh);
+    if (bat.tte_h >= 0.0f) cJSON_AddNumberToObject(root, "batteryTteH", bat.tte_h);
+    if (bat.ttf_h >= 0.0f) cJSON_AddNumberToObject(root, "batteryTtfH", bat.ttf_h);
+
+    // Ráfagas: solo las estadísticas reducidas (solarBurstIMax, batteryBurstVRms...)
+    for (int r = 0; r < INA_ROLE_MAX; r++) {
+        if (!ina->burst_valid[r]) continue;
+
+        char prefix[24];
+        char label[40];
+        const char *key = ina_role_key((ina_role_t)r);
+        const ina_burst_t *b = &ina->burst[r];
+
+        snprintf(prefix, sizeof(prefix), "%sBurstI", key);
+        add_signal_stats(root, prefix, &b->current_A);
+        snprintf(prefix, sizeof(prefix), "%sBurstV", key);
+        add_signal_stats(root, prefix, &b->voltage_V);
+
+        snprintf(label, sizeof(label), "%sBurstRate", key);
+        cJSON_AddNumberToObject(root, label, b->rate_hz);
+        snprintf(label, sizeof(label), "%sBurstSpikes", key);
+        cJSON_AddNumberToObject(root, label, b->current_A.rejected + b->voltage_V.rejected);
+    }
 
     // Datos LDRs (enviamos resistencia kOhm)
     for(int i = 0; i < LDR_COUNT; i++) {
@@ -97,13 +189,95 @@ int mqtt_send_telemetry(ina219_data_t *panel, ina219_data_t *bat, float soc, ldr
         // Añade directamente al objeto root
         cJSON_AddNumberToObject(root, label, ldrs[i].raw);
     }
+
+    // Irradiancia estimada (media de los LDR)
+    uint32_t irr = 0;
+    for(int i = 0; i < LDR_COUNT; i++) irr += ldrs[i].irradiance_wm2;
+    cJSON_AddNumberToObject(root, "irradiance", irr / LDR_COUNT);
     
     // Datos Tracker (Servos)
     if (tracker != NULL) {
         cJSON_AddNumberToObject(root, "servo_h", tracker->angle_h);
         cJSON_AddNumberToObject(root, "servo_v", tracker->angle_v);
+        cJSON_AddNumberToObject(root, "servo_moves", tracker->moves);
+        cJSON_AddBoolToObject(root, "tracker_idle", tracker->idle);
+        cJSON_AddNumberToObject(root, "tracker_wakeups_h", tracker->wakeups_per_hour);
+        cJSON_AddNumberToObject(root, "servo_off_s", tracker->idle_s);
+        if (tracker->lock_ms > 0) cJSON_AddNumberToObject(root, "lock_ms", tracker->lock_ms);
+        if (tracker->po_kept + tracker->po_reverted > 0) {
+            cJSON_AddNumberToObject(root, "po_kept", tracker->po_kept);
+            cJSON_AddNumberToObject(root, "po_reverted", tracker->po_reverted);
+            cJSON_AddNumberToObject(root, "po_ref_h", tracker->po_ref_h);
+            cJSON_AddNumberToObject(root, "po_ref_v", tracker->po_ref_v);
+        }
+        cJSON_AddBoolToObject(root, "tracker_diffuse", tracker->diffuse);
+        if (tracker->move_spent_j + tracker->move_gain_j > 0.0f || tracker->moves_skipped > 0) {
+            // Balance energético: gastado moviendo frente a ganancia estimada
+            cJSON_AddNumberToObject(root, "move_spent_j", tracker->move_spent_j);
+            cJSON_AddNumberToObject(root, "move_gain_j", tracker->move_gain_j);
+            cJSON_AddNumberToObject(root, "move_w", tracker->move_w);
+            cJSON_AddNumberToObject(root, "moves_skipped", tracker->moves_skipped);
+        }
+        if (tracker->sun_model) {
+            cJSON_AddNumberToObject(root, "sun_az", tracker->sun_azimuth);
+            cJSON_AddNumberToObject(root, "sun_el", tracker->sun_elevation);
+            cJSON_AddNumberToObject(root, "trim_h", tracker->trim_h);
+            cJSON_AddNumberToObject(root, "trim_v", tracker->trim_v);
+        }
+    }
+
+    // Plazos de las etapas periódicas (inaDeadlineMisses, trackerMaxMs...) y latencia muestra -> MQTT
+    pipeline_stats_t pipe;
+    pipeline_get_stats(&pipe);
+    for (int st = 0; st < PIPELINE_STAGE_MAX; st++) {
+        if (pipe.stage[st].runs == 0) continue;
+
+        char label[40];
+        const char *name = pipeline_stage_name((pipeline_stage_t)st);
+        snprintf(label, sizeof(label), "%sDeadlineMisses", name);
+        cJSON_AddNumberToObject(root, label, pipe.stage[st].misses);
+        snprintf(label, sizeof(label), "%sMaxMs", name);
+        cJSON_AddNumberToObject(root, label, pipe.stage[st].max_us / 1000.0f);
+        snprintf(label, sizeof(label), "%sJitterMs", name);
+        cJSON_AddNumberToObject(root, label, pipe.stage[st].jitter_max_us / 1000.0f);
+    }
+    if (pipe.latency_max_us > 0) {
+        cJSON_AddNumberToObject(root, "pipelineLatencyMs", pipe.latency_us / 1000.0f);
+        cJSON_AddNumberToObject(root, "pipelineLatencyMaxMs", pipe.latency_max_us / 1000.0f);
+    }
+
+    // Fases del arranque (bootIpMs, bootPublishMs...) y si la WiFi usó la reconexión rápida
+    for (int ph = 0; ph < BOOT_PHASE_MAX; ph++) {
+        uint32_t ms = boot_profile_ms((boot_phase_t)ph);
+        if (ms == 0) continue;
+
+        char label[32];
+        snprintf(label, sizeof(label), "boot%sMs", boot_phase_name((boot_phase_t)ph));
+        cJSON_AddNumberToObject(root, label, ms);
+    }
+    cJSON_AddBoolToObject(root, "bootFastWifi", wifi_fast_reconnect_used());
+    cJSON_AddNumberToObject(root, "radioOnSPerHour", wifi_radio_on_s_per_hour());
+
+#if CONFIG_ENERGY_MODES
+    // Modo de energía y SoC previsto con el que se decidió
+    cJSON_AddStringToObject(root, "energyMode", energy_mode_name(energy_mode_get()));
+    if (energy_mode_level() >= 0.0f) cJSON_AddNumberToObject(root, "energyLevel", energy_mode_level());
+#endif
+
+    // Calendario de deep sleep (UTC, segundos Unix): cuándo se duerme y cuándo despierta
+    sleep_schedule_t sched;
+    if (sleep_schedule_get(&sched)) {
+        cJSON_AddNumberToObject(root, "sunDawn", (double)sched.dawn);
+        cJSON_AddNumberToObject(root, "sunDusk", (double)sched.dusk);
+        cJSON_AddNumberToObject(root, "sleepAt", (double)sched.sleep_at);
+        cJSON_AddNumberToObject(root, "wakeAt", (double)sched.wake_at);
     }
 
+    return root;
+}
+
+static int publish_json(cJSON *root)
+{
     char *post_data = cJSON_PrintUnformatted(root);
     
     // Publicar al tópico definido en Kconfig
@@ -111,6 +285,17 @@ int mqtt_send_telemetry(ina219_data_t *panel, ina219_data_t *bat, float soc, ldr
     
     cJSON_Delete(root);
     free(post_data);
+    return msg_id;
+}
+
+int mqtt_send_telemetry(const ina_snapshot_t *ina, float soc, ldr_data_t *ldrs, tracker_data_t *tracker)
+{
+    if (!client || !s_mqtt_connected) {
+        ESP_LOGW(TAG, "No se puede publicar: Cliente no conectado");
+        return -1;
+    }
+
+    int msg_id = publish_json(telemetry_values(ina, soc, ldrs, tracker));
 
     if(msg_id >= 0) {
         ESP_LOGI(TAG, "Telemetría enviada OK, msg_id=%d", msg_id);
@@ -120,3 +305,70 @@ int mqtt_send_telemetry(ina219_data_t *panel, ina219_data_t *bat, float soc, ldr
 
     return msg_id;
 }
+
+int mqtt_send_batch(const telemetry_sample_t *samples, size_t n,
+                    const ina_snapshot_t *ina, float soc, ldr_data_t *ldrs, tracker_data_t *tracker)
+{
+    if (!client || !s_mqtt_connected) {
+        ESP_LOGW(TAG, "No se puede publicar el lote: Cliente no conectado");
+        return -1;
+    }
+
+    // Formato de ThingsBoard con marca de tiempo: [{"ts": ms, "values": {...}}, ...]
+    cJSON *root = cJSON_CreateArray();
+
+    for (size_t i = 0; i < n; i++) {
+        const telemetry_sample_t *s = &samples[i];
+        if (s->ts_ms <= 0) continue;    // Tomada antes de tener hora
+
+        cJSON *item = cJSON_CreateObject();
+        cJSON_AddNumberToObject(item, "ts", (double)s->ts_ms);
+        cJSON *values = cJSON_AddObjectToObject(item, "values");
+
+        for (int r = 0; r < INA_ROLE_MAX; r++) {
+            if (!(s->valid_mask & (1u << r))) continue;
+
+            char label[32];
+            const char *key = ina_role_key((ina_role_t)r);
+
+            snprintf(label, sizeof(label), "%sVoltage", key);
+            cJSON_AddNumberToObject(values, label, s->voltage_V[r]);
+            snprintf(label, sizeof(label), "%sCurrent", key);
+            cJSON_AddNumberToObject(values, label, s->current_A[r]);
+            snprintf(label, sizeof(label), "%sPower", key);
+            cJSON_AddNumberToObject(values, label, s->voltage_V[r] * s->current_A[r]);
+        }
+        cJSON_AddNumberToObject(values, "batteryChargeLvl", s->soc);
+        cJSON_AddNumberToObject(values, "irradiance", s->irradiance_wm2);
+        cJSON_AddNumberToObject(values, "servo_h", s->servo_h);
+        cJSON_AddNumberToObject(values, "servo_v", s->servo_v);
+
+        cJSON_AddItemToArray(root, item);
+    }
+
+    // Estado completo en el momento de la subida (sin "ts" si aún no hay hora: la pone el servidor)
+    cJSON *now_values = telemetry_values(ina, soc, ldrs, tracker);
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    time_t now = tv.tv_sec;
+    struct tm timeinfo;
+    localtime_r(&now, &timeinfo);
+    if (timeinfo.tm_year >= (2016 - 1900)) {
+        cJSON *item = cJSON_CreateObject();
+        cJSON_AddNumberToObject(item, "ts", (double)tv.tv_sec * 1000.0 + tv.tv_usec / 1000);
+        cJSON_AddItemToObject(item, "values", now_values);
+        cJSON_AddItemToArray(root, item);
+    } else {
+        cJSON_AddItemToArray(root, now_values);
+    }
+
+    int msg_id = publish_json(root);
+
+    if (msg_id >= 0) {
+        ESP_LOGI(TAG, "Lote de telemetría enviado (%u muestras), msg_id=%d", (unsigned)n, msg_id);
+    } else {
+        ESP_LOGE(TAG, "Error enviando el lote de telemetría");
+    }
+
+    return msg_id;
+}
@@ -5,10 +5,13 @@
 #include <esp_log.h>
 #include "nvs_flash.h"
 
+#include "nvs_managment.h"
+
 static const char *TAG = "NVS";
 static const char *NS = "storage";
 static const char *K_SSID = "SSID";
 static const char *K_PASS = "PASS";
+static const char *K_LDR_CAL = "LDR_CAL";
 
 void save_wifi_credentials(const char* ssid, const char* pass) {
     nvs_handle_t h;
@@ -35,6 +38,41 @@ bool load_wifi_credentials(char *ssid, size_t ssid_size, char* pass, size_t pass
     return (e1 == ESP_OK && e2 == ESP_OK);
 }
 
+bool save_ldr_calibration(const ldr_cal_t *cal) {
+    nvs_handle_t h;
+    if (nvs_open(NS, NVS_READWRITE, &h) != ESP_OK) return false;
+
+    esp_err_t err = nvs_set_blob(h, K_LDR_CAL, cal, sizeof(*cal));
+    if (err == ESP_OK) err = nvs_commit(h);
+    nvs_close(h);
+
+    if (err != ESP_OK) ESP_LOGW(TAG, "No se pudo guardar la calibración LDR: %s", esp_err_to_name(err));
+    return (err == ESP_OK);
+}
+
+bool load_ldr_calibration(ldr_cal_t *cal) {
+    nvs_handle_t h;
+    if (nvs_open(NS, NVS_READONLY, &h) != ESP_OK) return false;
+
+    // Un tamaño distinto indica un formato antiguo: se ignora
+    size_t len = sizeof(*cal);
+    esp_err_t err = nvs_get_blob(h, K_LDR_CAL, cal, &len);
+    nvs_close(h);
+
+    return (err == ESP_OK && len == sizeof(*cal) && cal->valid);
+}
+
+bool erase_ldr_calibration(void) {
+    nvs_handle_t h;
+    if (nvs_open(NS, NVS_READWRITE, &h) != ESP_OK) return false;
+
+    esp_err_t err = nvs_erase_key(h, K_LDR_CAL);
+    if (err == ESP_OK) err = nvs_commit(h);
+    nvs_close(h);
+
+    return (err == ESP_OK || err == ESP_ERR_NVS_NOT_FOUND);
+}
+
 void init_nvs(void) {
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
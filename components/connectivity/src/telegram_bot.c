@@ -8,6 +8,7 @@
 #include "esp_sleep.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
 
 #include "esp_http_client.h"
@@ -18,7 +19,12 @@
 #include "telegram_bot.h"
 #include "solar_tracker.h"
 #include "ina.h" // Para leer voltajes en el comando /status
-#include "protect.h"
+#include "snapshot.h"
+#include "battery_state.h"
+#include "pipeline.h"
+#include "sleep_schedule.h"
+#include "energy_mode.h"
+#include "wifi_managment.h"
 
 static const char *TAG = "TELEGRAM";
 
@@ -29,6 +35,46 @@ static const char *TAG = "TELEGRAM";
 // Control para mismos mensajes
 static int64_t last_update_id = 0;
 
+// Conexiones HTTPS persistentes: el handshake TLS se hace una vez y no en cada sondeo o respuesta
+static esp_http_client_handle_t s_send_client = NULL;
+static esp_http_client_handle_t s_poll_client = NULL;
+
+// s_send_client se comparte entre la tarea del bot y quien envíe avisos (bucle principal)
+static SemaphoreHandle_t s_send_lock = NULL;
+static StaticSemaphore_t s_send_lock_buf;
+static portMUX_TYPE s_init_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static SemaphoreHandle_t send_lock(void)
+{
+	portENTER_CRITICAL(&s_init_mux);
+	if (s_send_lock == NULL) s_send_lock = xSemaphoreCreateMutexStatic(&s_send_lock_buf);
+	portEXIT_CRITICAL(&s_init_mux);
+	return s_send_lock;
+}
+
+static esp_http_client_handle_t api_client(esp_http_client_handle_t *slot, int timeout_ms)
+{
+	if (*slot == NULL) {
+		esp_http_client_config_t config = {
+			.url = "https://api.telegram.org",
+			.transport_type = HTTP_TRANSPORT_OVER_SSL,
+			.crt_bundle_attach = esp_crt_bundle_attach,
+		};
+		if (timeout_ms > 0) config.timeout_ms = timeout_ms;
+		*slot = esp_http_client_init(&config);
+	}
+	return *slot;
+}
+
+// Tras un error la conexión puede haber quedado a medias: se abre otra en la siguiente petición
+static void api_client_drop(esp_http_client_handle_t *slot)
+{
+	if (*slot != NULL) {
+		esp_http_client_cleanup(*slot);
+		*slot = NULL;
+	}
+}
+
 void telegram_send_text(const char *format, ...)
 {
 	char msg_buffer[512];
@@ -42,14 +88,14 @@ void telegram_send_text(const char *format, ...)
 	// Construir URL
 	char url[1024];
 
-	esp_http_client_config_t config = {
-		.url = "https://api.telegram.org",
-		.transport_type = HTTP_TRANSPORT_OVER_SSL,
-		.crt_bundle_attach = esp_crt_bundle_attach,
-	
-	};
+	SemaphoreHandle_t lock = send_lock();
+	xSemaphoreTake(lock, portMAX_DELAY);
 
-	esp_http_client_handle_t client = esp_http_client_init(&config);
+	esp_http_client_handle_t client = api_client(&s_send_client, 0);
+	if (client == NULL) {
+		xSemaphoreGive(lock);
+		return;
+	}
 
 	// Construir URL completa
 	snprintf(url,  sizeof(url),  "https://api.telegram.org/bot%s/sendMessage", TELEGRAM_TOKEN);
@@ -70,14 +116,21 @@ void telegram_send_text(const char *format, ...)
         ESP_LOGI(TAG, "Mensaje enviado OK");
     } else {
         ESP_LOGE(TAG, "Error enviando mensaje: %s", esp_err_to_name(err));
+        api_client_drop(&s_send_client);
     }
+    xSemaphoreGive(lock);
 
     cJSON_Delete(root);
     free(post_data);
-    esp_http_client_cleanup(client);
 }
 
 
+#if CONFIG_ENERGY_MODES
+#define HELP_ENERGY "/energy [eco crit superv [hist]] - Ver/cambiar umbrales de SoC de los modos de energía\n"
+#else
+#define HELP_ENERGY ""
+#endif
+
 static void handle_command(char *text)
 {
 	ESP_LOGI(TAG, "Comando recibido: %s", text);
@@ -87,25 +140,121 @@ static void handle_command(char *text)
 		telegram_send_text("Comandos Disponibles:\n"
                            "/status - Voltaje y Bateria\n"
                            "/park - Aparcar servos (Seguro)\n"
+                           "/pi [kp ki [paso]] - Ver/cambiar ganancias del tracker\n"
+                           "/scan - Buscar el sol con un barrido\n"
+                           HELP_ENERGY
                            "/sleep - Forzar Deep Sleep\n"
                            "/reset - Reiniciar ESP32");
 	}
 	else if (strncmp(text, "/status", 7) == 0)
 	{
-		float v_bat = 0, soc = 0, v_panel = 0;
-		if (xSemaphoreTake(g_data_mutex, pdMS_TO_TICKS(200))) {
-            v_bat = g_ina219_data[INA219_DEVICE_BATTERY].bus_voltage_V;
-            v_panel = g_ina219_data[INA219_DEVICE_PANEL].bus_voltage_V;
-            soc = g_battery_soc;
-            xSemaphoreGive(g_data_mutex);
-        }
-		telegram_send_text("🔋 Estado:\nBateria: %.2f V (%.1f%%)\nPanel: %.2f V", v_bat, soc, v_panel);
+		ina_snapshot_t snap;
+		if (!snapshot_read_ina(&snap)) {
+			telegram_send_text("⚠️ Aún no hay lecturas de los sensores.");
+			return;
+		}
+		ina_bus_stats_t bus;
+		ina_get_bus_stats(&bus);
+
+		// Una línea por canal configurado
+		char lines[256] = "";
+		size_t len = 0;
+		for (int r = 0; r < INA_ROLE_MAX && len < sizeof(lines); r++) {
+			if (!snap.valid[r]) continue;
+			len += snprintf(lines + len, sizeof(lines) - len, "%s: %.2f V, %.2f A\n",
+			                ina_role_name((ina_role_t)r), snap.ch[r].bus_voltage_V, snap.ch[r].current_A);
+		}
+
+		// Autonomía con la corriente media: hasta vacía o, cargando, hasta llena
+		battery_state_t bat;
+		battery_state_get(&bat);
+		char forecast[48] = "";
+		if (bat.tte_h >= 0.0f) snprintf(forecast, sizeof(forecast), ", vacía en %.1f h", bat.tte_h);
+		else if (bat.ttf_h >= 0.0f) snprintf(forecast, sizeof(forecast), ", llena en %.1f h", bat.ttf_h);
+
+		pipeline_stats_t pipe;
+		pipeline_get_stats(&pipe);
+		uint32_t misses = 0;
+		for (int i = 0; i < PIPELINE_STAGE_MAX; i++) misses += pipe.stage[i].misses;
+
+		// Próxima noche en hora local
+		sleep_schedule_t sched;
+		char night[96] = "";
+		if (sleep_schedule_get(&sched)) {
+			struct tm t_sleep, t_wake;
+			localtime_r(&sched.sleep_at, &t_sleep);
+			localtime_r(&sched.wake_at, &t_wake);
+			snprintf(night, sizeof(night), "\nDeep sleep: %02d:%02d -> %02d:%02d",
+			         t_sleep.tm_hour, t_sleep.tm_min, t_wake.tm_hour, t_wake.tm_min);
+		}
+#if CONFIG_ENERGY_MODES
+		size_t nlen = strlen(night);
+		snprintf(night + nlen, sizeof(night) - nlen, "\nModo de energía: %s", energy_mode_name(energy_mode_get()));
+#endif
+
+		telegram_send_text("🔋 Estado:\n%sSoC: %.1f%%%s\nCapacidad: %.2f Ah (SoH %.0f%%)\nDatos de hace %lu ms\nI2C: %lu us/ciclo @%lu Hz\n"
+		                   "Muestra -> MQTT: %lu ms (max %lu), plazos perdidos: %lu%s",
+		                   lines, snap.battery_soc, forecast, bat.capacity_Ah, bat.soh,
+		                   (unsigned long)snapshot_age_ms(snap.timestamp_us),
+		                   (unsigned long)bus.avg_us, (unsigned long)bus.freq_hz,
+		                   (unsigned long)(pipe.latency_us / 1000), (unsigned long)(pipe.latency_max_us / 1000),
+		                   (unsigned long)misses, night);
 	}
 	else if (strncmp(text, "/park", 5) == 0) {
         telegram_send_text("🚧 Aparcando servos...");
         solar_tracker_park();
-        telegram_send_text("✅ Servos aparcados.");
+        telegram_send_text("✅ Servos aparcados. /scan reanuda el seguimiento.");
     }
+	else if (strncmp(text, "/scan", 5) == 0) {
+		solar_tracker_request_scan();
+		telegram_send_text("🔎 Barrido de adquisición solicitado.");
+	}
+	else if (strncmp(text, "/pi", 3) == 0) {
+		pi_gains_t g;
+		solar_tracker_get_gains(&g);
+
+		// "/pi" muestra las ganancias; "/pi kp ki [paso]" las cambia
+		float kp, ki, step;
+		int n = sscanf(text + 3, "%f %f %f", &kp, &ki, &step);
+		if (n >= 2) {
+			g.kp = kp;
+			g.ki = ki;
+			if (n == 3) g.max_step = step;
+			if (solar_tracker_set_gains(&g) != ESP_OK) {
+				telegram_send_text("⚠️ Ganancias no válidas (Kp, Ki >= 0, paso > 0).");
+				return;
+			}
+		}
+
+		telegram_send_text("🎛️ Lazo PI:\nKp: %.2f\nKi: %.2f\nPaso max: %.2f°\nHistéresis: %.0f%%",
+		                   g.kp, g.ki, g.max_step, g.hyst_off * 100.0f);
+	}
+#if CONFIG_ENERGY_MODES
+	else if (strncmp(text, "/energy", 7) == 0) {
+		energy_thresholds_t t;
+		energy_mode_get_thresholds(&t);
+
+		// "/energy" muestra el modo; "/energy eco crítico supervivencia [histéresis]" cambia los umbrales
+		float eco, crit, surv, hyst;
+		int n = sscanf(text + 7, "%f %f %f %f", &eco, &crit, &surv, &hyst);
+		if (n >= 3) {
+			t.eco_pct = eco;
+			t.critical_pct = crit;
+			t.survival_pct = surv;
+			if (n == 4) t.hyst_pct = hyst;
+			esp_err_t err = energy_mode_set_thresholds(&t);
+			if (err == ESP_ERR_INVALID_ARG) {
+				telegram_send_text("⚠️ Umbrales no válidos (eco > crítico > supervivencia >= 0, histéresis 0-20).");
+				return;
+			} else if (err != ESP_OK) {
+				telegram_send_text("⚠️ Umbrales aplicados, pero no se han podido guardar en NVS.");
+			}
+		}
+
+		telegram_send_text("⚡ Modo de energía: %s\nEco: < %.0f%%\nCrítico: < %.0f%%\nSupervivencia: < %.0f%%\nHistéresis: %.0f%%",
+		                   energy_mode_name(energy_mode_get()), t.eco_pct, t.critical_pct, t.survival_pct, t.hyst_pct);
+	}
+#endif
 	else if (strncmp(text, "/sleep", 6) == 0) {
         telegram_send_text("💤 Entrando en Deep Sleep forzado (1 min)...");
         
@@ -184,26 +333,35 @@ static void handle_command(char *text)
 }
 
 
-static void check_updates(void)
+// Abre la petición GET en la conexión persistente; si el servidor la había cerrado, en una nueva
+static esp_err_t poll_open(const char *url)
 {
-	esp_http_client_config_t config = {
-		.url = "https://api.telegram.org",
-		.transport_type = HTTP_TRANSPORT_OVER_SSL,
-		.crt_bundle_attach = esp_crt_bundle_attach,
-		.timeout_ms = POLLING_INTERVAL_MS,
-	};
-
-	esp_http_client_handle_t client = esp_http_client_init(&config);
+	esp_err_t err = ESP_FAIL;
+	for (int attempt = 0; attempt < 2 && err != ESP_OK; attempt++) {
+		bool reused = (s_poll_client != NULL);
+		esp_http_client_handle_t client = api_client(&s_poll_client, POLLING_INTERVAL_MS);
+		if (client == NULL) return ESP_ERR_NO_MEM;
+
+		esp_http_client_set_url(client, url);
+		esp_http_client_set_method(client, HTTP_METHOD_GET);
+		err = esp_http_client_open(client, 0);
+		if (err != ESP_OK) {
+			api_client_drop(&s_poll_client);
+			if (!reused) break;
+		}
+	}
+	return err;
+}
 
+static void check_updates(void)
+{
 	// URL para getUpdates con offset
 	char url[512];
 	snprintf(url, sizeof(url), "https://api.telegram.org/bot%s/getUpdates?offset=%lld&limit=1&timeout=0", TELEGRAM_TOKEN, last_update_id + 1);
 
-	esp_http_client_set_url(client, url);
-	esp_http_client_set_method(client, HTTP_METHOD_GET);
-	
 	// Ejecutar peticion
-	esp_err_t err = esp_http_client_open(client, 0);
+	esp_err_t err = poll_open(url);
+	esp_http_client_handle_t client = s_poll_client;
 	if (err == ESP_OK)
 	{
 		int content_length = esp_http_client_fetch_headers(client);
@@ -258,11 +416,11 @@ static void check_updates(void)
 				free(buffer);
 			}
 		}
+		// Lo que no se haya leído (respuesta troceada) se descarta para reutilizar la conexión
+		if (esp_http_client_flush_response(client, NULL) != ESP_OK) api_client_drop(&s_poll_client);
 	} else {
 		ESP_LOGE(TAG, "Fallo HTTP GET: %s", esp_err_to_name(err));
 	}
-
-	esp_http_client_cleanup(client);
 }
 
 
@@ -272,13 +430,19 @@ static void telegram_task(void *pvParameters)
     telegram_send_text("🔌 Sistema Solar Online. Escribe /help para ver comandos.");
 
     while (1) {
-        check_updates();
+        // Telemetría por lotes: con la radio apagada no se sondea (sólo durante las subidas)
+        bool poll = wifi_radio_is_on();
+#if CONFIG_ENERGY_MODES
+        poll = poll && energy_mode_policy()->telegram;
+#endif
+        if (poll) check_updates();
         vTaskDelay(pdMS_TO_TICKS(POLLING_INTERVAL_MS));
     }
 }
 
 void telegram_bot_start(void)
 {
-    xTaskCreate(telegram_task, "telegram_task", 6144, NULL, 5, NULL);
+    // Sondeo de red sin plazo: la prioridad más baja, junto a la pila WiFi
+    xTaskCreatePinnedToCore(telegram_task, "telegram_task", 6144, NULL, PIPELINE_PRIO_TELEGRAM, NULL, PIPELINE_CORE_NET);
 }
 
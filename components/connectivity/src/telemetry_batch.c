@@ -0,0 +1,284 @@
+#include "telemetry_batch.h"
+
+#if CONFIG_TELEMETRY_BATCH
+
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "boot_profile.h"
+#include "energy_mode.h"
+#include "mqtt_protocol.h"
+#include "pipeline.h"
+#include "wifi_managment.h"
+
+static const char *TAG = "BATCH";
+
+#define BATCH_MAX           CONFIG_TELEMETRY_BATCH_MAX
+#define BATCH_MAGIC         0xBA7C0001u
+#define SAMPLE_PERIOD_US    ((int64_t)CONFIG_TELEMETRY_BATCH_SAMPLE_S * 1000000)
+#define UPLOAD_PERIOD_US    ((int64_t)CONFIG_TELEMETRY_BATCH_PERIOD_MIN * 60 * 1000000)
+#define RADIO_TIMEOUT_MS    (CONFIG_TELEMETRY_RADIO_TIMEOUT_S * 1000)
+#define ALARM_SOC_HYST      5.0f	// % por encima del umbral para rearmar la alarma
+#define ALARM_SENSOR_FAILS  3		// Ciclos seguidos con fallo de lectura
+#define ALARM_SENSOR_STALE_US ((int64_t)3 * CONFIG_TASK_INA_PERIOD_MS * 1000)	// Sin muestra buena
+
+enum {
+	ALARM_SOC_LOW = 1 << 0,
+	ALARM_SENSOR  = 1 << 1,
+};
+
+// Cola circular en memoria RTC: las muestras de la tarde se suben al despertar
+typedef struct {
+	uint32_t magic;
+	uint32_t seq_head;		// Número de orden de la muestra más antigua
+	uint16_t head;
+	uint16_t count;
+	uint32_t dropped;		// Muestras perdidas por buffer lleno
+	telemetry_sample_t s[BATCH_MAX];
+} batch_rtc_t;
+
+static RTC_DATA_ATTR batch_rtc_t s_rtc;
+
+static telemetry_sample_t s_out[BATCH_MAX];	// Copia para serializar sin retener la cola
+
+// La cola sólo la tocan tareas (bucle principal y subida): un mutex, no una sección
+// crítica, porque copiarla entera (hasta BATCH_MAX muestras) lleva su tiempo
+static SemaphoreHandle_t s_lock = NULL;
+static StaticSemaphore_t s_lock_buf;
+static portMUX_TYPE s_init_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static TaskHandle_t s_task = NULL;
+static bool s_have_sample = false;
+static int64_t s_last_sample_us = 0;
+static volatile int64_t s_last_upload_us = 0;
+static uint8_t s_alarms = 0;
+#if CONFIG_ENERGY_MODES
+static energy_mode_t s_mode_seen = ENERGY_MODE_NORMAL;
+#endif
+
+static void batch_lock(void)
+{
+	portENTER_CRITICAL(&s_init_mux);
+	if (s_lock == NULL) s_lock = xSemaphoreCreateMutexStatic(&s_lock_buf);
+	portEXIT_CRITICAL(&s_init_mux);
+	xSemaphoreTake(s_lock, portMAX_DELAY);
+}
+
+static void batch_unlock(void)
+{
+	xSemaphoreGive(s_lock);
+}
+
+static bool time_valid(int64_t *ms)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	time_t now = tv.tv_sec;
+	struct tm timeinfo;
+	localtime_r(&now, &timeinfo);
+	if (ms) *ms = (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+	return timeinfo.tm_year >= (2016 - 1900);
+}
+
+static void push_sample(const telemetry_sample_t *s)
+{
+	batch_lock();
+	if (s_rtc.magic != BATCH_MAGIC) {
+		memset(&s_rtc, 0, sizeof(s_rtc));
+		s_rtc.magic = BATCH_MAGIC;
+	}
+	if (s_rtc.count == BATCH_MAX) {
+		// Lleno (sin red mucho tiempo): se pierde la más antigua
+		s_rtc.head = (s_rtc.head + 1) % BATCH_MAX;
+		s_rtc.seq_head++;
+		s_rtc.count--;
+		s_rtc.dropped++;
+	}
+	s_rtc.s[(s_rtc.head + s_rtc.count) % BATCH_MAX] = *s;
+	s_rtc.count++;
+	batch_unlock();
+}
+
+// Quita las muestras [seq0, seq0 + n) ya confirmadas (alguna pudo perderse mientras tanto)
+static void pop_samples(uint32_t seq0, size_t n)
+{
+	batch_lock();
+	uint32_t end = seq0 + (uint32_t)n;
+	if ((int32_t)(end - s_rtc.seq_head) > 0) {
+		uint32_t k = end - s_rtc.seq_head;
+		if (k > s_rtc.count) k = s_rtc.count;
+		s_rtc.head = (s_rtc.head + k) % BATCH_MAX;
+		s_rtc.seq_head += k;
+		s_rtc.count -= k;
+	}
+	batch_unlock();
+}
+
+size_t telemetry_batch_pending(void)
+{
+	batch_lock();
+	size_t n = (s_rtc.magic == BATCH_MAGIC) ? s_rtc.count : 0;
+	batch_unlock();
+	return n;
+}
+
+static uint8_t check_alarms(const ina_snapshot_t *ina)
+{
+	uint8_t a = s_alarms;
+
+	if (CONFIG_TELEMETRY_ALARM_SOC_PCT > 0) {
+		if (ina->battery_soc < CONFIG_TELEMETRY_ALARM_SOC_PCT) a |= ALARM_SOC_LOW;
+		else if (ina->battery_soc > CONFIG_TELEMETRY_ALARM_SOC_PCT + ALARM_SOC_HYST) a &= ~ALARM_SOC_LOW;
+	}
+
+	// Fallo de sensor: un canal ausente, con fallos seguidos o sin muestra buena reciente
+	// (esto último cubre también la tarea de los INA parada)
+	int64_t now = esp_timer_get_time();
+	bool fault = false;
+	for (int r = 0; r < INA_ROLE_MAX; r++) {
+		ina_channel_health_t h;
+		if (!ina_get_channel_health((ina_role_t)r, &h)) continue;
+		if (!h.present || h.fail_streak >= ALARM_SENSOR_FAILS ||
+		    now - h.last_ok_us > ALARM_SENSOR_STALE_US) fault = true;
+	}
+	a = fault ? (a | ALARM_SENSOR) : (a & ~ALARM_SENSOR);
+
+	return a;
+}
+
+void telemetry_batch_add(const ina_snapshot_t *ina, const ldr_snapshot_t *ldr, const tracker_snapshot_t *tracker)
+{
+	int64_t now = esp_timer_get_time();
+
+	if (!s_have_sample || now - s_last_sample_us >= SAMPLE_PERIOD_US) {
+		telemetry_sample_t s = { 0 };
+
+		// Sin hora válida (arranque en frío antes de SNTP) la muestra no se podrá colocar: no se guarda
+		if (time_valid(&s.ts_ms)) {
+			for (int r = 0; r < INA_ROLE_MAX; r++) {
+				if (!ina->valid[r]) continue;
+				s.voltage_V[r] = ina->ch[r].bus_voltage_V;
+				s.current_A[r] = ina->ch[r].current_A;
+				s.valid_mask |= (uint8_t)(1u << r);
+			}
+			s.soc = ina->battery_soc;
+
+			uint32_t irr = 0;
+			for (int i = 0; i < LDR_COUNT; i++) irr += ldr->ldr[i].irradiance_wm2;
+			s.irradiance_wm2 = (uint16_t)(irr / LDR_COUNT);
+
+			s.servo_h = tracker->tracker.angle_h;
+			s.servo_v = tracker->tracker.angle_v;
+
+			push_sample(&s);
+			s_have_sample = true;
+			s_last_sample_us = now;
+		}
+	}
+
+	uint8_t alarms = check_alarms(ina);
+	uint8_t raised = alarms & ~s_alarms;
+	s_alarms = alarms;
+
+	if (raised) {
+		ESP_LOGW(TAG, "Alarma:%s%s. Subida inmediata",
+		         (raised & ALARM_SOC_LOW) ? " batería baja" : "",
+		         (raised & ALARM_SENSOR) ? " fallo de sensor" : "");
+	}
+
+	int64_t period_us = UPLOAD_PERIOD_US;
+	bool mode_changed = false;
+#if CONFIG_ENERGY_MODES
+	// Los cambios de modo se suben enseguida; el periodo se estira con el modo
+	energy_mode_t mode = energy_mode_get();
+	mode_changed = (mode != s_mode_seen);
+	s_mode_seen = mode;
+	period_us *= energy_mode_policy()->publish_scale;
+#endif
+
+	bool due = raised || mode_changed ||
+	           now - s_last_upload_us >= period_us ||
+	           telemetry_batch_pending() >= (BATCH_MAX * 3) / 4;
+
+	if (due && s_task != NULL) xTaskNotifyGive(s_task);
+}
+
+static void upload(void)
+{
+	int64_t t0 = esp_timer_get_time();
+
+	// Las muestras se copian antes: el bucle principal puede seguir añadiendo durante la subida
+	batch_lock();
+	size_t n = (s_rtc.magic == BATCH_MAGIC) ? s_rtc.count : 0;
+	uint32_t seq0 = s_rtc.seq_head;
+	for (size_t i = 0; i < n; i++) s_out[i] = s_rtc.s[(s_rtc.head + i) % BATCH_MAX];
+	uint32_t dropped = s_rtc.dropped;
+	batch_unlock();
+
+	if (!wifi_radio_on(RADIO_TIMEOUT_MS)) {
+		ESP_LOGW(TAG, "Sin WiFi: %u muestras esperan a la siguiente subida", (unsigned)n);
+		goto done;
+	}
+
+	mqtt_app_resume();
+	if (!mqtt_wait_connected(RADIO_TIMEOUT_MS)) {
+		ESP_LOGW(TAG, "Broker MQTT no disponible");
+		goto done;
+	}
+
+	// Último estado completo, leído justo antes de publicar
+	ina_snapshot_t d_ina;
+	ldr_snapshot_t d_ldr;
+	tracker_snapshot_t d_tracker;
+	if (!snapshot_read_ina(&d_ina)) memset(&d_ina, 0, sizeof(d_ina));
+	if (!snapshot_read_ldr(&d_ldr)) memset(&d_ldr, 0, sizeof(d_ldr));
+	if (!snapshot_read_tracker(&d_tracker)) memset(&d_tracker, 0, sizeof(d_tracker));
+
+	if (mqtt_send_batch(s_out, n, &d_ina, d_ina.battery_soc, d_ldr.ldr, &d_tracker.tracker) >= 0 &&
+	    mqtt_wait_delivered(RADIO_TIMEOUT_MS)) {
+		pop_samples(seq0, n);
+		boot_profile_mark(BOOT_PHASE_PUBLISH);
+		ESP_LOGI(TAG, "Lote de %u muestras subido en %lu ms (%lu perdidas por buffer lleno)",
+		         (unsigned)n, (unsigned long)((esp_timer_get_time() - t0) / 1000), (unsigned long)dropped);
+	} else {
+		ESP_LOGW(TAG, "Lote sin confirmar: se reintenta en la siguiente subida");
+	}
+
+done:
+	s_last_upload_us = esp_timer_get_time();
+
+	// Hasta la primera sincronización SNTP la radio sigue encendida: sin hora no hay lotes
+	if (!time_valid(NULL)) return;
+
+	mqtt_app_suspend();
+	wifi_fast_ip_release();
+	wifi_radio_off();
+}
+
+static void batch_task(void *pvParameters)
+{
+	while (1) {
+		upload();
+		// Peticiones acumuladas durante la subida se atienden con una sola
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+	}
+}
+
+void telemetry_batch_start(void)
+{
+	if (s_task != NULL) return;
+
+	ESP_LOGI(TAG, "Telemetría por lotes: muestra cada %d s, subida cada %d min (%u pendientes)",
+	         CONFIG_TELEMETRY_BATCH_SAMPLE_S, CONFIG_TELEMETRY_BATCH_PERIOD_MIN, (unsigned)telemetry_batch_pending());
+
+	// Red sin plazo: misma prioridad y núcleo que el bot
+	xTaskCreatePinnedToCore(batch_task, "batch_task", 6144, NULL, PIPELINE_PRIO_TELEGRAM, &s_task, PIPELINE_CORE_NET);
+}
+
+#endif
@@ -1,7 +1,9 @@
 #include "esp_http_server.h"
 #include "esp_err.h"
 #include <esp_log.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/param.h>
 
 #include "esp_ota_ops.h"
@@ -10,6 +12,7 @@
 #include "web_managment.h"
 #include "nvs_managment.h"
 #include "wifi_managment.h"
+#include "adc.h"
 
 static const char *TAG_WEB = "WEB";
 
@@ -274,6 +277,84 @@ static esp_err_t ota_post_handler(httpd_req_t *req) {
 }
 
 
+// Barridos promediados en cada punto de calibración
+#define LDR_CAL_SCANS  4
+
+// Punto oscuro capturado (se usa al capturar el de luz)
+static int32_t s_ldr_dark[LDR_COUNT];
+static bool s_ldr_dark_ok = false;
+
+static void ldr_cal_send(httpd_req_t *req, const char *status) {
+    ldr_cal_t cal;
+    adc_ldr_cal_get(&cal);
+
+    char buf[384];
+    int len = snprintf(buf, sizeof(buf), "%s\nCalibrado: %s\n", status, cal.valid ? "si" : "no");
+    for (int i = 0; i < LDR_COUNT && cal.valid; i++) {
+        len += snprintf(buf + len, sizeof(buf) - len, "LDR%d: gain %.3f offset %ld\n",
+                        i + 1, cal.gain_q12[i] / (float)LDR_CAL_ONE, (long)cal.offset[i]);
+    }
+
+    httpd_resp_set_type(req, "text/plain");
+    httpd_resp_sendstr(req, buf);
+}
+
+/*
+ * Calibración entre canales:
+ *   1. (opcional) ?point=dark  con los 4 LDR tapados
+ *   2. ?point=light            con luz uniforme sobre los 4 (difusor / cielo nublado)
+ * Con solo el punto de luz se corrige la ganancia; con los dos, ganancia y offset.
+ */
+static esp_err_t ldr_cal_get_handler(httpd_req_t *req) {
+    char query[32] = {0};
+    char point[8] = {0};
+
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK ||
+        httpd_query_key_value(query, "point", point, sizeof(point)) != ESP_OK) {
+        ldr_cal_send(req, "Uso: /ldr_cal?point=dark|light|reset");
+        return ESP_OK;
+    }
+
+    if (strcmp(point, "reset") == 0) {
+        adc_ldr_cal_set(NULL);
+        erase_ldr_calibration();
+        s_ldr_dark_ok = false;
+        ldr_cal_send(req, "Calibracion borrada");
+        return ESP_OK;
+    }
+
+    int32_t avg[LDR_COUNT];
+    if (adc_ldr_capture(avg, LDR_CAL_SCANS) != ESP_OK) {
+        ldr_cal_send(req, "Error: no llegan lecturas del ADC");
+        return ESP_OK;
+    }
+
+    if (strcmp(point, "dark") == 0) {
+        memcpy(s_ldr_dark, avg, sizeof(avg));
+        s_ldr_dark_ok = true;
+        ESP_LOGI(TAG_WEB, "Punto oscuro LDR: %ld %ld %ld %ld", (long)avg[0], (long)avg[1], (long)avg[2], (long)avg[3]);
+        ldr_cal_send(req, "Punto oscuro capturado. Ahora ?point=light con luz uniforme");
+        return ESP_OK;
+    }
+
+    if (strcmp(point, "light") != 0) {
+        ldr_cal_send(req, "Punto desconocido");
+        return ESP_OK;
+    }
+
+    ldr_cal_t cal = {0};
+    if (adc_ldr_cal_compute(s_ldr_dark_ok ? s_ldr_dark : NULL, avg, &cal) != ESP_OK) {
+        ldr_cal_send(req, "Error: lecturas no validas (luz insuficiente o LDR desconectado)");
+        return ESP_OK;
+    }
+
+    adc_ldr_cal_set(&cal);
+    bool saved = save_ldr_calibration(&cal);
+    s_ldr_dark_ok = false;
+    ldr_cal_send(req, saved ? "Calibracion aplicada y guardada" : "Calibracion aplicada (NVS fallo)");
+    return ESP_OK;
+}
+
 httpd_handle_t start_webserver(void) {
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.stack_size = 8192;
@@ -315,4 +396,17 @@ void register_ota_handlers(httpd_handle_t server)
     httpd_register_uri_handler(server, &post_ota);
 
     ESP_LOGI(TAG_WEB, "Endpoints OTA registrados correctamente");
+}
+
+void register_ldr_cal_handlers(httpd_handle_t server)
+{
+	if (server == NULL) return;
+
+    httpd_uri_t get_cal = {
+        .uri = "/ldr_cal",
+        .method = HTTP_GET,
+        .handler = ldr_cal_get_handler,
+        .user_ctx = NULL
+    };
+    httpd_register_uri_handler(server, &get_cal);
 }
\ No newline at end of file
@@ -1,16 +1,24 @@
 #include <esp_log.h>
 #include <string.h>
+#include <time.h>
 
+#include "esp_attr.h"
 #include "esp_err.h"
 #include "esp_event.h"
 #include "esp_event_base.h"
+#include "esp_netif.h"
 #include "esp_netif_types.h"
+#include "esp_netif_net_stack.h"
 #include "esp_wifi.h"
 #include "esp_wifi_default.h"
 #include "esp_wifi_types_generic.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
 #include "freertos/idf_additions.h"
 #include "web_managment.h"
 #include "wifi_managment.h"
+#include "boot_profile.h"
+#include "lwip/dhcp.h"
 
 
 #define ESP_MAXIMUM_RETRY  5
@@ -20,12 +28,208 @@ static int s_retry_num = 0;
 
 EventGroupHandle_t s_wifi_event_group;
 
+static esp_netif_t *s_sta_netif = NULL;
+static wifi_config_t s_sta_config;
+
+// Tiempo con la radio encendida (la telemetría por lotes la apaga entre subidas)
+#define HOUR_US  3600000000LL
+
+static volatile bool s_radio_on = false;
+static volatile bool s_radio_stopping = false;	// Desconexión provocada: no reintentar
+static int64_t s_radio_since_us = 0;
+static uint64_t s_radio_on_us = 0;				// Acumulado desde el arranque
+static int64_t s_hour_start_us = 0;				// Ventana de la métrica por hora
+static uint64_t s_hour_on_us = 0;				// Acumulado al abrir la ventana
+static uint32_t s_on_s_per_hour = 0;
+static bool s_hour_done = false;
+static portMUX_TYPE s_radio_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static void radio_mark(bool on)
+{
+	int64_t now = esp_timer_get_time();
+	portENTER_CRITICAL(&s_radio_mux);
+	if (on && !s_radio_on) s_radio_since_us = now;
+	if (!on && s_radio_on) s_radio_on_us += (uint64_t)(now - s_radio_since_us);
+	s_radio_on = on;
+	portEXIT_CRITICAL(&s_radio_mux);
+}
+
+#if CONFIG_WIFI_FAST_RECONNECT
+#define FAST_CACHE_MAGIC   0x57A7CAC3u
+#define FAST_IP_MARGIN_S   600		// La concesión reutilizada debe durar al menos esto
+
+// Último AP y concesión DHCP: la memoria RTC se conserva en deep sleep
+typedef struct {
+	uint32_t magic;
+	uint32_t creds_hash;		// Credenciales con las que se obtuvo
+	uint8_t bssid[6];
+	uint8_t channel;
+	bool has_ip;
+	esp_netif_ip_info_t ip;
+	esp_netif_dns_info_t dns;
+	time_t lease_end;			// Fin de la concesión DHCP (0 = desconocido)
+} wifi_fast_cache_t;
+
+static RTC_DATA_ATTR wifi_fast_cache_t s_cache;
+static uint32_t s_creds_hash;
+static bool s_fast = false;			// Conectando con canal/BSSID guardados
+static bool s_static_ip = false;	// IP reutilizada, DHCP parado
+
+// FNV-1a: invalida la caché si cambian las credenciales
+static uint32_t creds_hash(const char *ssid, const char *pass)
+{
+	uint32_t h = 2166136261u;
+	for (const char *p = ssid; *p; p++) h = (h ^ (uint8_t)*p) * 16777619u;
+	h = (h ^ 0xFFu) * 16777619u;
+	for (const char *p = pass; *p; p++) h = (h ^ (uint8_t)*p) * 16777619u;
+	return h;
+}
+
+static bool time_valid(time_t t)
+{
+	struct tm tm;
+	localtime_r(&t, &tm);
+	return tm.tm_year >= (2016 - 1900);
+}
+
+// La IP sólo se reutiliza mientras la concesión siga vigente (el reloj RTC sigue en deep sleep)
+static bool fast_ip_usable(void)
+{
+#if CONFIG_WIFI_FAST_IP
+	return s_cache.has_ip && s_cache.lease_end != 0 && time(NULL) + FAST_IP_MARGIN_S < s_cache.lease_end;
+#else
+	return false;
+#endif
+}
+
+// Lee el estado DHCP de lwIP desde su propio hilo: los temporizadores lo modifican ahí
+static esp_err_t dhcp_lease_read(void *ctx)
+{
+	uint32_t *left = ctx;
+	struct netif *n = esp_netif_get_netif_impl(s_sta_netif);
+	struct dhcp *d = (n != NULL) ? netif_dhcp_data(n) : NULL;
+	if (d != NULL && d->t0_timeout > d->lease_used) {
+		*left = (uint32_t)(d->t0_timeout - d->lease_used) * DHCP_COARSE_TIMER_SECS;
+	}
+	return ESP_OK;
+}
+
+// Segundos que le quedan a la concesión DHCP según lwIP (cuenta las renovaciones). 0 si no se conoce.
+static uint32_t dhcp_lease_left_s(void)
+{
+	uint32_t left = 0;
+	if (esp_netif_tcpip_exec(dhcp_lease_read, &left) != ESP_OK) return 0;
+	return left;
+}
+
+static void lease_update(void)
+{
+	time_t now = time(NULL);
+	uint32_t left = dhcp_lease_left_s();
+	// Sin hora válida aún (arranque en frío) no se sabe cuándo vence: no se reutilizará
+	s_cache.lease_end = (time_valid(now) && left > 0) ? now + (time_t)left : 0;
+}
+
+// Antes de conectar: fija canal/BSSID y, si la concesión sigue vigente, la IP sin DHCP
+static void fast_apply(void)
+{
+	s_fast = (s_cache.magic == FAST_CACHE_MAGIC && s_cache.creds_hash == s_creds_hash && s_cache.channel != 0);
+	if (!s_fast) return;
+
+	memcpy(s_sta_config.sta.bssid, s_cache.bssid, sizeof(s_cache.bssid));
+	s_sta_config.sta.bssid_set = true;
+	s_sta_config.sta.channel = s_cache.channel;
+
+	if (fast_ip_usable() && esp_netif_dhcpc_stop(s_sta_netif) == ESP_OK) {
+		esp_netif_set_ip_info(s_sta_netif, &s_cache.ip);
+		esp_netif_set_dns_info(s_sta_netif, ESP_NETIF_DNS_MAIN, &s_cache.dns);
+		s_static_ip = true;
+	}
+
+	ESP_LOGI(TAG, "Reconexión rápida: canal %d, BSSID " MACSTR "%s",
+	         s_cache.channel, MAC2STR(s_cache.bssid), s_static_ip ? ", IP reutilizada" : "");
+}
+
+// El AP guardado no responde (o ha cambiado): escaneo completo y DHCP
+static void fast_fallback(void)
+{
+	ESP_LOGW(TAG, "Fallo en la reconexión rápida, escaneando...");
+	s_fast = false;
+	s_cache.magic = 0;
+
+	s_sta_config.sta.bssid_set = false;
+	s_sta_config.sta.channel = 0;
+	esp_wifi_set_config(WIFI_IF_STA, &s_sta_config);
+
+	if (s_static_ip) {
+		esp_netif_dhcpc_start(s_sta_netif);
+		s_static_ip = false;
+	}
+}
+
+// Conectado con IP: guarda el AP y, si la IP viene del DHCP, la concesión
+static void fast_save(const esp_netif_ip_info_t *ip)
+{
+	wifi_ap_record_t ap;
+	if (esp_wifi_sta_get_ap_info(&ap) != ESP_OK) return;
+
+	memcpy(s_cache.bssid, ap.bssid, sizeof(s_cache.bssid));
+	s_cache.channel = ap.primary;
+	s_cache.creds_hash = s_creds_hash;
+
+	if (!s_static_ip) {
+		s_cache.ip = *ip;
+		s_cache.has_ip = (esp_netif_get_dns_info(s_sta_netif, ESP_NETIF_DNS_MAIN, &s_cache.dns) == ESP_OK);
+		lease_update();
+	}
+	s_cache.magic = FAST_CACHE_MAGIC;
+}
+#endif
+
+void wifi_fast_ip_release(void)
+{
+#if CONFIG_WIFI_FAST_RECONNECT
+	if (!s_static_ip) return;
+	// Vuelve al DHCP para renovar la concesión durante el día (reabre las conexiones)
+	if (esp_netif_dhcpc_start(s_sta_netif) == ESP_OK) {
+		s_static_ip = false;
+		ESP_LOGI(TAG, "IP reutilizada devuelta al DHCP para renovar la concesión");
+	}
+#endif
+}
+
+void wifi_prepare_sleep(void)
+{
+#if CONFIG_WIFI_FAST_RECONNECT
+	// Las renovaciones del día alargan la concesión: se guarda el vencimiento actual
+	// (con la radio apagada ya lo guardó wifi_radio_off)
+	if (s_cache.magic == FAST_CACHE_MAGIC && !s_static_ip && s_radio_on) lease_update();
+#endif
+}
+
+bool wifi_fast_reconnect_used(void)
+{
+#if CONFIG_WIFI_FAST_RECONNECT
+	return s_fast;
+#else
+	return false;
+#endif
+}
+
 static void event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data) 
 {
 	if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
 		esp_wifi_connect();	
    	}
+	else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED) {
+		boot_profile_mark(BOOT_PHASE_WIFI);
+	}
 	else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
+		if (s_radio_stopping) return;	// Radio apagada a propósito (wifi_radio_off)
+#if CONFIG_WIFI_FAST_RECONNECT
+		// Sólo mientras se establece la primera conexión con los datos guardados
+		if (s_fast && !(xEventGroupGetBits(s_wifi_event_group) & WIFI_CONNECTED_BIT)) fast_fallback();
+#endif
 		if (s_retry_num < ESP_MAXIMUM_RETRY) {
 			esp_wifi_connect();
 			s_retry_num++;
@@ -39,6 +243,10 @@ static void event_handler(void *arg, esp_event_base_t event_base, int32_t event_
 	else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
 		ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
 		ESP_LOGI(TAG, "Conectado! IP: " IPSTR, IP2STR(&event->ip_info.ip));
+		boot_profile_mark(BOOT_PHASE_IP);
+#if CONFIG_WIFI_FAST_RECONNECT
+		fast_save(&event->ip_info);
+#endif
 		s_retry_num = 0;
 		xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
 	}
@@ -50,7 +258,7 @@ void wifi_init_system(void)
 	
 	ESP_ERROR_CHECK(esp_netif_init());
 	ESP_ERROR_CHECK(esp_event_loop_create_default());
-	esp_netif_create_default_wifi_sta();
+	s_sta_netif = esp_netif_create_default_wifi_sta();
 	esp_netif_create_default_wifi_ap();
 
 	wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
@@ -96,19 +304,25 @@ void wifi_start_ap(void)
 
 void wifi_start_sta(const char *ssid, const char *pass)
 {
-	wifi_config_t wifi_config = {
+	s_sta_config = (wifi_config_t){
 		.sta = {
 			.threshold.authmode = WIFI_AUTH_WPA2_PSK,
 			.sae_pwe_h2e = WPA3_SAE_PWE_BOTH,
 		},
 	};
 
-	strncpy((char*)wifi_config.sta.ssid, ssid, sizeof(wifi_config.sta.ssid));
-    strncpy((char*)wifi_config.sta.password, pass, sizeof(wifi_config.sta.password));
+	strncpy((char*)s_sta_config.sta.ssid, ssid, sizeof(s_sta_config.sta.ssid));
+    strncpy((char*)s_sta_config.sta.password, pass, sizeof(s_sta_config.sta.password));
+
+#if CONFIG_WIFI_FAST_RECONNECT
+	s_creds_hash = creds_hash(ssid, pass);
+	fast_apply();
+#endif
 
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
+    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &s_sta_config));
     ESP_ERROR_CHECK(esp_wifi_start());
+    radio_mark(true);
     
     ESP_LOGI(TAG, "Iniciando modo STA. Intentando conectar a %s...", ssid);
 }
@@ -134,3 +348,58 @@ uint16_t wifi_scan_networks(wifi_ap_record_t *ap_info, uint16_t max_aps) {
     }
     return ap_count;
 }
+
+bool wifi_radio_on(uint32_t timeout_ms)
+{
+	if (!s_radio_on) {
+		xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT | WIFI_FAIL_BIT);
+		s_retry_num = 0;
+		s_radio_stopping = false;
+		// Misma configuración STA: con la reconexión rápida, directo al AP guardado
+		if (esp_wifi_start() != ESP_OK) return false;
+		radio_mark(true);
+	}
+
+	EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group, WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
+	                                       pdFALSE, pdFALSE, pdMS_TO_TICKS(timeout_ms));
+	return (bits & WIFI_CONNECTED_BIT) != 0;
+}
+
+void wifi_radio_off(void)
+{
+	if (!s_radio_on) return;
+#if CONFIG_WIFI_FAST_RECONNECT
+	if (s_cache.magic == FAST_CACHE_MAGIC && !s_static_ip) lease_update();
+#endif
+	s_radio_stopping = true;
+	esp_wifi_stop();
+	xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+	radio_mark(false);
+}
+
+bool wifi_radio_is_on(void)
+{
+	return s_radio_on;
+}
+
+uint32_t wifi_radio_on_s_per_hour(void)
+{
+	int64_t now = esp_timer_get_time();
+
+	portENTER_CRITICAL(&s_radio_mux);
+	uint64_t on = s_radio_on_us + (s_radio_on ? (uint64_t)(now - s_radio_since_us) : 0);
+	int64_t elapsed = now - s_hour_start_us;
+	uint32_t rate = (elapsed > 0) ? (uint32_t)((on - s_hour_on_us) * 3600ULL / (uint64_t)elapsed) : 0;
+
+	// Al cerrar cada ventana se fija su valor; en la primera hora, lo que va de ella
+	if (elapsed >= HOUR_US) {
+		s_on_s_per_hour = rate;
+		s_hour_done = true;
+		s_hour_start_us = now;
+		s_hour_on_us = on;
+	}
+	if (s_hour_done) rate = s_on_s_per_hour;
+	portEXIT_CRITICAL(&s_radio_mux);
+
+	return rate;
+}
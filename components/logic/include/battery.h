@@ -1,6 +1,46 @@
 #pragma once
 
-// Calcula un % aproximado de la bateria a partir del voltaje en reposo
+#include <stdint.h>
+#include "sdkconfig.h"
+
+/*
+ * Calcula un % aproximado de la bateria a partir del voltaje en reposo con la
+ * curva OCV de la química y celdas de Kconfig (tabla generada en el build,
+ * búsqueda binaria)
+ */
 float battery_porcent_from_voltage(float volts);
 
-float battery_soc_update(float soc_prev, float v_bat, float current_A, float dt_s, float capacity_Ah);
\ No newline at end of file
+#ifdef CONFIG_BAT_OCV_TEMP_COMP
+// Temperatura de la batería para compensar la OCV (por defecto BAT_TEMP_C)
+void battery_set_temperature(float temp_c);
+#endif
+
+float battery_soc_update(float soc_prev, float v_bat, float current_A, float dt_s, float capacity_Ah);
+
+// Modelo Thevenin de 1 RC: V = OCV(SoC) - V_RC - R0 * I  (I > 0 = descarga)
+typedef struct {
+	float r0;			// Resistencia serie (Ohm)
+	float r1;			// Resistencia de polarización (Ohm)
+	float c1;			// Capacidad de polarización (F)
+	float capacity_Ah;
+} battery_model_t;
+
+// Estado del filtro de Kalman extendido
+typedef struct {
+	float soc;			// Estado de carga (0..1)
+	float v_rc;			// Tensión en el par R1/C1 (V)
+	float p[2][2];		// Covarianza del estado
+} battery_ekf_t;
+
+// Arranca con un SoC conocido (p.ej. por voltaje en reposo) y su incertidumbre
+void battery_ekf_init(battery_ekf_t *k, float soc_pct, float sigma_pct);
+
+/*
+ * Un paso del EKF: predicción por conteo de Coulomb y dinámica del RC,
+ * corrección con la tensión medida frente a la OCV de la tabla. Coste fijo
+ * (matrices 2x2 en float y una búsqueda en la tabla). Devuelve el SoC en %.
+ */
+float battery_ekf_update(battery_ekf_t *k, const battery_model_t *m, float v_bat, float current_A, float dt_s);
+
+// Desviación típica estimada del SoC (%): la confianza de la estimación
+float battery_ekf_sigma(const battery_ekf_t *k);
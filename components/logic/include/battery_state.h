@@ -0,0 +1,38 @@
+// Servicio único de estado de la batería (SoC y carga acumulada)
+#pragma once
+
+#include <stdbool.h>
+
+typedef struct {
+	float soc;			// Estado de carga (%)
+	float soc_sigma;	// Incertidumbre del SoC (%, 0 = no disponible)
+	float ah_out;		// Carga extraída acumulada (Ah)
+	float ah_in;		// Carga aportada acumulada (Ah)
+	float capacity_Ah;	// Capacidad aprendida (o la nominal de Kconfig)
+	float soh;			// Estado de salud: capacidad aprendida / nominal (%)
+	float tte_h;		// Tiempo hasta vacía con la corriente media (h, -1 = no descarga)
+	float ttf_h;		// Tiempo hasta llena con la corriente media (h, -1 = no carga)
+} battery_state_t;
+
+/*
+ * Recupera el estado: de la memoria RTC si sólo ha habido deep sleep o un
+ * reinicio (descontando el consumo durante el sueño), de NVS tras un corte de
+ * alimentación y, si no hay nada guardado, por la tensión v_bat (0 = sin lectura).
+ * La capacidad aprendida se lee de NVS. Requiere NVS inicializado.
+ */
+void battery_state_init(float v_bat);
+
+/*
+ * Integra una muestra de la batería (I > 0 = descarga) con el dt medido por
+ * esp_timer desde la anterior. Sólo la tarea de los INA debe llamarla.
+ * Con BAT_CAP_LEARN aprovecha los reposos para aprender la capacidad.
+ * Devuelve el SoC (%).
+ */
+float battery_state_update(float v_bat, float current_A);
+
+// Lectura para cualquier tarea: todos los consumidores ven el mismo valor
+void battery_state_get(battery_state_t *out);
+float battery_state_soc(void);
+
+// Guarda el estado en NVS ya (antes de dormir: sobrevive a un corte durante la noche)
+void battery_state_flush(void);
@@ -0,0 +1,23 @@
+// Marcas de tiempo de las fases del arranque (despertar -> primera telemetría)
+#pragma once
+
+#include <stdint.h>
+
+typedef enum {
+	BOOT_PHASE_SENSORS = 0,	// Tareas de sensores y tracker en marcha
+	BOOT_PHASE_WIFI,		// Asociado al AP
+	BOOT_PHASE_IP,			// IP (DHCP o concesión reutilizada)
+	BOOT_PHASE_TIME,		// Primera sincronización SNTP
+	BOOT_PHASE_MQTT,		// Conectado al broker
+	BOOT_PHASE_PUBLISH,		// Primera telemetría publicada
+	BOOT_PHASE_MAX
+} boot_phase_t;
+
+// Sólo cuenta la primera vez que se alcanza cada fase. PUBLISH deja el resumen en el log.
+void boot_profile_mark(boot_phase_t phase);
+
+// Milisegundos desde el arranque de la aplicación hasta la fase (0 = aún no alcanzada)
+uint32_t boot_profile_ms(boot_phase_t phase);
+
+// "Sensors", "Wifi"...: sufijo de las claves de telemetría (bootSensorsMs)
+const char *boot_phase_name(boot_phase_t phase);
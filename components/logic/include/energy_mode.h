@@ -0,0 +1,72 @@
+// Modos de energía: recorte progresivo del consumo según el SoC y su tendencia
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "battery_state.h"
+#include "snapshot.h"
+#include "sdkconfig.h"
+
+typedef enum {
+	ENERGY_MODE_NORMAL = 0,
+	ENERGY_MODE_ECO,		// Muestreo y publicación más espaciados
+	ENERGY_MODE_CRITICAL,	// Sin seguimiento ni Telegram, radio sólo para publicar
+	ENERGY_MODE_SURVIVAL,	// Deep sleep hasta que vuelva la tensión del panel
+	ENERGY_MODE_MAX
+} energy_mode_t;
+
+// Qué se mantiene en cada modo
+typedef struct {
+	uint8_t tick_scale;		// Multiplica el tick de muestreo (CONFIG_TASK_INA_PERIOD_MS)
+	uint8_t publish_scale;	// Y además el periodo de publicación (o de subida de lotes)
+	bool tracking;			// false = panel aparcado
+	bool telegram;			// Sondeo del bot
+	bool radio;				// WiFi siempre encendida (false = sólo para publicar)
+} energy_policy_t;
+
+// Umbrales de SoC (%), modificables en marcha
+typedef struct {
+	float eco_pct;
+	float critical_pct;
+	float survival_pct;
+	float hyst_pct;			// Margen sobre el umbral para volver al modo superior
+} energy_thresholds_t;
+
+#if CONFIG_ENERGY_MODES
+
+/*
+ * Umbrales de NVS (o de Kconfig) y el modo anterior al deep sleep, que se
+ * aplica ya: tick, tracker. Después de pipeline_start() y antes de
+ * solar_tracker_start() (sin seguimiento arranca ya en reposo).
+ */
+void energy_mode_init(void);
+
+/*
+ * Desde el bucle principal: evalúa el modo con el SoC proyectado por la
+ * tendencia (bat->tte_h) y aplica los cambios. Devuelve el modo vigente;
+ * en SURVIVAL quien llama debe dormir.
+ */
+energy_mode_t energy_mode_update(const battery_state_t *bat);
+
+/*
+ * Al despertar en supervivencia: true (y pasa a crítico) si el panel vuelve
+ * a dar tensión o, sin canal de panel, si la batería se está cargando.
+ * No se vuelve a supervivencia hasta pasados CONFIG_ENERGY_CRITICAL_DWELL_MIN.
+ */
+bool energy_mode_power_returned(const ina_snapshot_t *ina);
+
+energy_mode_t energy_mode_get(void);
+const energy_policy_t *energy_mode_policy(void);
+
+// SoC con el que se decidió el último cambio (proyectado, %)
+float energy_mode_level(void);
+
+// "normal", "eco", "critical", "survival" (valor de la telemetría energyMode)
+const char *energy_mode_name(energy_mode_t mode);
+
+void energy_mode_get_thresholds(energy_thresholds_t *out);
+// Requiere eco > crítico > supervivencia >= 0 e histéresis 0-20. Se guardan en NVS.
+esp_err_t energy_mode_set_thresholds(const energy_thresholds_t *t);
+
+#endif
@@ -0,0 +1,44 @@
+// Balance energético de los movimientos del tracker
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+#include "snapshot.h"
+
+typedef struct {
+	float spent_j;		// Energía gastada moviendo los servos (potencia extra x tiempo en movimiento)
+	float gained_j;		// Ganancia estimada de los movimientos realizados (modelo del coseno)
+	float move_w;		// Potencia extra de los servos en movimiento (medida o valor de Kconfig)
+	uint32_t skipped;	// Movimientos descartados por no compensar
+} move_energy_t;
+
+void move_energy_init(void);
+
+/*
+ * Una vez por ciclo del tracker. Clasifica cada instantánea INA nueva según
+ * los servos se estuvieran moviendo o no en ese instante, aprende la potencia
+ * extra del movimiento y acumula la energía gastada. El consumo sale del INA
+ * de carga o del balance panel + batería; sin ellos se usa TRACKER_MOVE_POWER_W.
+ */
+void move_energy_update(void);
+
+/*
+ * Decide si un movimiento de (dh, dv) grados compensa. Ganancia: la potencia
+ * máxima del panel por (1 - cos θ) durante el horizonte configurado, con θ el
+ * error angular que corrige; la potencia sale del INA del panel o, sin él, de
+ * la irradiancia de los LDR. Coste: potencia extra x duración del perfil.
+ * Si no compensa, cuenta como descartado.
+ */
+bool move_energy_pays(float dh, float dv, const ldr_snapshot_t *ldr);
+
+// La orden aceptada por move_energy_pays() en este ciclo se ha escrito: anota su ganancia
+void move_energy_moved(void);
+
+/*
+ * Luz difusa (nublado): poca luz total y poco contraste entre los LDR durante
+ * varios ciclos seguidos. light en cuentas raw, contrast en error normalizado.
+ */
+bool move_energy_diffuse(int light, float contrast);
+
+void move_energy_get(move_energy_t *out);
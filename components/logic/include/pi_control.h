@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+
+// Parámetros del lazo de cada eje (comunes a los dos)
+typedef struct {
+	float kp;			// Grados/ciclo por unidad de error normalizado
+	float ki;			// Grados/ciclo por unidad de error y segundo
+	float max_step;		// Límite de velocidad (grados/ciclo)
+	float hyst_off;		// Fracción del umbral de entrada bajo la que el eje se detiene (0..1)
+} pi_gains_t;
+
+// Estado de un eje
+typedef struct {
+	float integ;		// Término integral (grados/ciclo)
+	bool active;		// Fuera de la banda de histéresis
+} pi_axis_t;
+
+/*
+ * Error normalizado de un par de LDR: (a - b) / (a + b), en [-1, 1].
+ * Independiente del nivel de luz, así la misma ganancia vale con sol y con nubes.
+ */
+float pi_norm_error(int a, int b);
+
+// Umbral de entrada normalizado equivalente a |a - b| > tolerance (en cuentas raw)
+float pi_norm_threshold(int tolerance, int a, int b);
+
+void pi_axis_reset(pi_axis_t *ax);
+
+/*
+ * Un ciclo del lazo. Devuelve el incremento de ángulo a aplicar (grados).
+ *
+ * El eje arranca cuando |e| supera e_on y se detiene al bajar de e_on * hyst_off,
+ * sin oscilar en el borde de la banda muerta. Parado, el integral se conserva.
+ * Anti-windup: el integral no crece mientras la salida está saturada por max_step
+ * en el mismo sentido del error.
+ */
+float pi_axis_update(pi_axis_t *ax, const pi_gains_t *g, float e, float e_on, float dt_s);
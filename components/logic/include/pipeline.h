@@ -0,0 +1,72 @@
+// Reloj común de muestreo y plazos de las tareas periódicas
+#pragma once
+
+#include <stdint.h>
+#include "sdkconfig.h"
+
+/*
+ * Prioridades rate-monotonic: cuanto más corto el periodo, más prioridad.
+ * servo_motion (6) queda por encima: ejecuta los perfiles en curso.
+ * WiFi/LwIP viven en el núcleo 0; sensores y control van al otro núcleo.
+ */
+#define PIPELINE_PRIO_TRACKER   5	// CONFIG_TRACKER_UPDATE_MS
+#define PIPELINE_PRIO_INA       4	// Tick (CONFIG_TASK_INA_PERIOD_MS)
+#define PIPELINE_PRIO_ADC       3	// CONFIG_TASK_ADC_PERIOD_MS
+#define PIPELINE_PRIO_MAIN      2	// CONFIG_MAIN_LOOP_PERIOD_S
+#define PIPELINE_PRIO_TELEGRAM  1	// Sondeo de red, sin plazo
+
+#define PIPELINE_CORE_NET       0
+#if CONFIG_FREERTOS_UNICORE
+#define PIPELINE_CORE_APP       0
+#else
+#define PIPELINE_CORE_APP       1
+#endif
+
+typedef enum {
+	PIPELINE_STAGE_INA = 0,		// Cada tick
+	PIPELINE_STAGE_ADC,			// Cada N ticks (mismo instante que el INA)
+	PIPELINE_STAGE_TRACKER,		// Periodo propio con vTaskDelayUntil
+	PIPELINE_STAGE_MAIN,		// Cada N muestras INA publicadas
+	PIPELINE_STAGE_MAX
+} pipeline_stage_t;
+
+typedef struct {
+	uint32_t runs;
+	uint32_t misses;		// Ciclos terminados después de su plazo (o sin activación a tiempo)
+	uint32_t last_us;		// Tiempo de respuesta: activación -> fin del ciclo
+	uint32_t max_us;
+	uint32_t jitter_max_us;	// Activación -> inicio del ciclo
+} pipeline_stage_stats_t;
+
+typedef struct {
+	pipeline_stage_stats_t stage[PIPELINE_STAGE_MAX];
+	uint32_t ticks;
+	uint32_t latency_us;		// Muestra (tick) -> publicación MQTT, último ciclo
+	uint32_t latency_max_us;
+} pipeline_stats_t;
+
+// Arranca el tick compartido. Antes de crear las tareas de los sensores.
+void pipeline_start(void);
+
+/*
+ * Ahorro de energía: tick de muestreo tick_scale veces más lento y bucle
+ * principal main_scale veces más espaciado además (1, 1 = sdkconfig).
+ */
+void pipeline_set_rate(uint32_t tick_scale, uint32_t main_scale);
+
+/*
+ * Bloquea la etapa hasta su próxima activación (tick o muestra INA) y
+ * devuelve el instante de la activación (esp_timer, us): la marca de tiempo
+ * de la muestra. Si no llega en dos periodos cuenta como plazo perdido.
+ */
+int64_t pipeline_wait(pipeline_stage_t stage);
+
+// Fin del trabajo de un ciclo activado en release_us: tiempo de respuesta y plazo (= periodo)
+void pipeline_done(pipeline_stage_t stage, int64_t release_us);
+
+// Latencia de extremo a extremo de una muestra tomada en sample_us que se acaba de publicar
+void pipeline_record_latency(int64_t sample_us);
+
+void pipeline_get_stats(pipeline_stats_t *out);
+
+const char *pipeline_stage_name(pipeline_stage_t stage);
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Ejes que perturba el P&O (mismo orden que el tracker)
+#define PO_AXIS_H   0
+#define PO_AXIS_V   1
+#define PO_AXES     2
+
+typedef struct {
+	float step_min;		// Paso mínimo (unidades de la variable perturbada)
+	float step_max;		// Paso máximo
+	float grow;			// Factor del paso tras una mejora (> 1)
+	float shrink;		// Factor del paso tras un fallo (< 1)
+	float min_gain;		// Mejora relativa mínima para aceptar (por encima del ruido)
+} po_cfg_t;
+
+typedef struct {
+	float step[PO_AXES];
+	int8_t dir[PO_AXES];
+	uint8_t axis;		// Eje de la perturbación en curso
+	float delta;		// Incremento aplicado en la perturbación en curso
+	float p_base;		// Potencia media antes de perturbar
+	uint32_t kept;		// Perturbaciones que subieron la potencia
+	uint32_t reverted;	// Perturbaciones deshechas
+} po_state_t;
+
+void po_init(po_state_t *st, const po_cfg_t *cfg);
+
+/*
+ * Inicia una perturbación partiendo de la potencia media p_base.
+ * Devuelve el incremento a aplicar al eje *axis.
+ */
+float po_perturb(po_state_t *st, float p_base, uint8_t *axis);
+
+/*
+ * Decide con la potencia media tras la perturbación. Devuelve true si se
+ * mantiene; con false el llamador debe deshacer el incremento.
+ * Adapta el paso (crece con las mejoras, encoge cerca del óptimo) y alterna de eje.
+ */
+bool po_evaluate(po_state_t *st, const po_cfg_t *cfg, float p_after);
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Resumen de una ventana de muestras (tras descartar picos)
+typedef struct {
+	float min;
+	float max;
+	float mean;
+	float rms;
+	float p5;
+	float p50;
+	float p95;
+	uint16_t count;		// Muestras usadas
+	uint16_t rejected;	// Picos descartados
+} signal_stats_t;
+
+/*
+ * Reduce una ventana de muestras. Ordena el buffer en el sitio.
+ *
+ * Rechazo de picos: se descartan las muestras con |x - mediana| > k * sigma,
+ * con sigma estimada robustamente como 1.4826 * MAD. Con k <= 0 no se descarta
+ * nada; si se descartarían todas, se resume la ventana completa.
+ * scratch: buffer auxiliar de n floats para la MAD (NULL = sin rechazo de picos).
+ * Devuelve 0 si no hay muestras.
+ */
+size_t signal_stats_compute(float *samples, size_t n, float spike_k, float *scratch, signal_stats_t *out);
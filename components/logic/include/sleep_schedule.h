@@ -0,0 +1,32 @@
+// Calendario de deep sleep: dormir de anochecer a amanecer en el lugar configurado
+#pragma once
+
+#include <stdbool.h>
+#include <time.h>
+#include "sdkconfig.h"
+
+// Instantes UTC (time_t) del ciclo día/noche en curso
+typedef struct {
+	time_t dawn;		// El sol sube por encima de CONFIG_SLEEP_SUN_ELEV_DEG (día solar actual)
+	time_t dusk;		// Baja de nuevo
+	time_t sleep_at;	// Próximo deep sleep (= ahora si ya es de noche)
+	time_t wake_at;		// Despertar de ese deep sleep: el siguiente amanecer
+	bool night;			// Ahora el sol está por debajo: hay que dormir hasta wake_at
+} sleep_schedule_t;
+
+// Lee latitud, longitud y elevación de sdkconfig. Una vez, antes de usar el resto.
+void sleep_schedule_init(void);
+
+/*
+ * Calcula el calendario para 'now' (hora válida) y lo guarda para
+ * sleep_schedule_get(). Sol de medianoche: nunca es de noche y se
+ * recalcula en cada medianoche solar. Noche polar: despierta cada
+ * mediodía solar para volver a comprobarlo.
+ */
+void sleep_schedule_compute(time_t now, sleep_schedule_t *out);
+
+// Lo mismo para un lugar cualquiera, sin guardarlo (pruebas en el PC)
+void sleep_schedule_at(time_t now, float lat, float lon, float elev, sleep_schedule_t *out);
+
+// Último calendario calculado (telemetría). false si aún no hay hora válida.
+bool sleep_schedule_get(sleep_schedule_t *out);
@@ -0,0 +1,81 @@
+// Almacén de instantáneas compartidas entre tareas (sustituye al Mutex global)
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ina.h"
+#include "adc.h"
+#include "solar_tracker.h"
+
+/*
+ * Cada registro se protege con un seqlock: el escritor incrementa el contador
+ * antes (impar) y después (par) de copiar los datos, y los lectores copian sin
+ * bloquear y reintentan si el contador ha cambiado durante la copia. Los
+ * escritores de un mismo registro se serializan entre sí con su propio mutex.
+ *
+ * timestamp_us: instante de la publicación (esp_timer_get_time()).
+ * seq:          número de publicaciones realizadas (0 = nunca publicado).
+ */
+
+typedef struct {
+	ina_data_t ch[INA_ROLE_MAX];	// Indexado por función (ina_role_t)
+	bool valid[INA_ROLE_MAX];	// false si el canal no existe o no ha respondido nunca
+	float battery_soc;
+	float battery_soc_sigma;	// Incertidumbre del SoC (%, 0 = no disponible)
+	ina_burst_t burst[INA_ROLE_MAX];	// Última ráfaga de cada canal (modo burst)
+	bool burst_valid[INA_ROLE_MAX];
+	int64_t burst_timestamp_us;
+	int64_t sample_us;			// Tick de muestreo compartido con los LDR (pipeline)
+	int64_t timestamp_us;
+	uint32_t seq;
+} ina_snapshot_t;
+
+typedef struct {
+	ldr_data_t ldr[LDR_COUNT];
+	bool calibrated;	// raw corregido con la calibración por canal
+	int64_t sample_us;	// Tick de muestreo (0 en modo continuo: frames propios)
+	int64_t timestamp_us;
+	uint32_t seq;
+} ldr_snapshot_t;
+
+typedef struct {
+	tracker_data_t tracker;
+	int64_t timestamp_us;
+	uint32_t seq;
+} tracker_snapshot_t;
+
+// Publicación (los campos timestamp_us y seq de la entrada se ignoran)
+void snapshot_publish_ina(const ina_snapshot_t *snap);
+void snapshot_publish_ldr(const ldr_snapshot_t *snap);
+void snapshot_publish_tracker(const tracker_snapshot_t *snap);
+
+typedef enum {
+	SNAPSHOT_OK = 0,
+	SNAPSHOT_EMPTY,		// Nunca publicado
+	SNAPSHOT_BUSY,		// Escritor a mitad de copia durante todos los reintentos
+} snapshot_result_t;
+
+/*
+ * Lectura sin bloquear al escritor. Si éste está a mitad de copia se reintenta
+ * con espera creciente (como mucho unos pocos ticks). Salvo SNAPSHOT_OK, la
+ * salida queda a cero.
+ */
+snapshot_result_t snapshot_try_read_ina(ina_snapshot_t *out);
+snapshot_result_t snapshot_try_read_ldr(ldr_snapshot_t *out);
+snapshot_result_t snapshot_try_read_tracker(tracker_snapshot_t *out);
+
+// Atajos: true sólo con SNAPSHOT_OK
+bool snapshot_read_ina(ina_snapshot_t *out);
+bool snapshot_read_ldr(ldr_snapshot_t *out);
+bool snapshot_read_tracker(tracker_snapshot_t *out);
+
+/*
+ * Función llamada tras cada snapshot_publish_ldr(), en la tarea del productor.
+ * Debe ser breve y no bloquear (p.ej. notificar a otra tarea). NULL la desactiva.
+ */
+typedef void (*snapshot_ldr_hook_t)(const ldr_snapshot_t *snap);
+void snapshot_set_ldr_hook(snapshot_ldr_hook_t hook);
+
+// Antigüedad de una instantánea en milisegundos
+uint32_t snapshot_age_ms(int64_t timestamp_us);
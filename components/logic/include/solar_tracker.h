@@ -1,16 +1,51 @@
 // Une los datos leidos por el ADC con el servo
 #pragma once
 
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "pi_control.h"
+
 typedef struct {
     float angle_h; // Ángulo Horizontal (Azimut)
     float angle_v; // Ángulo Vertical (Elevación)
+    float sun_azimuth;   // Posición calculada del sol (grados, 0 = Norte)
+    float sun_elevation; // Grados sobre el horizonte
+    float trim_h;        // Corrección aplicada por los LDR sobre el modelo
+    float trim_v;
+    bool sun_model;      // true si el modelo astronómico dirige los servos
+    uint32_t moves;      // Escrituras a los servos desde el arranque
+    bool idle;           // Convergido: servos apagados y tarea bloqueada
+    uint32_t wakeups_per_hour; // Despertares de la tarea del tracker
+    uint32_t idle_s;     // Tiempo total con los servos apagados (s)
+    uint32_t lock_ms;    // Duración de la última adquisición (0 = sin adquirir)
+    uint32_t po_kept;    // Perturbaciones P&O que subieron la potencia del panel
+    uint32_t po_reverted;
+    float po_ref_h;      // Consigna de error de los LDR fijada por el P&O (modo exterior)
+    float po_ref_v;
+    float move_spent_j;  // Energía gastada moviendo los servos (J)
+    float move_gain_j;   // Ganancia estimada de los movimientos realizados (J)
+    float move_w;        // Potencia extra de los servos en movimiento (W)
+    uint32_t moves_skipped; // Movimientos descartados por no compensar
+    bool diffuse;        // Luz difusa: seguimiento congelado o panel horizontal
 } tracker_data_t;
 
-// Variable global para que el Main la lea
-extern tracker_data_t g_tracker_data;
-
 // Iniciar el hardware de servos y la tarea de seguimiento
 void solar_tracker_start(void);
 
-// Mueve los servos a posición de reposo (ej: 90 grados H, 0 grados V)
-void solar_tracker_park(void);
\ No newline at end of file
+// Pide un barrido de adquisición (se ejecuta en la tarea del tracker). Reanuda tras aparcar.
+void solar_tracker_request_scan(void);
+
+/*
+ * Lleva los servos a la posición de reposo (90 grados H, 0 grados V) y los
+ * apaga. Lo hace la tarea del tracker; espera a que termine (como mucho 5 s).
+ * El panel sigue aparcado hasta solar_tracker_request_scan().
+ */
+void solar_tracker_park(void);
+
+// Modos de energía: aparca el panel (CONFIG_ENERGY_PARK_*) y detiene el seguimiento hasta reanudarlo
+void solar_tracker_set_suspended(bool suspended);
+
+// Ganancias del lazo PI (compartidas por ambos ejes). Se pueden cambiar en marcha.
+void solar_tracker_get_gains(pi_gains_t *out);
+esp_err_t solar_tracker_set_gains(const pi_gains_t *g);
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+// Posición del sol vista desde un punto de la Tierra
+typedef struct {
+	float azimuth_deg;		// 0 = Norte, 90 = Este, 180 = Sur
+	float elevation_deg;	// Sobre el horizonte, con refracción atmosférica
+} sun_pos_t;
+
+/*
+ * Algoritmo de baja precisión del Astronomical Almanac / NOAA (~0.01° entre
+ * 1950 y 2050) en float. Los términos que crecen con los días desde J2000 se
+ * reducen a 360° por separado para no perder precisión en coma flotante simple.
+ *
+ * utc: segundos desde la época Unix (time(NULL), independiente de la zona horaria).
+ * lon_deg: positiva hacia el Este.
+ */
+void sun_position_compute(time_t utc, float lat_deg, float lon_deg, sun_pos_t *out);
+
+typedef enum {
+	SUN_EVENTS_OK = 0,
+	SUN_EVENTS_ALWAYS_UP,		// No baja de la elevación en todo el día (sol de medianoche)
+	SUN_EVENTS_ALWAYS_DOWN,		// No llega a ella (noche polar)
+} sun_events_t;
+
+/*
+ * Instantes UTC en que el sol cruza elev_deg subiendo (rise) y bajando (set)
+ * durante el día solar medio que contiene utc (de medianoche a medianoche
+ * solar, por lo que no depende de la zona horaria ni del horario de verano).
+ * Elevación geométrica: -6 para el crepúsculo civil, -0.833 para orto y ocaso.
+ * Sol de medianoche: rise/set son las medianoches solares. Noche polar: rise = set = mediodía solar.
+ */
+sun_events_t sun_events_compute(time_t utc, float lat_deg, float lon_deg, float elev_deg, time_t *rise, time_t *set);
+
+// Compara con una tabla de referencia (NOAA en doble precisión). Devuelve el error máximo en grados.
+float sun_position_selftest(void);
@@ -0,0 +1,107 @@
+// Decisión de un ciclo del tracker, sin ESP-IDF: la usan tracker_task y el simulador del PC
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include "pi_control.h"
+#include "po_control.h"
+#include "solar_tracker.h"
+
+// Configuración fija del lazo (de Kconfig en el equipo, de la línea de órdenes en el simulador)
+typedef struct {
+	int tolerance;			// Banda muerta (raw)
+	int tolerance_cal;		// Banda muerta con LDR calibrados
+	float dt_s;				// Periodo del lazo
+	bool ldr_drives;		// false: sólo el P&O mueve los servos
+	bool sun_model;			// El modelo astronómico dirige y los LDR corrigen el trim
+	float lat, lon;
+	float az_center;		// Azimut del servo H a 90°
+	float v_offset;
+	float min_elevation;
+	bool h_invert, v_invert;
+	float trim_max;
+	float move_min;			// Cambio mínimo para escribir con el modelo
+	int trim_min_raw;		// Luz mínima para aplicar trim
+	bool diffuse_flat;		// Con luz difusa, panel a (flat_h, flat_v)
+	float flat_h, flat_v;
+} tracker_cfg_t;
+
+// Estado del lazo entre ciclos
+typedef struct {
+	float angle_h, angle_v;
+	float trim_h, trim_v;		// Corrección de los LDR sobre el modelo. Se conserva entre nubes.
+	float po_ref[PO_AXES];		// Consigna de error de los LDR (P&O exterior)
+	pi_axis_t pi_h, pi_v;
+	bool sun_active;			// El modelo dirigió el último ciclo
+	float written_h, written_v;	// Última orden a los servos (< 0: ninguna)
+	uint32_t moves;
+} tracker_state_t;
+
+// Entradas de un ciclo
+typedef struct {
+	int top, bot, left, right;	// Lecturas raw de los LDR
+	bool calibrated;
+	time_t utc;					// Hora para el modelo solar
+	pi_gains_t gains;
+} tracker_inputs_t;
+
+/*
+ * E/S inyectada. move e is_moving son obligatorias; el resto puede ser NULL.
+ * diffuse: true si la luz es difusa y no compensa seguir.
+ * pays: true si compensa mover (dh, dv) grados.
+ * perturb: un paso del P&O (sin diffuse); devuelve true con una perturbación en curso.
+ */
+typedef struct {
+	bool (*move)(void *ctx, float h, float v);
+	bool (*is_moving)(void *ctx);
+	bool (*diffuse)(void *ctx, int light, float contrast);
+	bool (*pays)(void *ctx, float dh, float dv);
+	bool (*perturb)(void *ctx, bool diffuse);
+	void *ctx;
+} tracker_io_t;
+
+typedef struct {
+	bool moved;			// Orden escrita a los servos
+	bool busy;			// Orden, movimiento en curso o perturbación: no pasar a reposo
+	bool deferred;		// Movimiento descartado por no compensar
+	bool diffuse;
+	bool model;
+} tracker_step_result_t;
+
+// Lo que el hook de LDR compara con el tracker en reposo
+typedef struct {
+	bool model;			// Con el modelo solar el lazo mueve el trim
+	float pos_h, pos_v;	// Ángulo o trim según el caso
+	float lo, hi;		// Límites de pos_h/pos_v
+	float ref_h, ref_v;	// Consigna del P&O exterior
+} tracker_wake_ref_t;
+
+void tracker_state_init(tracker_state_t *st, float angle_h, float angle_v);
+
+/*
+ * Posición de los servos que apunta al sol según el modelo, sin el trim.
+ * Rellena la posición del sol en td (puede ser NULL). Devuelve false si la
+ * hora no es válida o el sol está bajo el horizonte configurado.
+ */
+bool tracker_sun_target(const tracker_cfg_t *cfg, time_t utc, tracker_data_t *td, float *base_h, float *base_v);
+
+// true si algún eje ha cambiado más de min_delta desde la última orden
+bool tracker_needs_move(const tracker_state_t *st, float h, float v, float min_delta);
+
+// Orden coordinada a (h, v) sólo si hace falta; true si se ha escrito
+bool tracker_command(tracker_state_t *st, const tracker_io_t *io, float h, float v, float min_delta);
+
+/*
+ * Un ciclo del lazo: error de los LDR, PI (sobre el ángulo o sobre el trim del
+ * modelo), luz difusa, P&O, límites, coste del movimiento y orden a los servos.
+ * Rellena en td la posición, el modelo, el trim y los movimientos.
+ */
+void tracker_step(tracker_state_t *st, const tracker_cfg_t *cfg, const tracker_inputs_t *in,
+                  const tracker_io_t *io, tracker_data_t *td, tracker_step_result_t *res);
+
+// Referencia del hook a partir del estado, justo antes de pasar a reposo
+void tracker_wake_ref(const tracker_state_t *st, const tracker_cfg_t *cfg, tracker_wake_ref_t *ref);
+
+// true si con estas lecturas el lazo movería algún eje (el tracker en reposo debe despertar)
+bool tracker_wake_check(const tracker_wake_ref_t *ref, const tracker_cfg_t *cfg, const tracker_inputs_t *in);
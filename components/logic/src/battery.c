@@ -2,48 +2,53 @@
 
 #include <math.h>
 
-// Tabla de búsqueda para la curva de descarga (ajustar según tu batería LiPo/Li-Ion real)
-typedef struct {
-    float voltage;
-    float percent;
-} bat_lut_t;
-
-static const bat_lut_t c_bat_lut[] = {
-    {4.20f, 100.0f},
-    {4.10f, 90.0f},
-    {4.00f, 80.0f},
-    {3.90f, 70.0f},
-    {3.80f, 60.0f},
-    {3.75f, 50.0f},
-    {3.70f, 40.0f},
-    {3.65f, 30.0f},
-    {3.55f, 20.0f},
-    {3.45f, 10.0f},
-    {3.30f, 0.0f}   // Punto mínimo
-};
+#include "ocv_table.h"	// Generado en el build (tools/gen_ocv_table.py)
+
+#if CONFIG_BAT_OCV_TEMP_COMP
+// OCV(T) - OCV(25 °C) del pack (V): la tabla está calibrada a 25 °C
+#define OCV_TEMP_OFFSET(t)  (CONFIG_BAT_CELLS * CONFIG_BAT_OCV_TEMPCO_UV_C * 1e-6f * ((t) - 25.0f))
+
+static float s_ocv_temp_offset = OCV_TEMP_OFFSET(CONFIG_BAT_TEMP_C);
+
+void battery_set_temperature(float temp_c)
+{
+	s_ocv_temp_offset = OCV_TEMP_OFFSET(temp_c);
+}
+#define OCV_TEMP_OFFSET_V  s_ocv_temp_offset
+#else
+#define OCV_TEMP_OFFSET_V  0.0f
+#endif
+
+/*
+ * Tramo i de una tabla creciente con t[i] <= v < t[i + 1] (v ya dentro de
+ * rango). Número fijo de iteraciones y sin saltos dependientes del dato:
+ * el compilador resuelve la comparación con un select.
+ */
+static int ocv_segment(const float *t, int n, float v)
+{
+	int base = 0;
+	int len = n - 1;
+	while (len > 1) {
+		int half = len / 2;
+		base = (t[base + half] <= v) ? base + half : base;
+		len -= half;
+	}
+	return base;
+}
+
+static float ocv_to_percent(const float *t, int n, float volts)
+{
+	if (volts >= t[n - 1]) return 100.0f;
+	if (volts <= t[0]) return 0.0f;
+
+	int i = ocv_segment(t, n, volts);
+	float frac = (volts - t[i]) / (t[i + 1] - t[i]);
+	return (i + frac) * 100.0f / (n - 1);
+}
 
 float battery_porcent_from_voltage(float volts)
 {
-	// Límites superiores e inferiores
-    if (volts >= c_bat_lut[0].voltage) return 100.0f;
-    
-    int len = sizeof(c_bat_lut) / sizeof(c_bat_lut[0]);
-    if (volts <= c_bat_lut[len-1].voltage) return 0.0f;
-
-    // Búsqueda e interpolación lineal
-    for (int i = 0; i < len - 1; i++) {
-        if (volts <= c_bat_lut[i].voltage && volts > c_bat_lut[i+1].voltage) {
-            float v_high = c_bat_lut[i].voltage;
-            float v_low  = c_bat_lut[i+1].voltage;
-            float p_high = c_bat_lut[i].percent;
-            float p_low  = c_bat_lut[i+1].percent;
-
-            // Fórmula de la recta entre dos puntos
-            return p_low + (volts - v_low) * (p_high - p_low) / (v_high - v_low);
-        }
-    }
-    
-    return 0.0f;
+	return ocv_to_percent(s_ocv_table, OCV_TABLE_POINTS, volts - OCV_TEMP_OFFSET_V);
 }
 
 float battery_soc_update(float soc_prev, float v_bat, float current_A, float dt_s, float capacity_Ah)
@@ -77,4 +82,82 @@ float battery_soc_update(float soc_prev, float v_bat, float current_A, float dt_
     if (soc > 100.0f) soc = 100.0f;
 
     return soc;
-}
\ No newline at end of file
+}
+
+// Ruido de proceso (por segundo) y de medida del EKF
+#define EKF_Q_SOC       1e-9f	// Error del conteo de Coulomb (SoC^2/s)
+#define EKF_Q_VRC       1e-6f	// Dinámica no modelada del RC (V^2/s)
+#define EKF_R_V         1e-4f	// Ruido de la tensión medida (10 mV)^2 más error de la tabla
+#define EKF_MIN_V       1.0f	// Por debajo no hay lectura válida: sólo predicción
+
+static float clamp01(float x)
+{
+	return (x < 0.0f) ? 0.0f : (x > 1.0f) ? 1.0f : x;
+}
+
+// OCV de la tabla para un SoC (0..1) y su pendiente dOCV/dSoC (V por unidad de SoC)
+static float ocv_from_soc(float soc, float *slope)
+{
+	// Rejilla uniforme de SoC: el tramo es un índice directo
+	float pos = clamp01(soc) * (OCV_TABLE_POINTS - 1);
+	int i = (int)pos;
+	if (i > OCV_TABLE_POINTS - 2) i = OCV_TABLE_POINTS - 2;
+
+	float v_low = s_ocv_table[i], v_high = s_ocv_table[i + 1];
+	*slope = (v_high - v_low) * (OCV_TABLE_POINTS - 1);
+	return v_low + (pos - i) * (v_high - v_low) + OCV_TEMP_OFFSET_V;
+}
+
+void battery_ekf_init(battery_ekf_t *k, float soc_pct, float sigma_pct)
+{
+	k->soc = clamp01(soc_pct / 100.0f);
+	k->v_rc = 0.0f;
+	k->p[0][0] = (sigma_pct / 100.0f) * (sigma_pct / 100.0f);
+	k->p[0][1] = k->p[1][0] = 0.0f;
+	k->p[1][1] = 0.05f * 0.05f;
+}
+
+float battery_ekf_update(battery_ekf_t *k, const battery_model_t *m, float v_bat, float current_A, float dt_s)
+{
+	// Predicción: conteo de Coulomb y relajación del RC (F = diag(1, a))
+	float tau = m->r1 * m->c1;
+	float a = (tau > 0.0f) ? expf(-dt_s / tau) : 0.0f;
+
+	k->soc = clamp01(k->soc - current_A * dt_s / (3600.0f * m->capacity_Ah));
+	k->v_rc = a * k->v_rc + m->r1 * (1.0f - a) * current_A;
+
+	k->p[0][0] += EKF_Q_SOC * dt_s;
+	k->p[0][1] *= a;
+	k->p[1][0] *= a;
+	k->p[1][1] = a * a * k->p[1][1] + EKF_Q_VRC * dt_s;
+
+	if (v_bat < EKF_MIN_V) return k->soc * 100.0f;
+
+	// Corrección con la tensión en bornes: H = [dOCV/dSoC, -1]
+	float h0;
+	float v_pred = ocv_from_soc(k->soc, &h0) - k->v_rc - m->r0 * current_A;
+
+	float hp0 = h0 * k->p[0][0] - k->p[1][0];	// (H P)
+	float hp1 = h0 * k->p[0][1] - k->p[1][1];
+	float s = hp0 * h0 - hp1 + EKF_R_V;
+	float k0 = hp0 / s;							// Ganancia K = P H' / S
+	float k1 = hp1 / s;
+
+	float innov = v_bat - v_pred;
+	k->soc = clamp01(k->soc + k0 * innov);
+	k->v_rc += k1 * innov;
+
+	// P = (I - K H) P, forzando la simetría
+	k->p[0][0] -= k0 * hp0;
+	k->p[1][1] -= k1 * hp1;
+	float p01 = k->p[0][1] - k0 * hp1;
+	float p10 = k->p[1][0] - k1 * hp0;
+	k->p[0][1] = k->p[1][0] = 0.5f * (p01 + p10);
+
+	return k->soc * 100.0f;
+}
+
+float battery_ekf_sigma(const battery_ekf_t *k)
+{
+	return sqrtf(fmaxf(k->p[0][0], 0.0f)) * 100.0f;
+}
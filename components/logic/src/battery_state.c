@@ -0,0 +1,356 @@
+#include "battery_state.h"
+#include "battery.h"
+
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "nvs.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+static const char *TAG = "BAT_STATE";
+
+#define RTC_MAGIC          0xB5A7E020u	// Cambia con el formato de bat_rtc_t
+#define NVS_NS             "battery"
+#define NVS_KEY            "state"
+#define NVS_KEY_CAP        "capacity"
+#define SIGMA_VOLTAGE_PCT  20.0f	// SoC por voltaje: puede haber carga aplicada
+#define SIGMA_NVS_PCT      30.0f	// Tras un corte no se sabe cuánto tiempo ha pasado
+#define SIGMA_NONE_PCT     50.0f
+#define SLEEP_MAX_H        (24.0f * 30.0f)	// Más que esto: reloj no fiable, no se descuenta
+#define CAP_MIN_FRAC       0.3f		// Capacidad aprendida admitida respecto a la nominal
+#define CAP_MAX_FRAC       1.3f
+#define CAP_LEARN_GAIN     0.5f		// Peso de una estimación con un ciclo completo (100 % de SoC)
+#define TTE_MIN_A          0.005f	// Por debajo de esta corriente media no hay previsión
+
+// Estado vivo en memoria RTC: sobrevive al deep sleep y a los reinicios por software
+typedef struct {
+	uint32_t magic;
+	float soc;
+#if CONFIG_BAT_SOC_EKF
+	battery_ekf_t ekf;
+#endif
+	float ah_out;
+	float ah_in;
+	int64_t wall_us;	// Reloj del sistema en la última muestra (el RTC sigue contando dormido)
+#if CONFIG_BAT_CAP_LEARN
+	float anchor_soc;	// SoC por voltaje en el último reposo (-1 = ninguno)
+	float anchor_ah;	// Carga neta extraída (ah_out - ah_in) en ese momento
+#endif
+} bat_rtc_t;
+
+// Copia en NVS para sobrevivir a un corte de alimentación
+typedef struct {
+	float soc;
+	float ah_out;
+	float ah_in;
+} bat_nvs_t;
+
+// Capacidad aprendida: clave aparte, sólo se escribe al aprender
+typedef struct {
+	float capacity_Ah;
+	uint32_t estimates;		// Estimaciones acumuladas
+} bat_cap_t;
+
+static RTC_DATA_ATTR bat_rtc_t s_rtc;
+
+static float s_nominal_Ah;
+static bat_cap_t s_cap;
+#if CONFIG_BAT_SOC_EKF || CONFIG_BAT_CAP_LEARN
+static battery_model_t s_model;
+#endif
+
+static float s_i_avg = 0.0f;			// Corriente media para la autonomía (A)
+#if CONFIG_BAT_CAP_LEARN
+static int64_t s_rest_since_us = 0;	// Inicio del reposo actual (0 = con carga)
+#endif
+
+static int64_t s_last_us = 0;		// esp_timer de la última muestra (0 = ninguna en este arranque)
+static int64_t s_nvs_last_us = 0;
+static float s_nvs_soc = -1.0f;
+
+// Lo que ven los consumidores
+static battery_state_t s_pub;
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static int64_t wall_us(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (int64_t)tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+static float clamp_pct(float x)
+{
+	return (x < 0.0f) ? 0.0f : (x > 100.0f) ? 100.0f : x;
+}
+
+void battery_state_get(battery_state_t *out)
+{
+	portENTER_CRITICAL(&s_mux);
+	*out = s_pub;
+	portEXIT_CRITICAL(&s_mux);
+}
+
+static bool nvs_load(bat_nvs_t *out)
+{
+	nvs_handle_t h;
+	if (nvs_open(NVS_NS, NVS_READONLY, &h) != ESP_OK) return false;
+
+	// Un tamaño distinto indica un formato antiguo: se ignora
+	size_t len = sizeof(*out);
+	esp_err_t err = nvs_get_blob(h, NVS_KEY, out, &len);
+	nvs_close(h);
+
+	return err == ESP_OK && len == sizeof(*out) && out->soc >= 0.0f && out->soc <= 100.0f;
+}
+
+// Guarda lo publicado: se puede llamar desde cualquier tarea
+static void nvs_save(void)
+{
+	battery_state_t st;
+	battery_state_get(&st);
+	bat_nvs_t nv = { .soc = st.soc, .ah_out = st.ah_out, .ah_in = st.ah_in };
+	nvs_handle_t h;
+	if (nvs_open(NVS_NS, NVS_READWRITE, &h) != ESP_OK) return;
+
+	esp_err_t err = nvs_set_blob(h, NVS_KEY, &nv, sizeof(nv));
+	if (err == ESP_OK) err = nvs_commit(h);
+	nvs_close(h);
+
+	if (err != ESP_OK) {
+		ESP_LOGW(TAG, "No se pudo guardar el estado de la batería: %s", esp_err_to_name(err));
+		return;
+	}
+	s_nvs_last_us = esp_timer_get_time();
+	s_nvs_soc = st.soc;
+}
+
+static void cap_load(void)
+{
+	s_cap = (bat_cap_t){ .capacity_Ah = s_nominal_Ah };
+
+	nvs_handle_t h;
+	if (nvs_open(NVS_NS, NVS_READONLY, &h) != ESP_OK) return;
+
+	bat_cap_t c;
+	size_t len = sizeof(c);
+	esp_err_t err = nvs_get_blob(h, NVS_KEY_CAP, &c, &len);
+	nvs_close(h);
+
+	if (err == ESP_OK && len == sizeof(c) &&
+	    c.capacity_Ah >= s_nominal_Ah * CAP_MIN_FRAC && c.capacity_Ah <= s_nominal_Ah * CAP_MAX_FRAC) {
+		s_cap = c;
+	}
+}
+
+#if CONFIG_BAT_CAP_LEARN
+static void cap_save(void)
+{
+	nvs_handle_t h;
+	if (nvs_open(NVS_NS, NVS_READWRITE, &h) != ESP_OK) return;
+
+	esp_err_t err = nvs_set_blob(h, NVS_KEY_CAP, &s_cap, sizeof(s_cap));
+	if (err == ESP_OK) err = nvs_commit(h);
+	nvs_close(h);
+
+	if (err != ESP_OK) ESP_LOGW(TAG, "No se pudo guardar la capacidad: %s", esp_err_to_name(err));
+}
+#endif
+
+// La capacidad aprendida es la que usan el conteo de Coulomb y el EKF
+static void cap_apply(void)
+{
+#if CONFIG_BAT_SOC_EKF || CONFIG_BAT_CAP_LEARN
+	s_model.capacity_Ah = s_cap.capacity_Ah;
+#endif
+}
+
+#if CONFIG_BAT_CAP_LEARN
+/*
+ * Anclajes en reposo: tras BAT_REST_MIN minutos con poca corriente, la tensión
+ * (sumando la caída estacionaria en R0 + R1) da el SoC por la curva OCV. Entre
+ * dos anclajes separados al menos BAT_LEARN_MIN_DELTA_PCT, la carga neta
+ * contada dividida por la variación del SoC es una medida de la capacidad.
+ * Un ciclo completo pesa más que uno parcial.
+ */
+static void cap_learn(float v_bat, float current_A, int64_t now)
+{
+	if (fabsf(current_A) * 1000.0f > CONFIG_BAT_REST_CURRENT_MA || v_bat < 1.0f) {
+		s_rest_since_us = 0;
+		return;
+	}
+	if (s_rest_since_us == 0) {
+		s_rest_since_us = now;
+		return;
+	}
+	if (now - s_rest_since_us < (int64_t)CONFIG_BAT_REST_MIN * 60000000LL) return;
+	s_rest_since_us = now;	// El siguiente anclaje necesita otro periodo de reposo
+
+	float soc_v = battery_porcent_from_voltage(v_bat + (s_model.r0 + s_model.r1) * current_A);
+	float ah_net = s_rtc.ah_out - s_rtc.ah_in;
+
+	if (s_rtc.anchor_soc >= 0.0f) {
+		float d_soc = s_rtc.anchor_soc - soc_v;		// > 0 si se ha descargado
+		if (fabsf(d_soc) < CONFIG_BAT_LEARN_MIN_DELTA_PCT) return;	// Se conserva el anclaje: más recorrido, mejor medida
+
+		float est = (ah_net - s_rtc.anchor_ah) / (d_soc / 100.0f);
+		if (est >= s_nominal_Ah * CAP_MIN_FRAC && est <= s_nominal_Ah * CAP_MAX_FRAC) {
+			float w = CAP_LEARN_GAIN * fabsf(d_soc) / 100.0f;
+			s_cap.capacity_Ah += w * (est - s_cap.capacity_Ah);
+			s_cap.estimates++;
+			cap_apply();
+			cap_save();
+			ESP_LOGI(TAG, "Capacidad: %.3f Ah medidos en %.0f%% de SoC -> %.3f Ah (SoH %.0f%%)",
+			         est, fabsf(d_soc), s_cap.capacity_Ah, s_cap.capacity_Ah / s_nominal_Ah * 100.0f);
+		} else {
+			ESP_LOGW(TAG, "Estimación de capacidad descartada: %.3f Ah", est);
+		}
+	}
+
+	s_rtc.anchor_soc = soc_v;
+	s_rtc.anchor_ah = ah_net;
+}
+#endif
+
+static void publish(void)
+{
+	battery_state_t st = {
+		.soc = s_rtc.soc,
+#if CONFIG_BAT_SOC_EKF
+		.soc_sigma = battery_ekf_sigma(&s_rtc.ekf),
+#endif
+		.ah_out = s_rtc.ah_out,
+		.ah_in = s_rtc.ah_in,
+		.capacity_Ah = s_cap.capacity_Ah,
+		.soh = s_cap.capacity_Ah / s_nominal_Ah * 100.0f,
+		.tte_h = -1.0f,
+		.ttf_h = -1.0f,
+	};
+
+	// Previsiones con la corriente media: lo que queda (o falta) entre la corriente
+	if (s_i_avg > TTE_MIN_A) {
+		st.tte_h = s_rtc.soc / 100.0f * s_cap.capacity_Ah / s_i_avg;
+	} else if (s_i_avg < -TTE_MIN_A) {
+		st.ttf_h = (100.0f - s_rtc.soc) / 100.0f * s_cap.capacity_Ah / -s_i_avg;
+	}
+
+	portENTER_CRITICAL(&s_mux);
+	s_pub = st;
+	portEXIT_CRITICAL(&s_mux);
+}
+
+void battery_state_init(float v_bat)
+{
+	s_nominal_Ah = strtof(CONFIG_BAT_CAPACITY_AH, NULL);
+	cap_load();
+#if CONFIG_BAT_SOC_EKF || CONFIG_BAT_CAP_LEARN
+	// Parámetros del modelo de batería (se parsean una sola vez)
+	s_model.r0 = strtof(CONFIG_BAT_R0_OHM, NULL);
+	s_model.r1 = strtof(CONFIG_BAT_R1_OHM, NULL);
+	s_model.c1 = strtof(CONFIG_BAT_C1_F, NULL);
+	cap_apply();
+#endif
+
+	int64_t now_wall = wall_us();
+
+	if (s_rtc.magic == RTC_MAGIC && s_rtc.soc >= 0.0f && s_rtc.soc <= 100.0f) {
+		// Deep sleep o reinicio: se sigue donde se dejó, descontando el consumo dormido
+		float slept_h = (float)(now_wall - s_rtc.wall_us) / 3.6e9f;
+		float ah = 0.0f;
+		if (slept_h > 0.0f && slept_h < SLEEP_MAX_H) {
+			ah = CONFIG_BAT_SLEEP_CURRENT_UA * 1e-6f * slept_h;
+			s_rtc.soc = clamp_pct(s_rtc.soc - ah / s_cap.capacity_Ah * 100.0f);
+			s_rtc.ah_out += ah;
+#if CONFIG_BAT_SOC_EKF
+			s_rtc.ekf.soc = s_rtc.soc / 100.0f;
+			s_rtc.ekf.v_rc = 0.0f;	// La polarización se ha relajado
+#endif
+		}
+		ESP_LOGI(TAG, "Estado recuperado de RTC: SoC %.1f%% (%.1f h dormido, %.4f Ah)", s_rtc.soc, slept_h, ah);
+	} else {
+		bat_nvs_t nv;
+		float sigma;
+		s_rtc = (bat_rtc_t){ .magic = RTC_MAGIC };
+#if CONFIG_BAT_CAP_LEARN
+		s_rtc.anchor_soc = -1.0f;
+#endif
+
+		if (nvs_load(&nv)) {
+			s_rtc.soc = nv.soc;
+			s_rtc.ah_out = nv.ah_out;
+			s_rtc.ah_in = nv.ah_in;
+			sigma = SIGMA_NVS_PCT;
+			ESP_LOGI(TAG, "Estado recuperado de NVS: SoC %.1f%%", s_rtc.soc);
+		} else if (v_bat > 1.0f) {
+			s_rtc.soc = battery_porcent_from_voltage(v_bat);
+			sigma = SIGMA_VOLTAGE_PCT;
+			ESP_LOGI(TAG, "SoC inicial (por voltaje): Vbat=%.3f V -> %.1f%%", v_bat, s_rtc.soc);
+		} else {
+			s_rtc.soc = 50.0f;
+			sigma = SIGMA_NONE_PCT;
+			ESP_LOGW(TAG, "Sin estado guardado ni Vbat; usando SoC=50%%");
+		}
+#if CONFIG_BAT_SOC_EKF
+		battery_ekf_init(&s_rtc.ekf, s_rtc.soc, sigma);
+#else
+		(void)sigma;
+#endif
+	}
+
+	s_rtc.wall_us = now_wall;
+	s_nvs_soc = s_rtc.soc;
+	s_nvs_last_us = esp_timer_get_time();
+	publish();
+}
+
+float battery_state_update(float v_bat, float current_A)
+{
+	int64_t now = esp_timer_get_time();
+	float dt_s = (s_last_us > 0) ? (float)(now - s_last_us) / 1e6f : 0.0f;
+	s_last_us = now;
+
+#if CONFIG_BAT_SOC_EKF
+	s_rtc.soc = battery_ekf_update(&s_rtc.ekf, &s_model, v_bat, current_A, dt_s);
+#else
+	s_rtc.soc = battery_soc_update(s_rtc.soc, v_bat, current_A, dt_s, s_cap.capacity_Ah);
+#endif
+
+	float ah = current_A * dt_s / 3600.0f;
+	if (ah > 0.0f) s_rtc.ah_out += ah;
+	else s_rtc.ah_in -= ah;
+	s_rtc.wall_us = wall_us();
+
+	// Media exponencial con constante de tiempo BAT_TTE_TAU_S (arranca en la primera muestra)
+	if (dt_s <= 0.0f) s_i_avg = current_A;
+	else s_i_avg += dt_s / (CONFIG_BAT_TTE_TAU_S + dt_s) * (current_A - s_i_avg);
+
+#if CONFIG_BAT_CAP_LEARN
+	cap_learn(v_bat, current_A, now);
+#endif
+
+	publish();
+
+	// NVS sólo de vez en cuando y si el SoC ha cambiado (desgaste de la flash)
+	if (now - s_nvs_last_us >= (int64_t)CONFIG_BAT_NVS_COMMIT_MIN * 60000000LL &&
+	    fabsf(s_rtc.soc - s_nvs_soc) >= CONFIG_BAT_NVS_COMMIT_DELTA_PCT) {
+		nvs_save();
+	}
+
+	return s_rtc.soc;
+}
+
+float battery_state_soc(void)
+{
+	battery_state_t st;
+	battery_state_get(&st);
+	return st.soc;
+}
+
+void battery_state_flush(void)
+{
+	nvs_save();
+}
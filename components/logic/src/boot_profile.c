@@ -0,0 +1,50 @@
+#include "boot_profile.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+static const char *TAG = "BOOT";
+
+static const char *s_names[BOOT_PHASE_MAX] = { "Sensors", "Wifi", "Ip", "Time", "Mqtt", "Publish" };
+
+static uint32_t s_ms[BOOT_PHASE_MAX];
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+
+const char *boot_phase_name(boot_phase_t phase)
+{
+	return (phase < BOOT_PHASE_MAX) ? s_names[phase] : "?";
+}
+
+void boot_profile_mark(boot_phase_t phase)
+{
+	if (phase >= BOOT_PHASE_MAX) return;
+
+	// esp_timer arranca con la aplicación (tras el bootloader): 1 ms mínimo para distinguirlo de "sin marcar"
+	uint32_t ms = (uint32_t)(esp_timer_get_time() / 1000);
+	if (ms == 0) ms = 1;
+
+	bool first = false;
+	portENTER_CRITICAL(&s_mux);
+	if (s_ms[phase] == 0) {
+		s_ms[phase] = ms;
+		first = true;
+	}
+	portEXIT_CRITICAL(&s_mux);
+
+	if (first && phase == BOOT_PHASE_PUBLISH) {
+		ESP_LOGI(TAG, "Arranque: sensores %lu ms, WiFi %lu ms, IP %lu ms, hora %lu ms, MQTT %lu ms, primera publicación %lu ms",
+		         (unsigned long)s_ms[BOOT_PHASE_SENSORS], (unsigned long)s_ms[BOOT_PHASE_WIFI],
+		         (unsigned long)s_ms[BOOT_PHASE_IP], (unsigned long)s_ms[BOOT_PHASE_TIME],
+		         (unsigned long)s_ms[BOOT_PHASE_MQTT], (unsigned long)ms);
+	}
+}
+
+uint32_t boot_profile_ms(boot_phase_t phase)
+{
+	if (phase >= BOOT_PHASE_MAX) return 0;
+	portENTER_CRITICAL(&s_mux);
+	uint32_t ms = s_ms[phase];
+	portEXIT_CRITICAL(&s_mux);
+	return ms;
+}
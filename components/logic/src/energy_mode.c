@@ -0,0 +1,227 @@
+#include "energy_mode.h"
+
+#if CONFIG_ENERGY_MODES
+
+#include <stdlib.h>
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "nvs.h"
+#include "pipeline.h"
+#include "solar_tracker.h"
+
+static const char *TAG = "ENERGY";
+
+#define RTC_MAGIC       0xE4E6D025u
+#define NVS_NS          "energy"
+#define NVS_KEY         "thresholds"
+#define TREND_H         (CONFIG_ENERGY_TREND_MIN / 60.0f)
+#define HYST_MAX_PCT    20.0f
+#define DWELL_US        ((int64_t)CONFIG_ENERGY_CRITICAL_DWELL_MIN * 60 * 1000000)
+
+static const char *s_names[ENERGY_MODE_MAX] = { "normal", "eco", "critical", "survival" };
+
+// Cada modo recorta sobre el anterior
+static const energy_policy_t s_policy[ENERGY_MODE_MAX] = {
+	[ENERGY_MODE_NORMAL]   = { .tick_scale = 1, .publish_scale = 1, .tracking = true,  .telegram = true,  .radio = true  },
+	[ENERGY_MODE_ECO]      = { .tick_scale = 2, .publish_scale = 3, .tracking = true,  .telegram = true,  .radio = true  },
+	[ENERGY_MODE_CRITICAL] = { .tick_scale = 5, .publish_scale = 6, .tracking = false, .telegram = false, .radio = false },
+	[ENERGY_MODE_SURVIVAL] = { .tick_scale = 5, .publish_scale = 6, .tracking = false, .telegram = false, .radio = false },
+};
+
+// El modo sobrevive al deep sleep: en supervivencia decide si el arranque sigue
+typedef struct {
+	uint32_t magic;
+	uint8_t mode;
+} energy_rtc_t;
+
+static RTC_DATA_ATTR energy_rtc_t s_rtc;
+
+static energy_thresholds_t s_thr;
+static float s_panel_wake_V;
+static volatile energy_mode_t s_mode = ENERGY_MODE_NORMAL;
+static float s_level = -1.0f;
+static int64_t s_wake_us = -1;		// Salida de supervivencia (-1 = no ha habido)
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+
+const char *energy_mode_name(energy_mode_t mode)
+{
+	return (mode < ENERGY_MODE_MAX) ? s_names[mode] : "?";
+}
+
+static bool thresholds_ok(const energy_thresholds_t *t)
+{
+	return t->eco_pct <= 100.0f && t->eco_pct > t->critical_pct &&
+	       t->critical_pct > t->survival_pct && t->survival_pct >= 0.0f &&
+	       t->hyst_pct >= 0.0f && t->hyst_pct <= HYST_MAX_PCT;
+}
+
+static void apply(energy_mode_t mode)
+{
+	const energy_policy_t *p = &s_policy[mode];
+	pipeline_set_rate(p->tick_scale, p->publish_scale);
+	solar_tracker_set_suspended(!p->tracking);
+}
+
+static void set_mode(energy_mode_t mode, float level)
+{
+	energy_mode_t prev = s_mode;
+
+	portENTER_CRITICAL(&s_mux);
+	s_mode = mode;
+	s_level = level;
+	portEXIT_CRITICAL(&s_mux);
+
+	s_rtc.magic = RTC_MAGIC;
+	s_rtc.mode = (uint8_t)mode;
+
+	if (mode == prev) return;
+	ESP_LOGW(TAG, "Modo de energía: %s -> %s (SoC %.1f%%)", s_names[prev], s_names[mode], level);
+	apply(mode);
+}
+
+void energy_mode_init(void)
+{
+	s_thr = (energy_thresholds_t){
+		.eco_pct = CONFIG_ENERGY_ECO_PCT,
+		.critical_pct = CONFIG_ENERGY_CRITICAL_PCT,
+		.survival_pct = CONFIG_ENERGY_SURVIVAL_PCT,
+		.hyst_pct = CONFIG_ENERGY_HYST_PCT,
+	};
+	s_panel_wake_V = strtof(CONFIG_ENERGY_PANEL_WAKE_V, NULL);
+
+	// Los cambiados con /energy prevalecen sobre Kconfig
+	nvs_handle_t h;
+	if (nvs_open(NVS_NS, NVS_READONLY, &h) == ESP_OK) {
+		energy_thresholds_t t;
+		size_t len = sizeof(t);
+		esp_err_t err = nvs_get_blob(h, NVS_KEY, &t, &len);
+		nvs_close(h);
+		if (err == ESP_OK && len == sizeof(t) && thresholds_ok(&t)) s_thr = t;
+	}
+
+	if (!thresholds_ok(&s_thr)) {
+		ESP_LOGW(TAG, "Umbrales de Kconfig no válidos (eco > crítico > supervivencia): modos desactivados");
+		s_thr = (energy_thresholds_t){ .eco_pct = 0.0f, .critical_pct = -1.0f, .survival_pct = -2.0f };
+	}
+
+	// Tras un deep sleep se retoma el modo (después de un corte, normal hasta la primera evaluación)
+	energy_mode_t mode = (s_rtc.magic == RTC_MAGIC && s_rtc.mode < ENERGY_MODE_MAX) ? s_rtc.mode : ENERGY_MODE_NORMAL;
+	s_mode = mode;
+	// En supervivencia el tick se deja normal: la comprobación del panel debe ser breve
+	if (mode == ENERGY_MODE_SURVIVAL) solar_tracker_set_suspended(true);
+	else if (mode != ENERGY_MODE_NORMAL) apply(mode);
+
+	ESP_LOGI(TAG, "Modo %s. Umbrales: eco < %.0f%%, crítico < %.0f%%, supervivencia < %.0f%% (histéresis %.0f%%)",
+	         s_names[mode], s_thr.eco_pct, s_thr.critical_pct, s_thr.survival_pct, s_thr.hyst_pct);
+}
+
+// SoC previsto dentro de TREND_H con la corriente media; cargando o sin previsión, el actual
+static float projected_soc(const battery_state_t *bat)
+{
+	if (bat->tte_h <= 0.0f || TREND_H <= 0.0f) return bat->soc;
+	float soc = bat->soc * (1.0f - TREND_H / bat->tte_h);
+	return (soc > 0.0f) ? soc : 0.0f;
+}
+
+energy_mode_t energy_mode_update(const battery_state_t *bat)
+{
+	energy_thresholds_t t;
+	portENTER_CRITICAL(&s_mux);
+	t = s_thr;
+	energy_mode_t cur = s_mode;
+	portEXIT_CRITICAL(&s_mux);
+
+	float level = projected_soc(bat);
+
+	// Bajada: directamente al modo cuyo umbral se ha cruzado
+	energy_mode_t next = ENERGY_MODE_NORMAL;
+	if (level < t.eco_pct) next = ENERGY_MODE_ECO;
+	if (level < t.critical_pct) next = ENERGY_MODE_CRITICAL;
+	// Cargando (el panel ya da energía) no tiene sentido dormir esperándolo. Recién salido de
+	// supervivencia la tendencia aún no existe (ttf_h = -1 aunque cargue): se sigue en crítico.
+	bool dwell = s_wake_us >= 0 && esp_timer_get_time() - s_wake_us < DWELL_US;
+	if (level < t.survival_pct && bat->ttf_h < 0.0f && !dwell) next = ENERGY_MODE_SURVIVAL;
+
+	if (next <= cur) {
+		// Subida: de uno en uno y con margen sobre el umbral del modo actual.
+		// De supervivencia sólo se sale al volver la tensión del panel.
+		const float enter[ENERGY_MODE_MAX] = { 0.0f, t.eco_pct, t.critical_pct, t.survival_pct };
+		next = cur;
+		if (cur == ENERGY_MODE_ECO || cur == ENERGY_MODE_CRITICAL) {
+			if (level > enter[cur] + t.hyst_pct) next = cur - 1;
+		}
+	}
+
+	set_mode(next, level);
+	return next;
+}
+
+bool energy_mode_power_returned(const ina_snapshot_t *ina)
+{
+	bool back;
+	if (ina->valid[INA_ROLE_PANEL]) {
+		back = ina->ch[INA_ROLE_PANEL].bus_voltage_V >= s_panel_wake_V;
+		ESP_LOGI(TAG, "Supervivencia: panel a %.2f V (mínimo %.2f V)", ina->ch[INA_ROLE_PANEL].bus_voltage_V, s_panel_wake_V);
+	} else {
+		back = ina->valid[INA_ROLE_BATTERY] && ina->ch[INA_ROLE_BATTERY].current_A < 0.0f;
+	}
+
+	if (back) {
+		s_wake_us = esp_timer_get_time();
+		set_mode(ENERGY_MODE_CRITICAL, ina->battery_soc);
+	}
+	return back;
+}
+
+energy_mode_t energy_mode_get(void)
+{
+	return s_mode;
+}
+
+const energy_policy_t *energy_mode_policy(void)
+{
+	return &s_policy[s_mode];
+}
+
+float energy_mode_level(void)
+{
+	portENTER_CRITICAL(&s_mux);
+	float level = s_level;
+	portEXIT_CRITICAL(&s_mux);
+	return level;
+}
+
+void energy_mode_get_thresholds(energy_thresholds_t *out)
+{
+	portENTER_CRITICAL(&s_mux);
+	*out = s_thr;
+	portEXIT_CRITICAL(&s_mux);
+}
+
+esp_err_t energy_mode_set_thresholds(const energy_thresholds_t *t)
+{
+	if (!thresholds_ok(t)) return ESP_ERR_INVALID_ARG;
+
+	portENTER_CRITICAL(&s_mux);
+	s_thr = *t;
+	portEXIT_CRITICAL(&s_mux);
+
+	nvs_handle_t h;
+	esp_err_t err = nvs_open(NVS_NS, NVS_READWRITE, &h);
+	if (err != ESP_OK) return err;
+	err = nvs_set_blob(h, NVS_KEY, t, sizeof(*t));
+	if (err == ESP_OK) err = nvs_commit(h);
+	nvs_close(h);
+
+	if (err != ESP_OK) {
+		ESP_LOGW(TAG, "Umbrales aplicados pero no guardados: %s", esp_err_to_name(err));
+	} else {
+		ESP_LOGI(TAG, "Umbrales: eco < %.0f%%, crítico < %.0f%%, supervivencia < %.0f%% (histéresis %.0f%%)",
+		         t->eco_pct, t->critical_pct, t->survival_pct, t->hyst_pct);
+	}
+	return err;
+}
+
+#endif
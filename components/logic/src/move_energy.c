@@ -0,0 +1,167 @@
+#include "move_energy.h"
+#include "servo_control.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <math.h>
+#include <stdlib.h>
+
+#ifdef CONFIG_TRACKER_ENERGY_AWARE
+static const char *TAG = "MOVE_ENERGY";
+
+#define DEG2RAD(x)      ((x) * (float)M_PI / 180.0f)
+
+#define EWMA_ALPHA      0.2f
+#define MIN_SAMPLES     3		// Muestras de cada clase antes de fiarse de la medida
+#define MAX_ERR_DEG     80.0f	// Por encima, 1/cos se dispara: el movimiento siempre compensa
+
+static float s_prior_w;
+static float s_panel_wp;
+static float s_payback;
+static float s_diffuse_contrast;
+
+// Consumo medio del equipo con los servos quietos y en movimiento
+static float s_p_still = 0.0f;
+static float s_p_move = 0.0f;
+static uint32_t s_n_still = 0;
+static uint32_t s_n_move = 0;
+static uint32_t s_ina_seq = 0;
+
+static uint32_t s_motion_ms = 0;	// servo_motion_ms() en el último ciclo
+static move_energy_t s_bal;
+static float s_pending_gain_j = 0.0f;	// Ganancia del movimiento aceptado en este ciclo
+
+// Ciclos seguidos dentro/fuera de la condición de luz difusa
+static bool s_diffuse = false;
+static uint32_t s_diffuse_cycles = 0;
+
+void move_energy_init(void)
+{
+	s_prior_w = strtof(CONFIG_TRACKER_MOVE_POWER_W, NULL);
+	s_panel_wp = strtof(CONFIG_TRACKER_PANEL_WP, NULL);
+	s_payback = strtof(CONFIG_TRACKER_PAYBACK_RATIO, NULL);
+	s_diffuse_contrast = strtof(CONFIG_TRACKER_DIFFUSE_CONTRAST, NULL);
+	s_motion_ms = servo_motion_ms();
+	s_bal.move_w = s_prior_w;
+}
+
+static float ewma(float avg, uint32_t n, float x)
+{
+	return (n == 0) ? x : avg + EWMA_ALPHA * (x - avg);
+}
+
+// Potencia extra de los servos en movimiento: medida cuando hay muestras suficientes
+static float extra_power(void)
+{
+	if (s_n_still < MIN_SAMPLES || s_n_move < MIN_SAMPLES) return s_prior_w;
+	float w = s_p_move - s_p_still;
+	return (w > 0.0f) ? w : 0.0f;
+}
+
+/*
+ * Consumo del equipo en la instantánea: el INA de carga si existe; si no, el
+ * balance panel + batería (I > 0 descarga). La batería sola no vale: la carga
+ * solar varía con las nubes y se confundiría con el gasto de los servos.
+ */
+static bool consumption(const ina_snapshot_t *snap, float *p)
+{
+	if (snap->valid[INA_ROLE_LOAD]) {
+		*p = snap->ch[INA_ROLE_LOAD].bus_voltage_V * snap->ch[INA_ROLE_LOAD].current_A;
+		return true;
+	}
+	if (snap->valid[INA_ROLE_PANEL] && snap->valid[INA_ROLE_BATTERY]) {
+		const ina_data_t *bat = &snap->ch[INA_ROLE_BATTERY];
+		*p = snap->ch[INA_ROLE_PANEL].power_W + bat->bus_voltage_V * bat->current_A;
+		return true;
+	}
+	return false;	// Sin medida del consumo se queda el valor de Kconfig
+}
+
+void move_energy_update(void)
+{
+	s_pending_gain_j = 0.0f;
+
+	ina_snapshot_t snap;
+	if (snapshot_read_ina(&snap) && snap.seq != s_ina_seq) {
+		s_ina_seq = snap.seq;
+
+		float p;
+		if (servo_is_powered() && consumption(&snap, &p)) {
+			if (servo_was_moving_at(snap.timestamp_us)) {
+				s_p_move = ewma(s_p_move, s_n_move, p);
+				s_n_move++;
+			} else if (!servo_is_moving()) {
+				s_p_still = ewma(s_p_still, s_n_still, p);
+				s_n_still++;
+			}
+		}
+	}
+
+	s_bal.move_w = extra_power();
+
+	uint32_t motion = servo_motion_ms();
+	s_bal.spent_j += s_bal.move_w * (float)(motion - s_motion_ms) / 1000.0f;
+	s_motion_ms = motion;
+}
+
+bool move_energy_pays(float dh, float dv, const ldr_snapshot_t *ldr)
+{
+	s_pending_gain_j = 0.0f;
+
+	float err = sqrtf(dh * dh + dv * dv);
+	if (err >= MAX_ERR_DEG) return true;
+	float c = cosf(DEG2RAD(err));
+
+	// Potencia que daría el panel bien orientado
+	float p_max = 0.0f;
+	ina_snapshot_t snap;
+	if (snapshot_read_ina(&snap) && snap.valid[INA_ROLE_PANEL]) {
+		p_max = snap.ch[INA_ROLE_PANEL].power_W / c;
+	} else if (ldr != NULL) {
+		float irr = 0.0f;
+		for (int i = 0; i < LDR_COUNT; i++) irr += ldr->ldr[i].irradiance_wm2;
+		p_max = irr / LDR_COUNT * s_panel_wp / 1000.0f;
+	}
+
+	float gain_j = p_max * (1.0f - c) * CONFIG_TRACKER_GAIN_HORIZON_S;
+
+	float dist = fmaxf(fabsf(dh), fabsf(dv));
+	float cost_j = extra_power() * (float)servo_move_time_ms(dist) / 1000.0f;
+
+	if (gain_j < cost_j * s_payback) {
+		s_bal.skipped++;
+		ESP_LOGV(TAG, "Movimiento de %.2f° descartado: gana %.3f J, cuesta %.3f J", err, gain_j, cost_j);
+		return false;
+	}
+
+	// Se anota en move_energy_moved() si la orden llega a los servos
+	s_pending_gain_j = gain_j;
+	return true;
+}
+
+void move_energy_moved(void)
+{
+	s_bal.gained_j += s_pending_gain_j;
+	s_pending_gain_j = 0.0f;
+}
+
+bool move_energy_diffuse(int light, float contrast)
+{
+	bool cond = light < CONFIG_TRACKER_DIFFUSE_MAX_RAW &&
+	            contrast < s_diffuse_contrast;
+
+	// Cambia de estado sólo tras varios ciclos seguidos en la condición contraria
+	if (cond == s_diffuse) {
+		s_diffuse_cycles = 0;
+	} else if (++s_diffuse_cycles >= CONFIG_TRACKER_DIFFUSE_CYCLES) {
+		s_diffuse = cond;
+		s_diffuse_cycles = 0;
+		ESP_LOGI(TAG, "%s", s_diffuse ? "Luz difusa detectada" : "Vuelve la luz directa");
+	}
+	return s_diffuse;
+}
+
+void move_energy_get(move_energy_t *out)
+{
+	*out = s_bal;
+}
+#endif
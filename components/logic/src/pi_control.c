@@ -0,0 +1,52 @@
+#include "pi_control.h"
+
+#include <math.h>
+
+static float clampf(float x, float lim)
+{
+	return (x > lim) ? lim : (x < -lim) ? -lim : x;
+}
+
+float pi_norm_error(int a, int b)
+{
+	int sum = a + b;
+	if (sum <= 0) return 0.0f;
+	return (float)(a - b) / (float)sum;
+}
+
+float pi_norm_threshold(int tolerance, int a, int b)
+{
+	int sum = a + b;
+	if (sum <= 0) return 1.0f;	// Sin luz no hay error que corregir
+	return (float)tolerance / (float)sum;
+}
+
+void pi_axis_reset(pi_axis_t *ax)
+{
+	ax->integ = 0.0f;
+	ax->active = false;
+}
+
+float pi_axis_update(pi_axis_t *ax, const pi_gains_t *g, float e, float e_on, float dt_s)
+{
+	float mag = fabsf(e);
+
+	// Histéresis: entra por encima de e_on, sale por debajo de e_on * hyst_off
+	if (ax->active) {
+		if (mag < e_on * g->hyst_off) ax->active = false;
+	} else if (mag > e_on) {
+		ax->active = true;
+	}
+	if (!ax->active) return 0.0f;
+
+	float di = g->ki * e * dt_s;
+	float u_raw = g->kp * e + ax->integ + di;
+	float u = clampf(u_raw, g->max_step);
+
+	// Integración condicional: no acumular mientras la salida satura en el sentido del error
+	if (u == u_raw || (u_raw > 0.0f) != (e > 0.0f)) {
+		ax->integ = clampf(ax->integ + di, g->max_step);
+	}
+
+	return u;
+}
@@ -0,0 +1,201 @@
+#include "pipeline.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#if CONFIG_PM_ENABLE
+#include "esp_pm.h"
+#endif
+
+static const char *TAG = "PIPELINE";
+
+#define TICK_MS          CONFIG_TASK_INA_PERIOD_MS
+#define TICKS_IN(ms)     (((ms) / TICK_MS > 0) ? (uint32_t)((ms) / TICK_MS) : 1u)
+
+typedef struct {
+	uint32_t divider;		// Activaciones de la fuente (tick o muestra INA) por ciclo
+	uint32_t period_us;		// Plazo relativo
+	uint32_t count;
+	int64_t release_us;		// Última activación
+	bool pm_held;			// Ciclo en curso con el cerrojo de light sleep
+} stage_cfg_t;
+
+static const char *s_names[PIPELINE_STAGE_MAX] = { "ina", "ldr", "tracker", "main" };
+
+static stage_cfg_t s_stage[PIPELINE_STAGE_MAX];
+static pipeline_stats_t s_stats;
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+static EventGroupHandle_t s_events = NULL;
+static esp_timer_handle_t s_tick_timer = NULL;
+static uint32_t s_main_div = 1;		// Divisor del bucle principal con la escala 1
+#if CONFIG_PM_ENABLE
+// Entre activaciones las etapas duermen (light sleep automático); durante el ciclo no
+static esp_pm_lock_handle_t s_pm_lock = NULL;
+#endif
+
+const char *pipeline_stage_name(pipeline_stage_t stage)
+{
+	return (stage < PIPELINE_STAGE_MAX) ? s_names[stage] : "?";
+}
+
+// Activa la etapa si le toca. Si aún no había recogido la activación anterior, la ha perdido.
+static void release(pipeline_stage_t stage, int64_t now)
+{
+	stage_cfg_t *s = &s_stage[stage];
+	if (++s->count < s->divider) return;
+	s->count = 0;
+
+	EventBits_t bit = BIT(stage);
+	bool pending = (xEventGroupGetBits(s_events) & bit) != 0;
+
+	portENTER_CRITICAL(&s_mux);
+	if (pending) s_stats.stage[stage].misses++;
+	s->release_us = now;
+	portEXIT_CRITICAL(&s_mux);
+
+	xEventGroupSetBits(s_events, bit);
+}
+
+// Tarea de esp_timer: INA y LDR se muestrean en el mismo instante
+static void tick_cb(void *arg)
+{
+	(void)arg;
+	int64_t now = esp_timer_get_time();
+
+	portENTER_CRITICAL(&s_mux);
+	s_stats.ticks++;
+	portEXIT_CRITICAL(&s_mux);
+
+	release(PIPELINE_STAGE_INA, now);
+#if CONFIG_LDR_ADC_ONESHOT
+	release(PIPELINE_STAGE_ADC, now);
+#endif
+}
+
+void pipeline_start(void)
+{
+	if (s_events != NULL) return;
+	s_events = xEventGroupCreate();
+#if CONFIG_PM_ENABLE
+	ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "pipeline", &s_pm_lock));
+#endif
+
+	const uint32_t ldr_div = TICKS_IN(CONFIG_TASK_ADC_PERIOD_MS);
+	const uint32_t main_div = TICKS_IN(CONFIG_MAIN_LOOP_PERIOD_S * 1000);
+	s_main_div = main_div;
+
+	s_stage[PIPELINE_STAGE_INA] = (stage_cfg_t){ .divider = 1, .period_us = TICK_MS * 1000 };
+	s_stage[PIPELINE_STAGE_ADC] = (stage_cfg_t){ .divider = ldr_div, .period_us = ldr_div * TICK_MS * 1000 };
+	s_stage[PIPELINE_STAGE_TRACKER] = (stage_cfg_t){ .divider = 1, .period_us = CONFIG_TRACKER_UPDATE_MS * 1000 };
+	s_stage[PIPELINE_STAGE_MAIN] = (stage_cfg_t){ .divider = main_div, .period_us = main_div * TICK_MS * 1000 };
+
+	// La primera activación llega con el primer tick en todas las etapas
+	for (int i = 0; i < PIPELINE_STAGE_MAX; i++) s_stage[i].count = s_stage[i].divider - 1;
+
+	const esp_timer_create_args_t args = {
+		.callback = tick_cb,
+		.name = "pipeline_tick",
+	};
+	ESP_ERROR_CHECK(esp_timer_create(&args, &s_tick_timer));
+	ESP_ERROR_CHECK(esp_timer_start_periodic(s_tick_timer, TICK_MS * 1000ULL));
+
+	ESP_LOGI(TAG, "Tick de %d ms: INA cada tick, LDR cada %lu, publicación cada %lu muestras",
+	         TICK_MS, (unsigned long)ldr_div, (unsigned long)main_div);
+}
+
+void pipeline_set_rate(uint32_t tick_scale, uint32_t main_scale)
+{
+	if (s_tick_timer == NULL) return;
+	if (tick_scale == 0) tick_scale = 1;
+	if (main_scale == 0) main_scale = 1;
+
+	const uint32_t tick_us = TICK_MS * 1000 * tick_scale;
+	const uint32_t main_div = s_main_div * main_scale;
+
+	// Los plazos crecen con el periodo; el LDR conserva su divisor (mismo instante que el INA)
+	portENTER_CRITICAL(&s_mux);
+	s_stage[PIPELINE_STAGE_INA].period_us = tick_us;
+	s_stage[PIPELINE_STAGE_ADC].period_us = s_stage[PIPELINE_STAGE_ADC].divider * tick_us;
+	s_stage[PIPELINE_STAGE_MAIN].divider = main_div;
+	s_stage[PIPELINE_STAGE_MAIN].period_us = main_div * tick_us;
+	if (s_stage[PIPELINE_STAGE_MAIN].count >= main_div) s_stage[PIPELINE_STAGE_MAIN].count = main_div - 1;
+	portEXIT_CRITICAL(&s_mux);
+
+	esp_timer_restart(s_tick_timer, tick_us);
+
+	ESP_LOGI(TAG, "Tick de %lu ms, publicación cada %lu muestras",
+	         (unsigned long)(tick_us / 1000), (unsigned long)main_div);
+}
+
+int64_t pipeline_wait(pipeline_stage_t stage)
+{
+	stage_cfg_t *s = &s_stage[stage];
+	EventBits_t bit = BIT(stage);
+
+	EventBits_t got = xEventGroupWaitBits(s_events, bit, pdTRUE, pdTRUE, pdMS_TO_TICKS(2 * s->period_us / 1000));
+	int64_t now = esp_timer_get_time();
+	int64_t release_us = now;
+
+#if CONFIG_PM_ENABLE
+	if (!s->pm_held) {
+		esp_pm_lock_acquire(s_pm_lock);
+		s->pm_held = true;
+	}
+#endif
+
+	portENTER_CRITICAL(&s_mux);
+	pipeline_stage_stats_t *st = &s_stats.stage[stage];
+	if (got & bit) {
+		release_us = s->release_us;
+		uint32_t jitter = (uint32_t)(now - release_us);
+		if (jitter > st->jitter_max_us) st->jitter_max_us = jitter;
+	} else {
+		st->misses++;	// La fuente no ha activado la etapa en dos periodos
+	}
+	portEXIT_CRITICAL(&s_mux);
+
+	return release_us;
+}
+
+void pipeline_done(pipeline_stage_t stage, int64_t release_us)
+{
+	int64_t now = esp_timer_get_time();
+	uint32_t resp = (uint32_t)(now - release_us);
+
+	portENTER_CRITICAL(&s_mux);
+	pipeline_stage_stats_t *st = &s_stats.stage[stage];
+	st->runs++;
+	st->last_us = resp;
+	if (resp > st->max_us) st->max_us = resp;
+	if (resp > s_stage[stage].period_us) st->misses++;
+	portEXIT_CRITICAL(&s_mux);
+
+#if CONFIG_PM_ENABLE
+	if (s_stage[stage].pm_held) {
+		s_stage[stage].pm_held = false;
+		esp_pm_lock_release(s_pm_lock);
+	}
+#endif
+
+	// Cada muestra INA publicada cuenta para el bucle principal (con la marca del tick)
+	if (stage == PIPELINE_STAGE_INA && s_events != NULL) release(PIPELINE_STAGE_MAIN, release_us);
+}
+
+void pipeline_record_latency(int64_t sample_us)
+{
+	if (sample_us <= 0) return;
+	uint32_t lat = (uint32_t)(esp_timer_get_time() - sample_us);
+
+	portENTER_CRITICAL(&s_mux);
+	s_stats.latency_us = lat;
+	if (lat > s_stats.latency_max_us) s_stats.latency_max_us = lat;
+	portEXIT_CRITICAL(&s_mux);
+}
+
+void pipeline_get_stats(pipeline_stats_t *out)
+{
+	portENTER_CRITICAL(&s_mux);
+	*out = s_stats;
+	portEXIT_CRITICAL(&s_mux);
+}
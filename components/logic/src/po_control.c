@@ -0,0 +1,54 @@
+#include "po_control.h"
+
+#include <math.h>
+
+// Evita dividir por cero con el panel a oscuras
+#define PO_MIN_BASE_W  1e-3f
+
+void po_init(po_state_t *st, const po_cfg_t *cfg)
+{
+	// Empezar a medio camino (geométrico) entre el paso mínimo y el máximo
+	float step = sqrtf(cfg->step_min * cfg->step_max);
+
+	for (int i = 0; i < PO_AXES; i++) {
+		st->step[i] = step;
+		st->dir[i] = 1;
+	}
+	st->axis = PO_AXIS_H;
+	st->delta = 0.0f;
+	st->p_base = 0.0f;
+	st->kept = 0;
+	st->reverted = 0;
+}
+
+float po_perturb(po_state_t *st, float p_base, uint8_t *axis)
+{
+	st->p_base = p_base;
+	st->delta = st->dir[st->axis] * st->step[st->axis];
+	*axis = st->axis;
+	return st->delta;
+}
+
+bool po_evaluate(po_state_t *st, const po_cfg_t *cfg, float p_after)
+{
+	uint8_t ax = st->axis;
+	float base = (st->p_base > PO_MIN_BASE_W) ? st->p_base : PO_MIN_BASE_W;
+	float gain = (p_after - st->p_base) / base;
+	bool keep = (gain > cfg->min_gain);
+
+	if (keep) {
+		// Vamos en buena dirección: seguir y acelerar
+		st->step[ax] *= cfg->grow;
+		if (st->step[ax] > cfg->step_max) st->step[ax] = cfg->step_max;
+		st->kept++;
+	} else {
+		// Peor o dentro del ruido: cerca del óptimo, volver y probar al otro lado con menos paso
+		st->dir[ax] = -st->dir[ax];
+		st->step[ax] *= cfg->shrink;
+		if (st->step[ax] < cfg->step_min) st->step[ax] = cfg->step_min;
+		st->reverted++;
+	}
+
+	st->axis = (uint8_t)((ax + 1) % PO_AXES);
+	return keep;
+}
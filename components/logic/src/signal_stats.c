@@ -0,0 +1,81 @@
+#include "signal_stats.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Factor que convierte la MAD en desviación típica para ruido gaussiano
+#define MAD_TO_SIGMA  1.4826f
+
+static int cmp_float(const void *a, const void *b)
+{
+	float fa = *(const float *)a;
+	float fb = *(const float *)b;
+	return (fa > fb) - (fa < fb);
+}
+
+// Percentil (0..100) de un buffer ordenado, con interpolación lineal
+static float percentile_sorted(const float *v, size_t n, float p)
+{
+	if (n == 1) return v[0];
+
+	float pos = (p / 100.0f) * (float)(n - 1);
+	size_t i = (size_t)pos;
+	if (i >= n - 1) return v[n - 1];
+
+	float frac = pos - (float)i;
+	return v[i] + frac * (v[i + 1] - v[i]);
+}
+
+size_t signal_stats_compute(float *samples, size_t n, float spike_k, float *scratch, signal_stats_t *out)
+{
+	memset(out, 0, sizeof(*out));
+	if (n == 0) return 0;
+
+	qsort(samples, n, sizeof(float), cmp_float);
+	float median = percentile_sorted(samples, n, 50.0f);
+
+	// Al estar ordenadas, las muestras válidas forman un tramo contiguo [lo, hi)
+	size_t lo = 0, hi = n;
+
+	if (spike_k > 0.0f && scratch != NULL && n >= 4) {
+		// MAD: mediana de las desviaciones absolutas (en el buffer auxiliar para no desordenar)
+		for (size_t i = 0; i < n; i++) scratch[i] = fabsf(samples[i] - median);
+		qsort(scratch, n, sizeof(float), cmp_float);
+		float mad = percentile_sorted(scratch, n, 50.0f);
+
+		float limit = spike_k * MAD_TO_SIGMA * mad;
+		if (limit > 0.0f) {
+			while (lo < hi && samples[lo] < median - limit) lo++;
+			while (hi > lo && samples[hi - 1] > median + limit) hi--;
+		}
+
+		// Distribución bimodal con k pequeño: no queda nada que resumir, se usa la ventana entera
+		if (lo == hi) {
+			lo = 0;
+			hi = n;
+		}
+	}
+
+	const float *v = &samples[lo];
+	size_t m = hi - lo;
+
+	// En float: el ESP32 no tiene FPU de doble precisión
+	float sum = 0.0f, sum_sq = 0.0f;
+	for (size_t i = 0; i < m; i++) {
+		sum += v[i];
+		sum_sq += v[i] * v[i];
+	}
+
+	out->min = v[0];
+	out->max = v[m - 1];
+	out->mean = sum / (float)m;
+	out->rms = sqrtf(sum_sq / (float)m);
+	out->p5 = percentile_sorted(v, m, 5.0f);
+	out->p50 = percentile_sorted(v, m, 50.0f);
+	out->p95 = percentile_sorted(v, m, 95.0f);
+	out->count = (uint16_t)m;
+	out->rejected = (uint16_t)(n - m);
+
+	return m;
+}
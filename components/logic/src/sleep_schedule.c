@@ -0,0 +1,60 @@
+#include "sleep_schedule.h"
+
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "sun_position.h"
+
+#define SECS_DAY    86400
+
+static float s_lat, s_lon, s_elev;
+static sleep_schedule_t s_last;
+static bool s_valid = false;
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+
+void sleep_schedule_init(void)
+{
+	s_lat = strtof(CONFIG_SUN_LATITUDE, NULL);
+	s_lon = strtof(CONFIG_SUN_LONGITUDE, NULL);
+	s_elev = strtof(CONFIG_SLEEP_SUN_ELEV_DEG, NULL);
+}
+
+void sleep_schedule_at(time_t now, float lat, float lon, float elev, sleep_schedule_t *out)
+{
+	time_t rise, set, next_rise, next_set;
+	sun_events_compute(now, lat, lon, elev, &rise, &set);
+	out->dawn = rise;
+	out->dusk = set;
+
+	if (now < rise) {
+		// Madrugada: dormir hasta el amanecer de hoy
+		out->night = true;
+		out->sleep_at = now;
+		out->wake_at = rise;
+		return;
+	}
+
+	// Ya ha amanecido: el próximo despertar es el amanecer del día solar siguiente
+	sun_events_compute(now + SECS_DAY, lat, lon, elev, &next_rise, &next_set);
+	out->night = (now >= set);
+	out->sleep_at = out->night ? now : set;
+	out->wake_at = next_rise;
+}
+
+void sleep_schedule_compute(time_t now, sleep_schedule_t *out)
+{
+	sleep_schedule_at(now, s_lat, s_lon, s_elev, out);
+
+	portENTER_CRITICAL(&s_mux);
+	s_last = *out;
+	s_valid = true;
+	portEXIT_CRITICAL(&s_mux);
+}
+
+bool sleep_schedule_get(sleep_schedule_t *out)
+{
+	portENTER_CRITICAL(&s_mux);
+	bool ok = s_valid;
+	if (ok) *out = s_last;
+	portEXIT_CRITICAL(&s_mux);
+	return ok;
+}
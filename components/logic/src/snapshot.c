@@ -0,0 +1,181 @@
+#include "snapshot.h"
+
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
+
+/*
+ * Un escritor en el otro núcleo termina en lo que dura un memcpy: los primeros
+ * reintentos esperan unos microsegundos. Si sigue a medias es que ha sido
+ * desalojado en este núcleo y hay que cederle la CPU (vTaskDelay, no portYIELD:
+ * el lector puede tener más prioridad que el escritor).
+ */
+#define SNAPSHOT_SPIN_RETRIES  8
+#define SNAPSHOT_SPIN_US       5
+#define SNAPSHOT_MAX_RETRIES   (SNAPSHOT_SPIN_RETRIES + 8)
+
+// Cabecera de cada registro. El mutex sólo serializa a los escritores de ese registro;
+// los lectores nunca lo toman.
+typedef struct {
+	uint32_t seq;
+	SemaphoreHandle_t lock;
+	StaticSemaphore_t lock_buf;
+} slot_hdr_t;
+
+typedef struct {
+	slot_hdr_t hdr;
+	ina_snapshot_t data;
+} ina_slot_t;
+
+typedef struct {
+	slot_hdr_t hdr;
+	ldr_snapshot_t data;
+} ldr_slot_t;
+
+typedef struct {
+	slot_hdr_t hdr;
+	tracker_snapshot_t data;
+} tracker_slot_t;
+
+static ina_slot_t s_ina;
+static ldr_slot_t s_ldr;
+static tracker_slot_t s_tracker;
+
+static snapshot_ldr_hook_t s_ldr_hook = NULL;
+
+static portMUX_TYPE s_init_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static SemaphoreHandle_t write_lock(slot_hdr_t *hdr)
+{
+	// La primera publicación puede llegar a la vez desde varias tareas
+	portENTER_CRITICAL(&s_init_mux);
+	if (hdr->lock == NULL) hdr->lock = xSemaphoreCreateMutexStatic(&hdr->lock_buf);
+	portEXIT_CRITICAL(&s_init_mux);
+	return hdr->lock;
+}
+
+static void seq_write(slot_hdr_t *hdr, void *dst, const void *src, size_t len)
+{
+	SemaphoreHandle_t lock = write_lock(hdr);
+	xSemaphoreTake(lock, portMAX_DELAY);
+
+	uint32_t *seq = &hdr->seq;
+	uint32_t s = __atomic_load_n(seq, __ATOMIC_RELAXED);
+	__atomic_store_n(seq, s + 1, __ATOMIC_RELAXED);	// Impar: escritura en curso
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	memcpy(dst, src, len);
+
+	__atomic_store_n(seq, s + 2, __ATOMIC_RELEASE);	// Par: datos consistentes
+
+	xSemaphoreGive(lock);
+}
+
+// Copia consistente en dst con el número de publicaciones en *pub. Si falla, dst queda a cero.
+static snapshot_result_t seq_read(const uint32_t *seq, void *dst, const void *src, size_t len, uint32_t *pub)
+{
+	for (int i = 0; i < SNAPSHOT_MAX_RETRIES; i++) {
+		uint32_t s0 = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+		if (s0 == 0) break;		// Nunca publicado
+
+		if (!(s0 & 1u)) {
+			memcpy(dst, src, len);
+
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			uint32_t s1 = __atomic_load_n(seq, __ATOMIC_RELAXED);
+
+			if (s0 == s1) {
+				*pub = s0 >> 1;
+				return SNAPSHOT_OK;
+			}
+		}
+
+		// Escritor a mitad de copia
+		if (i < SNAPSHOT_SPIN_RETRIES) esp_rom_delay_us(SNAPSHOT_SPIN_US);
+		else vTaskDelay(1);
+	}
+
+	uint32_t s = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+	memset(dst, 0, len);
+	*pub = 0;
+	return (s == 0) ? SNAPSHOT_EMPTY : SNAPSHOT_BUSY;
+}
+
+void snapshot_publish_ina(const ina_snapshot_t *snap)
+{
+	ina_snapshot_t tmp = *snap;
+	tmp.timestamp_us = esp_timer_get_time();
+	seq_write(&s_ina.hdr, &s_ina.data, &tmp, sizeof(tmp));
+}
+
+void snapshot_publish_ldr(const ldr_snapshot_t *snap)
+{
+	ldr_snapshot_t tmp = *snap;
+	tmp.timestamp_us = esp_timer_get_time();
+	seq_write(&s_ldr.hdr, &s_ldr.data, &tmp, sizeof(tmp));
+
+	snapshot_ldr_hook_t hook = __atomic_load_n(&s_ldr_hook, __ATOMIC_ACQUIRE);
+	if (hook != NULL) hook(&tmp);
+}
+
+void snapshot_set_ldr_hook(snapshot_ldr_hook_t hook)
+{
+	__atomic_store_n(&s_ldr_hook, hook, __ATOMIC_RELEASE);
+}
+
+void snapshot_publish_tracker(const tracker_snapshot_t *snap)
+{
+	tracker_snapshot_t tmp = *snap;
+	tmp.timestamp_us = esp_timer_get_time();
+	seq_write(&s_tracker.hdr, &s_tracker.data, &tmp, sizeof(tmp));
+}
+
+snapshot_result_t snapshot_try_read_ina(ina_snapshot_t *out)
+{
+	uint32_t pub;
+	snapshot_result_t r = seq_read(&s_ina.hdr.seq, out, &s_ina.data, sizeof(*out), &pub);
+	out->seq = pub;
+	return r;
+}
+
+snapshot_result_t snapshot_try_read_ldr(ldr_snapshot_t *out)
+{
+	uint32_t pub;
+	snapshot_result_t r = seq_read(&s_ldr.hdr.seq, out, &s_ldr.data, sizeof(*out), &pub);
+	out->seq = pub;
+	return r;
+}
+
+snapshot_result_t snapshot_try_read_tracker(tracker_snapshot_t *out)
+{
+	uint32_t pub;
+	snapshot_result_t r = seq_read(&s_tracker.hdr.seq, out, &s_tracker.data, sizeof(*out), &pub);
+	out->seq = pub;
+	return r;
+}
+
+bool snapshot_read_ina(ina_snapshot_t *out)
+{
+	return snapshot_try_read_ina(out) == SNAPSHOT_OK;
+}
+
+bool snapshot_read_ldr(ldr_snapshot_t *out)
+{
+	return snapshot_try_read_ldr(out) == SNAPSHOT_OK;
+}
+
+bool snapshot_read_tracker(tracker_snapshot_t *out)
+{
+	return snapshot_try_read_tracker(out) == SNAPSHOT_OK;
+}
+
+uint32_t snapshot_age_ms(int64_t timestamp_us)
+{
+	int64_t age = esp_timer_get_time() - timestamp_us;
+	if (age < 0) age = 0;
+	return (uint32_t)(age / 1000);
+}
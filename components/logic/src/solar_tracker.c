@@ -1,12 +1,21 @@
 #include "solar_tracker.h"
 #include "adc.h"
 #include "servo_control.h"
-#include "protect.h"
+#include "snapshot.h"
+#include "sun_position.h"
+#include "pi_control.h"
+#include "po_control.h"
+#include "move_energy.h"
+#include "tracker_step.h"
+#include "pipeline.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include <stdlib.h> 
 #include <math.h>
+#include <string.h>
+#include <time.h>
 
 
 static const char *TAG = "TRACKER";
@@ -14,8 +23,8 @@ static const char *TAG = "TRACKER";
 #define PIN_SERVO_H       CONFIG_SERVO_PIN_HORIZ
 #define PIN_SERVO_V       CONFIG_SERVO_PIN_VERT
 #define TOLERANCE         CONFIG_TRACKER_TOLERANCE
+#define TOLERANCE_CAL     CONFIG_TRACKER_TOLERANCE_CAL
 #define CYCLE_MS          CONFIG_TRACKER_UPDATE_MS
-#define STEP_DEG          strtof(CONFIG_TRACKER_STEP_DEG, NULL)
 #define CHANNEL_H         LEDC_CHANNEL_0
 #define CHANNEL_V         LEDC_CHANNEL_1
 
@@ -25,11 +34,601 @@ static const char *TAG = "TRACKER";
 #define IDX_LEFT   2 
 #define IDX_RIGHT  3
 
-tracker_data_t g_tracker_data = { .angle_h = 90.0f, .angle_v = 45.0f };
+// Estado del lazo (ángulos, trim, PI de cada eje, última orden a los servos). Sólo lo toca la tarea.
+static tracker_state_t s_trk;
+static tracker_cfg_t s_cfg;
 
-// Estado actual de los ángulos
-static float s_angle_h = 90.0f; // Empezar centrado
-static float s_angle_v = 45.0f; // Empezar a 45 grados
+// Las ganancias del PI se leen de Kconfig al arrancar y pueden cambiarse en marcha.
+static pi_gains_t s_gains;
+static portMUX_TYPE s_gains_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static TaskHandle_t s_tracker_task = NULL;
+
+// Aparcado: lo ejecuta la tarea (única que mueve los servos) y se mantiene hasta un barrido
+#define PARK_H             90.0f	// Ajusta estos valores según tu montaje físico
+#define PARK_V             0.0f
+#define PARK_POLL_MS       50
+#define PARK_TIMEOUT_MS    5000
+
+static volatile bool s_park_requested = false;
+static volatile bool s_parked = false;
+static volatile uint32_t s_park_seq = 0;		// Aparcados completados
+
+#ifdef CONFIG_TRACKER_ACQUIRE_ENABLE
+#define ACQ_STEP_H        CONFIG_TRACKER_ACQ_STEP_H_DEG
+#define ACQ_STEP_V        CONFIG_TRACKER_ACQ_STEP_V_DEG
+#define ACQ_V_MAX         CONFIG_TRACKER_ACQ_V_MAX_DEG
+#define ACQ_POLL_MS       20
+#define ACQ_MOTION_MAX_MS 5000
+
+// Espera máxima a una instantánea posterior al asentamiento del punto
+#ifdef CONFIG_TRACKER_ACQ_SOURCE_PANEL
+#define ACQ_SAMPLE_TIMEOUT_MS  (2 * CONFIG_TASK_INA_PERIOD_MS + 500)
+#else
+#define ACQ_SAMPLE_TIMEOUT_MS  (2 * CONFIG_TASK_ADC_PERIOD_MS + 500)
+#endif
+
+static volatile bool s_scan_requested = true;	// La primera pasada de la tarea adquiere
+static uint32_t s_lock_ms = 0;					// Duración de la última adquisición
+#endif
+
+#ifdef CONFIG_TRACKER_IDLE_ENABLE
+#define IDLE_AFTER_CYCLES  CONFIG_TRACKER_IDLE_AFTER_CYCLES
+#define RECHECK_MS         (CONFIG_TRACKER_RECHECK_S * 1000)
+#define HOUR_US            (3600LL * 1000000LL)
+
+// Reposo: servos sin pulsos y tarea bloqueada hasta que los LDR pidan corregir o toque revisar
+static volatile bool s_idle = false;
+static uint32_t s_still_cycles = 0;		// Ciclos seguidos sin mover los servos
+static int64_t s_idle_us_total = 0;		// Tiempo total con los servos apagados
+
+// Despertares de la tarea: hora en curso y última hora completa
+static uint32_t s_wakeups_hour = 0;
+static uint32_t s_wakeups_last_hour = 0;
+static int64_t s_hour_start_us = 0;
+
+// Copia del estado que necesita el hook de LDR (corre en la tarea del ADC)
+static tracker_wake_ref_t s_hook_ref;
+static portMUX_TYPE s_hook_mux = portMUX_INITIALIZER_UNLOCKED;
+#endif
+
+#ifdef CONFIG_TRACKER_PO_ENABLE
+// Perturbar y observar sobre la potencia del panel
+typedef enum {
+	PO_PHASE_WAIT,		// Esperando al siguiente intervalo
+	PO_PHASE_BASE,		// Midiendo la potencia de referencia
+	PO_PHASE_SETTLE,	// Perturbación aplicada, esperando a que se asiente
+	PO_PHASE_AFTER,		// Midiendo la potencia tras la perturbación
+} po_phase_t;
+
+static po_cfg_t s_po_cfg;
+static po_state_t s_po;
+static po_phase_t s_po_phase = PO_PHASE_WAIT;
+static int64_t s_po_t_us = 0;		// Próximo intervalo o inicio del asentamiento
+static uint32_t s_po_seq = 0;		// Última instantánea INA acumulada
+static float s_po_acc = 0.0f;
+static int s_po_n = 0;
+static uint8_t s_po_axis = 0;
+static float s_po_delta = 0.0f;
+static float s_po_min_power;
+static float s_po_ref_max;
+#endif
+
+#if CONFIG_ENERGY_MODES
+// Modo de energía sin seguimiento: panel en la posición de reposo y tarea bloqueada
+#define HOLD_H  ((float)CONFIG_ENERGY_PARK_H_DEG)
+#define HOLD_V  ((float)CONFIG_ENERGY_PARK_V_DEG)
+
+static volatile bool s_suspended = false;
+#endif
+
+#ifdef CONFIG_TRACKER_ENERGY_AWARE
+// Último movimiento descartado por no compensar: los LDR no despiertan al tracker
+// en reposo, el error pendiente se revisa con la revisión programada
+static volatile bool s_move_deferred = false;
+#endif
+
+// En modo sólo potencia los LDR no mueven los servos
+#ifdef CONFIG_TRACKER_PO_ONLY
+#define LDR_DRIVES_SERVOS  false
+#else
+#define LDR_DRIVES_SERVOS  true
+#endif
+
+static float clampf(float x, float lo, float hi)
+{
+	return (x < lo) ? lo : (x > hi) ? hi : x;
+}
+
+static void tracker_cfg_load(void)
+{
+	s_cfg = (tracker_cfg_t){
+		.tolerance = TOLERANCE,
+		.tolerance_cal = TOLERANCE_CAL,
+		.dt_s = CYCLE_MS / 1000.0f,
+		.ldr_drives = LDR_DRIVES_SERVOS,
+	};
+
+#ifdef CONFIG_TRACKER_SUN_MODEL
+	s_cfg.sun_model = true;
+	s_cfg.lat = strtof(CONFIG_SUN_LATITUDE, NULL);
+	s_cfg.lon = strtof(CONFIG_SUN_LONGITUDE, NULL);
+	s_cfg.az_center = strtof(CONFIG_SUN_AZ_CENTER_DEG, NULL);
+	s_cfg.v_offset = strtof(CONFIG_SUN_V_OFFSET_DEG, NULL);
+	s_cfg.min_elevation = strtof(CONFIG_SUN_MIN_ELEVATION_DEG, NULL);
+	s_cfg.trim_max = strtof(CONFIG_TRACKER_TRIM_MAX_DEG, NULL);
+	s_cfg.move_min = strtof(CONFIG_TRACKER_MOVE_MIN_DEG, NULL);
+	s_cfg.trim_min_raw = CONFIG_TRACKER_TRIM_MIN_RAW;
+#ifdef CONFIG_SUN_H_INVERT
+	s_cfg.h_invert = true;
+#endif
+#ifdef CONFIG_SUN_V_INVERT
+	s_cfg.v_invert = true;
+#endif
+
+#ifdef CONFIG_SUN_POSITION_SELFTEST
+	float err = sun_position_selftest();
+	if (err > 0.05f) ESP_LOGW(TAG, "Modelo solar: error máximo %.3f° frente a la referencia", err);
+	else             ESP_LOGI(TAG, "Modelo solar: error máximo %.3f° frente a la referencia", err);
+#endif
+#endif
+
+#ifdef CONFIG_TRACKER_DIFFUSE_FLAT
+	s_cfg.diffuse_flat = true;
+	s_cfg.flat_h = CONFIG_TRACKER_FLAT_H_DEG;
+	s_cfg.flat_v = CONFIG_TRACKER_FLAT_V_DEG;
+#endif
+}
+
+// E/S del lazo sobre los servos reales
+static bool io_move(void *ctx, float h, float v)
+{
+	static const ledc_channel_t channels[2] = { CHANNEL_H, CHANNEL_V };
+	float angles[2] = { h, v };
+	esp_err_t err = servo_move(channels, angles, 2);
+	if (err != ESP_OK) {
+		ESP_LOGW(TAG, "No se pudo mover los servos: %s", esp_err_to_name(err));
+		return false;
+	}
+	return true;
+}
+
+static bool io_is_moving(void *ctx)
+{
+	return servo_is_moving();
+}
+
+static const tracker_io_t s_servo_io = { .move = io_move, .is_moving = io_is_moving };
+
+/*
+ * Lleva ambos ejes a (h, v) con un movimiento coordinado, sólo si alguno ha
+ * cambiado más de min_delta desde la última orden.
+ */
+static bool servo_update(float h, float v, float min_delta)
+{
+	return tracker_command(&s_trk, &s_servo_io, h, v, min_delta);
+}
+
+#ifdef CONFIG_TRACKER_PO_ENABLE
+static void po_load(void)
+{
+	s_po_cfg.step_min = strtof(CONFIG_TRACKER_PO_STEP_MIN, NULL);
+	s_po_cfg.step_max = strtof(CONFIG_TRACKER_PO_STEP_MAX, NULL);
+	s_po_cfg.grow = strtof(CONFIG_TRACKER_PO_GROW, NULL);
+	s_po_cfg.shrink = strtof(CONFIG_TRACKER_PO_SHRINK, NULL);
+	s_po_cfg.min_gain = strtof(CONFIG_TRACKER_PO_MIN_GAIN_PCT, NULL) / 100.0f;
+	s_po_min_power = strtof(CONFIG_TRACKER_PO_MIN_POWER_W, NULL);
+#ifdef CONFIG_TRACKER_PO_OUTER
+	s_po_ref_max = strtof(CONFIG_TRACKER_PO_REF_MAX, NULL);
+#endif
+	po_init(&s_po, &s_po_cfg);
+	s_po_t_us = esp_timer_get_time() + (int64_t)CONFIG_TRACKER_PO_INTERVAL_S * 1000000LL;
+}
+
+// Aplica un incremento a la variable que perturba el P&O en el eje indicado
+static void po_apply(uint8_t axis, float delta)
+{
+#ifdef CONFIG_TRACKER_PO_OUTER
+	s_trk.po_ref[axis] = clampf(s_trk.po_ref[axis] + delta, -s_po_ref_max, s_po_ref_max);
+#else
+	// Con el modelo activo se perturba el trim; si no, el ángulo directamente
+	if (s_trk.sun_active) {
+		float *trim = (axis == PO_AXIS_H) ? &s_trk.trim_h : &s_trk.trim_v;
+		*trim = clampf(*trim + delta, -s_cfg.trim_max, s_cfg.trim_max);
+		return;
+	}
+	float *angle = (axis == PO_AXIS_H) ? &s_trk.angle_h : &s_trk.angle_v;
+	*angle = clampf(*angle + delta, 0.0f, 180.0f);
+#endif
+}
+
+// Acumula potencia del panel de instantáneas INA nuevas. true al tener la ventana completa.
+static bool po_collect(void)
+{
+	ina_snapshot_t snap;
+	if (!snapshot_read_ina(&snap) || snap.seq == s_po_seq) return false;
+	s_po_seq = snap.seq;
+
+	if (snap.valid[INA_ROLE_PANEL]) {
+		s_po_acc += snap.ch[INA_ROLE_PANEL].power_W;
+		s_po_n++;
+	}
+	return s_po_n >= CONFIG_TRACKER_PO_SAMPLES;
+}
+
+// Empieza una ventana de medida descartando lo ya publicado
+static void po_window_start(po_phase_t phase)
+{
+	ina_snapshot_t snap;
+	s_po_seq = snapshot_read_ina(&snap) ? snap.seq : 0;
+	s_po_acc = 0.0f;
+	s_po_n = 0;
+	s_po_phase = phase;
+}
+
+/*
+ * Un ciclo del P&O, sin bloquear. Como mucho una perturbación cada
+ * CONFIG_TRACKER_PO_INTERVAL_S; cada una mide la potencia media antes y después.
+ */
+static void po_tick(void)
+{
+	int64_t now = esp_timer_get_time();
+
+	switch (s_po_phase) {
+	case PO_PHASE_WAIT:
+		if (now >= s_po_t_us && !servo_is_moving()) po_window_start(PO_PHASE_BASE);
+		break;
+
+	case PO_PHASE_BASE:
+		if (!po_collect()) break;
+		if (s_po_acc / s_po_n < s_po_min_power) {
+			// Poca potencia (nublado, noche): no hay nada que optimizar
+			s_po_t_us = now + (int64_t)CONFIG_TRACKER_PO_INTERVAL_S * 1000000LL;
+			s_po_phase = PO_PHASE_WAIT;
+			break;
+		}
+		s_po_delta = po_perturb(&s_po, s_po_acc / s_po_n, &s_po_axis);
+		po_apply(s_po_axis, s_po_delta);
+		s_po_t_us = now;
+		s_po_phase = PO_PHASE_SETTLE;
+		break;
+
+	case PO_PHASE_SETTLE:
+		// En modo exterior el lazo PI también tiene que llegar a la nueva consigna
+		if (servo_is_moving() || s_trk.pi_h.active || s_trk.pi_v.active) s_po_t_us = now;
+		if (now - s_po_t_us >= (int64_t)CONFIG_TRACKER_PO_SETTLE_MS * 1000) po_window_start(PO_PHASE_AFTER);
+		break;
+
+	case PO_PHASE_AFTER: {
+		if (!po_collect()) break;
+
+		float p_after = s_po_acc / s_po_n;
+		bool keep = po_evaluate(&s_po, &s_po_cfg, p_after);
+		if (!keep) po_apply(s_po_axis, -s_po_delta);
+
+		ESP_LOGD(TAG, "P&O eje %s %+.3f: %.3f W -> %.3f W, %s", (s_po_axis == PO_AXIS_H) ? "H" : "V",
+		         s_po_delta, s_po.p_base, p_after, keep ? "se mantiene" : "se deshace");
+
+		s_po_t_us = now + (int64_t)CONFIG_TRACKER_PO_INTERVAL_S * 1000000LL;
+		s_po_phase = PO_PHASE_WAIT;
+		break;
+	}
+	}
+}
+
+// Paso del P&O dentro del ciclo del lazo; true con una perturbación en curso
+static bool io_perturb(void *ctx, bool diffuse)
+{
+	if (!diffuse) po_tick();
+	return s_po_phase != PO_PHASE_WAIT;
+}
+#endif
+
+#ifdef CONFIG_TRACKER_ENERGY_AWARE
+static bool io_diffuse(void *ctx, int light, float contrast)
+{
+	return move_energy_diffuse(light, contrast);
+}
+
+// ctx: instantánea de LDR del ciclo
+static bool io_pays(void *ctx, float dh, float dv)
+{
+	return move_energy_pays(dh, dv, (const ldr_snapshot_t *)ctx);
+}
+#endif
+
+#ifdef CONFIG_TRACKER_IDLE_ENABLE
+/*
+ * Se ejecuta en la tarea del ADC con cada instantánea de LDR nueva. En reposo
+ * sólo despierta al tracker si el error de algún eje sale de la banda muerta.
+ */
+static void tracker_ldr_hook(const ldr_snapshot_t *snap)
+{
+	if (!s_idle || s_tracker_task == NULL) return;
+#ifdef CONFIG_TRACKER_ENERGY_AWARE
+	if (s_move_deferred) return;
+#endif
+
+	tracker_wake_ref_t ref;
+	portENTER_CRITICAL(&s_hook_mux);
+	ref = s_hook_ref;
+	portEXIT_CRITICAL(&s_hook_mux);
+
+	tracker_inputs_t in = {
+		.top = snap->ldr[IDX_TOP].raw,
+		.bot = snap->ldr[IDX_BOT].raw,
+		.left = snap->ldr[IDX_LEFT].raw,
+		.right = snap->ldr[IDX_RIGHT].raw,
+		.calibrated = snap->calibrated,
+	};
+	if (tracker_wake_check(&ref, &s_cfg, &in)) xTaskNotifyGive(s_tracker_task);
+}
+
+// Lo que el hook compara mientras la tarea duerme; se fija justo antes de dormir
+static void hook_ref_update(void)
+{
+	tracker_wake_ref_t ref;
+	tracker_wake_ref(&s_trk, &s_cfg, &ref);
+
+	portENTER_CRITICAL(&s_hook_mux);
+	s_hook_ref = ref;
+	portEXIT_CRITICAL(&s_hook_mux);
+}
+
+// Cuenta un despertar de la tarea y rota la ventana horaria
+static void count_wakeup(void)
+{
+	int64_t now = esp_timer_get_time();
+	if (now - s_hour_start_us >= HOUR_US) {
+		s_wakeups_last_hour = s_wakeups_hour;
+		s_wakeups_hour = 0;
+		s_hour_start_us = now;
+	}
+	s_wakeups_hour++;
+}
+
+// Despertares por hora: la última hora completa o, en la primera, la extrapolación de la actual
+static uint32_t wakeups_per_hour(void)
+{
+	if (s_wakeups_last_hour > 0) return s_wakeups_last_hour;
+
+	int64_t elapsed = esp_timer_get_time() - s_hour_start_us;
+	if (elapsed <= 0) return s_wakeups_hour;
+	return (uint32_t)((int64_t)s_wakeups_hour * HOUR_US / elapsed);
+}
+
+static void publish_idle(bool idle)
+{
+	tracker_snapshot_t snap;
+	if (!snapshot_read_tracker(&snap)) memset(&snap, 0, sizeof(snap));
+
+	snap.tracker.idle = idle;
+	snap.tracker.wakeups_per_hour = wakeups_per_hour();
+	snap.tracker.idle_s = (uint32_t)(s_idle_us_total / 1000000LL);
+	snapshot_publish_tracker(&snap);
+}
+
+/*
+ * Apaga los servos y bloquea la tarea hasta que el hook de LDR la despierte o
+ * venza la revisión programada (el modelo solar sigue moviéndose).
+ */
+static void tracker_idle(void)
+{
+	if (servo_power_down() != ESP_OK) {
+		s_still_cycles = 0;
+		return;
+	}
+
+	ESP_LOGD(TAG, "Tracker en reposo");
+	hook_ref_update();
+	s_idle = true;
+	publish_idle(true);
+
+	int64_t t0 = esp_timer_get_time();
+	int64_t timeout_ms = RECHECK_MS;
+#ifdef CONFIG_TRACKER_PO_ENABLE
+	// No dormir más allá de la siguiente perturbación
+	int64_t to_po_ms = (s_po_t_us - t0) / 1000;
+	if (to_po_ms < timeout_ms) timeout_ms = (to_po_ms > CYCLE_MS) ? to_po_ms : CYCLE_MS;
+#endif
+	uint32_t woke = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeout_ms));
+
+	s_idle = false;
+	s_idle_us_total += esp_timer_get_time() - t0;
+	s_still_cycles = 0;
+
+	ESP_LOGD(TAG, "Tracker despierta (%s)", woke ? "LDR" : "revisión");
+	servo_power_up();
+	publish_idle(false);
+}
+#endif
+
+#ifdef CONFIG_TRACKER_ACQUIRE_ENABLE
+static void wait_motion(void)
+{
+	for (int waited = 0; servo_is_moving() && waited < ACQ_MOTION_MAX_MS; waited += ACQ_POLL_MS) {
+		vTaskDelay(pdMS_TO_TICKS(ACQ_POLL_MS));
+	}
+}
+
+// Luz en la posición actual, con una instantánea publicada después de 'since_us'
+static bool acq_sample(int64_t since_us, float *metric)
+{
+	for (int waited = 0; waited < ACQ_SAMPLE_TIMEOUT_MS; waited += ACQ_POLL_MS) {
+#ifdef CONFIG_TRACKER_ACQ_SOURCE_PANEL
+		ina_snapshot_t snap;
+		if (snapshot_read_ina(&snap) && snap.timestamp_us >= since_us && snap.valid[INA_ROLE_PANEL]) {
+			*metric = snap.ch[INA_ROLE_PANEL].power_W;
+			return true;
+		}
+#else
+		ldr_snapshot_t snap;
+		if (snapshot_read_ldr(&snap) && snap.timestamp_us >= since_us) {
+			int sum = 0;
+			for (int i = 0; i < LDR_COUNT; i++) sum += snap.ldr[i].raw;
+			*metric = (float)sum / LDR_COUNT;
+			return true;
+		}
+#endif
+		vTaskDelay(pdMS_TO_TICKS(ACQ_POLL_MS));
+	}
+	return false;
+}
+
+/*
+ * Adquisición rápida: barrido grueso en serpentina por ambos ejes, salto al
+ * máximo global y entrega al seguimiento fino. Con el modelo solar disponible
+ * el barrido sobra y se va directamente a la posición calculada.
+ */
+static void tracker_acquire(void)
+{
+	int64_t t0 = esp_timer_get_time();
+
+#ifdef CONFIG_TRACKER_SUN_MODEL
+	tracker_data_t td;
+	float base_h, base_v;
+	if (tracker_sun_target(&s_cfg, time(NULL), &td, &base_h, &base_v)) {
+		s_trk.angle_h = clampf(base_h + s_trk.trim_h, 0.0f, 180.0f);
+		s_trk.angle_v = clampf(base_v + s_trk.trim_v, 0.0f, 180.0f);
+		servo_update(s_trk.angle_h, s_trk.angle_v, 0.0f);
+		wait_motion();
+
+		s_lock_ms = (uint32_t)((esp_timer_get_time() - t0) / 1000);
+		ESP_LOGI(TAG, "Sol adquirido por el modelo en %lu ms (H:%.1f V:%.1f)",
+		         (unsigned long)s_lock_ms, s_trk.angle_h, s_trk.angle_v);
+		return;
+	}
+#endif
+
+	float best = -1.0f, best_h = s_trk.angle_h, best_v = s_trk.angle_v;
+	int points = 0;
+	bool reverse = false;
+
+	for (int v = 0; v <= ACQ_V_MAX; v += ACQ_STEP_V) {
+		for (int i = 0; i * ACQ_STEP_H <= 180; i++) {
+			// Aparcar (antes de dormir) no espera a que termine el barrido
+			if (s_park_requested) return;
+
+			int h = reverse ? 180 - i * ACQ_STEP_H : i * ACQ_STEP_H;
+
+			servo_update((float)h, (float)v, 0.0f);
+			wait_motion();
+			vTaskDelay(pdMS_TO_TICKS(CONFIG_TRACKER_ACQ_DWELL_MS));
+
+			float m;
+			if (!acq_sample(esp_timer_get_time(), &m)) continue;
+			points++;
+
+			if (m > best) {
+				best = m;
+				best_h = (float)h;
+				best_v = (float)v;
+			}
+		}
+		reverse = !reverse;
+	}
+
+#ifdef CONFIG_TRACKER_ACQ_SOURCE_PANEL
+	bool dark = (best <= 0.0f);
+#else
+	bool dark = (best < CONFIG_TRACKER_ACQ_MIN_LIGHT);
+#endif
+	if (points == 0 || dark) {
+		// Sin sol que buscar: volver a la posición previa y seguir con el lazo normal
+		servo_update(s_trk.angle_h, s_trk.angle_v, 0.0f);
+		s_lock_ms = 0;
+		ESP_LOGW(TAG, "Barrido sin luz suficiente (%d puntos, max %.1f)", points, best);
+		return;
+	}
+
+	s_trk.angle_h = best_h;
+	s_trk.angle_v = best_v;
+	servo_update(s_trk.angle_h, s_trk.angle_v, 0.0f);
+	wait_motion();
+
+	// El lazo fino arranca desde cero en la nueva posición
+	pi_axis_reset(&s_trk.pi_h);
+	pi_axis_reset(&s_trk.pi_v);
+
+	s_lock_ms = (uint32_t)((esp_timer_get_time() - t0) / 1000);
+	ESP_LOGI(TAG, "Sol adquirido por barrido en %lu ms: H:%.0f V:%.0f (max %.1f, %d puntos)",
+	         (unsigned long)s_lock_ms, best_h, best_v, best, points);
+}
+#endif
+
+#if CONFIG_ENERGY_MODES
+// Lleva el panel a reposo, corta los servos y espera a que se reanude el seguimiento
+static void tracker_hold(void)
+{
+	servo_update(HOLD_H, HOLD_V, 0.0f);
+	for (int waited = 0; servo_is_moving() && waited < 3000; waited += 50) {
+		vTaskDelay(pdMS_TO_TICKS(50));
+	}
+	servo_power_down();
+
+	s_trk.angle_h = HOLD_H;
+	s_trk.angle_v = HOLD_V;
+	pi_axis_reset(&s_trk.pi_h);
+	pi_axis_reset(&s_trk.pi_v);
+
+	tracker_snapshot_t snap;
+	if (!snapshot_read_tracker(&snap)) memset(&snap, 0, sizeof(snap));
+	snap.tracker.angle_h = HOLD_H;
+	snap.tracker.angle_v = HOLD_V;
+	snap.tracker.idle = true;
+	snapshot_publish_tracker(&snap);
+
+	// Los LDR o un /scan también notifican: sólo sale al reanudar o para aparcar
+	while (s_suspended && !s_park_requested) ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+	servo_power_up();
+#ifdef CONFIG_TRACKER_ACQUIRE_ENABLE
+	s_scan_requested = true;	// El sol se ha movido mientras tanto
+#endif
+}
+#endif
+
+/*
+ * Aparca el panel a petición de solar_tracker_park() y se queda ahí, con los
+ * servos apagados, hasta que solar_tracker_request_scan() reanude el seguimiento.
+ */
+static void tracker_park(void)
+{
+	ESP_LOGI(TAG, "Aparcando servos...");
+	s_park_requested = false;
+
+	servo_update(PARK_H, PARK_V, 0.0f);
+	s_trk.angle_h = PARK_H;
+	s_trk.angle_v = PARK_V;
+	pi_axis_reset(&s_trk.pi_h);
+	pi_axis_reset(&s_trk.pi_v);
+
+	// Actualizamos la instantánea por si se envía un último MQTT
+	tracker_snapshot_t snap;
+	if (!snapshot_read_tracker(&snap)) memset(&snap, 0, sizeof(snap));
+	snap.tracker.angle_h = PARK_H;
+	snap.tracker.angle_v = PARK_V;
+	snap.tracker.moves = s_trk.moves;
+	snapshot_publish_tracker(&snap);
+
+	// Importante: esperar a que termine el perfil y dar tiempo físico a los motores
+	for (int waited = 0; servo_is_moving() && waited < 3000; waited += PARK_POLL_MS) {
+		vTaskDelay(pdMS_TO_TICKS(PARK_POLL_MS));
+	}
+	vTaskDelay(pdMS_TO_TICKS(300));
+	servo_power_down();
+
+	s_park_seq++;
+	ESP_LOGI(TAG, "Servos aparcados.");
+
+	while (s_parked && !s_park_requested) ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+	if (s_park_requested) return;	// Otro aparcado: la siguiente vuelta lo atiende
+
+	servo_power_up();
+#ifdef CONFIG_TRACKER_ACQUIRE_ENABLE
+	s_scan_requested = true;
+#endif
+}
 
 static void tracker_task(void *pvParameters)
 {
@@ -37,108 +636,221 @@ static void tracker_task(void *pvParameters)
 
 	// Pequeña espera para asegurar que ADC ya tiene datos
     vTaskDelay(pdMS_TO_TICKS(2000));
+
+    // Periodo fijo con vTaskDelayUntil: el ciclo no se alarga con el tiempo de cálculo
+    TickType_t last_wake = xTaskGetTickCount();
 	
 	while (1) {
-        int raw[LDR_COUNT] = {0};
-        bool data_ok = false;
-
-        // Leer datos globales de forma segura
-        if (g_data_mutex != NULL) {
-            if (xSemaphoreTake(g_data_mutex, pdMS_TO_TICKS(50)) == pdTRUE) {
-                for (int i = 0; i < LDR_COUNT; i++) {
-                    raw[i] = g_ldr_data[i].raw;
-                }
-                xSemaphoreGive(g_data_mutex);
-                data_ok = true;
-            }
+        if (s_park_requested) {
+            tracker_park();
+            last_wake = xTaskGetTickCount();
+            continue;
+        }
+#if CONFIG_ENERGY_MODES
+        if (s_suspended) {
+            tracker_hold();
+            last_wake = xTaskGetTickCount();
         }
+#endif
+        int64_t release_us = esp_timer_get_time();
+
+#ifdef CONFIG_TRACKER_ACQUIRE_ENABLE
+        if (s_scan_requested) {
+            s_scan_requested = false;
+            tracker_acquire();
+            last_wake = xTaskGetTickCount();
+            release_us = esp_timer_get_time();
+        }
+#endif
+
+        ldr_snapshot_t ldr_snap;
+
+        // Lectura sin bloqueo de la última instantánea del ADC
+        if (snapshot_read_ldr(&ldr_snap)) {
+            tracker_inputs_t in = {
+                .top = ldr_snap.ldr[IDX_TOP].raw,
+                .bot = ldr_snap.ldr[IDX_BOT].raw,
+                .left = ldr_snap.ldr[IDX_LEFT].raw,
+                .right = ldr_snap.ldr[IDX_RIGHT].raw,
+                .calibrated = ldr_snap.calibrated,
+                .utc = time(NULL),
+            };
+            portENTER_CRITICAL(&s_gains_mux);
+            in.gains = s_gains;
+            portEXIT_CRITICAL(&s_gains_mux);
+
+            tracker_io_t io = s_servo_io;
+            io.ctx = &ldr_snap;
+#ifdef CONFIG_TRACKER_ENERGY_AWARE
+            move_energy_update();
+            io.diffuse = io_diffuse;
+            io.pays = io_pays;
+#endif
+#ifdef CONFIG_TRACKER_PO_ENABLE
+            io.perturb = io_perturb;
+#endif
+
+            // La decisión del ciclo es la misma que ejecuta el simulador del PC (host_test)
+            tracker_data_t td = { 0 };
+            tracker_step_result_t res;
+            tracker_step(&s_trk, &s_cfg, &in, &io, &td, &res);
 
-        if (data_ok) {
-            // Calcular promedios/diferencias
-            int val_top   = raw[IDX_TOP];
-            int val_bot   = raw[IDX_BOT];
-            int val_left  = raw[IDX_LEFT];
-            int val_right = raw[IDX_RIGHT];
-
-            // Lógica Vertical
-            int diff_v = val_top - val_bot;
-            if (abs(diff_v) > TOLERANCE) {
-                // Si Top > Bot -> Sol arriba (asumiendo Raw alto = más luz)
-                // Ajustar signo (+/-) según la mecánica de tu servo
-                if (val_top > val_bot) s_angle_v -= STEP_DEG; 
-                else                   s_angle_v += STEP_DEG;
-            }
-
-            // Lógica Horizontal
-            int diff_h = val_left - val_right;
-            if (abs(diff_h) > TOLERANCE) {
-                 // Si Left > Right -> Sol a la izquierda
-                if (val_left > val_right) s_angle_h += STEP_DEG;
-                else                      s_angle_h -= STEP_DEG;
-            }
-
-            // Límites de seguridad (0 a 180 grados)
-            if (s_angle_v < 0.0f) s_angle_v = 0.0f;
-            if (s_angle_v > 180.0f) s_angle_v = 180.0f;
-
-            if (s_angle_h < 0.0f) s_angle_h = 0.0f;
-            if (s_angle_h > 180.0f) s_angle_h = 180.0f;
-
-            // Mover Servos
-            servo_set_angle(CHANNEL_V, s_angle_v);
-            servo_set_angle(CHANNEL_H, s_angle_h);
-
-			if (g_data_mutex != NULL) {
-                if (xSemaphoreTake(g_data_mutex, pdMS_TO_TICKS(50)) == pdTRUE) {
-                    g_tracker_data.angle_h = s_angle_h;
-                    g_tracker_data.angle_v = s_angle_v;
-                    xSemaphoreGive(g_data_mutex);
-                }
-            }
+#ifdef CONFIG_TRACKER_ENERGY_AWARE
+            s_move_deferred = res.deferred;
+            if (res.moved) move_energy_moved();
+#endif
+#ifdef CONFIG_TRACKER_PO_ENABLE
+            td.po_kept = s_po.kept;
+            td.po_reverted = s_po.reverted;
+            td.po_ref_h = s_trk.po_ref[PO_AXIS_H];
+            td.po_ref_v = s_trk.po_ref[PO_AXIS_V];
+#endif
+
+#ifdef CONFIG_TRACKER_IDLE_ENABLE
+            // Convergido: ni órdenes nuevas ni movimiento en curso durante varios ciclos
+            if (res.busy) s_still_cycles = 0;
+            else s_still_cycles++;
+
+            td.wakeups_per_hour = wakeups_per_hour();
+            td.idle_s = (uint32_t)(s_idle_us_total / 1000000LL);
+#endif
+
+#ifdef CONFIG_TRACKER_ACQUIRE_ENABLE
+            td.lock_ms = s_lock_ms;
+#endif
+#ifdef CONFIG_TRACKER_ENERGY_AWARE
+            move_energy_t bal;
+            move_energy_get(&bal);
+            td.move_spent_j = bal.spent_j;
+            td.move_gain_j = bal.gained_j;
+            td.move_w = bal.move_w;
+            td.moves_skipped = bal.skipped;
+#endif
+            tracker_snapshot_t snap = { .tracker = td };
+            snapshot_publish_tracker(&snap);
 
             // Log opcional para depuración (nivel VERBOSE para no saturar)
             ESP_LOGV(TAG, "V:%.1f H:%.1f | T:%d B:%d L:%d R:%d", 
-                     s_angle_v, s_angle_h, val_top, val_bot, val_left, val_right);
+                     s_trk.angle_v, s_trk.angle_h, in.top, in.bot, in.left, in.right);
+        }
+
+        pipeline_done(PIPELINE_STAGE_TRACKER, release_us);
+
+#ifdef CONFIG_TRACKER_IDLE_ENABLE
+        if (s_still_cycles >= IDLE_AFTER_CYCLES) {
+            tracker_idle();
+            count_wakeup();
+            last_wake = xTaskGetTickCount();	// Sin recuperar los ciclos dormidos
+            continue;
         }
+#endif
+
+        vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(CYCLE_MS));
+#ifdef CONFIG_TRACKER_IDLE_ENABLE
+        count_wakeup();
+#endif
+    }
+}
+
+void solar_tracker_get_gains(pi_gains_t *out)
+{
+    portENTER_CRITICAL(&s_gains_mux);
+    *out = s_gains;
+    portEXIT_CRITICAL(&s_gains_mux);
+}
 
-        vTaskDelay(pdMS_TO_TICKS(CYCLE_MS));
+esp_err_t solar_tracker_set_gains(const pi_gains_t *g)
+{
+    if (g->kp < 0.0f || g->ki < 0.0f || g->max_step <= 0.0f ||
+        g->hyst_off < 0.0f || g->hyst_off > 1.0f) {
+        return ESP_ERR_INVALID_ARG;
     }
+
+    portENTER_CRITICAL(&s_gains_mux);
+    s_gains = *g;
+    portEXIT_CRITICAL(&s_gains_mux);
+
+    ESP_LOGI(TAG, "Ganancias PI: Kp=%.2f Ki=%.2f paso max=%.2f° histéresis=%.2f",
+             g->kp, g->ki, g->max_step, g->hyst_off);
+    return ESP_OK;
 }
 
 void solar_tracker_start(void) {
+    // Ganancias iniciales desde Kconfig (se parsean una sola vez)
+    s_gains.kp = strtof(CONFIG_TRACKER_PI_KP, NULL);
+    s_gains.ki = strtof(CONFIG_TRACKER_PI_KI, NULL);
+    s_gains.max_step = strtof(CONFIG_TRACKER_STEP_DEG, NULL);
+    s_gains.hyst_off = CONFIG_TRACKER_HYST_PCT / 100.0f;
+    tracker_state_init(&s_trk, 90.0f, 45.0f);	// Empezar centrado y a 45 grados
+    tracker_cfg_load();
+
     // Inicializar Hardware de Servos
     servo_init(PIN_SERVO_H, CHANNEL_H);
     servo_init(PIN_SERVO_V, CHANNEL_V);
 
+#ifdef CONFIG_TRACKER_PO_ENABLE
+    po_load();
+#endif
+#ifdef CONFIG_TRACKER_ENERGY_AWARE
+    move_energy_init();
+#endif
+
+#if CONFIG_ENERGY_MODES
+    // Arranque en un modo sin seguimiento: directamente a reposo
+    if (s_suspended) {
+        s_trk.angle_h = HOLD_H;
+        s_trk.angle_v = HOLD_V;
+    }
+#endif
+
     // Mover a posición inicial
-    servo_set_angle(CHANNEL_H, s_angle_h);
-    servo_set_angle(CHANNEL_V, s_angle_v);
+    servo_update(s_trk.angle_h, s_trk.angle_v, 0.0f);
+
+    tracker_snapshot_t snap = { .tracker = { .angle_h = s_trk.angle_h, .angle_v = s_trk.angle_v } };
+    snapshot_publish_tracker(&snap);
 
     // Crear la tarea
-    xTaskCreate(tracker_task, "tracker_logic", 4096, NULL, 5, NULL);
+    xTaskCreatePinnedToCore(tracker_task, "tracker_logic", 4096, NULL, PIPELINE_PRIO_TRACKER, &s_tracker_task, PIPELINE_CORE_APP);
+
+#ifdef CONFIG_TRACKER_IDLE_ENABLE
+    s_hour_start_us = esp_timer_get_time();
+    snapshot_set_ldr_hook(tracker_ldr_hook);
+#endif
+}
+
+void solar_tracker_request_scan(void)
+{
+    // También saca al tracker de la posición de aparcado
+    s_parked = false;
+#ifdef CONFIG_TRACKER_ACQUIRE_ENABLE
+    s_scan_requested = true;
+#endif
+    // Despierta a la tarea si está en reposo
+    if (s_tracker_task != NULL) xTaskNotifyGive(s_tracker_task);
 }
 
 void solar_tracker_park(void)
 {
-	ESP_LOGI(TAG, "Aparcando servos para dormir...");
-
-    // Ajusta estos valores según tu montaje físico
-    float park_h = 90.0f; 
-    float park_v = 0.0f;  
-
-    servo_set_angle(CHANNEL_H, park_h);
-    servo_set_angle(CHANNEL_V, park_v);
-    
-    // Actualizamos la estructura global por si se envía un último MQTT
-    if (g_data_mutex != NULL) {
-        if (xSemaphoreTake(g_data_mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
-            g_tracker_data.angle_h = park_h;
-            g_tracker_data.angle_v = park_v;
-            xSemaphoreGive(g_data_mutex);
-        }
+    if (s_tracker_task == NULL) return;
+
+    // Los servos sólo los mueve la tarea del tracker: se le pide y se espera a que termine
+    uint32_t seq = s_park_seq;
+    s_parked = true;
+    s_park_requested = true;
+    xTaskNotifyGive(s_tracker_task);
+
+    for (int waited = 0; s_park_seq == seq && waited < PARK_TIMEOUT_MS; waited += PARK_POLL_MS) {
+        vTaskDelay(pdMS_TO_TICKS(PARK_POLL_MS));
     }
+    if (s_park_seq == seq) ESP_LOGW(TAG, "El tracker no ha confirmado el aparcado en %d ms", PARK_TIMEOUT_MS);
+}
 
-    // Importante: Dar tiempo físico a los motores para llegar a la posición
-    vTaskDelay(pdMS_TO_TICKS(2000));
-    ESP_LOGI(TAG, "Servos aparcados.");
-}
\ No newline at end of file
+#if CONFIG_ENERGY_MODES
+void solar_tracker_set_suspended(bool suspended)
+{
+	if (s_suspended == suspended) return;
+	s_suspended = suspended;
+	ESP_LOGI(TAG, "%s", suspended ? "Seguimiento detenido: panel en reposo (ahorro de energía)" : "Seguimiento reanudado");
+	if (s_tracker_task != NULL) xTaskNotifyGive(s_tracker_task);
+}
+#endif
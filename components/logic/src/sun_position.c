@@ -0,0 +1,182 @@
+#include "sun_position.h"
+
+#include <math.h>
+
+#define DEG2RAD(x)  ((x) * (float)M_PI / 180.0f)
+#define RAD2DEG(x)  ((x) * 180.0f / (float)M_PI)
+
+#define UNIX_J2000  946728000LL	// 2000-01-01 12:00 UTC
+#define SECS_DAY    86400LL
+#define SUN_EVENT_RES_S  2	// Resolución de la bisección de orto/ocaso
+
+// Reduce a [0, 360)
+static float wrap360(float a)
+{
+	a = fmodf(a, 360.0f);
+	return (a < 0.0f) ? a + 360.0f : a;
+}
+
+/*
+ * Término lineal a + rate * (n + frac) reducido a 360° sin perder precisión en float.
+ * rate llega ya sin vueltas enteras por día y n se parte en bloques de 256 días
+ * para que ningún producto supere unos cientos de grados.
+ */
+static float linear_deg(float a, float rate, int32_t n, float frac)
+{
+	float block = wrap360(rate * 256.0f);
+	float whole = wrap360(rate * (float)(n % 256)) + wrap360(block * (float)(n / 256));
+	return wrap360(a + whole + rate * frac);
+}
+
+// Refracción atmosférica (NOAA), en grados, a sumar a la elevación geométrica
+static float refraction_deg(float el)
+{
+	if (el > 85.0f) return 0.0f;
+
+	float te = tanf(DEG2RAD(el));
+	float arcsec;
+
+	if (el > 5.0f)
+		arcsec = 58.1f / te - 0.07f / (te * te * te) + 0.000086f / (te * te * te * te * te);
+	else if (el > -0.575f)
+		arcsec = 1735.0f + el * (-518.2f + el * (103.4f + el * (-12.79f + el * 0.711f)));
+	else
+		arcsec = -20.772f / te;
+
+	return arcsec / 3600.0f;
+}
+
+// Acimut y elevación geométrica (sin refracción), en grados
+static void sun_geometry(time_t utc, float lat_deg, float lon_deg, float *az_deg, float *el_deg)
+{
+	// Días desde J2000: parte entera exacta + fracción
+	int64_t secs = (int64_t)utc - UNIX_J2000;
+	int32_t n = (int32_t)(secs / SECS_DAY);
+	int64_t rem = secs - (int64_t)n * SECS_DAY;
+	if (rem < 0) {
+		rem += SECS_DAY;
+		n--;
+	}
+	float frac = (float)rem / (float)SECS_DAY;
+	float days = (float)n + frac;
+
+	// Longitud media y anomalía media
+	float L = linear_deg(280.460f, 0.9856474f, n, frac);
+	float g = DEG2RAD(linear_deg(357.528f, 0.9856003f, n, frac));
+
+	// Longitud eclíptica y oblicuidad
+	float lambda = DEG2RAD(L + 1.915f * sinf(g) + 0.020f * sinf(2.0f * g));
+	float eps = DEG2RAD(23.439f - 0.0000004f * days);
+
+	// Coordenadas ecuatoriales
+	float ra = atan2f(cosf(eps) * sinf(lambda), cosf(lambda));
+	float decl = asinf(sinf(eps) * sinf(lambda));
+
+	// Tiempo sidéreo local (grados) y ángulo horario
+	// 360.98564736629 °/día: la vuelta diaria completa se suma aparte como 360 * frac
+	float gmst = wrap360(linear_deg(280.46061837f, 0.98564736629f, n, frac) + 360.0f * frac);
+	float ha = DEG2RAD(wrap360(gmst + lon_deg - RAD2DEG(ra)));
+
+	float lat = DEG2RAD(lat_deg);
+	float sin_el = sinf(lat) * sinf(decl) + cosf(lat) * cosf(decl) * cosf(ha);
+	if (sin_el > 1.0f) sin_el = 1.0f;
+	if (sin_el < -1.0f) sin_el = -1.0f;
+	float el = asinf(sin_el);
+
+	// Acimut desde el Norte, sentido horario
+	float az = atan2f(-sinf(ha) * cosf(decl),
+	                  cosf(lat) * sinf(decl) - sinf(lat) * cosf(decl) * cosf(ha));
+
+	*az_deg = wrap360(RAD2DEG(az));
+	*el_deg = RAD2DEG(el);
+}
+
+void sun_position_compute(time_t utc, float lat_deg, float lon_deg, sun_pos_t *out)
+{
+	float el;
+	sun_geometry(utc, lat_deg, lon_deg, &out->azimuth_deg, &el);
+	out->elevation_deg = el + refraction_deg(el);
+}
+
+static float sun_elevation_geo(int64_t utc, float lat_deg, float lon_deg)
+{
+	float az, el;
+	sun_geometry((time_t)utc, lat_deg, lon_deg, &az, &el);
+	return el;
+}
+
+// Cruce de elev_deg entre a y b (el sol está por debajo en 'a' si rising, por encima si no)
+static int64_t sun_crossing(int64_t a, int64_t b, bool rising, float lat_deg, float lon_deg, float elev_deg)
+{
+	while (b - a > SUN_EVENT_RES_S) {
+		int64_t m = a + (b - a) / 2;
+		bool up = sun_elevation_geo(m, lat_deg, lon_deg) >= elev_deg;
+		if (up == rising) b = m;
+		else a = m;
+	}
+	return a + (b - a) / 2;
+}
+
+sun_events_t sun_events_compute(time_t utc, float lat_deg, float lon_deg, float elev_deg, time_t *rise, time_t *set)
+{
+	// Día solar medio que contiene utc: la hora solar adelanta 240 s por grado hacia el Este
+	int64_t lon_s = (int64_t)lroundf(lon_deg * 240.0f);
+	int64_t local = (int64_t)utc + lon_s;
+	int64_t day = local / SECS_DAY - ((local % SECS_DAY) < 0 ? 1 : 0);
+	int64_t noon = day * SECS_DAY + SECS_DAY / 2 - lon_s;
+	int64_t mid_a = noon - SECS_DAY / 2, mid_b = noon + SECS_DAY / 2;
+
+	if (sun_elevation_geo(noon, lat_deg, lon_deg) < elev_deg) {
+		*rise = *set = (time_t)noon;
+		return SUN_EVENTS_ALWAYS_DOWN;
+	}
+
+	bool up_a = sun_elevation_geo(mid_a, lat_deg, lon_deg) >= elev_deg;
+	bool up_b = sun_elevation_geo(mid_b, lat_deg, lon_deg) >= elev_deg;
+
+	*rise = (time_t)(up_a ? mid_a : sun_crossing(mid_a, noon, true, lat_deg, lon_deg, elev_deg));
+	*set = (time_t)(up_b ? mid_b : sun_crossing(noon, mid_b, false, lat_deg, lon_deg, elev_deg));
+	return (up_a && up_b) ? SUN_EVENTS_ALWAYS_UP : SUN_EVENTS_OK;
+}
+
+// Referencia: algoritmo NOAA completo en doble precisión
+typedef struct {
+	long long utc;
+	float lat, lon;
+	float az, el;
+} sun_ref_t;
+
+static const sun_ref_t s_sun_ref[] = {
+	{ 1718971200LL, 40.4168f, -3.7038f, 167.018f, 72.664f },	// 2024-06-21 12:00 UTC
+	{ 1734773400LL, 40.4168f, -3.7038f, 141.503f, 15.787f },	// 2024-12-21 09:30 UTC
+	{ 1742490000LL, 40.4168f, -3.7038f, 256.457f, 15.632f },	// 2025-03-20 17:00 UTC
+	{ 1790147700LL, 40.4168f, -3.7038f, 101.253f, 12.804f },	// 2026-09-23 07:15 UTC
+	{ 1894676400LL, -33.8688f, 151.2093f, 312.518f, 72.318f },	// 2030-01-15 03:00 UTC
+	{ 1846349100LL, 37.7749f, -122.4194f, 121.733f, 65.693f },	// 2028-07-04 18:45 UTC
+	{ 1825156800LL, 0.0000f, 0.0000f, 195.256f, 74.691f },	// 2027-11-02 12:00 UTC
+	{ 2062389600LL, 60.1699f, 24.9384f, 103.751f, 27.977f },	// 2035-05-10 06:00 UTC
+	{ 1943360400LL, 28.4636f, -16.2518f, 239.977f, 71.097f },	// 2031-08-01 14:20 UTC
+	{ 1993242600LL, -33.8688f, 151.2093f, 75.236f, 33.584f },	// 2033-02-28 22:30 UTC
+};
+
+float sun_position_selftest(void)
+{
+	float max_err = 0.0f;
+
+	for (size_t i = 0; i < sizeof(s_sun_ref) / sizeof(s_sun_ref[0]); i++) {
+		const sun_ref_t *r = &s_sun_ref[i];
+		sun_pos_t p;
+		sun_position_compute((time_t)r->utc, r->lat, r->lon, &p);
+
+		float d_az = fabsf(p.azimuth_deg - r->az);
+		if (d_az > 180.0f) d_az = 360.0f - d_az;
+		// Error de acimut proyectado sobre el cielo (cerca del cénit el acimut es inestable)
+		d_az *= cosf(DEG2RAD(r->el));
+		float d_el = fabsf(p.elevation_deg - r->el);
+
+		if (d_az > max_err) max_err = d_az;
+		if (d_el > max_err) max_err = d_el;
+	}
+
+	return max_err;
+}
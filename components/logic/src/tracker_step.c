@@ -0,0 +1,204 @@
+#include "tracker_step.h"
+#include "sun_position.h"
+
+#include <math.h>
+
+// Antes de esta fecha el reloj no se ha sincronizado por SNTP (2020-01-01)
+#define SUN_TIME_VALID_MIN  1577836800
+#define LDR_N               4	// Arriba, abajo, izquierda, derecha
+
+static float clampf(float x, float lo, float hi)
+{
+	return (x < lo) ? lo : (x > hi) ? hi : x;
+}
+
+void tracker_state_init(tracker_state_t *st, float angle_h, float angle_v)
+{
+	*st = (tracker_state_t){
+		.angle_h = angle_h,
+		.angle_v = angle_v,
+		.written_h = -1.0f,
+		.written_v = -1.0f,
+	};
+	pi_axis_reset(&st->pi_h);
+	pi_axis_reset(&st->pi_v);
+}
+
+bool tracker_sun_target(const tracker_cfg_t *cfg, time_t utc, tracker_data_t *td, float *base_h, float *base_v)
+{
+	if (utc < SUN_TIME_VALID_MIN) return false;
+
+	sun_pos_t pos;
+	sun_position_compute(utc, cfg->lat, cfg->lon, &pos);
+	if (td != NULL) {
+		td->sun_azimuth = pos.azimuth_deg;
+		td->sun_elevation = pos.elevation_deg;
+	}
+
+	if (pos.elevation_deg < cfg->min_elevation) return false;
+
+	float d_az = fmodf(pos.azimuth_deg - cfg->az_center + 540.0f, 360.0f) - 180.0f;
+	if (cfg->h_invert) d_az = -d_az;
+	float el = pos.elevation_deg;
+	if (cfg->v_invert) el = -el;
+
+	*base_h = 90.0f + d_az;
+	*base_v = cfg->v_offset + el;
+	return true;
+}
+
+bool tracker_needs_move(const tracker_state_t *st, float h, float v, float min_delta)
+{
+	return st->written_h < 0.0f || fabsf(h - st->written_h) > min_delta ||
+	       st->written_v < 0.0f || fabsf(v - st->written_v) > min_delta;
+}
+
+bool tracker_command(tracker_state_t *st, const tracker_io_t *io, float h, float v, float min_delta)
+{
+	if (!tracker_needs_move(st, h, v, min_delta)) return false;
+	if (!io->move(io->ctx, h, v)) return false;
+
+	st->written_h = h;
+	st->written_v = v;
+	st->moves++;
+	return true;
+}
+
+void tracker_step(tracker_state_t *st, const tracker_cfg_t *cfg, const tracker_inputs_t *in,
+                  const tracker_io_t *io, tracker_data_t *td, tracker_step_result_t *res)
+{
+	*res = (tracker_step_result_t){ 0 };
+
+	// Con LDRs calibrados la banda muerta puede ser más estrecha
+	int tolerance = in->calibrated ? cfg->tolerance_cal : cfg->tolerance;
+	int light = (in->top + in->bot + in->left + in->right) / LDR_N;
+
+	// Error normalizado por eje. Top > Bot -> bajar angle_v, Left > Right -> subir angle_h
+	// (ajustar el orden según la mecánica de tu servo). El P&O exterior desplaza el equilibrio.
+	float e_v = pi_norm_error(in->bot, in->top) - st->po_ref[PO_AXIS_V];
+	float e_h = pi_norm_error(in->left, in->right) - st->po_ref[PO_AXIS_H];
+	float on_v = pi_norm_threshold(tolerance, in->top, in->bot);
+	float on_h = pi_norm_threshold(tolerance, in->left, in->right);
+
+	// Nublado: poca luz y sin dirección clara, no compensa seguir
+	bool diffuse = false;
+	if (io->diffuse != NULL) {
+		float contrast = fmaxf(fabsf(pi_norm_error(in->bot, in->top)), fabsf(pi_norm_error(in->left, in->right)));
+		diffuse = io->diffuse(io->ctx, light, contrast);
+		if (diffuse) {
+			pi_axis_reset(&st->pi_h);
+			pi_axis_reset(&st->pi_v);
+		}
+	}
+
+	// Posición antes de este ciclo, por si el movimiento no compensa
+	const float prev_h = st->angle_h, prev_v = st->angle_v;
+	const float prev_trim_h = st->trim_h, prev_trim_v = st->trim_v;
+
+	bool model = false;
+	float move_min = 0.0f;
+	if (cfg->sun_model) {
+		float base_h, base_v;
+		move_min = cfg->move_min;
+		model = tracker_sun_target(cfg, in->utc, td, &base_h, &base_v);
+		st->sun_active = model;
+		if (model && !diffuse) {
+			// Los LDR sólo corrigen el error residual, y únicamente con luz suficiente
+			if (cfg->ldr_drives && light >= cfg->trim_min_raw) {
+				st->trim_v += pi_axis_update(&st->pi_v, &in->gains, e_v, on_v, cfg->dt_s);
+				st->trim_h += pi_axis_update(&st->pi_h, &in->gains, e_h, on_h, cfg->dt_s);
+
+				st->trim_v = clampf(st->trim_v, -cfg->trim_max, cfg->trim_max);
+				st->trim_h = clampf(st->trim_h, -cfg->trim_max, cfg->trim_max);
+			}
+
+			st->angle_h = base_h + st->trim_h;
+			st->angle_v = base_v + st->trim_v;
+		}
+		td->trim_h = st->trim_h;
+		td->trim_v = st->trim_v;
+	}
+
+	if (cfg->ldr_drives && !model && !diffuse) {
+		st->angle_v += pi_axis_update(&st->pi_v, &in->gains, e_v, on_v, cfg->dt_s);
+		st->angle_h += pi_axis_update(&st->pi_h, &in->gains, e_h, on_h, cfg->dt_s);
+	}
+
+	if (cfg->diffuse_flat && diffuse) {
+		st->angle_h = cfg->flat_h;
+		st->angle_v = cfg->flat_v;
+	}
+
+	bool perturbing = (io->perturb != NULL) && io->perturb(io->ctx, diffuse);
+
+	// Límites de seguridad (0 a 180 grados)
+	st->angle_v = clampf(st->angle_v, 0.0f, 180.0f);
+	st->angle_h = clampf(st->angle_h, 0.0f, 180.0f);
+
+	bool pays = true;
+	if (io->pays != NULL && tracker_needs_move(st, st->angle_h, st->angle_v, move_min)) {
+		// La primera orden, la posición horizontal y las perturbaciones del P&O no se evalúan
+		bool forced = diffuse || st->written_h < 0.0f || perturbing;
+		pays = forced || io->pays(io->ctx, st->angle_h - st->written_h, st->angle_v - st->written_v);
+		if (!pays) {
+			// Se queda donde está; el error pendiente crece hasta que compense
+			st->angle_h = prev_h;
+			st->angle_v = prev_v;
+			st->trim_h = prev_trim_h;
+			st->trim_v = prev_trim_v;
+		}
+	}
+
+	res->deferred = !pays;
+	res->moved = pays && tracker_command(st, io, st->angle_h, st->angle_v, move_min);
+	// Convergido: ni órdenes nuevas ni movimiento en curso
+	res->busy = res->moved || io->is_moving(io->ctx) || (perturbing && !diffuse);
+	res->diffuse = diffuse;
+	res->model = model;
+
+	td->angle_h = st->angle_h;
+	td->angle_v = st->angle_v;
+	td->sun_model = model;
+	td->diffuse = diffuse;
+	td->moves = st->moves;
+}
+
+void tracker_wake_ref(const tracker_state_t *st, const tracker_cfg_t *cfg, tracker_wake_ref_t *ref)
+{
+	*ref = (tracker_wake_ref_t){
+		.pos_h = st->angle_h, .pos_v = st->angle_v, .lo = 0.0f, .hi = 180.0f,
+		.ref_h = st->po_ref[PO_AXIS_H], .ref_v = st->po_ref[PO_AXIS_V],
+	};
+	if (cfg->sun_model && st->sun_active) {
+		ref->model = true;
+		ref->pos_h = st->trim_h;
+		ref->pos_v = st->trim_v;
+		ref->lo = -cfg->trim_max;
+		ref->hi = cfg->trim_max;
+	}
+}
+
+// true si un error e fuera de la banda movería el eje (no está ya en el tope en ese sentido)
+static bool axis_would_move(float e, float e_on, float pos, float lo, float hi)
+{
+	if (fabsf(e) <= e_on) return false;
+	return (e > 0.0f) ? (pos < hi) : (pos > lo);
+}
+
+bool tracker_wake_check(const tracker_wake_ref_t *ref, const tracker_cfg_t *cfg, const tracker_inputs_t *in)
+{
+	// Sólo manda la potencia del panel: los LDR no despiertan al tracker
+	if (!cfg->ldr_drives) return false;
+
+	int tolerance = in->calibrated ? cfg->tolerance_cal : cfg->tolerance;
+	float e_v = pi_norm_error(in->bot, in->top) - ref->ref_v;
+	float e_h = pi_norm_error(in->left, in->right) - ref->ref_h;
+	float on_v = pi_norm_threshold(tolerance, in->top, in->bot);
+	float on_h = pi_norm_threshold(tolerance, in->left, in->right);
+
+	// Con el modelo, los LDR sólo mueven el trim y sólo con luz suficiente
+	if (ref->model && (in->top + in->bot + in->left + in->right) / LDR_N < cfg->trim_min_raw) return false;
+
+	return axis_would_move(e_v, on_v, ref->pos_v, ref->lo, ref->hi) ||
+	       axis_would_move(e_h, on_h, ref->pos_h, ref->lo, ref->hi);
+}
@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+"""Genera ocv_table.h: curva OCV (tensión en reposo) frente al SoC de la batería.
+
+Lo invoca el CMakeLists del componente con los valores de sdkconfig.
+Cada química tiene unos puntos de referencia por celda; se interpolan con
+un spline cúbico monótono (Fritsch-Carlson, no oscila en las mesetas planas
+de LiFePO4 y plomo) sobre una rejilla uniforme de SoC y se escalan por el
+número de celdas en serie:
+    s_ocv_table[k] = OCV del pack con SoC = k / (OCV_TABLE_POINTS - 1)
+La tabla es estrictamente creciente: SoC -> OCV es un índice directo y
+OCV -> SoC una búsqueda binaria.
+"""
+
+import argparse
+
+# (SoC %, V por celda) en reposo a 25 °C
+CHEMISTRIES = {
+    # Curva original del proyecto (celda LiPo/Li-ion)
+    'liion': [
+        (0, 3.30), (10, 3.45), (20, 3.55), (30, 3.65), (40, 3.70), (50, 3.75),
+        (60, 3.80), (70, 3.90), (80, 4.00), (90, 4.10), (100, 4.20),
+    ],
+    # Meseta muy plana entre el 20 y el 90 %: hacen falta más puntos
+    'lifepo4': [
+        (0, 2.50), (5, 2.90), (10, 3.00), (20, 3.20), (30, 3.225), (40, 3.25),
+        (50, 3.26), (60, 3.275), (70, 3.29), (80, 3.315), (90, 3.335),
+        (99, 3.35), (100, 3.40),
+    ],
+    # Plomo-ácido (AGM/gel): casi lineal con la densidad del electrolito
+    'lead_acid': [
+        (0, 1.885), (10, 1.918), (20, 1.943), (30, 1.968), (40, 1.993),
+        (50, 2.017), (60, 2.040), (70, 2.062), (80, 2.083), (90, 2.103),
+        (100, 2.122),
+    ],
+}
+
+
+def pchip(xs, ys):
+    """Pendientes de un spline cúbico de Hermite monótono (Fritsch-Carlson)."""
+    n = len(xs)
+    h = [xs[i + 1] - xs[i] for i in range(n - 1)]
+    d = [(ys[i + 1] - ys[i]) / h[i] for i in range(n - 1)]
+    m = [0.0] * n
+    m[0], m[-1] = d[0], d[-1]
+    for i in range(1, n - 1):
+        if d[i - 1] * d[i] <= 0.0:
+            m[i] = 0.0
+        else:
+            w1 = 2.0 * h[i] + h[i - 1]
+            w2 = h[i] + 2.0 * h[i - 1]
+            m[i] = (w1 + w2) / (w1 / d[i - 1] + w2 / d[i])
+    return m
+
+
+def interp(xs, ys, m, x):
+    i = 0
+    while i < len(xs) - 2 and x > xs[i + 1]:
+        i += 1
+    h = xs[i + 1] - xs[i]
+    t = (x - xs[i]) / h
+    h00 = (1 + 2 * t) * (1 - t) ** 2
+    h10 = t * (1 - t) ** 2
+    h01 = t * t * (3 - 2 * t)
+    h11 = t * t * (t - 1)
+    return h00 * ys[i] + h10 * h * m[i] + h01 * ys[i + 1] + h11 * h * m[i + 1]
+
+
+def table(chem, cells, points):
+    xs = [p[0] for p in CHEMISTRIES[chem]]
+    ys = [p[1] for p in CHEMISTRIES[chem]]
+    m = pchip(xs, ys)
+    out = [round(interp(xs, ys, m, 100.0 * k / (points - 1)) * cells, 4) for k in range(points)]
+    for a, b in zip(out, out[1:]):
+        if b <= a:
+            raise SystemExit(f'gen_ocv_table: la curva {chem} no es estrictamente creciente')
+    return out
+
+
+def main():
+    p = argparse.ArgumentParser()
+    p.add_argument('--out', required=True)
+    p.add_argument('--chem', choices=sorted(CHEMISTRIES), required=True)
+    p.add_argument('--cells', type=int, default=1, help='Celdas en serie')
+    p.add_argument('--points', type=int, default=101, help='Puntos de la tabla (SoC uniforme)')
+    a = p.parse_args()
+
+    def fmt(values, per_line=8):
+        lines = []
+        for i in range(0, len(values), per_line):
+            lines.append('\t' + ', '.join(f'{v:.4f}f' for v in values[i:i + per_line]) + ',')
+        return '\n'.join(lines)
+
+    with open(a.out, 'w', encoding='utf-8') as f:
+        f.write('// Generado por tools/gen_ocv_table.py a partir de sdkconfig. No editar.\n')
+        f.write('#pragma once\n\n')
+        f.write(f'// {a.chem}, {a.cells} celda(s) en serie, OCV a 25 °C\n')
+        f.write(f'#define OCV_TABLE_POINTS  {a.points}\n\n')
+        f.write(f'static const float s_ocv_table[OCV_TABLE_POINTS] = {{\n{fmt(table(a.chem, a.cells, a.points))}\n}};\n')
+
+
+if __name__ == '__main__':
+    main()
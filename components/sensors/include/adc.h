@@ -1,6 +1,8 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
+#include "esp_err.h"
 
 #define LDR_MIN_OHM         CONFIG_LDR_MIN_OHM
 #define LDR_MAX_OHM         CONFIG_LDR_MAX_OHM
@@ -9,12 +11,32 @@
 
 // Estructura con los datso de cada LDR
 typedef struct {
-	int32_t raw;
+	int32_t raw;		// Cuentas corregidas con la calibración del canal
+	int32_t raw_adc;	// Cuentas del ADC sin corregir
 	int32_t voltage_mv;
-	float resistance_kohm;
+	uint32_t resistance_ohm;
+	uint32_t lux;
+	uint16_t irradiance_wm2;	// Estimada a partir de los lux (CONFIG_LDR_LUX_PER_WM2)
 } ldr_data_t;
 
-// Array global con las lecturas de los 4 LDRs
-extern ldr_data_t g_ldr_data[LDR_COUNT];
+// Calibración por canal: raw = gain * raw_adc + offset (gain en Q12, 4096 = 1.0)
+#define LDR_CAL_ONE         4096
 
-void adc_task(void *pvParameters);
\ No newline at end of file
+typedef struct {
+	int32_t gain_q12[LDR_COUNT];
+	int32_t offset[LDR_COUNT];
+	bool valid;
+} ldr_cal_t;
+
+void adc_task(void *pvParameters);
+
+// Aplica una calibración (NULL o !valid = sin corrección)
+void adc_ldr_cal_set(const ldr_cal_t *cal);
+void adc_ldr_cal_get(ldr_cal_t *out);
+
+// Media de raw_adc sobre varios barridos publicados (bloquea hasta tenerlos)
+esp_err_t adc_ldr_capture(int32_t out[LDR_COUNT], int scans);
+
+// Coeficientes para igualar todos los canales a su media.
+// Con dark == NULL se calibra solo la ganancia (un punto con luz uniforme).
+esp_err_t adc_ldr_cal_compute(const int32_t *dark, const int32_t *light, ldr_cal_t *out);
\ No newline at end of file
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Decodificación y diezmado de los buffers DMA del ADC en modo continuo.
+ * No depende de ESP-IDF: se puede probar en el PC con buffers sintéticos.
+ *
+ * Formato TYPE1 (ESP32): 2 bytes por conversión, little-endian,
+ * bits 11:0 = dato, bits 15:12 = canal.
+ */
+
+#define ADC_FRAME_RESULT_BYTES  2
+#define ADC_FRAME_ADC_CHANNELS  16	// Canales que caben en el campo de 4 bits
+#define ADC_FRAME_MAX_SLOTS     8
+#define ADC_FRAME_NO_SLOT       (-1)
+
+typedef struct {
+	uint32_t sum[ADC_FRAME_MAX_SLOTS];
+	uint32_t count[ADC_FRAME_MAX_SLOTS];
+	uint32_t discarded;		// Conversiones de canales que no están en el mapa
+} adc_frame_acc_t;
+
+// Traducción canal ADC -> posición en el frame (ADC_FRAME_NO_SLOT si no interesa)
+typedef struct {
+	int8_t slot[ADC_FRAME_ADC_CHANNELS];
+	uint8_t nslots;
+} adc_frame_map_t;
+
+void adc_frame_map_init(adc_frame_map_t *map, const uint8_t *channels, uint8_t nslots);
+
+void adc_frame_acc_reset(adc_frame_acc_t *acc);
+
+// Acumula todas las conversiones de un buffer DMA (len en bytes)
+void adc_frame_acc_feed(adc_frame_acc_t *acc, const adc_frame_map_t *map, const uint8_t *buf, uint32_t len);
+
+// true si todos los canales tienen al menos per_slot muestras
+bool adc_frame_acc_ready(const adc_frame_acc_t *acc, const adc_frame_map_t *map, uint32_t per_slot);
+
+// Media redondeada de cada canal (0 si un canal no tiene muestras)
+void adc_frame_acc_average(const adc_frame_acc_t *acc, const adc_frame_map_t *map, uint16_t *out);
@@ -1,42 +1,79 @@
 #pragma once
 
 #include "esp_err.h"
+#include "signal_stats.h"
+#include <stdbool.h>
 #include <stdint.h>
 
-typedef struct {
-	uint8_t i2c_addr;	// Direccion I2C del INA219 para ir cambiando
-	float current_lsb;  // Registro CURRENT
-	float power_lbs; 	// Registro POWER
-} ina219_t;
+// Familias de monitor de potencia soportadas
+typedef enum {
+	INA_CHIP_INA219 = 0,	// 12 bits, PGA, registros CURRENT/POWER
+	INA_CHIP_INA226,		// 16 bits, ALERT de conversión lista
+	INA_CHIP_INA3221,		// 3 canales, corriente calculada a partir del shunt
+	INA_CHIP_MAX
+} ina_chip_t;
+
+// Función de cada canal de medida. Como mucho un canal por función.
+typedef enum {
+    INA_ROLE_PANEL = 0,
+    INA_ROLE_BATTERY,
+    INA_ROLE_LOAD,
+    INA_ROLE_MPPT,
+    INA_ROLE_MAX
+} ina_role_t;
 
 typedef struct {
     float bus_voltage_V;
     float current_A;
     float power_W;
-} ina219_data_t;
-
-typedef enum {
-    INA219_DEVICE_PANEL = 0,
-    INA219_DEVICE_BATTERY,
-    INA219_DEVICE_MAX
-} ina219_device_t;
+} ina_data_t;
 
-extern ina219_data_t g_ina219_data[INA219_DEVICE_MAX];
+// Entrada de la tabla de canales (se construye desde Kconfig)
+typedef struct {
+	ina_role_t role;
+	ina_chip_t chip;
+	uint8_t i2c_addr;
+	uint8_t channel;		// 0..2 en INA3221, 0 en el resto
+	float shunt_ohms;
+	float max_current_A;	// Fondo de escala (INA219/INA226) o límite crítico (INA3221)
+	int alert_gpio;			// INA226: pin ALERT, -1 = sondeo del flag CVRF
+} ina_channel_cfg_t;
 
-extern float g_battery_soc;
+// Tiempo de bus (I2C) empleado en leer todos los INA en cada ciclo
+typedef struct {
+	uint32_t cycles;	// Ciclos medidos
+	uint32_t last_us;	// Último ciclo
+	uint32_t avg_us;	// Media móvil exponencial
+	uint32_t max_us;	// Peor caso
+	uint32_t freq_hz;	// Frecuencia SCL con la que se ha medido
+} ina_bus_stats_t;
 
-void ina_task(void *pvParameters);
+// Salud de un canal, para las alarmas de fallo de sensor
+typedef struct {
+	bool present;			// Chip inicializado y canal calibrado
+	uint32_t fail_streak;	// Ciclos seguidos con fallo de lectura
+	int64_t last_ok_us;		// Última muestra buena (esp_timer, 0: ninguna)
+} ina_channel_health_t;
 
+// Estadísticas de una ráfaga de muestreo rápido de un canal
+typedef struct {
+	signal_stats_t current_A;
+	signal_stats_t voltage_V;
+	float rate_hz;		// Muestras nuevas por segundo conseguidas
+	uint32_t window_ms;	// Duración real de la ventana
+} ina_burst_t;
 
-/* Inicia una instancia de INA219 con la direccion I2C dada
-esp_err_t ina219_init(ina219_t *dev, uint8_t i2c_addr, float shunt_ohms, float max_current_A);
+// pvParameters: i2c_master_bus_handle_t del bus donde cuelgan los INA
+void ina_task(void *pvParameters);
 
-// Lee el voltaje de BUS en voltios (VIN- respecto GND)
-esp_err_t ina219_read_bus_voltage(ina219_t *dev ,float *volts);
+void ina_get_bus_stats(ina_bus_stats_t *out);
 
-// Lee la corriente del registro CURRENT calibrado
-esp_err_t ina219_read_current(ina219_t *dev, float *current_A);
+// false si la función no tiene canal configurado
+bool ina_get_channel_health(ina_role_t role, ina_channel_health_t *out);
 
-// Lee la potencia del registro POWER calibrado
-esp_err_t ina219_read_power(ina219_t *dev, float *power_W);*/
+// Nombre legible ("Panel") y prefijo de telemetría ("solar") de cada función
+const char *ina_role_name(ina_role_t role);
+const char *ina_role_key(ina_role_t role);
 
+// true si la función tiene un canal configurado
+bool ina_role_configured(ina_role_t role);
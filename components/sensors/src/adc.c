@@ -8,13 +8,23 @@
 #include "freertos/projdefs.h"
 #include "freertos/task.h"
 #include "esp_log.h"
+#include "esp_attr.h"
+#if CONFIG_LDR_TABLE_BENCHMARK
+#include "esp_cpu.h"
+#endif
 
 #include "esp_adc/adc_oneshot.h"
 #include "esp_adc/adc_cali.h"
 #include "esp_adc/adc_cali_scheme.h"
+#if CONFIG_LDR_ADC_CONTINUOUS
+#include "esp_adc/adc_continuous.h"
+#include "adc_frame.h"
+#endif
 
 #include "adc.h"
-#include "protect.h"
+#include "snapshot.h"
+#include "pipeline.h"
+#include "ldr_table.h"	// Generado en el build (tools/gen_ldr_table.py)
 //#include "mqtt_protocol.h"
 //#include "http_protocol.h"
 
@@ -22,6 +32,10 @@ static const char *TAG = "ADC";
 
 #define ADC_ATTEN   		ADC_ATTEN_DB_12
 
+#define ADC_INIT_RETRY_MS	5000
+
+#define LDR_TABLE_MASK		((1u << LDR_TABLE_SHIFT) - 1)
+
 //#define PROTOCOL			CONFIG_SELECT_PROTOCOL
 
 
@@ -44,84 +58,277 @@ static const char *s_ldr_names[LDR_COUNT] = {
     "LDR4"
 };
 
-ldr_data_t g_ldr_data[LDR_COUNT];
-
-static adc_oneshot_unit_handle_t s_adc1_handle = NULL;
 static adc_cali_handle_t s_adc1_cali_handle = NULL;
 static bool s_adc_calibrated = false;
 
+// Calibración entre canales (la escribe la tarea HTTP, la lee adc_task)
+static ldr_cal_t s_ldr_cal = { .valid = false };
+static portMUX_TYPE s_ldr_cal_mux = portMUX_INITIALIZER_UNLOCKED;
+
+#define LDR_CAL_MIN_COUNTS	200		// Señal mínima de un punto de calibración
+#define LDR_CAL_GAIN_MIN	(LDR_CAL_ONE / 2)
+#define LDR_CAL_GAIN_MAX	(LDR_CAL_ONE * 2)
+#define LDR_CAPTURE_POLL_MS	50
+
+#if CONFIG_LDR_ADC_CONTINUOUS
+
+// 64 barridos del patrón por interrupción (256 conversiones, 12.8 ms a 20 kHz)
+#define ADC_CONV_FRAME_BYTES	(LDR_COUNT * ADC_FRAME_RESULT_BYTES * 64)
+#define ADC_POOL_BYTES			(ADC_CONV_FRAME_BYTES * 2)
+
+// Muestras de cada canal que se promedian en un frame publicado
+#define ADC_SAMPLES_PER_FRAME	((uint32_t)CONFIG_LDR_ADC_SAMPLE_FREQ_HZ * CONFIG_LDR_ADC_FRAME_MS / 1000 / LDR_COUNT)
+
+// Frames entre dos logs (mismo ritmo que el modo oneshot)
+#define ADC_LOG_EVERY_FRAMES	((CONFIG_TASK_ADC_PERIOD_MS + CONFIG_LDR_ADC_FRAME_MS - 1) / CONFIG_LDR_ADC_FRAME_MS)
 
-static void adc_hw_init(void);
+static adc_continuous_handle_t s_adc_cont = NULL;
+static adc_frame_map_t s_frame_map;
+static adc_frame_acc_t s_frame_acc;				// Solo lo toca el callback
+static uint16_t s_frame_avg[LDR_COUNT];			// Último frame completo
+static uint32_t s_frame_discarded = 0;
+static portMUX_TYPE s_frame_mux = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t s_adc_task = NULL;
+
+#else
+
+static adc_oneshot_unit_handle_t s_adc1_handle = NULL;
+
+#endif
+
+static esp_err_t adc_hw_init(void);
 static bool adc_calibration_init(adc_unit_t unit, adc_atten_t atten, adc_cali_handle_t *out_handle);
 // static void adc_calibration_deinit(adc_cali_handle_t handle);
-static int calc_ohm(int raw_data);
+static void ldr_fill(ldr_data_t *out, int adc_raw, const ldr_cal_t *cal, int ch);
+#if CONFIG_LDR_TABLE_BENCHMARK
+static void ldr_table_benchmark(void);
+#endif
 
 //#define PROTOCOL			CONFIG_SELECT_PROTOCOL
 
+#if CONFIG_LDR_ADC_CONTINUOUS
+
+/*
+ * Callback de fin de conversión (contexto de ISR). Diezma aquí mismo: solo
+ * despierta a la tarea cuando hay un frame promediado completo. En IRAM, como
+ * adc_frame.c (linker.lf), para seguir funcionando con la caché de flash desactivada.
+ */
+static bool IRAM_ATTR adc_conv_done_cb(adc_continuous_handle_t handle, const adc_continuous_evt_data_t *edata, void *user_data)
+{
+	BaseType_t woken = pdFALSE;
+
+	adc_frame_acc_feed(&s_frame_acc, &s_frame_map, edata->conv_frame_buffer, edata->size);
+
+	if (adc_frame_acc_ready(&s_frame_acc, &s_frame_map, ADC_SAMPLES_PER_FRAME)) {
+		portENTER_CRITICAL_ISR(&s_frame_mux);
+		adc_frame_acc_average(&s_frame_acc, &s_frame_map, s_frame_avg);
+		s_frame_discarded += s_frame_acc.discarded;
+		portEXIT_CRITICAL_ISR(&s_frame_mux);
+
+		adc_frame_acc_reset(&s_frame_acc);
+		vTaskNotifyGiveFromISR(s_adc_task, &woken);
+	}
+
+	return (woken == pdTRUE);
+}
+
 void adc_task(void *pvParameters) {
     (void) pvParameters;
-    
-    adc_hw_init();
+
+	s_adc_task = xTaskGetCurrentTaskHandle();
+
+#if CONFIG_LDR_TABLE_BENCHMARK
+	ldr_table_benchmark();
+#endif
+
+    while (adc_hw_init() != ESP_OK) {
+		vTaskDelay(pdMS_TO_TICKS(ADC_INIT_RETRY_MS));
+	}
+
+	uint32_t frames = 0;
+
+	while (1) {
+		// Se duerme hasta que el callback completa un frame
+		if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CONFIG_LDR_ADC_FRAME_MS * 5)) == 0) {
+			ESP_LOGW(TAG, "Sin frames del ADC continuo");
+			continue;
+		}
+
+		uint16_t avg[LDR_COUNT];
+		uint32_t discarded;
+
+		portENTER_CRITICAL(&s_frame_mux);
+		memcpy(avg, s_frame_avg, sizeof(avg));
+		discarded = s_frame_discarded;
+		portEXIT_CRITICAL(&s_frame_mux);
+
+		ldr_cal_t cal;
+		adc_ldr_cal_get(&cal);
+
+		ldr_snapshot_t snap = { .calibrated = cal.valid };
+		for (int i = 0; i < LDR_COUNT; i++) {
+			ldr_fill(&snap.ldr[i], avg[i], &cal, i);
+		}
+		snapshot_publish_ldr(&snap);
+
+		if ((frames++ % ADC_LOG_EVERY_FRAMES) == 0) {
+			for (int i = 0; i < LDR_COUNT; i++) {
+				ESP_LOGI(TAG, "%s -> Raw: %d, Voltage: %d mV, R: %lu Ohm, %lu lux",
+	                     s_ldr_names[i],
+	                     (int)snap.ldr[i].raw,
+	                     (int)snap.ldr[i].voltage_mv,
+	                     (unsigned long)snap.ldr[i].resistance_ohm,
+	                     (unsigned long)snap.ldr[i].lux);
+			}
+			if (discarded) ESP_LOGW(TAG, "%lu conversiones de canales inesperados", (unsigned long)discarded);
+		}
+	}
+}
+
+static esp_err_t adc_hw_init(void) {
+	adc_continuous_handle_cfg_t handle_cfg = {
+		.max_store_buf_size = ADC_POOL_BYTES,
+		.conv_frame_size = ADC_CONV_FRAME_BYTES,
+		.flags.flush_pool = 1,	// Los datos se consumen en el callback, no con adc_continuous_read
+	};
+	esp_err_t err = adc_continuous_new_handle(&handle_cfg, &s_adc_cont);
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "Error creando ADC continuo: %s", esp_err_to_name(err));
+		return err;
+	}
+
+	// Tabla de patrones: el hardware recorre CH4..CH7 sin intervención de la CPU
+	adc_digi_pattern_config_t pattern[LDR_COUNT] = {0};
+	uint8_t channels[LDR_COUNT];
+	for (int i = 0; i < LDR_COUNT; i++) {
+		pattern[i].atten = ADC_ATTEN;
+		pattern[i].channel = s_ldr_channels[i] & 0x7;
+		pattern[i].unit = ADC_UNIT_1;
+		pattern[i].bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+		channels[i] = (uint8_t)s_ldr_channels[i];
+	}
+	adc_frame_map_init(&s_frame_map, channels, LDR_COUNT);
+	adc_frame_acc_reset(&s_frame_acc);
+
+	adc_continuous_config_t dig_cfg = {
+		.pattern_num = LDR_COUNT,
+		.adc_pattern = pattern,
+		.sample_freq_hz = CONFIG_LDR_ADC_SAMPLE_FREQ_HZ,
+		.conv_mode = ADC_CONV_SINGLE_UNIT_1,
+		.format = ADC_DIGI_OUTPUT_FORMAT_TYPE1,
+	};
+
+	adc_continuous_evt_cbs_t cbs = {
+		.on_conv_done = adc_conv_done_cb,
+	};
+
+	if ((err = adc_continuous_config(s_adc_cont, &dig_cfg)) != ESP_OK ||
+	    (err = adc_continuous_register_event_callbacks(s_adc_cont, &cbs, NULL)) != ESP_OK) {
+		ESP_LOGE(TAG, "Error configurando ADC continuo: %s", esp_err_to_name(err));
+		return err;
+	}
+
+	s_adc_calibrated = adc_calibration_init(ADC_UNIT_1,
+                                            ADC_ATTEN,
+                                            &s_adc1_cali_handle);
+
+	err = adc_continuous_start(s_adc_cont);
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "Error arrancando ADC continuo: %s", esp_err_to_name(err));
+		return err;
+	}
+
+	ESP_LOGI(TAG, "ADC continuo: %d Hz, %lu muestras/canal por frame de %d ms",
+	         CONFIG_LDR_ADC_SAMPLE_FREQ_HZ, (unsigned long)ADC_SAMPLES_PER_FRAME, CONFIG_LDR_ADC_FRAME_MS);
+	return ESP_OK;
+}
+
+#else
+
+void adc_task(void *pvParameters) {
+    (void) pvParameters;
+
+#if CONFIG_LDR_TABLE_BENCHMARK
+	ldr_table_benchmark();
+#endif
+
+    while (adc_hw_init() != ESP_OK) {
+		vTaskDelay(pdMS_TO_TICKS(ADC_INIT_RETRY_MS));
+	}
+
+	// Se rellena el barrido completo y se publica una sola vez.
+	// Si un canal falla se mantiene su lectura anterior.
+	ldr_snapshot_t snap = {0};
+
    	while (1) {
+		// Mismo tick que los INA: luz y potencia del mismo instante
+		int64_t release_us = pipeline_wait(PIPELINE_STAGE_ADC);
+
+		ldr_cal_t cal;
+		adc_ldr_cal_get(&cal);
+		snap.calibrated = cal.valid;
+
 		for (int i = 0; i < LDR_COUNT; i++) {
 			int adc_raw = 0;
-			int adc_voltage = 0;
-			
-			ESP_ERROR_CHECK(adc_oneshot_read(s_adc1_handle, s_ldr_channels[i], &adc_raw));
-		
-			if(s_adc_calibrated)
-				ESP_ERROR_CHECK(adc_cali_raw_to_voltage(s_adc1_cali_handle, adc_raw, &adc_voltage));
-			else
-				adc_voltage = (int)((adc_raw * 3300) / 4095);
-			
-			int resistence_ohm = calc_ohm(adc_raw);
-			
-			if(g_data_mutex != NULL) {
-				if(xSemaphoreTake(g_data_mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
-					// Guardar en el array global
-					g_ldr_data[i].raw = adc_raw;
-					g_ldr_data[i].voltage_mv = adc_voltage;
-					g_ldr_data[i].resistance_kohm = resistence_ohm / 1000.0f;
-					
-					xSemaphoreGive(g_data_mutex);
-				}
+
+			esp_err_t err = adc_oneshot_read(s_adc1_handle, s_ldr_channels[i], &adc_raw);
+			if (err != ESP_OK) {
+				ESP_LOGW(TAG, "%s -> Error de lectura: %s", s_ldr_names[i], esp_err_to_name(err));
+				continue;
 			}
-			
-		
-			ESP_LOGI(TAG, "%s -> Raw: %d, Voltage: %d mV, R: %.2f kOhm",
+
+			ldr_fill(&snap.ldr[i], adc_raw, &cal, i);
+
+			ESP_LOGI(TAG, "%s -> Raw: %d, Voltage: %d mV, R: %lu Ohm, %lu lux",
                      s_ldr_names[i],
-                     g_ldr_data[i].raw,
-                     g_ldr_data[i].voltage_mv,
-                     g_ldr_data[i].resistance_kohm);
+                     (int)snap.ldr[i].raw,
+                     (int)snap.ldr[i].voltage_mv,
+                     (unsigned long)snap.ldr[i].resistance_ohm,
+                     (unsigned long)snap.ldr[i].lux);
 		}
-		vTaskDelay(pdMS_TO_TICKS(CONFIG_TASK_ADC_PERIOD_MS));
+
+		snap.sample_us = release_us;
+		snapshot_publish_ldr(&snap);
+
+		pipeline_done(PIPELINE_STAGE_ADC, release_us);
 	}
 }
 
-static void adc_hw_init(void) {
+static esp_err_t adc_hw_init(void) {
 	adc_oneshot_unit_init_cfg_t init_config1 = {
         .unit_id = ADC_UNIT_1,
     };
-    ESP_ERROR_CHECK(adc_oneshot_new_unit(&init_config1, &s_adc1_handle));
-    
+    esp_err_t err = adc_oneshot_new_unit(&init_config1, &s_adc1_handle);
+    if (err != ESP_OK) {
+		ESP_LOGE(TAG, "Error creando unidad ADC: %s", esp_err_to_name(err));
+		return err;
+	}
+
     adc_oneshot_chan_cfg_t config = {
         .bitwidth = ADC_BITWIDTH_DEFAULT,
         .atten = ADC_ATTEN,
     };
-    
+
     for (int i = 0; i < LDR_COUNT; i++) {
-        ESP_ERROR_CHECK(adc_oneshot_config_channel(s_adc1_handle, s_ldr_channels[i], &config));
+        err = adc_oneshot_config_channel(s_adc1_handle, s_ldr_channels[i], &config);
+        if (err != ESP_OK) {
+			ESP_LOGE(TAG, "Error configurando %s: %s", s_ldr_names[i], esp_err_to_name(err));
+			return err;
+		}
     }
 
 	s_adc_calibrated = adc_calibration_init(ADC_UNIT_1,
                                             ADC_ATTEN,
                                             &s_adc1_cali_handle);
+	return ESP_OK;
 }
 
+#endif
+
 static bool adc_calibration_init(adc_unit_t unit, adc_atten_t atten, adc_cali_handle_t *out_handle) {
     adc_cali_handle_t handle = NULL;
     esp_err_t ret = ESP_FAIL;
-    
+
     adc_cali_line_fitting_config_t cali_config = {
         .unit_id = unit,
         .atten = atten,
@@ -130,7 +337,7 @@ static bool adc_calibration_init(adc_unit_t unit, adc_atten_t atten, adc_cali_ha
     ret = adc_cali_create_scheme_line_fitting(&cali_config, &handle);
 
     *out_handle = handle;
-    
+
     if (ret == ESP_OK) {
         ESP_LOGI(TAG, "Calibration OK");
     } else {
@@ -146,6 +353,163 @@ static void adc_calibration_deinit(adc_cali_handle_t handle) {
 }
 */
 
-static int calc_ohm(int raw_data) {
+// Interpolación lineal entre dos nudos de la tabla, solo con enteros
+static inline uint32_t ldr_interp(const uint32_t *table, uint32_t idx, uint32_t frac) {
+	int32_t a = (int32_t)table[idx];
+	int32_t b = (int32_t)table[idx + 1];
+	return (uint32_t)(a + (((b - a) * (int32_t)frac) >> LDR_TABLE_SHIFT));
+}
+
+// raw -> mV (nominal), Ohm, lux e irradiancia a partir de las tablas generadas
+static void ldr_table_lookup(ldr_data_t *out, uint32_t adc_raw) {
+	if (adc_raw > 4095) adc_raw = 4095;
+
+	uint32_t idx = adc_raw >> LDR_TABLE_SHIFT;
+	uint32_t frac = adc_raw & LDR_TABLE_MASK;
+
+	int32_t mv_a = s_ldr_mv_table[idx];
+	int32_t mv_b = s_ldr_mv_table[idx + 1];
+
+	out->raw = (int32_t)adc_raw;
+	out->voltage_mv = mv_a + (((mv_b - mv_a) * (int32_t)frac) >> LDR_TABLE_SHIFT);
+	out->resistance_ohm = ldr_interp(s_ldr_ohm_table, idx, frac);
+	out->lux = ldr_interp(s_ldr_lux_table, idx, frac);
+	out->irradiance_wm2 = (uint16_t)(out->lux / CONFIG_LDR_LUX_PER_WM2);
+}
+
+// Corrige la dispersión entre LDRs (igual respuesta para igual luz)
+static int32_t ldr_apply_cal(const ldr_cal_t *cal, int ch, int32_t adc_raw) {
+	if (!cal->valid) return adc_raw;
+
+	int32_t v = ((cal->gain_q12[ch] * adc_raw + LDR_CAL_ONE / 2) >> 12) + cal->offset[ch];
+	if (v < 0) v = 0;
+	if (v > 4095) v = 4095;
+	return v;
+}
+
+// Convierte una lectura (o media) cruda. La tensión calibrada sustituye a la nominal.
+static void ldr_fill(ldr_data_t *out, int adc_raw, const ldr_cal_t *cal, int ch) {
+	int adc_voltage = 0;
+
+	// Resistencia y lux salen de las cuentas corregidas; la tensión es la medida real
+	ldr_table_lookup(out, (uint32_t)ldr_apply_cal(cal, ch, adc_raw));
+	out->raw_adc = adc_raw;
+
+	if (s_adc_calibrated && adc_cali_raw_to_voltage(s_adc1_cali_handle, adc_raw, &adc_voltage) == ESP_OK)
+		out->voltage_mv = adc_voltage;
+	else
+		out->voltage_mv = (adc_raw * 3300) / 4095;
+}
+
+void adc_ldr_cal_set(const ldr_cal_t *cal) {
+	portENTER_CRITICAL(&s_ldr_cal_mux);
+	if (cal != NULL) s_ldr_cal = *cal;
+	else s_ldr_cal.valid = false;
+	portEXIT_CRITICAL(&s_ldr_cal_mux);
+
+	if (cal != NULL && cal->valid) {
+		for (int i = 0; i < LDR_COUNT; i++) {
+			ESP_LOGI(TAG, "%s -> cal: gain %.3f, offset %ld", s_ldr_names[i],
+			         cal->gain_q12[i] / (float)LDR_CAL_ONE, (long)cal->offset[i]);
+		}
+	} else {
+		ESP_LOGI(TAG, "LDR sin calibración por canal");
+	}
+}
+
+void adc_ldr_cal_get(ldr_cal_t *out) {
+	portENTER_CRITICAL(&s_ldr_cal_mux);
+	*out = s_ldr_cal;
+	portEXIT_CRITICAL(&s_ldr_cal_mux);
+}
+
+esp_err_t adc_ldr_capture(int32_t out[LDR_COUNT], int scans) {
+	int64_t sum[LDR_COUNT] = {0};
+	uint32_t last_seq = 0;
+	int got = 0;
+
+	// Margen generoso: el modo oneshot publica cada CONFIG_TASK_ADC_PERIOD_MS
+	int timeout_ms = scans * (2 * CONFIG_TASK_ADC_PERIOD_MS + 1000);
+
+	while (got < scans && timeout_ms > 0) {
+		ldr_snapshot_t snap;
+		if (snapshot_read_ldr(&snap) && snap.seq != last_seq) {
+			if (last_seq != 0) {	// La primera puede ser antigua
+				for (int i = 0; i < LDR_COUNT; i++) sum[i] += snap.ldr[i].raw_adc;
+				got++;
+			}
+			last_seq = snap.seq;
+		}
+		vTaskDelay(pdMS_TO_TICKS(LDR_CAPTURE_POLL_MS));
+		timeout_ms -= LDR_CAPTURE_POLL_MS;
+	}
+
+	if (got < scans) return ESP_ERR_TIMEOUT;
+
+	for (int i = 0; i < LDR_COUNT; i++) out[i] = (int32_t)(sum[i] / scans);
+	return ESP_OK;
+}
+
+esp_err_t adc_ldr_cal_compute(const int32_t *dark, const int32_t *light, ldr_cal_t *out) {
+	int32_t ref_light = 0, ref_dark = 0;
+
+	for (int i = 0; i < LDR_COUNT; i++) {
+		ref_light += light[i];
+		if (dark) ref_dark += dark[i];
+	}
+	ref_light /= LDR_COUNT;
+	ref_dark /= LDR_COUNT;
+
+	for (int i = 0; i < LDR_COUNT; i++) {
+		int32_t span = light[i] - (dark ? dark[i] : 0);
+		if (span < LDR_CAL_MIN_COUNTS) {
+			ESP_LOGW(TAG, "%s: poca diferencia entre puntos (%ld cuentas)", s_ldr_names[i], (long)span);
+			return ESP_ERR_INVALID_STATE;
+		}
+
+		int32_t ref_span = ref_light - ref_dark;
+		int32_t gain = (int32_t)(((int64_t)ref_span * LDR_CAL_ONE + span / 2) / span);
+		if (gain < LDR_CAL_GAIN_MIN || gain > LDR_CAL_GAIN_MAX) {
+			ESP_LOGW(TAG, "%s: ganancia fuera de rango (%.2f)", s_ldr_names[i], gain / (float)LDR_CAL_ONE);
+			return ESP_ERR_INVALID_STATE;
+		}
+
+		out->gain_q12[i] = gain;
+		out->offset[i] = dark ? ref_dark - ((gain * dark[i] + LDR_CAL_ONE / 2) >> 12) : 0;
+	}
+
+	out->valid = true;
+	return ESP_OK;
+}
+
+#if CONFIG_LDR_TABLE_BENCHMARK
+
+// Cálculo anterior (lineal en cuentas y en double), solo como referencia
+static int calc_ohm_legacy(int raw_data) {
     return LDR_MAX_OHM - (LDR_MAX_OHM - LDR_MIN_OHM) * (raw_data / 4095.0);
-}
\ No newline at end of file
+}
+
+static void ldr_table_benchmark(void) {
+	volatile uint32_t sink = 0;	// Evita que el compilador elimine los bucles
+	volatile float sink_f = 0.0f;
+	ldr_data_t d;
+
+	uint32_t t0 = esp_cpu_get_cycle_count();
+	for (int raw = 0; raw <= 4095; raw++) {
+		int ohm = calc_ohm_legacy(raw);
+		sink_f = ohm / 1000.0f;
+	}
+	uint32_t t1 = esp_cpu_get_cycle_count();
+	for (int raw = 0; raw <= 4095; raw++) {
+		ldr_table_lookup(&d, (uint32_t)raw);
+		sink = d.resistance_ohm + d.lux;
+	}
+	uint32_t t2 = esp_cpu_get_cycle_count();
+
+	(void) sink;
+	(void) sink_f;
+	ESP_LOGI(TAG, "Conversión LDR: double %lu ciclos, tabla %lu ciclos (Ohm+lux+irradiancia)",
+	         (unsigned long)((t1 - t0) / 4096), (unsigned long)((t2 - t1) / 4096));
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,53 @@
+#include "adc_frame.h"
+
+#include <string.h>
+
+#define ADC_FRAME_DATA_MASK     0x0FFF
+#define ADC_FRAME_CHAN_SHIFT    12
+
+void adc_frame_map_init(adc_frame_map_t *map, const uint8_t *channels, uint8_t nslots)
+{
+	if (nslots > ADC_FRAME_MAX_SLOTS) nslots = ADC_FRAME_MAX_SLOTS;
+
+	memset(map->slot, ADC_FRAME_NO_SLOT, sizeof(map->slot));
+	for (uint8_t i = 0; i < nslots; i++) {
+		if (channels[i] < ADC_FRAME_ADC_CHANNELS) map->slot[channels[i]] = (int8_t)i;
+	}
+	map->nslots = nslots;
+}
+
+void adc_frame_acc_reset(adc_frame_acc_t *acc)
+{
+	memset(acc, 0, sizeof(*acc));
+}
+
+void adc_frame_acc_feed(adc_frame_acc_t *acc, const adc_frame_map_t *map, const uint8_t *buf, uint32_t len)
+{
+	for (uint32_t i = 0; i + ADC_FRAME_RESULT_BYTES <= len; i += ADC_FRAME_RESULT_BYTES) {
+		uint16_t word = (uint16_t)buf[i] | ((uint16_t)buf[i + 1] << 8);
+		int8_t slot = map->slot[word >> ADC_FRAME_CHAN_SHIFT];
+
+		if (slot == ADC_FRAME_NO_SLOT) {
+			acc->discarded++;
+			continue;
+		}
+
+		acc->sum[slot] += word & ADC_FRAME_DATA_MASK;
+		acc->count[slot]++;
+	}
+}
+
+bool adc_frame_acc_ready(const adc_frame_acc_t *acc, const adc_frame_map_t *map, uint32_t per_slot)
+{
+	for (uint8_t i = 0; i < map->nslots; i++) {
+		if (acc->count[i] < per_slot) return false;
+	}
+	return true;
+}
+
+void adc_frame_acc_average(const adc_frame_acc_t *acc, const adc_frame_map_t *map, uint16_t *out)
+{
+	for (uint8_t i = 0; i < map->nslots; i++) {
+		out[i] = acc->count[i] ? (uint16_t)((acc->sum[i] + acc->count[i] / 2) / acc->count[i]) : 0;
+	}
+}
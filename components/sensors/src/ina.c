@@ -1,33 +1,35 @@
 #include "freertos/idf_additions.h"
 #include "freertos/projdefs.h"
 
-#include "protect.h"
+#include "snapshot.h"
 #include "ina.h"
-#include "battery.h"
+#include "battery_state.h"
+#include "pipeline.h"
 
-#include "driver/i2c.h"
+#include "driver/gpio.h"
+#include "driver/i2c_master.h"
 
+#include "esp_attr.h"
 #include "esp_err.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "freertos/FreeRTOS.h"
 
+#include <math.h>
 #include <stdbool.h>
 #include <stdlib.h>
 
-static const char *TAG = "INA219";
-
-#define INA_PANEL_ADDR   CONFIG_INA_ADDR_PANEL
-#define INA_BAT_ADDR     CONFIG_INA_ADDR_BAT
-#define INA_RSHUNT_OHMS  strtof(CONFIG_SHUNT_RESISTOR_OHM, NULL)
-#define INA_PANEL_IMAX_A strtof(CONFIG_MAX_CURRENT_PANEL_A, NULL)
-#define INA_BAT_IMAX_A   strtof(CONFIG_MAX_CURRENT_BAT_A, NULL)
+static const char *TAG = "INA";
 
 // Configuracion de I2C
-#define I2C_MASTER_NUM I2C_NUM_0
-
+#define INA_I2C_TIMEOUT_MS  100
+#define INA_MAX_REGS        4	// Registros por canal en cada lote (INA226: MASK, BUS, CURRENT, POWER)
+#define INA_MAX_CHANNELS    INA_ROLE_MAX
+#define INA_MAX_DEVICES     INA_ROLE_MAX
 
-// Direcciones de registros
+// --- INA219 ---
 #define INA219_REG_CONFIG      0x00
 #define INA219_REG_SHUNT_VOLT  0x01
 #define INA219_REG_BUS_VOLT    0x02
@@ -35,43 +37,260 @@ static const char *TAG = "INA219";
 #define INA219_REG_CURRENT     0x04
 #define INA219_REG_CALIB       0x05
 
-#define BAT_CAPACITY_AH  strtof(CONFIG_BAT_CAPACITY_AH, NULL)
+// Campos del registro CONFIG
+#define INA219_CFG_RST         0x8000
+#define INA219_CFG_BRNG_32V    0x2000
+#define INA219_CFG_PG_SHIFT    11
+#define INA219_CFG_BADC_SHIFT  7
+#define INA219_CFG_SADC_SHIFT  3
+#define INA219_CFG_MODE_CONT   0x0007	// Shunt y bus en continuo
+
+// Bits de estado en el registro BUS_VOLT
+#define INA219_BUS_CNVR        0x0002	// Conversión nueva (se borra al leer POWER)
+#define INA219_BUS_OVF         0x0001	// Desbordamiento en CURRENT/POWER
+
+#define INA219_PGA_MAX         3	// /8 -> 320 mV
+#define INA219_PGA_DOWN_SAMPLES 60	// Muestras seguidas con poca corriente antes de bajar el PGA
+#define INA219_PGA_DOWN_FRAC   0.4f	// Fracción del rango inferior que se considera "poca"
+
+// --- INA226 ---
+#define INA226_REG_CONFIG      0x00
+#define INA226_REG_BUS_VOLT    0x02
+#define INA226_REG_POWER       0x03
+#define INA226_REG_CURRENT     0x04
+#define INA226_REG_CALIB       0x05
+#define INA226_REG_MASK        0x06
+
+#define INA226_CFG_AVG_SHIFT   9
+#define INA226_CFG_VBUSCT_SHIFT 6
+#define INA226_CFG_VSHCT_SHIFT 3
+#define INA226_CFG_CT_1100US   0x4	// Tiempo de conversión de bus y shunt
+#define INA226_CFG_CT_332US    0x2	// Ráfagas
+#define INA226_CFG_MODE_CONT   0x0007
+
+#define INA226_MASK_CNVR       0x0400	// ALERT se activa con cada conversión lista
+#define INA226_MASK_CVRF       0x0008	// Conversión lista (se borra al leer MASK)
+#define INA226_MASK_OVF        0x0004	// Desbordamiento en CURRENT/POWER
+
+// --- INA3221 ---
+#define INA3221_REG_CONFIG     0x00
+#define INA3221_REG_SHUNT(ch)  (0x01 + 2 * (ch))
+#define INA3221_REG_BUS(ch)    (0x02 + 2 * (ch))
+#define INA3221_REG_CRIT(ch)   (0x07 + 2 * (ch))
+#define INA3221_REG_MASK       0x0F
+
+#define INA3221_CFG_CH_EN(ch)  (0x4000 >> (ch))
+#define INA3221_CFG_AVG_SHIFT  9
+#define INA3221_CFG_VBUSCT_SHIFT 6
+#define INA3221_CFG_VSHCT_SHIFT 3
+#define INA3221_CFG_CT_1100US  0x4
+#define INA3221_CFG_CT_332US   0x2
+#define INA3221_CFG_MODE_CONT  0x0007
+
+#define INA3221_MASK_CVRF      0x0001
+
+typedef enum {
+	INA_SAMPLE_OK = 0,
+	INA_SAMPLE_STALE,	// Sin conversión nueva desde la última lectura
+	INA_SAMPLE_OVF,		// Corriente fuera de rango
+	INA_SAMPLE_FAIL,	// Error de bus
+} ina_sample_t;
+
+#if CONFIG_INA_BURST_ENABLE
+#define BURST_SPIKE_K_MIN  2.0f	// Por debajo se descartaría buena parte del ruido normal
+#define BURST_MIN_SAMPLES  8	// Menos muestras no dan percentiles con sentido
+#define BURST_MAX_FAILS    10
+#endif
+
+// --- Tabla de canales (Kconfig) ---
+// Los símbolos que dependen del chip elegido no existen si no aplican
+
+#ifdef CONFIG_INA_PANEL_CHANNEL
+#define INA_PANEL_CHANNEL    (CONFIG_INA_PANEL_CHANNEL - 1)
+#else
+#define INA_PANEL_CHANNEL    0
+#endif
+#ifdef CONFIG_INA_PANEL_ALERT_GPIO
+#define INA_PANEL_ALERT      CONFIG_INA_PANEL_ALERT_GPIO
+#else
+#define INA_PANEL_ALERT      -1
+#endif
+
+#ifdef CONFIG_INA_BAT_CHANNEL
+#define INA_BAT_CHANNEL      (CONFIG_INA_BAT_CHANNEL - 1)
+#else
+#define INA_BAT_CHANNEL      0
+#endif
+#ifdef CONFIG_INA_BAT_ALERT_GPIO
+#define INA_BAT_ALERT        CONFIG_INA_BAT_ALERT_GPIO
+#else
+#define INA_BAT_ALERT        -1
+#endif
+
+#ifdef CONFIG_INA_LOAD_CHANNEL
+#define INA_LOAD_CHANNEL     (CONFIG_INA_LOAD_CHANNEL - 1)
+#else
+#define INA_LOAD_CHANNEL     0
+#endif
+#ifdef CONFIG_INA_LOAD_ALERT_GPIO
+#define INA_LOAD_ALERT       CONFIG_INA_LOAD_ALERT_GPIO
+#else
+#define INA_LOAD_ALERT       -1
+#endif
+
+#ifdef CONFIG_INA_MPPT_CHANNEL
+#define INA_MPPT_CHANNEL     (CONFIG_INA_MPPT_CHANNEL - 1)
+#else
+#define INA_MPPT_CHANNEL     0
+#endif
+#ifdef CONFIG_INA_MPPT_ALERT_GPIO
+#define INA_MPPT_ALERT       CONFIG_INA_MPPT_ALERT_GPIO
+#else
+#define INA_MPPT_ALERT       -1
+#endif
+
+// Shunt y corriente máxima son cadenas de Kconfig: se parsean una sola vez al iniciar
+typedef struct {
+	ina_role_t role;
+	ina_chip_t chip;
+	uint8_t i2c_addr;
+	uint8_t channel;
+	const char *shunt_ohms;
+	const char *max_current_A;
+	int alert_gpio;
+} ina_channel_kconfig_t;
+
+static const ina_channel_kconfig_t s_channel_table[] = {
+	{ INA_ROLE_PANEL,   CONFIG_INA_PANEL_CHIP, CONFIG_INA_ADDR_PANEL, INA_PANEL_CHANNEL,
+	  CONFIG_INA_PANEL_SHUNT_OHM, CONFIG_MAX_CURRENT_PANEL_A, INA_PANEL_ALERT },
+	{ INA_ROLE_BATTERY, CONFIG_INA_BAT_CHIP,   CONFIG_INA_ADDR_BAT,   INA_BAT_CHANNEL,
+	  CONFIG_INA_BAT_SHUNT_OHM,   CONFIG_MAX_CURRENT_BAT_A,   INA_BAT_ALERT },
+#if CONFIG_INA_LOAD_ENABLE
+	{ INA_ROLE_LOAD,    CONFIG_INA_LOAD_CHIP,  CONFIG_INA_ADDR_LOAD,  INA_LOAD_CHANNEL,
+	  CONFIG_INA_LOAD_SHUNT_OHM,  CONFIG_MAX_CURRENT_LOAD_A,  INA_LOAD_ALERT },
+#endif
+#if CONFIG_INA_MPPT_ENABLE
+	{ INA_ROLE_MPPT,    CONFIG_INA_MPPT_CHIP,  CONFIG_INA_ADDR_MPPT,  INA_MPPT_CHANNEL,
+	  CONFIG_INA_MPPT_SHUNT_OHM,  CONFIG_MAX_CURRENT_MPPT_A,  INA_MPPT_ALERT },
+#endif
+};
+
+#define INA_TABLE_LEN  ((int)(sizeof(s_channel_table) / sizeof(s_channel_table[0])))
+
+static const char *s_role_names[INA_ROLE_MAX] = { "Panel", "Bateria", "Carga", "MPPT" };
+static const char *s_role_keys[INA_ROLE_MAX]  = { "solar", "battery", "load", "mppt" };
 
-ina219_data_t g_ina219_data[INA219_DEVICE_MAX];
-float g_battery_soc = 50.0f;
+// --- Estado en tiempo de ejecución ---
+
+// Chip físico (una dirección I2C). Un INA3221 puede dar servicio a varios canales.
+typedef struct {
+	ina_chip_t chip;
+	uint8_t i2c_addr;
+	i2c_master_dev_handle_t handle;
+	uint8_t pga;			// INA219: 0..3 -> /1 (40mV) /2 (80mV) /4 (160mV) /8 (320mV)
+	uint8_t pga_base;		// INA219: PGA inicial; al bajar no se pasa de aquí
+	uint16_t pga_low;		// INA219: muestras seguidas que cabrían en el rango inferior
+	bool pga_sat_logged;	// INA219: saturación en /8 ya avisada
+	uint8_t channel_mask;	// INA3221: canales habilitados
+	bool fresh;				// INA3221: CVRF leído por el canal primario en este lote
+	bool fast;				// Ráfaga en curso: conversión sin promediado
+	int alert_gpio;			// INA226: pin ALERT o -1
+	bool ready;				// Reset y CONFIG escritos (false: ausente o sin responder)
+} ina_dev_t;
+
+typedef struct {
+	ina_channel_cfg_t cfg;
+	ina_dev_t *dev;
+	uint8_t regs[INA_MAX_REGS];	// Registros del lote (deben vivir durante la transferencia)
+	uint8_t nregs;
+	bool reads_status;		// INA3221: el primer canal del chip lee MASK/ENABLE
+	float max_current_A;	// Rango actual (sube si el PGA del INA219 se amplía por OVF)
+	float current_lsb;		// Registro CURRENT
+	float power_lsb;		// Registro POWER
+	bool ready;				// Chip listo y canal calibrado: entra en los lotes
+} ina_channel_t;
+
+// Operaciones de cada familia de chip
+typedef struct {
+	const char *name;
+	esp_err_t (*configure)(ina_dev_t *dev);		// CONFIG del chip (tras el reset y al entrar/salir de ráfaga)
+	esp_err_t (*calibrate)(ina_channel_t *ch);	// CALIB / límites del canal
+	void (*setup_regs)(ina_channel_t *ch);		// Registros que se leen en cada lote
+	ina_sample_t (*decode)(ina_channel_t *ch, const uint16_t raw[], ina_data_t *out);
+	void (*on_overflow)(ina_channel_t *ch);		// Reacción a OVF (puede ser NULL)
+	void (*on_sample)(ina_channel_t *ch, const ina_data_t *d);	// Tras una muestra buena (puede ser NULL)
+	uint32_t (*conv_time_ms)(const ina_dev_t *dev);
+} ina_chip_ops_t;
+
+static ina_dev_t s_devs[INA_MAX_DEVICES];
+static int s_dev_count = 0;
+static ina_channel_t s_channels[INA_MAX_CHANNELS];
+static int s_channel_count = 0;
+
+
+static i2c_master_bus_handle_t s_bus = NULL;
+static SemaphoreHandle_t s_alert_sem = NULL;	// ALERT de conversión lista (INA226)
+
+// Lote de lecturas de un ciclo. Los buffers son estáticos porque en modo
+// asíncrono el driver escribe en ellos después de que la llamada haya vuelto.
+typedef struct {
+	uint8_t rx[INA_MAX_CHANNELS][INA_MAX_REGS][2];
+	volatile uint32_t pending;	// Transferencias aún en vuelo
+	volatile bool failed[INA_MAX_CHANNELS];
+	volatile int64_t t_end_us;	// Marca de la última transferencia completada
+	TaskHandle_t waiter;
+} ina_batch_t;
+
+static ina_batch_t s_batch;
+static portMUX_TYPE s_batch_mux = portMUX_INITIALIZER_UNLOCKED;
+#if CONFIG_I2C_ASYNC_BATCH
+static bool s_batch_async = true;	// false si el lote no cabe en la cola del driver
+#endif
+
+static ina_bus_stats_t s_bus_stats;
+static portMUX_TYPE s_stats_mux = portMUX_INITIALIZER_UNLOCKED;
+static ina_channel_health_t s_health[INA_ROLE_MAX];	// Protegido por s_stats_mux
 
 // Escribir un valor en un registro
-static esp_err_t ina219_write_reg(ina219_t *dev ,uint8_t reg, uint16_t value)
+static esp_err_t ina_write_reg(ina_dev_t *dev, uint8_t reg, uint16_t value)
 {
-	// INA219 tiene 6 registros, cada registro son de 16 bits
+	// Todos los registros de la familia son de 16 bits
 	uint8_t data[3];
 	data[0] = reg;
 	data[1] = (uint8_t)(value >> 8);
 	data[2] = (uint8_t)(value & 0xFF);
-	
-	// START -> direccion (0x40) -> byte de registro -> datos (MSB, LSB) -> STOP 
-	return i2c_master_write_to_device(I2C_MASTER_NUM, 
-									  dev->i2c_addr,
-									  data, 
-									  sizeof(data),
-									  pdMS_TO_TICKS(100));
+
+	// START -> direccion -> byte de registro -> datos (MSB, LSB) -> STOP
+	esp_err_t err = i2c_master_transmit(dev->handle, data, sizeof(data), INA_I2C_TIMEOUT_MS);
+
+#if CONFIG_I2C_ASYNC_BATCH
+	// En modo asíncrono hay que esperar: data[] vive en la pila
+	if (err == ESP_OK)
+		err = i2c_master_bus_wait_all_done(s_bus, INA_I2C_TIMEOUT_MS);
+#endif
+
+	return err;
 }
 
-static esp_err_t ina219_read_reg(ina219_t *dev ,uint8_t reg, uint16_t *value)
+static esp_err_t ina_read_reg(ina_dev_t *dev, uint8_t reg, uint16_t *value)
 {
     uint8_t buf[2];
 
     // Primero escribir el registro que quieres leer
-    esp_err_t err = i2c_master_write_read_device(
-        I2C_MASTER_NUM,
-        dev->i2c_addr,
-        &reg, 
+    esp_err_t err = i2c_master_transmit_receive(
+        dev->handle,
+        &reg,
 		1,        // escribir 1 byte: dirección del registro
-        buf, 
+        buf,
 		sizeof(buf),
-        pdMS_TO_TICKS(100)
+        INA_I2C_TIMEOUT_MS
     );
 
+#if CONFIG_I2C_ASYNC_BATCH
+    if (err == ESP_OK)
+        err = i2c_master_bus_wait_all_done(s_bus, INA_I2C_TIMEOUT_MS);
+#endif
+
     if (err != ESP_OK)
         return err;
 
@@ -81,189 +300,1077 @@ static esp_err_t ina219_read_reg(ina219_t *dev ,uint8_t reg, uint16_t *value)
     return ESP_OK;
 }
 
-static esp_err_t ina219_init(ina219_t *dev, uint8_t i2c_addr, float shunt_ohms, float max_current_A)
+// ---------------------------------------------------------------------------
+// INA219
+// ---------------------------------------------------------------------------
+
+// Rango de tensión de shunt de cada ganancia del PGA
+static float ina219_pga_range_V(uint8_t pga)
+{
+	return 0.04f * (float)(1 << pga);
+}
+
+// Código BADC/SADC para N muestras promediadas (12 bits). 1 -> 0011, 2..128 -> 1001..1111
+static uint16_t ina219_adc_code(int samples)
+{
+	if (samples <= 1) return 0x3;
+
+	uint16_t code = 0x8;
+	while (samples > 1 && code < 0xF) {
+		samples >>= 1;
+		code++;
+	}
+	return code;
+}
+
+// Tiempo (ms) de una conversión completa de shunt + bus con el promediado configurado
+static uint32_t ina219_conv_time_ms(const ina_dev_t *dev)
+{
+	(void) dev;
+	// 532 us por muestra de 12 bits, una vez para el shunt y otra para el bus
+	uint32_t us = 2 * 532 * CONFIG_INA_ADC_AVG_SAMPLES;
+	return (us + 999) / 1000;
+}
+
+static uint16_t ina219_config_word(const ina_dev_t *dev)
+{
+	// En ráfaga, una sola muestra de 12 bits (532 us)
+	uint16_t adc = ina219_adc_code(dev->fast ? 1 : CONFIG_INA_ADC_AVG_SAMPLES);
+	uint16_t config = INA219_CFG_MODE_CONT
+	                | (adc << INA219_CFG_BADC_SHIFT)
+	                | (adc << INA219_CFG_SADC_SHIFT)
+	                | ((uint16_t)dev->pga << INA219_CFG_PG_SHIFT);
+#if CONFIG_INA_BUS_RANGE_32V
+	config |= INA219_CFG_BRNG_32V;
+#endif
+	return config;
+}
+
+static esp_err_t ina219_configure(ina_dev_t *dev)
+{
+	return ina_write_reg(dev, INA219_REG_CONFIG, ina219_config_word(dev));
+}
+
+// Escribe CONFIG (rango, PGA, promediado) y recalcula CALIB para el rango actual
+static esp_err_t ina219_calibrate(ina_channel_t *ch)
 {
-	if (!dev) return ESP_ERR_INVALID_ARG;
-	dev->i2c_addr = i2c_addr;
+	ina_dev_t *dev = ch->dev;
 
-	// Resetea la configuracion de INA219 por si acaso de otros programas se ha quedado basura en el registro de configuracion
-	// Este bit (15 a 1).
-	esp_err_t err = ina219_write_reg(dev, INA219_REG_CONFIG, 0x8000);
+	uint16_t config = ina219_config_word(dev);
+	esp_err_t err = ina_write_reg(dev, INA219_REG_CONFIG, config);
 	if (err != ESP_OK) {
-		ESP_LOGI(TAG, "Error haciendo reset al INA219(0x%02X): %s",dev->i2c_addr, esp_err_to_name(err));
+		ESP_LOGI(TAG, "Error escribiendo CONFIG en INA219(0x%02X): %s", dev->i2c_addr, esp_err_to_name(err));
 		return err;
 	}
-	
-	// Haciendo un delay para darle tiempo a hacer el reset
-	vTaskDelay(pdMS_TO_TICKS(2));
 
 	// Current_LSB = Imax / 32767
-	float current_lsb = max_current_A / 32767.0f;
-	dev->current_lsb = current_lsb;
-	dev->power_lbs = 20.0f * current_lsb;
+	float current_lsb = ch->max_current_A / 32767.0f;
+	ch->current_lsb = current_lsb;
+	ch->power_lsb = 20.0f * current_lsb;
 
 	// Calibracion: Cal = trunc(0.04096 / (Current_LSB * Rshunt))
-	float calib_f = 0.04096f / (current_lsb * shunt_ohms);
+	float calib_f = 0.04096f / (current_lsb * ch->cfg.shunt_ohms);
 	if (calib_f > 65535.0f) calib_f = 65535.0f;
 	uint16_t calib = (uint16_t)(calib_f + 0.5f);
-	
-	err = ina219_write_reg(dev, INA219_REG_CALIB, calib);
+
+	err = ina_write_reg(dev, INA219_REG_CALIB, calib);
 	if (err != ESP_OK) {
-		ESP_LOGI(TAG, "Error escribiendo CALIB en INA219(0x%02X): %s",dev->i2c_addr, esp_err_to_name(err));
+		ESP_LOGI(TAG, "Error escribiendo CALIB en INA219(0x%02X): %s", dev->i2c_addr, esp_err_to_name(err));
 		return err;
 	}
-	
-	
-	ESP_LOGI(TAG, "INA219(0x%02X) calibrado: Rshunt=%.3fΩ, Imax=%.2fA, I_LSB=%.6fA, CAL=0x%04X", dev->i2c_addr, shunt_ohms, max_current_A, current_lsb, calib);
+
+	ESP_LOGI(TAG, "INA219(0x%02X) calibrado: Rshunt=%.3fΩ, Imax=%.2fA, PGA=/%d, AVG=%d, I_LSB=%.6fA, CONFIG=0x%04X, CAL=0x%04X",
+	         dev->i2c_addr, ch->cfg.shunt_ohms, ch->max_current_A, 1 << dev->pga,
+	         CONFIG_INA_ADC_AVG_SAMPLES, current_lsb, config, calib);
 	return ESP_OK;
 }
 
-static esp_err_t ina219_read_all(ina219_t *dev, float *v, float *i, float *p)
+static void ina219_setup_regs(ina_channel_t *ch)
+{
+#if CONFIG_INA_PGA_GAIN_AUTO
+	// Menor rango de shunt que cubre Imax*Rshunt (más resolución)
+	ch->dev->pga = 0;
+	while (ch->dev->pga < INA219_PGA_MAX &&
+	       ina219_pga_range_V(ch->dev->pga) < ch->max_current_A * ch->cfg.shunt_ohms)
+		ch->dev->pga++;
+#else
+	ch->dev->pga = CONFIG_INA_PGA_INDEX;
+#endif
+	ch->dev->pga_base = ch->dev->pga;
+	ch->dev->pga_low = 0;
+	ch->dev->pga_sat_logged = false;
+
+	// POWER el último: su lectura borra CNVR
+	ch->regs[0] = INA219_REG_BUS_VOLT;
+	ch->regs[1] = INA219_REG_CURRENT;
+	ch->regs[2] = INA219_REG_POWER;
+	ch->nregs = 3;
+}
+
+static ina_sample_t ina219_decode(ina_channel_t *ch, const uint16_t raw[], ina_data_t *out)
 {
-    uint16_t raw_v, raw_i, raw_p;
-    
-    // Lectura en bloque (o secuencial robusta)
-    if (ina219_read_reg(dev, INA219_REG_BUS_VOLT, &raw_v) != ESP_OK) return ESP_FAIL;
-    if (ina219_read_reg(dev, INA219_REG_CURRENT, &raw_i) != ESP_OK) return ESP_FAIL;
-    if (ina219_read_reg(dev, INA219_REG_POWER, &raw_p) != ESP_OK) return ESP_FAIL;
+	uint16_t raw_v = raw[0];
 
-    // Conversiones
-    *v = (float)(raw_v >> 3) * 0.004f;
-    *i = (float)((int16_t)raw_i) * dev->current_lsb;
-    *p = (float)raw_p * dev->power_lbs;
+    out->bus_voltage_V = (float)(raw_v >> 3) * 0.004f;
+    out->current_A = (float)((int16_t)raw[1]) * ch->current_lsb;
+    out->power_W = (float)raw[2] * ch->power_lsb;
 
-    return ESP_OK;
+    if (raw_v & INA219_BUS_OVF) return INA_SAMPLE_OVF;
+    if (!(raw_v & INA219_BUS_CNVR)) return INA_SAMPLE_STALE;
+    return INA_SAMPLE_OK;
 }
 
-static esp_err_t ina219_read_bus_voltage(ina219_t *dev, float *volts)
+// Ante OVF amplía el rango del PGA un paso y ajusta Imax/CALIB a ese rango
+static void ina219_step_pga(ina_channel_t *ch)
 {
-	if (!dev || !volts)
-		return 	ESP_ERR_INVALID_ARG;
+	ina_dev_t *dev = ch->dev;
 
-	uint16_t raw;
-	esp_err_t err = ina219_read_reg(dev, INA219_REG_BUS_VOLT, &raw);
-	if (err != ESP_OK)
+	dev->pga_low = 0;
+	if (dev->pga >= INA219_PGA_MAX) {
+		// Se avisa una vez; vuelve a avisar tras bajar de rango
+		if (!dev->pga_sat_logged) {
+			ESP_LOGW(TAG, "INA219(0x%02X) saturado incluso con PGA /8 (>%.2f A)", dev->i2c_addr, ch->max_current_A);
+			dev->pga_sat_logged = true;
+		}
+		return;
+	}
+
+	dev->pga++;
+	float range_A = ina219_pga_range_V(dev->pga) / ch->cfg.shunt_ohms;
+	if (range_A > ch->max_current_A) ch->max_current_A = range_A;
+
+	ESP_LOGW(TAG, "INA219(0x%02X) OVF -> PGA /%d, nuevo Imax=%.2f A", dev->i2c_addr, 1 << dev->pga, ch->max_current_A);
+	ina219_calibrate(ch);
+}
+
+// Vuelve al rango inferior (sin bajar del PGA inicial) tras INA219_PGA_DOWN_SAMPLES
+// muestras seguidas por debajo de INA219_PGA_DOWN_FRAC de ese rango
+static void ina219_check_pga(ina_channel_t *ch, const ina_data_t *d)
+{
+	ina_dev_t *dev = ch->dev;
+	if (dev->pga <= dev->pga_base) return;
+
+	float shunt_V = fabsf(d->current_A) * ch->cfg.shunt_ohms;
+	if (shunt_V >= INA219_PGA_DOWN_FRAC * ina219_pga_range_V(dev->pga - 1)) {
+		dev->pga_low = 0;
+		return;
+	}
+	if (++dev->pga_low < INA219_PGA_DOWN_SAMPLES) return;
+
+	dev->pga_low = 0;
+	dev->pga_sat_logged = false;
+	dev->pga--;
+	// En el PGA inicial se recupera el Imax de Kconfig; por encima, el del rango
+	float range_A = ina219_pga_range_V(dev->pga) / ch->cfg.shunt_ohms;
+	ch->max_current_A = (dev->pga == dev->pga_base || range_A < ch->cfg.max_current_A) ?
+	                    ch->cfg.max_current_A : range_A;
+
+	ESP_LOGI(TAG, "INA219(0x%02X) corriente baja -> PGA /%d, Imax=%.2f A", dev->i2c_addr, 1 << dev->pga, ch->max_current_A);
+	ina219_calibrate(ch);
+}
+
+// ---------------------------------------------------------------------------
+// INA226 / INA3221 (mismo campo AVG y tiempos de conversión)
+// ---------------------------------------------------------------------------
+
+// Código AVG para 1, 4, 16, 64, 128 muestras -> 0..4 (redondea hacia abajo)
+static uint16_t ina2xx_avg_code(int samples, int *actual)
+{
+	static const int s_avg[] = { 1, 4, 16, 64, 128 };
+	uint16_t code = 0;
+	while (code < 4 && s_avg[code + 1] <= samples) code++;
+	if (actual) *actual = s_avg[code];
+	return code;
+}
+
+static uint32_t ina226_conv_time_ms(const ina_dev_t *dev)
+{
+	(void) dev;
+	int avg;
+	ina2xx_avg_code(CONFIG_INA_ADC_AVG_SAMPLES, &avg);
+	uint32_t us = 2 * 1100 * avg;	// Shunt + bus
+	return (us + 999) / 1000;
+}
+
+static esp_err_t ina226_configure(ina_dev_t *dev)
+{
+	// En ráfaga: sin promediado y conversión de 332 us
+	uint16_t ct = dev->fast ? INA226_CFG_CT_332US : INA226_CFG_CT_1100US;
+	uint16_t config = INA226_CFG_MODE_CONT
+	                | (ina2xx_avg_code(dev->fast ? 1 : CONFIG_INA_ADC_AVG_SAMPLES, NULL) << INA226_CFG_AVG_SHIFT)
+	                | (ct << INA226_CFG_VBUSCT_SHIFT)
+	                | (ct << INA226_CFG_VSHCT_SHIFT);
+
+	esp_err_t err = ina_write_reg(dev, INA226_REG_CONFIG, config);
+	if (err != ESP_OK) return err;
+
+	// Con ALERT conectado, el pin se activa en cada conversión lista
+	uint16_t mask = (dev->alert_gpio >= 0) ? INA226_MASK_CNVR : 0;
+	return ina_write_reg(dev, INA226_REG_MASK, mask);
+}
+
+static esp_err_t ina226_calibrate(ina_channel_t *ch)
+{
+	// Current_LSB = Imax / 2^15, CAL = 0.00512 / (Current_LSB * Rshunt)
+	float current_lsb = ch->max_current_A / 32768.0f;
+	ch->current_lsb = current_lsb;
+	ch->power_lsb = 25.0f * current_lsb;
+
+	float calib_f = 0.00512f / (current_lsb * ch->cfg.shunt_ohms);
+	if (calib_f > 32767.0f) calib_f = 32767.0f;
+	uint16_t calib = (uint16_t)(calib_f + 0.5f);
+
+	esp_err_t err = ina_write_reg(ch->dev, INA226_REG_CALIB, calib);
+	if (err != ESP_OK) {
+		ESP_LOGI(TAG, "Error escribiendo CALIB en INA226(0x%02X): %s", ch->dev->i2c_addr, esp_err_to_name(err));
 		return err;
+	}
 
-	// Segun el datasheet:
-	// volts = (BUS << 3) * 4 / 1000
-	raw >>= 3;
-	*volts = (float)raw * (4.0 / 1000);
+	ESP_LOGI(TAG, "INA226(0x%02X) calibrado: Rshunt=%.3fΩ, Imax=%.2fA, I_LSB=%.6fA, CAL=0x%04X, ALERT=%d",
+	         ch->dev->i2c_addr, ch->cfg.shunt_ohms, ch->max_current_A, current_lsb, calib, ch->dev->alert_gpio);
+	return ESP_OK;
+}
+
+static void ina226_setup_regs(ina_channel_t *ch)
+{
+	// MASK primero: su lectura borra CVRF y libera el pin ALERT
+	ch->regs[0] = INA226_REG_MASK;
+	ch->regs[1] = INA226_REG_BUS_VOLT;
+	ch->regs[2] = INA226_REG_CURRENT;
+	ch->regs[3] = INA226_REG_POWER;
+	ch->nregs = 4;
+}
+
+static ina_sample_t ina226_decode(ina_channel_t *ch, const uint16_t raw[], ina_data_t *out)
+{
+	uint16_t mask = raw[0];
+
+	out->bus_voltage_V = (float)raw[1] * 0.00125f;
+	out->current_A = (float)((int16_t)raw[2]) * ch->current_lsb;
+	out->power_W = (float)raw[3] * ch->power_lsb;
 
+	if (mask & INA226_MASK_OVF) return INA_SAMPLE_OVF;
+	if (!(mask & INA226_MASK_CVRF)) return INA_SAMPLE_STALE;
+	return INA_SAMPLE_OK;
+}
+
+static void ina226_overflow(ina_channel_t *ch)
+{
+	// Rango de shunt fijo (81.92 mV): solo se puede avisar
+	ESP_LOGW(TAG, "INA226(0x%02X) desbordado (>%.2f A)", ch->dev->i2c_addr, ch->max_current_A);
+}
+
+static uint32_t ina3221_conv_time_ms(const ina_dev_t *dev)
+{
+	int avg, n = 0;
+	ina2xx_avg_code(CONFIG_INA_ADC_AVG_SAMPLES, &avg);
+	for (int c = 0; c < 3; c++) n += (dev->channel_mask >> c) & 1;
+	uint32_t us = 2 * 1100 * avg * n;	// Shunt + bus de cada canal habilitado
+	return (us + 999) / 1000;
+}
+
+static esp_err_t ina3221_configure(ina_dev_t *dev)
+{
+	uint16_t ct = dev->fast ? INA3221_CFG_CT_332US : INA3221_CFG_CT_1100US;
+	uint16_t config = INA3221_CFG_MODE_CONT
+	                | (ina2xx_avg_code(dev->fast ? 1 : CONFIG_INA_ADC_AVG_SAMPLES, NULL) << INA3221_CFG_AVG_SHIFT)
+	                | (ct << INA3221_CFG_VBUSCT_SHIFT)
+	                | (ct << INA3221_CFG_VSHCT_SHIFT);
+
+	// Solo se convierten los canales usados (acorta el ciclo)
+	for (int c = 0; c < 3; c++) {
+		if (dev->channel_mask & (1 << c)) config |= INA3221_CFG_CH_EN(c);
+	}
+
+	return ina_write_reg(dev, INA3221_REG_CONFIG, config);
+}
+
+static esp_err_t ina3221_calibrate(ina_channel_t *ch)
+{
+	// No hay CALIB: la corriente se calcula con el shunt. Se programa el
+	// límite crítico del canal (LSB 40 uV, bits 15:3) con Imax * Rshunt.
+	float limit_lsb = ch->max_current_A * ch->cfg.shunt_ohms / 40e-6f;
+	if (limit_lsb > 4095.0f) limit_lsb = 4095.0f;
+	uint16_t limit = (uint16_t)limit_lsb << 3;
+
+	esp_err_t err = ina_write_reg(ch->dev, INA3221_REG_CRIT(ch->cfg.channel), limit);
+	if (err != ESP_OK) {
+		ESP_LOGI(TAG, "Error escribiendo límite en INA3221(0x%02X): %s", ch->dev->i2c_addr, esp_err_to_name(err));
+		return err;
+	}
+
+	ESP_LOGI(TAG, "INA3221(0x%02X) canal %d: Rshunt=%.3fΩ, límite=%.2fA",
+	         ch->dev->i2c_addr, ch->cfg.channel + 1, ch->cfg.shunt_ohms, ch->max_current_A);
 	return ESP_OK;
 }
 
-static esp_err_t ina219_read_current(ina219_t *dev, float *current_A)
+static void ina3221_setup_regs(ina_channel_t *ch)
+{
+	uint8_t n = 0;
+	if (ch->reads_status) ch->regs[n++] = INA3221_REG_MASK;
+	ch->regs[n++] = INA3221_REG_SHUNT(ch->cfg.channel);
+	ch->regs[n++] = INA3221_REG_BUS(ch->cfg.channel);
+	ch->nregs = n;
+}
+
+static ina_sample_t ina3221_decode(ina_channel_t *ch, const uint16_t raw[], ina_data_t *out)
 {
-	if (!dev || !current_A)
-		return 	ESP_ERR_INVALID_ARG;
+	int i = 0;
+	if (ch->reads_status) ch->dev->fresh = (raw[i++] & INA3221_MASK_CVRF) != 0;
 
-	uint16_t raw_u;
-	esp_err_t err = ina219_read_reg(dev, INA219_REG_CURRENT, &raw_u);
-	if (err != ESP_OK)
+	float shunt_V = (float)((int16_t)raw[i++] >> 3) * 40e-6f;
+	out->bus_voltage_V = (float)((int16_t)raw[i] >> 3) * 0.008f;
+	out->current_A = shunt_V / ch->cfg.shunt_ohms;
+	out->power_W = fabsf(out->bus_voltage_V * out->current_A);
+
+	return ch->dev->fresh ? INA_SAMPLE_OK : INA_SAMPLE_STALE;
+}
+
+static const ina_chip_ops_t s_chip_ops[INA_CHIP_MAX] = {
+	[INA_CHIP_INA219] = {
+		.name = "INA219",
+		.configure = ina219_configure,	// calibrate también reescribe CONFIG (depende del PGA)
+		.calibrate = ina219_calibrate,
+		.setup_regs = ina219_setup_regs,
+		.decode = ina219_decode,
+		.on_overflow = ina219_step_pga,
+		.on_sample = ina219_check_pga,
+		.conv_time_ms = ina219_conv_time_ms,
+	},
+	[INA_CHIP_INA226] = {
+		.name = "INA226",
+		.configure = ina226_configure,
+		.calibrate = ina226_calibrate,
+		.setup_regs = ina226_setup_regs,
+		.decode = ina226_decode,
+		.on_overflow = ina226_overflow,
+		.conv_time_ms = ina226_conv_time_ms,
+	},
+	[INA_CHIP_INA3221] = {
+		.name = "INA3221",
+		.configure = ina3221_configure,
+		.calibrate = ina3221_calibrate,
+		.setup_regs = ina3221_setup_regs,
+		.decode = ina3221_decode,
+		.on_overflow = NULL,	// El límite crítico solo avisa
+		.conv_time_ms = ina3221_conv_time_ms,
+	},
+};
+
+// ---------------------------------------------------------------------------
+// Registro de canales
+// ---------------------------------------------------------------------------
+
+#if CONFIG_I2C_ASYNC_BATCH
+// Se ejecuta en contexto de ISR al terminar cada transferencia del lote
+static bool IRAM_ATTR ina_trans_done_cb(i2c_master_dev_handle_t handle, const i2c_master_event_data_t *evt, void *arg)
+{
+	BaseType_t woken = pdFALSE;
+	bool last = false;
+	(void) arg;
+
+	portENTER_CRITICAL_ISR(&s_batch_mux);
+	if (s_batch.pending > 0) {	// Si no, es una transferencia fuera de lote (init, lecturas sueltas)
+		if (evt->event != I2C_EVENT_DONE) {
+			// El callback es por chip: se marcan todos sus canales
+			for (int c = 0; c < s_channel_count; c++) {
+				if (s_channels[c].dev->handle == handle) s_batch.failed[c] = true;
+			}
+		}
+		last = (--s_batch.pending == 0);
+	}
+	portEXIT_CRITICAL_ISR(&s_batch_mux);
+
+	if (last) {
+		s_batch.t_end_us = esp_timer_get_time();
+		vTaskNotifyGiveFromISR(s_batch.waiter, &woken);
+	}
+
+	return (woken == pdTRUE);
+}
+#endif
+
+// ALERT del INA226 (conversión lista). La notificación de tarea ya la usa el
+// lote I2C, así que se señaliza con un semáforo binario.
+static void IRAM_ATTR ina_alert_isr(void *arg)
+{
+	BaseType_t woken = pdFALSE;
+	(void) arg;
+	xSemaphoreGiveFromISR(s_alert_sem, &woken);
+	if (woken == pdTRUE) portYIELD_FROM_ISR(woken);
+}
+
+// Devuelve el chip de esa dirección, creándolo si es la primera vez que aparece
+static ina_dev_t *ina_get_dev(ina_chip_t chip, uint8_t addr, bool *created)
+{
+	*created = false;
+	for (int d = 0; d < s_dev_count; d++) {
+		if (s_devs[d].i2c_addr == addr) {
+			if (s_devs[d].chip != chip)
+				ESP_LOGW(TAG, "Dirección 0x%02X configurada con chips distintos", addr);
+			return &s_devs[d];
+		}
+	}
+
+	ina_dev_t *dev = &s_devs[s_dev_count++];
+	dev->chip = chip;
+	dev->i2c_addr = addr;
+	dev->alert_gpio = -1;
+	*created = true;
+	return dev;
+}
+
+static esp_err_t ina_dev_init(ina_dev_t *dev)
+{
+	const char *name = s_chip_ops[dev->chip].name;
+
+	dev->ready = false;
+
+	// En un reintento el dispositivo ya está en el bus: solo se repiten reset y CONFIG
+	bool first = (dev->handle == NULL);
+	esp_err_t err;
+	if (first) {
+		i2c_device_config_t dev_cfg = {
+			.dev_addr_length = I2C_ADDR_BIT_LEN_7,
+			.device_address = dev->i2c_addr,
+			.scl_speed_hz = CONFIG_I2C_FREQ_HZ,
+		};
+
+		err = i2c_master_bus_add_device(s_bus, &dev_cfg, &dev->handle);
+		if (err != ESP_OK) {
+			ESP_LOGE(TAG, "No se pudo añadir %s(0x%02X) al bus: %s", name, dev->i2c_addr, esp_err_to_name(err));
+			dev->handle = NULL;
+			return err;
+		}
+
+#if CONFIG_I2C_ASYNC_BATCH
+		i2c_master_event_callbacks_t cbs = { .on_trans_done = ina_trans_done_cb };
+		err = i2c_master_register_event_callbacks(dev->handle, &cbs, NULL);
+		if (err != ESP_OK) return err;
+#endif
+	}
+
+	// Resetea la configuracion por si acaso de otros programas se ha quedado basura en el registro de configuracion
+	// El bit RST (15) del registro CONFIG es el mismo en los tres chips
+	err = ina_write_reg(dev, INA219_REG_CONFIG, INA219_CFG_RST);
+	if (err != ESP_OK) {
+		ESP_LOGI(TAG, "Error haciendo reset al %s(0x%02X): %s", name, dev->i2c_addr, esp_err_to_name(err));
 		return err;
+	}
+
+	// Haciendo un delay para darle tiempo a hacer el reset
+	vTaskDelay(pdMS_TO_TICKS(2));
+
+	if (s_chip_ops[dev->chip].configure) {
+		err = s_chip_ops[dev->chip].configure(dev);
+		if (err != ESP_OK) {
+			ESP_LOGI(TAG, "Error configurando %s(0x%02X): %s", name, dev->i2c_addr, esp_err_to_name(err));
+			return err;
+		}
+	}
 
-	int16_t raw_a = (int16_t)raw_u;
-	*current_A = (float)raw_a * dev->current_lsb;
+	dev->ready = true;
+
+	if (first && dev->alert_gpio >= 0) {
+		// ALERT es activo a nivel bajo y en drenador abierto
+		gpio_config_t io = {
+			.pin_bit_mask = 1ULL << dev->alert_gpio,
+			.mode = GPIO_MODE_INPUT,
+			.pull_up_en = GPIO_PULLUP_ENABLE,
+			.intr_type = GPIO_INTR_NEGEDGE,
+		};
+		gpio_config(&io);
+		gpio_install_isr_service(0);	// ESP_ERR_INVALID_STATE si ya estaba instalado
+		gpio_isr_handler_add(dev->alert_gpio, ina_alert_isr, dev);
+	}
 
 	return ESP_OK;
 }
 
-static esp_err_t ina219_read_power(ina219_t *dev, float *power_W)
+// Construye chips y canales a partir de la tabla de Kconfig y los inicializa
+static esp_err_t ina_registry_init(void)
 {
-	if (!dev || !power_W)
-		return 	ESP_ERR_INVALID_ARG;
+	for (int i = 0; i < INA_TABLE_LEN; i++) {
+		const ina_channel_kconfig_t *k = &s_channel_table[i];
+		ina_channel_t *ch = &s_channels[s_channel_count++];
+		bool created;
 
-	uint16_t raw_w;
-	esp_err_t err = ina219_read_reg(dev, INA219_REG_POWER, &raw_w);
-	if (err != ESP_OK)
-		return err;
+		ch->cfg.role = k->role;
+		ch->cfg.chip = k->chip;
+		ch->cfg.i2c_addr = k->i2c_addr;
+		ch->cfg.channel = k->channel;
+		ch->cfg.shunt_ohms = strtof(k->shunt_ohms, NULL);
+		ch->cfg.max_current_A = strtof(k->max_current_A, NULL);
+		ch->cfg.alert_gpio = k->alert_gpio;
+		ch->max_current_A = ch->cfg.max_current_A;
 
-	*power_W = (float)raw_w * dev->power_lbs;
+		ch->dev = ina_get_dev(k->chip, k->i2c_addr, &created);
+		ch->reads_status = created;	// Primer canal del chip
+		ch->dev->channel_mask |= (1 << k->channel);
+		if (k->chip == INA_CHIP_INA226 && k->alert_gpio >= 0) ch->dev->alert_gpio = k->alert_gpio;
+	}
+
+	if (s_alert_sem == NULL) s_alert_sem = xSemaphoreCreateBinary();
 
+	// Un chip que no responde deja sus canales ausentes; el resto sigue funcionando
+	esp_err_t ret = ESP_OK;
+	for (int d = 0; d < s_dev_count; d++) {
+		esp_err_t err = ina_dev_init(&s_devs[d]);
+		if (err != ESP_OK) ret = err;
+	}
+
+	for (int c = 0; c < s_channel_count; c++) {
+		ina_channel_t *ch = &s_channels[c];
+		const ina_chip_ops_t *ops = &s_chip_ops[ch->cfg.chip];
+
+		ops->setup_regs(ch);
+		esp_err_t err = ch->dev->ready ? ops->calibrate(ch) : ESP_ERR_INVALID_STATE;
+		ch->ready = (err == ESP_OK);
+		if (err != ESP_OK) {
+			ret = err;
+			ESP_LOGE(TAG, "Canal %s -> %s(0x%02X) ausente, se reintentará",
+			         s_role_names[ch->cfg.role], ops->name, ch->cfg.i2c_addr);
+			continue;
+		}
+
+		ESP_LOGI(TAG, "Canal %s -> %s(0x%02X)", s_role_names[ch->cfg.role], ops->name, ch->cfg.i2c_addr);
+	}
+
+#if CONFIG_I2C_ASYNC_BATCH
+	// Con la cola llena el driver rechaza las transferencias sobrantes y el lote fallaría en cada ciclo
+	uint32_t total = 0;
+	for (int c = 0; c < s_channel_count; c++) total += s_channels[c].nregs;
+	if (total > CONFIG_I2C_TRANS_QUEUE_DEPTH) {
+		ESP_LOGE(TAG, "El lote necesita %lu transferencias y la cola I2C admite %d "
+		         "(CONFIG_I2C_TRANS_QUEUE_DEPTH): se leerá registro a registro",
+		         (unsigned long)total, CONFIG_I2C_TRANS_QUEUE_DEPTH);
+		s_batch_async = false;
+	}
+#endif
+
+	return ret;
+}
+
+// Peor tiempo de conversión entre todos los chips
+static uint32_t ina_max_conv_time_ms(void)
+{
+	uint32_t t = 1;
+	for (int d = 0; d < s_dev_count; d++) {
+		uint32_t td = s_chip_ops[s_devs[d].chip].conv_time_ms(&s_devs[d]);
+		if (td > t) t = td;
+	}
+	return t;
+}
+
+static bool ina_has_alert(void)
+{
+	for (int d = 0; d < s_dev_count; d++) {
+		if (s_devs[d].alert_gpio >= 0) return true;
+	}
+	return false;
+}
+
+// Lectura secuencial de un único canal (arranque)
+static esp_err_t ina_read_channel(ina_channel_t *ch, ina_data_t *out)
+{
+	uint16_t raw[INA_MAX_REGS];
+
+	for (int r = 0; r < ch->nregs; r++) {
+		if (ina_read_reg(ch->dev, ch->regs[r], &raw[r]) != ESP_OK) return ESP_FAIL;
+	}
+
+	s_chip_ops[ch->cfg.chip].decode(ch, raw, out);
 	return ESP_OK;
 }
 
-void ina_task(void *pvParameters) 
+static void ina_bus_stats_add(uint32_t bus_us)
+{
+	portENTER_CRITICAL(&s_stats_mux);
+	s_bus_stats.cycles++;
+	s_bus_stats.last_us = bus_us;
+	if (bus_us > s_bus_stats.max_us) s_bus_stats.max_us = bus_us;
+	// EMA con alfa = 1/8
+	if (s_bus_stats.cycles == 1) s_bus_stats.avg_us = bus_us;
+	else s_bus_stats.avg_us = s_bus_stats.avg_us - (s_bus_stats.avg_us >> 3) + (bus_us >> 3);
+	portEXIT_CRITICAL(&s_stats_mux);
+}
+
+void ina_get_bus_stats(ina_bus_stats_t *out)
+{
+	portENTER_CRITICAL(&s_stats_mux);
+	*out = s_bus_stats;
+	portEXIT_CRITICAL(&s_stats_mux);
+}
+
+bool ina_get_channel_health(ina_role_t role, ina_channel_health_t *out)
+{
+	if (!ina_role_configured(role)) return false;
+	portENTER_CRITICAL(&s_stats_mux);
+	*out = s_health[role];
+	portEXIT_CRITICAL(&s_stats_mux);
+	return true;
+}
+
+// Actualiza la salud de todos los canales con el resultado del ciclo
+static void ina_health_update(const ina_sample_t status[], int64_t sample_us)
+{
+	portENTER_CRITICAL(&s_stats_mux);
+	for (int i = 0; i < s_channel_count; i++) {
+		ina_channel_health_t *h = &s_health[s_channels[i].cfg.role];
+		h->present = s_channels[i].ready;
+		if (status[i] == INA_SAMPLE_OK) {
+			h->fail_streak = 0;
+			h->last_ok_us = sample_us;
+		} else if (status[i] == INA_SAMPLE_FAIL) {
+			h->fail_streak++;
+		}
+	}
+	portEXIT_CRITICAL(&s_stats_mux);
+}
+
+const char *ina_role_name(ina_role_t role)
+{
+	return (role < INA_ROLE_MAX) ? s_role_names[role] : "?";
+}
+
+const char *ina_role_key(ina_role_t role)
+{
+	return (role < INA_ROLE_MAX) ? s_role_keys[role] : "unknown";
+}
+
+bool ina_role_configured(ina_role_t role)
+{
+	for (int i = 0; i < INA_TABLE_LEN; i++) {
+		if (s_channel_table[i].role == role) return true;
+	}
+	return false;
+}
+
+/*
+ * Lee los registros de los canales indicados en un solo lote.
+ * Con CONFIG_I2C_ASYNC_BATCH las transferencias se encolan en el driver
+ * y la tarea duerme hasta que el callback de la última la despierta. Sin él
+ * se hace la lectura secuencial bloqueante (una transacción por registro).
+ * mask: bit i = canal i de s_channels. account: sumar el tiempo a ina_bus_stats
+ * (las ráfagas no cuentan, falsearían el coste de un ciclo normal).
+ */
+static void ina_read_batch(uint32_t mask, bool account, ina_data_t out[], ina_sample_t status[])
+{
+	int64_t t_start = esp_timer_get_time();
+	int64_t t_end;
+
+#if CONFIG_I2C_ASYNC_BATCH
+	if (s_batch_async) {
+		uint32_t total = 0;
+		for (int c = 0; c < s_channel_count; c++) {
+			s_batch.failed[c] = false;
+			if (mask & (1u << c)) total += s_channels[c].nregs;
+		}
+
+		s_batch.waiter = xTaskGetCurrentTaskHandle();
+		s_batch.t_end_us = 0;
+		s_batch.pending = total;
+		ulTaskNotifyTake(pdTRUE, 0);	// Descartar notificaciones viejas
+
+		uint32_t queued = 0;
+		for (int c = 0; c < s_channel_count; c++) {
+			if (!(mask & (1u << c))) continue;
+			ina_channel_t *ch = &s_channels[c];
+
+			for (int r = 0; r < ch->nregs; r++) {
+				if (i2c_master_transmit_receive(ch->dev->handle, &ch->regs[r], 1,
+				                                s_batch.rx[c][r], 2, INA_I2C_TIMEOUT_MS) == ESP_OK) {
+					queued++;
+				} else {
+					s_batch.failed[c] = true;
+				}
+			}
+		}
+
+		// Las que no se llegaron a encolar no van a generar callback
+		portENTER_CRITICAL(&s_batch_mux);
+		s_batch.pending -= total - queued;
+		bool done = (s_batch.pending == 0);
+		portEXIT_CRITICAL(&s_batch_mux);
+
+		if (!done && ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(INA_I2C_TIMEOUT_MS)) == 0) {
+			// Timeout: vaciar la cola antes de reutilizar los buffers
+			i2c_master_bus_wait_all_done(s_bus, INA_I2C_TIMEOUT_MS);
+			portENTER_CRITICAL(&s_batch_mux);
+			s_batch.pending = 0;
+			portEXIT_CRITICAL(&s_batch_mux);
+			for (int c = 0; c < s_channel_count; c++) s_batch.failed[c] = true;
+		}
+
+		t_end = (s_batch.t_end_us != 0) ? s_batch.t_end_us : esp_timer_get_time();
+	} else
+#endif
+	{
+		for (int c = 0; c < s_channel_count; c++) {
+			if (!(mask & (1u << c))) continue;
+			ina_channel_t *ch = &s_channels[c];
+
+			bool ch_ok = true;
+			for (int r = 0; r < ch->nregs && ch_ok; r++) {
+				esp_err_t err = i2c_master_transmit_receive(ch->dev->handle, &ch->regs[r], 1,
+				                                            s_batch.rx[c][r], 2, INA_I2C_TIMEOUT_MS);
+#if CONFIG_I2C_ASYNC_BATCH
+				// Bus asíncrono: una transferencia en vuelo cada vez
+				if (err == ESP_OK) err = i2c_master_bus_wait_all_done(s_bus, INA_I2C_TIMEOUT_MS);
+#endif
+				ch_ok = (err == ESP_OK);
+			}
+			s_batch.failed[c] = !ch_ok;
+		}
+
+		t_end = esp_timer_get_time();
+	}
+
+	if (account) ina_bus_stats_add((uint32_t)(t_end - t_start));
+
+	// Se decodifica en orden de tabla: el canal primario de un INA3221 va antes que el resto
+	for (int c = 0; c < s_channel_count; c++) {
+		if (!(mask & (1u << c))) continue;
+		ina_channel_t *ch = &s_channels[c];
+
+		if (s_batch.failed[c]) {
+			status[c] = INA_SAMPLE_FAIL;
+			continue;
+		}
+
+		uint16_t raw[INA_MAX_REGS];
+		for (int r = 0; r < ch->nregs; r++) {
+			raw[r] = ((uint16_t)s_batch.rx[c][r][0] << 8) | s_batch.rx[c][r][1];
+		}
+		status[c] = s_chip_ops[ch->cfg.chip].decode(ch, raw, &out[c]);
+	}
+}
+
+// En un INA3221 el estado lo lee su canal primario: hay que incluirlo en el lote
+static uint32_t ina_add_status_readers(uint32_t mask)
+{
+	for (int i = 0; i < s_channel_count; i++) {
+		if (!(mask & (1u << i)) || s_channels[i].cfg.chip != INA_CHIP_INA3221) continue;
+		for (int j = 0; j < s_channel_count; j++) {
+			if (s_channels[j].dev == s_channels[i].dev && s_channels[j].reads_status)
+				mask |= (1u << j);
+		}
+	}
+	return mask;
+}
+
+// Canales de mask que están listos para leerse
+static uint32_t ina_ready_mask(uint32_t mask)
+{
+	for (int c = 0; c < s_channel_count; c++) {
+		if (!s_channels[c].ready) mask &= ~(1u << c);
+	}
+	return mask;
+}
+
+/*
+ * Reintenta un canal que ha dejado de responder: reset y CONFIG del chip y
+ * calibración de todos sus canales (el reset también borra la de los demás).
+ */
+static esp_err_t ina_channel_reinit(ina_channel_t *ch)
 {
-	(void) pvParameters;
+	ina_dev_t *dev = ch->dev;
+	esp_err_t ret = ina_dev_init(dev);
+
+	for (int c = 0; c < s_channel_count; c++) {
+		ina_channel_t *o = &s_channels[c];
+		if (o->dev != dev) continue;
+
+		esp_err_t err = ret;
+		if (err == ESP_OK) {
+			s_chip_ops[o->cfg.chip].setup_regs(o);
+			o->max_current_A = o->cfg.max_current_A;
+			err = s_chip_ops[o->cfg.chip].calibrate(o);
+		}
+		o->ready = (err == ESP_OK);
+	}
+	return ch->ready ? ESP_OK : ESP_FAIL;
+}
+
+#if CONFIG_INA_BURST_ENABLE
+
+// Buffers circulares de la ráfaga: un slot por canal de panel/batería
+#define BURST_SLOTS  2
+
+static ina_data_t s_burst_ring[BURST_SLOTS][CONFIG_INA_BURST_SAMPLES];
+static float s_burst_work[CONFIG_INA_BURST_SAMPLES];	// Copia que se ordena al reducir
+static float s_burst_scratch[CONFIG_INA_BURST_SAMPLES];	// Desviaciones para la MAD
+static float s_spike_k;
+
+/*
+ * CONFIG_INA_BURST_SPIKE_K se lee una vez: 0 desactiva el rechazo, negativo no es válido.
+ * Devuelve false si la ventana no cabe en un periodo de ina_task (bloquearía el pipeline).
+ */
+static bool ina_burst_init(void)
+{
+	if (CONFIG_INA_BURST_WINDOW_MS >= CONFIG_TASK_INA_PERIOD_MS) {
+		ESP_LOGE(TAG, "INA_BURST_WINDOW_MS=%d no es menor que el periodo INA (%d ms): ráfagas desactivadas",
+		         CONFIG_INA_BURST_WINDOW_MS, CONFIG_TASK_INA_PERIOD_MS);
+		return false;
+	}
+
+	s_spike_k = strtof(CONFIG_INA_BURST_SPIKE_K, NULL);
+	if (s_spike_k < 0.0f) {
+		ESP_LOGE(TAG, "INA_BURST_SPIKE_K=%s no válido: rechazo de picos desactivado", CONFIG_INA_BURST_SPIKE_K);
+		s_spike_k = 0.0f;
+	} else if (s_spike_k > 0.0f && s_spike_k < BURST_SPIKE_K_MIN) {
+		ESP_LOGW(TAG, "INA_BURST_SPIKE_K=%s demasiado bajo: se usa %.1f", CONFIG_INA_BURST_SPIKE_K, BURST_SPIKE_K_MIN);
+		s_spike_k = BURST_SPIKE_K_MIN;
+	}
+	return true;
+}
+
+static void ina_set_fast(uint32_t mask, bool fast)
+{
+	for (int d = 0; d < s_dev_count; d++) {
+		ina_dev_t *dev = &s_devs[d];
+		bool used = false;
+		for (int c = 0; c < s_channel_count; c++) {
+			if ((mask & (1u << c)) && s_channels[c].dev == dev) used = true;
+		}
+		if (!used || dev->fast == fast) continue;
+
+		dev->fast = fast;
+		if (s_chip_ops[dev->chip].configure(dev) != ESP_OK)
+			ESP_LOGW(TAG, "No se pudo cambiar el modo de %s(0x%02X)", s_chip_ops[dev->chip].name, dev->i2c_addr);
+	}
+}
+
+/*
+ * Muestrea panel y batería sin promediado durante CONFIG_INA_BURST_WINDOW_MS,
+ * guardando solo conversiones nuevas, y reduce cada canal a estadísticas.
+ */
+static void ina_burst_run(ina_snapshot_t *snap)
+{
+	int slot_ch[BURST_SLOTS];
+	uint32_t head[BURST_SLOTS] = {0}, count[BURST_SLOTS] = {0};
+	uint32_t fresh[BURST_SLOTS] = {0};
+	int nslots = 0;
+	uint32_t mask = 0;
+
+	for (int c = 0; c < s_channel_count && nslots < BURST_SLOTS; c++) {
+		ina_role_t role = s_channels[c].cfg.role;
+		if (s_channels[c].ready && (role == INA_ROLE_PANEL || role == INA_ROLE_BATTERY)) {
+			slot_ch[nslots++] = c;
+			mask |= (1u << c);
+		}
+	}
+	if (nslots == 0) return;
+	mask = ina_add_status_readers(mask);
+
+	ina_set_fast(mask, true);
+	vTaskDelay(pdMS_TO_TICKS(2));	// Primera conversión rápida
+
+	ina_data_t data[INA_MAX_CHANNELS];
+	ina_sample_t status[INA_MAX_CHANNELS];
+	int fails = 0;
+
+	int64_t t0 = esp_timer_get_time();
+	int64_t t_end = t0 + (int64_t)CONFIG_INA_BURST_WINDOW_MS * 1000;
+	int64_t now = t0;
+
+	while (now < t_end && fails < BURST_MAX_FAILS) {
+		ina_read_batch(mask, false, data, status);
+
+		for (int s = 0; s < nslots; s++) {
+			int c = slot_ch[s];
+			if (status[c] == INA_SAMPLE_FAIL) {
+				fails++;
+				continue;
+			}
+			// STALE: el bus va más rápido que el ADC, se ignora la repetición
+			if (status[c] != INA_SAMPLE_OK) continue;
+
+			s_burst_ring[s][head[s]] = data[c];
+			head[s] = (head[s] + 1) % CONFIG_INA_BURST_SAMPLES;
+			if (count[s] < CONFIG_INA_BURST_SAMPLES) count[s]++;
+			fresh[s]++;
+		}
+		now = esp_timer_get_time();
+	}
+
+	ina_set_fast(mask, false);
 
-	ina219_t dev_panel;
-	ina219_t dev_battery;
+	uint32_t window_ms = (uint32_t)((now - t0) / 1000);
+	if (fails >= BURST_MAX_FAILS) ESP_LOGW(TAG, "Ráfaga abortada por fallos de bus");
+
+	for (int s = 0; s < nslots; s++) {
+		ina_role_t role = s_channels[slot_ch[s]].cfg.role;
+		snap->burst_valid[role] = false;
+		if (count[s] < BURST_MIN_SAMPLES) continue;
+
+		ina_burst_t *b = &snap->burst[role];
+
+		for (uint32_t i = 0; i < count[s]; i++) s_burst_work[i] = s_burst_ring[s][i].current_A;
+		signal_stats_compute(s_burst_work, count[s], s_spike_k, s_burst_scratch, &b->current_A);
+
+		for (uint32_t i = 0; i < count[s]; i++) s_burst_work[i] = s_burst_ring[s][i].bus_voltage_V;
+		signal_stats_compute(s_burst_work, count[s], s_spike_k, s_burst_scratch, &b->voltage_V);
+
+		b->window_ms = window_ms;
+		b->rate_hz = window_ms ? (1000.0f * fresh[s] / window_ms) : 0.0f;
+		snap->burst_valid[role] = true;
+
+		ESP_LOGI(TAG, "Ráfaga %s: %lu muestras @%.0f Hz, I=[%.3f..%.3f] A rms %.3f, picos %u",
+		         s_role_names[role], (unsigned long)count[s], b->rate_hz,
+		         b->current_A.min, b->current_A.max, b->current_A.rms, b->current_A.rejected);
+	}
+	snap->burst_timestamp_us = now;
+}
+
+#endif
+
+void ina_task(void *pvParameters)
+{
+	s_bus = (i2c_master_bus_handle_t) pvParameters;
 
 	// Contadores de fallos
-    int fail_count[INA219_DEVICE_MAX] = {0, 0};
+    int fail_count[INA_MAX_CHANNELS] = {0};
     const int MAX_FAILURES = 10;
 
-	ESP_ERROR_CHECK(ina219_init(&dev_panel, INA_PANEL_ADDR, INA_RSHUNT_OHMS, INA_PANEL_IMAX_A));
-	ESP_ERROR_CHECK(ina219_init(&dev_battery, INA_BAT_ADDR, INA_RSHUNT_OHMS, INA_BAT_IMAX_A));
+	s_bus_stats.freq_hz = CONFIG_I2C_FREQ_HZ;
+
+	// Un canal ausente no detiene la tarea: se marca y se reintenta en el bucle
+	if (ina_registry_init() != ESP_OK) ESP_LOGE(TAG, "Algún INA no ha arrancado; se sigue con el resto");
 
-	ina219_t* devices[INA219_DEVICE_MAX] = { &dev_panel, &dev_battery };
+	const uint32_t all_mask = (1u << s_channel_count) - 1;
+	const bool use_alert = ina_has_alert();
+	const uint32_t conv_ms = ina_max_conv_time_ms();
 
-	// Estimación inicial del SoC
-    float v_start = 0, i_dum, p_dum;
-    if(ina219_read_all(&dev_battery, &v_start, &i_dum, &p_dum) == ESP_OK && v_start > 1.0f) {
-        g_battery_soc = battery_porcent_from_voltage(v_start);
-        ESP_LOGI(TAG, "SoC inicial (por voltaje): %.1f%%", g_battery_soc);
-    }
+	// Estado de la batería: RTC/NVS o, si no hay, tensión de la primera conversión promediada
+	vTaskDelay(pdMS_TO_TICKS(conv_ms));
+	float v_bat_init = 0.0f;
+	for (int c = 0; c < s_channel_count; c++) {
+		ina_data_t d;
+		if (s_channels[c].cfg.role == INA_ROLE_BATTERY && s_channels[c].ready &&
+		    ina_read_channel(&s_channels[c], &d) == ESP_OK) {
+	        v_bat_init = d.bus_voltage_V;
+	    }
+	}
+	battery_state_init(v_bat_init);
+
+	// Última lectura buena de cada función (se mantiene si un ciclo falla)
+	ina_snapshot_t snap = {0};
+#if CONFIG_INA_BURST_ENABLE
+	uint32_t burst_cycle = 0;
+	const bool burst_on = ina_burst_init();
+#endif
 
 	while(1) {
+		// Todas las lecturas del ciclo llevan la marca del tick compartido
+		int64_t release_us = pipeline_wait(PIPELINE_STAGE_INA);
+
 		// Variables locales para almacenar lecturas temporalmente
-        ina219_data_t local_data[INA219_DEVICE_MAX];
-        bool read_ok[INA219_DEVICE_MAX] = {false, false};
-
-		for (int i = 0; i < INA219_DEVICE_MAX; i++) {
-			if (fail_count[i] > MAX_FAILURES) {
-                // Podríamos intentar reinicializar aquí
-                // ina219_init(devices[i], ...);
-                fail_count[i] = 0; // Reset counter para reintentar
-                ESP_LOGW(TAG, "Reintentando sensor INA %d tras fallos...", i);
+        ina_data_t local_data[INA_MAX_CHANNELS];
+        ina_sample_t status[INA_MAX_CHANNELS];
+
+		for (int i = 0; i < s_channel_count; i++) {
+			if (fail_count[i] >= MAX_FAILURES) {
+				// La última lectura buena ya no vale: se retira y se reinicializa el chip
+				ina_role_t role = s_channels[i].cfg.role;
+				snap.valid[role] = false;
+				fail_count[i] = 0; // Siguiente intento tras otros MAX_FAILURES ciclos
+				esp_err_t err = ina_channel_reinit(&s_channels[i]);
+				ESP_LOGW(TAG, "Canal %s sin lecturas tras %d fallos: reinicio %s",
+				         s_role_names[role], MAX_FAILURES, (err == ESP_OK) ? "correcto" : "fallido");
+			}
+		}
+
+		// INA226 con ALERT: esperar a la interrupción de conversión lista en vez de sondear
+		if (use_alert) xSemaphoreTake(s_alert_sem, pdMS_TO_TICKS(2 * conv_ms + 10));
+
+		// Leer sensores (un lote para todos los canales listos; los ausentes cuentan como fallo)
+		uint32_t read_mask = ina_ready_mask(all_mask);
+		for (int i = 0; i < s_channel_count; i++) {
+			if (!(read_mask & (1u << i))) status[i] = INA_SAMPLE_FAIL;
+		}
+		if (read_mask) ina_read_batch(read_mask, true, local_data, status);
+
+		// Si algún canal no tenía conversión nueva, se espera una conversión y se
+		// repite solo para esos (releer los demás borraría su flag de conversión)
+		uint32_t stale_mask = 0;
+		for (int i = 0; i < s_channel_count; i++) {
+			if (status[i] == INA_SAMPLE_STALE) stale_mask |= (1u << i);
+		}
+
+		if (stale_mask) {
+			ina_data_t retry_data[INA_MAX_CHANNELS];
+			ina_sample_t retry_status[INA_MAX_CHANNELS];
+
+			stale_mask = ina_ready_mask(ina_add_status_readers(stale_mask));
+			vTaskDelay(pdMS_TO_TICKS(conv_ms));
+			ina_read_batch(stale_mask, true, retry_data, retry_status);
+
+			for (int i = 0; i < s_channel_count; i++) {
+				if (stale_mask & (1u << i)) {
+					status[i] = retry_status[i];
+					local_data[i] = retry_data[i];
+				}
 			}
+		}
+
+		if (use_alert) xSemaphoreTake(s_alert_sem, 0);	// Flancos anteriores a la lectura de MASK
 
-            // Leer sensores
-            if(ina219_read_all(devices[i], 
-                               &local_data[i].bus_voltage_V, 
-                               &local_data[i].current_A, 
-                               &local_data[i].power_W) == ESP_OK) 
-            {
-                read_ok[i] = true;
+		for (int i = 0; i < s_channel_count; i++) {
+			ina_channel_t *ch = &s_channels[i];
+			ina_role_t role = ch->cfg.role;
+
+            switch (status[i]) {
+            case INA_SAMPLE_OK:
                 fail_count[i] = 0;
-            } else {
-                read_ok[i] = false;
+                snap.ch[role] = local_data[i];
+                snap.valid[role] = true;
+                if (s_chip_ops[ch->cfg.chip].on_sample) s_chip_ops[ch->cfg.chip].on_sample(ch, &local_data[i]);
+
+                // El servicio de batería integra con el dt medido entre muestras
+                if (role == INA_ROLE_BATTERY) {
+                    battery_state_update(local_data[i].bus_voltage_V, local_data[i].current_A);
+                }
+                break;
+            case INA_SAMPLE_OVF:
+                // Muestra saturada: se descarta y el chip reacciona (p.ej. ampliar PGA)
+                if (s_chip_ops[ch->cfg.chip].on_overflow) s_chip_ops[ch->cfg.chip].on_overflow(ch);
+                break;
+            case INA_SAMPLE_STALE:
+                // Sin conversión nueva: se mantiene la anterior, no es un fallo
+                break;
+            case INA_SAMPLE_FAIL:
                 fail_count[i]++;
                 // Solo loguear error de vez en cuando para no saturar
-                if(fail_count[i] == 1) ESP_LOGW(TAG, "Fallo lectura INA %d", i);
+                if(fail_count[i] == 1) ESP_LOGW(TAG, "Fallo lectura canal %s", s_role_names[role]);
+                break;
             }
         }
+		ina_health_update(status, release_us);
 
-		// Robustez 2.C: Actualización del SoC aquí (cada 1s preciso)
-        if (read_ok[INA219_DEVICE_BATTERY]) {
-            // Asumiendo que esta tarea corre cada 1000ms
-            g_battery_soc = battery_soc_update(
-                g_battery_soc, 
-                local_data[INA219_DEVICE_BATTERY].bus_voltage_V, 
-                local_data[INA219_DEVICE_BATTERY].current_A, 
-                1.0f, // dt = 1 segundo exacto
-                BAT_CAPACITY_AH
-            );
-        }
+		ina_bus_stats_t st;
+		ina_get_bus_stats(&st);
+		if ((st.cycles % 60) == 1) {
+			ESP_LOGI(TAG, "Bus I2C @%lu Hz: %lu us/ciclo (media %lu, max %lu)",
+			         (unsigned long)st.freq_hz, (unsigned long)st.last_us,
+			         (unsigned long)st.avg_us, (unsigned long)st.max_us);
+		}
 
-		// Tomar Mutex UNA sola vez para actualizar todo
-		if(g_data_mutex != NULL) {
-			if(xSemaphoreTake(g_data_mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
-				for(int i=0; i<INA219_DEVICE_MAX; i++) {
-                    if(read_ok[i]) {
-                        g_ina219_data[i] = local_data[i];
-                    }
-                }
-				xSemaphoreGive(g_data_mutex);
-			}
+#if CONFIG_INA_BURST_ENABLE
+		if (burst_on && ++burst_cycle >= CONFIG_INA_BURST_EVERY_N_CYCLES) {
+			burst_cycle = 0;
+			ina_burst_run(&snap);
 		}
+#endif
 
-		vTaskDelay(pdMS_TO_TICKS(CONFIG_TASK_INA_PERIOD_MS));
+		// Publicar UNA sola vez todo el ciclo (sin bloquear a los lectores)
+		battery_state_t bat;
+		battery_state_get(&bat);
+		snap.battery_soc = bat.soc;
+		snap.battery_soc_sigma = bat.soc_sigma;
+		snap.sample_us = release_us;
+		snapshot_publish_ina(&snap);
+
+		pipeline_done(PIPELINE_STAGE_INA, release_us);
 	}
 }
-
-
-
-
@@ -0,0 +1,65 @@
+#!/usr/bin/env python3
+"""Genera ldr_table.h: tablas en punto fijo raw -> mV -> Ohm -> lux de los LDR.
+
+Lo invoca el CMakeLists del componente con los valores de sdkconfig.
+El LDR está en el lado alto del divisor (3V3 - LDR - ADC - Rdiv - GND):
+    R_ldr = Rdiv * (4095 - raw) / raw
+y la curva del LDR es una recta en log-log entre los dos extremos de Kconfig:
+    (Rmin, lux_min_ohm)  luz directa
+    (Rmax, lux_max_ohm)  oscuridad
+"""
+
+import argparse
+import math
+
+ADC_MAX = 4095
+VREF_MV = 3300
+
+
+def main():
+    p = argparse.ArgumentParser()
+    p.add_argument('--out', required=True)
+    p.add_argument('--r-min', type=float, required=True, help='Resistencia mínima (luz directa)')
+    p.add_argument('--r-max', type=float, required=True, help='Resistencia máxima (oscuridad)')
+    p.add_argument('--r-div', type=float, required=True, help='Resistencia fija del divisor')
+    p.add_argument('--lux-at-min', type=float, required=True, help='Lux con Rmin')
+    p.add_argument('--lux-at-max', type=float, required=True, help='Lux con Rmax')
+    p.add_argument('--shift', type=int, default=4, help='log2 de cuentas por tramo')
+    a = p.parse_args()
+
+    step = 1 << a.shift
+    knots = ADC_MAX // step + 2  # Un nudo extra para interpolar hasta 4095
+
+    # R = Rmax * (lux / lux_max) ^ -gamma
+    gamma = math.log(a.r_max / a.r_min) / math.log(a.lux_at_min / a.lux_at_max)
+
+    mv, ohm, lux = [], [], []
+    for k in range(knots):
+        raw = min(k * step, ADC_MAX)
+        mv.append(round(raw * VREF_MV / ADC_MAX))
+
+        r = a.r_max if raw == 0 else a.r_div * (ADC_MAX - raw) / raw
+        r = min(max(r, a.r_min), a.r_max)
+        ohm.append(round(r))
+
+        lux.append(round(a.lux_at_max * (a.r_max / r) ** (1.0 / gamma)))
+
+    def fmt(values, per_line=8):
+        lines = []
+        for i in range(0, len(values), per_line):
+            lines.append('\t' + ', '.join(str(v) for v in values[i:i + per_line]) + ',')
+        return '\n'.join(lines)
+
+    with open(a.out, 'w', encoding='utf-8') as f:
+        f.write('// Generado por tools/gen_ldr_table.py a partir de sdkconfig. No editar.\n')
+        f.write('#pragma once\n\n#include <stdint.h>\n\n')
+        f.write(f'// Rmin={a.r_min:g} Rmax={a.r_max:g} Rdiv={a.r_div:g} lux=[{a.lux_at_max:g}..{a.lux_at_min:g}] gamma={gamma:.3f}\n')
+        f.write(f'#define LDR_TABLE_SHIFT  {a.shift}\n')
+        f.write(f'#define LDR_TABLE_KNOTS  {knots}\n\n')
+        f.write(f'static const uint16_t s_ldr_mv_table[LDR_TABLE_KNOTS] = {{\n{fmt(mv)}\n}};\n\n')
+        f.write(f'static const uint32_t s_ldr_ohm_table[LDR_TABLE_KNOTS] = {{\n{fmt(ohm)}\n}};\n\n')
+        f.write(f'static const uint32_t s_ldr_lux_table[LDR_TABLE_KNOTS] = {{\n{fmt(lux)}\n}};\n')
+
+
+if __name__ == '__main__':
+    main()
@@ -1,6 +1,10 @@
 #ifndef SERVO_CONTROL_H
 #define SERVO_CONTROL_H
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
 #include "driver/ledc.h"
 
 // Configuración PWM Servo
@@ -13,10 +17,51 @@
 #define SERVO_MAX_PULSE_US     2500
 #define SERVO_MAX_DEGREE       180
 
+// Ejes que se pueden mover a la vez con servo_move()
+#define SERVO_MAX_AXES         4
+
 // Inicializa un servo en un pin y canal específico
-void servo_init(int gpio_pin, ledc_channel_t channel);
+esp_err_t servo_init(int gpio_pin, ledc_channel_t channel);
+
+// Mueve el servo de golpe (sin perfil). No escribe si el duty no cambia.
+esp_err_t servo_set_angle(ledc_channel_t channel, float angle);
+
+/*
+ * Mueve varios ejes a la vez con un perfil trapezoidal o en S (Kconfig) limitado
+ * por CONFIG_SERVO_MAX_VEL_DPS y CONFIG_SERVO_MAX_ACC_DPS2. Todos los ejes llegan
+ * a la vez. Los tramos los ejecuta el fade hardware del LEDC; la CPU sólo
+ * interviene al final de cada tramo.
+ *
+ * No bloquea: la orden sustituye a la pendiente y un movimiento en curso se
+ * replanifica desde su posición actual al terminar el tramo.
+ */
+esp_err_t servo_move(const ledc_channel_t *channels, const float *angles, size_t n);
+
+// true mientras haya un movimiento en curso o pendiente
+bool servo_is_moving(void);
+
+// Último ángulo alcanzado por el servo (-1 si no se ha movido nunca)
+float servo_get_angle(ledc_channel_t channel);
+
+/*
+ * Reposo: detiene los pulsos PWM de todos los servos y, si hay CONFIG_SERVO_POWER_GPIO,
+ * corta su alimentación. Falla con ESP_ERR_INVALID_STATE si hay un movimiento en curso
+ * o una orden pendiente.
+ */
+esp_err_t servo_power_down(void);
+
+// Devuelve la alimentación y reanuda los pulsos en la última posición
+esp_err_t servo_power_up(void);
+
+bool servo_is_powered(void);
+
+// Tiempo total en movimiento desde el arranque (ms)
+uint32_t servo_motion_ms(void);
+
+// true si el último movimiento estaba en curso en el instante t_us (esp_timer)
+bool servo_was_moving_at(int64_t t_us);
 
-// Mueve el servo
-void servo_set_angle(ledc_channel_t channel, float angle);
+// Duración del perfil para un recorrido de dist_deg grados (ms)
+uint32_t servo_move_time_ms(float dist_deg);
 
 #endif
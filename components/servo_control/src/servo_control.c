@@ -1,9 +1,271 @@
 #include "servo_control.h"
 
+#include <math.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "driver/gpio.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#if CONFIG_PM_ENABLE
+#include "esp_pm.h"
+#endif
+
+static const char *TAG = "SERVO";
+
+#define MAX_VEL_DPS        ((float)CONFIG_SERVO_MAX_VEL_DPS)
+#define MAX_ACC_DPS2       ((float)CONFIG_SERVO_MAX_ACC_DPS2)
+#define ACC_SEGMENTS       CONFIG_SERVO_PROFILE_SEGMENTS
+#define MAX_SEGMENTS       (2 * ACC_SEGMENTS + 1)
+
+// El LEDC sólo cambia el duty una vez por periodo PWM: tramos más cortos no aportan nada
+#define PWM_PERIOD_MS      (1000 / SERVO_FREQ_HZ)
+#define MIN_SEGMENT_MS     (2 * PWM_PERIOD_MS)
+
+// Margen sobre la duración del tramo antes de dar el fade por perdido
+#define FADE_TIMEOUT_MS    100
+
+// Orden de movimiento coordinado
+typedef struct {
+    ledc_channel_t channel[SERVO_MAX_AXES];
+    float angle[SERVO_MAX_AXES];
+    size_t n;
+} servo_cmd_t;
+
+// Perfil normalizado: instante final de cada tramo y fracción del recorrido alcanzada
+typedef struct {
+    uint32_t end_ms[MAX_SEGMENTS];
+    float frac[MAX_SEGMENTS];
+    int n;
+} servo_profile_t;
+
 static bool timer_configured = false;
+static bool s_ready[LEDC_CHANNEL_MAX];
+static uint32_t s_duty[LEDC_CHANNEL_MAX];   // Último duty escrito (0 = nunca)
+
+static QueueHandle_t s_cmd_queue = NULL;
+static TaskHandle_t s_motion_task = NULL;
+static volatile bool s_moving = false;
+static volatile bool s_powered = true;
+
+// Publicar una orden, darla por terminada y cortar la alimentación son excluyentes:
+// si no, una orden recién encolada podía quedar pendiente con s_moving a false
+static SemaphoreHandle_t s_cmd_lock = NULL;
+
+#if CONFIG_PM_ENABLE
+// Con los servos alimentados el LEDC necesita el APB a 80 MHz y sin light sleep
+static esp_pm_lock_handle_t s_pm_lock = NULL;
+#endif
+
+// Intervalo del último movimiento y tiempo total en movimiento
+static volatile int64_t s_move_start_us = 0;
+static volatile int64_t s_move_end_us = 0;      // 0 = en curso
+static uint32_t s_motion_ms_total = 0;
+
+static uint32_t angle_to_duty(float angle) {
+    if (angle < 0) angle = 0;
+    if (angle > SERVO_MAX_DEGREE) angle = SERVO_MAX_DEGREE;
+
+    uint32_t duty_us = SERVO_MIN_PULSE_US +
+                       (uint32_t)((angle / (float)SERVO_MAX_DEGREE) * (SERVO_MAX_PULSE_US - SERVO_MIN_PULSE_US));
+
+    // Convertir us a Duty (Resolución 14 bits -> 16383)
+    uint32_t max_duty = (1 << SERVO_TIMER_BIT) - 1;
+    return (duty_us * max_duty) / 20000; // 20000us = 20ms periodo
+}
+
+static float duty_to_angle(uint32_t duty) {
+    uint32_t max_duty = (1 << SERVO_TIMER_BIT) - 1;
+    float duty_us = (float)duty * 20000.0f / (float)max_duty;
+    return (duty_us - SERVO_MIN_PULSE_US) * (float)SERVO_MAX_DEGREE / (float)(SERVO_MAX_PULSE_US - SERVO_MIN_PULSE_US);
+}
+
+// Fracción recorrida de la fase de aceleración en función del tiempo normalizado u (0..1)
+static float accel_shape(float u) {
+#ifdef CONFIG_SERVO_PROFILE_SCURVE
+    // Aceleración sinusoidal: sin saltos de aceleración (jerk acotado)
+    return u - sinf((float)M_PI * u) / (float)M_PI;
+#else
+    return u * u;
+#endif
+}
+
+// Tiempo para alcanzar la velocidad v sin superar la aceleración máxima
+static float accel_time(float v) {
+#ifdef CONFIG_SERVO_PROFILE_SCURVE
+    return (float)M_PI * v / (2.0f * MAX_ACC_DPS2);
+#else
+    return v / MAX_ACC_DPS2;
+#endif
+}
+
+/*
+ * Planifica un recorrido de 'dist' grados. En ambos perfiles la fase de aceleración
+ * recorre v * ta / 2; si no cabe crucero se reduce la velocidad de pico.
+ * Devuelve la duración total en ms.
+ */
+static uint32_t plan_profile(float dist, servo_profile_t *p) {
+    float v = MAX_VEL_DPS;
+    float ta = accel_time(v);
+    float da = v * ta / 2.0f;
+
+    if (2.0f * da > dist) {
+        v = sqrtf(dist * MAX_VEL_DPS / accel_time(MAX_VEL_DPS));
+        ta = accel_time(v);
+        da = dist / 2.0f;
+    }
+    float tc = (dist - 2.0f * da) / v;
+
+    // Puntos de paso: aceleración, crucero y frenado (simétrico)
+    float t[MAX_SEGMENTS], s[MAX_SEGMENTS];
+    int n = 0;
+    for (int k = 1; k <= ACC_SEGMENTS; k++) {
+        float u = (float)k / ACC_SEGMENTS;
+        t[n] = ta * u;
+        s[n++] = da * accel_shape(u);
+    }
+    if (tc > 0.0f) {
+        t[n] = ta + tc;
+        s[n++] = dist - da;
+    }
+    for (int k = 1; k <= ACC_SEGMENTS; k++) {
+        float u = (float)k / ACC_SEGMENTS;
+        t[n] = ta + tc + ta * u;
+        s[n++] = dist - da * accel_shape(1.0f - u);
+    }
+
+    // Fusionar tramos más cortos que el mínimo útil para el fade
+    p->n = 0;
+    uint32_t last_ms = 0;
+    for (int i = 0; i < n; i++) {
+        uint32_t end_ms = (uint32_t)(t[i] * 1000.0f + 0.5f);
+        bool final = (i == n - 1);
+        if (!final && end_ms - last_ms < MIN_SEGMENT_MS) continue;
+
+        p->end_ms[p->n] = end_ms;
+        p->frac[p->n] = final ? 1.0f : s[i] / dist;
+        p->n++;
+        last_ms = end_ms;
+    }
+
+    return last_ms;
+}
+
+static bool IRAM_ATTR servo_fade_end_cb(const ledc_cb_param_t *param, void *user_arg) {
+    BaseType_t woken = pdFALSE;
+    if (param->event == LEDC_FADE_END_EVT && s_motion_task != NULL) {
+        vTaskNotifyGiveFromISR(s_motion_task, &woken);
+    }
+    return woken == pdTRUE;
+}
+
+static esp_err_t write_duty(ledc_channel_t channel, uint32_t duty) {
+    esp_err_t err = ledc_set_duty(SERVO_MODE, channel, duty);
+    if (err == ESP_OK) err = ledc_update_duty(SERVO_MODE, channel);
+    if (err == ESP_OK) s_duty[channel] = duty;
+    return err;
+}
+
+// Ejecuta una orden tramo a tramo. Vuelve antes si llega otra orden.
+static void run_move(const servo_cmd_t *cmd) {
+    uint32_t start[SERVO_MAX_AXES], target[SERVO_MAX_AXES];
+    float dist_max = 0.0f;
+
+    for (size_t i = 0; i < cmd->n; i++) {
+        ledc_channel_t ch = cmd->channel[i];
+        start[i] = s_duty[ch];
+        target[i] = angle_to_duty(cmd->angle[i]);
+
+        // Sin posición conocida no hay perfil posible: se salta directamente
+        if (start[i] == 0) {
+            write_duty(ch, target[i]);
+            start[i] = target[i];
+        }
+
+        float dist = fabsf(duty_to_angle(target[i]) - duty_to_angle(start[i]));
+        if (dist > dist_max) dist_max = dist;
+    }
+    if (dist_max <= 0.0f) return;
+
+    // El eje con más recorrido marca el tiempo; el resto escala su perfil y llega a la vez
+    servo_profile_t prof;
+    uint32_t total_ms = plan_profile(dist_max, &prof);
+
+    if (total_ms < MIN_SEGMENT_MS) {
+        for (size_t i = 0; i < cmd->n; i++) write_duty(cmd->channel[i], target[i]);
+        return;
+    }
+
+    uint32_t prev_ms = 0;
+    for (int seg = 0; seg < prof.n; seg++) {
+        uint32_t seg_ms = prof.end_ms[seg] - prev_ms;
+        prev_ms = prof.end_ms[seg];
+
+        ulTaskNotifyTake(pdTRUE, 0);
+        int pending = 0;
+
+        for (size_t i = 0; i < cmd->n; i++) {
+            ledc_channel_t ch = cmd->channel[i];
+            int32_t delta = (int32_t)target[i] - (int32_t)start[i];
+            uint32_t duty = (uint32_t)((int32_t)start[i] + (int32_t)lroundf(delta * prof.frac[seg]));
+            if (duty == s_duty[ch]) continue;
+
+            esp_err_t err = ledc_set_fade_with_time(SERVO_MODE, ch, duty, (int)seg_ms);
+            if (err == ESP_OK) err = ledc_fade_start(SERVO_MODE, ch, LEDC_FADE_NO_WAIT);
+            if (err != ESP_OK) {
+                ESP_LOGW(TAG, "Fade canal %d: %s", ch, esp_err_to_name(err));
+                write_duty(ch, duty);
+                continue;
+            }
+            s_duty[ch] = duty;
+            pending++;
+        }
+
+        // Esperar al final de todos los fades del tramo
+        while (pending > 0) {
+            if (ulTaskNotifyTake(pdFALSE, pdMS_TO_TICKS(seg_ms + FADE_TIMEOUT_MS)) == 0) {
+                ESP_LOGW(TAG, "Fin de fade no recibido");
+                break;
+            }
+            pending--;
+        }
+
+        // Orden nueva: se replanifica desde la posición alcanzada
+        if (uxQueueMessagesWaiting(s_cmd_queue) > 0) return;
+    }
+}
+
+static void motion_task(void *pvParameters) {
+    servo_cmd_t cmd;
+
+    while (1) {
+        if (xQueueReceive(s_cmd_queue, &cmd, portMAX_DELAY) != pdTRUE) continue;
+
+        int64_t t0 = esp_timer_get_time();
+        if (s_move_end_us != 0 || s_move_start_us == 0) {
+            s_move_start_us = t0;
+            s_move_end_us = 0;
+        }
+        s_moving = true;
 
-static void _configure_timer(void) {
-    if (timer_configured) return;
+        run_move(&cmd);
+
+        int64_t t1 = esp_timer_get_time();
+        s_motion_ms_total += (uint32_t)((t1 - t0) / 1000);
+
+        xSemaphoreTake(s_cmd_lock, portMAX_DELAY);
+        if (uxQueueMessagesWaiting(s_cmd_queue) == 0) {
+            s_move_end_us = t1;
+            s_moving = false;
+        }
+        xSemaphoreGive(s_cmd_lock);
+    }
+}
+
+static esp_err_t _configure_timer(void) {
+    if (timer_configured) return ESP_OK;
 
     ledc_timer_config_t ledc_timer = {
         .speed_mode       = SERVO_MODE,
@@ -12,12 +274,48 @@ static void _configure_timer(void) {
         .freq_hz          = SERVO_FREQ_HZ,
         .clk_cfg          = LEDC_AUTO_CLK
     };
-    ESP_ERROR_CHECK(ledc_timer_config(&ledc_timer));
+    esp_err_t err = ledc_timer_config(&ledc_timer);
+    if (err != ESP_OK) return err;
+
+    err = ledc_fade_func_install(0);
+    if (err != ESP_OK) return err;
+
+#if CONFIG_SERVO_POWER_GPIO >= 0
+    gpio_config_t io = {
+        .pin_bit_mask = 1ULL << CONFIG_SERVO_POWER_GPIO,
+        .mode = GPIO_MODE_OUTPUT,
+    };
+    err = gpio_config(&io);
+    if (err != ESP_OK) return err;
+    gpio_set_level(CONFIG_SERVO_POWER_GPIO, CONFIG_SERVO_POWER_ACTIVE_LEVEL);
+#endif
+
+    // Una orden pendiente como máximo: la nueva sustituye a la anterior
+    s_cmd_queue = xQueueCreate(1, sizeof(servo_cmd_t));
+    s_cmd_lock = xSemaphoreCreateMutex();
+    if (s_cmd_queue == NULL || s_cmd_lock == NULL) return ESP_ERR_NO_MEM;
+
+    if (xTaskCreate(motion_task, "servo_motion", 3072, NULL, 6, &s_motion_task) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+
+#if CONFIG_PM_ENABLE
+    // Se arranca alimentado (s_powered)
+    err = esp_pm_lock_create(ESP_PM_APB_FREQ_MAX, 0, "servo", &s_pm_lock);
+    if (err != ESP_OK) return err;
+    esp_pm_lock_acquire(s_pm_lock);
+#endif
+
     timer_configured = true;
+    return ESP_OK;
 }
 
-void servo_init(int gpio_pin, ledc_channel_t channel) {
-    _configure_timer();
+esp_err_t servo_init(int gpio_pin, ledc_channel_t channel) {
+    esp_err_t err = _configure_timer();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error configurando timer LEDC: %s", esp_err_to_name(err));
+        return err;
+    }
 
     ledc_channel_config_t ledc_channel = {
         .speed_mode     = SERVO_MODE,
@@ -28,20 +326,159 @@ void servo_init(int gpio_pin, ledc_channel_t channel) {
         .duty           = 0,
         .hpoint         = 0
     };
-    ESP_ERROR_CHECK(ledc_channel_config(&ledc_channel));
+    err = ledc_channel_config(&ledc_channel);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error configurando canal %d: %s", channel, esp_err_to_name(err));
+        return err;
+    }
+
+    ledc_cbs_t cbs = { .fade_cb = servo_fade_end_cb };
+    err = ledc_cb_register(SERVO_MODE, channel, &cbs, NULL);
+    if (err != ESP_OK) return err;
+
+    s_duty[channel] = 0;
+    s_ready[channel] = true;
+    return ESP_OK;
 }
 
-void servo_set_angle(ledc_channel_t channel, float angle) {
-    if (angle < 0) angle = 0;
-    if (angle > SERVO_MAX_DEGREE) angle = SERVO_MAX_DEGREE;
+esp_err_t servo_set_angle(ledc_channel_t channel, float angle) {
+    if (channel >= LEDC_CHANNEL_MAX || !s_ready[channel]) return ESP_ERR_INVALID_STATE;
+    if (s_moving || !s_powered) return ESP_ERR_INVALID_STATE;
 
-    uint32_t duty_us = SERVO_MIN_PULSE_US +
-                       (uint32_t)((angle / (float)SERVO_MAX_DEGREE) * (SERVO_MAX_PULSE_US - SERVO_MIN_PULSE_US));
+    uint32_t duty = angle_to_duty(angle);
+    if (duty == s_duty[channel]) return ESP_OK;
 
-    // Convertir us a Duty (Resolución 14 bits -> 16383)
-    uint32_t max_duty = (1 << SERVO_TIMER_BIT) - 1;
-    uint32_t duty = (duty_us * max_duty) / 20000; // 20000us = 20ms periodo
+    return write_duty(channel, duty);
+}
+
+static esp_err_t power_up_locked(void);
+
+esp_err_t servo_move(const ledc_channel_t *channels, const float *angles, size_t n) {
+    if (n == 0 || n > SERVO_MAX_AXES) return ESP_ERR_INVALID_ARG;
+
+    servo_cmd_t cmd = { .n = n };
+    for (size_t i = 0; i < n; i++) {
+        if (channels[i] >= LEDC_CHANNEL_MAX || !s_ready[channels[i]]) return ESP_ERR_INVALID_STATE;
+        cmd.channel[i] = channels[i];
+        cmd.angle[i] = angles[i];
+    }
+
+    xSemaphoreTake(s_cmd_lock, portMAX_DELAY);
+
+    // Una orden con los servos apagados los vuelve a encender antes de moverlos
+    esp_err_t err = s_powered ? ESP_OK : power_up_locked();
+    if (err == ESP_OK) {
+        bool changed = false;
+        for (size_t i = 0; i < n; i++) {
+            if (angle_to_duty(angles[i]) != s_duty[channels[i]]) changed = true;
+        }
+
+        // Ya en destino y sin nada en marcha: no hay nada que escribir
+        if (changed || s_moving) {
+            s_moving = true;
+            xQueueOverwrite(s_cmd_queue, &cmd);
+        }
+    }
+
+    xSemaphoreGive(s_cmd_lock);
+    return err;
+}
+
+bool servo_is_moving(void) {
+    return s_moving;
+}
+
+float servo_get_angle(ledc_channel_t channel) {
+    if (channel >= LEDC_CHANNEL_MAX || s_duty[channel] == 0) return -1.0f;
+    return duty_to_angle(s_duty[channel]);
+}
+
+static esp_err_t power_down_locked(void) {
+    // Una orden encolada aún no recibida también cuenta como movimiento
+    if (s_moving || uxQueueMessagesWaiting(s_cmd_queue) > 0) return ESP_ERR_INVALID_STATE;
+    if (!s_powered) return ESP_OK;
+
+    // Salida a nivel bajo: sin pulsos el servo deja de mantener la posición y apenas consume
+    for (int ch = 0; ch < LEDC_CHANNEL_MAX; ch++) {
+        if (!s_ready[ch]) continue;
+        esp_err_t err = ledc_stop(SERVO_MODE, (ledc_channel_t)ch, 0);
+        if (err != ESP_OK) return err;
+    }
+
+#if CONFIG_SERVO_POWER_GPIO >= 0
+    gpio_set_level(CONFIG_SERVO_POWER_GPIO, !CONFIG_SERVO_POWER_ACTIVE_LEVEL);
+#endif
+
+    s_powered = false;
+#if CONFIG_PM_ENABLE
+    if (s_pm_lock) esp_pm_lock_release(s_pm_lock);
+#endif
+    return ESP_OK;
+}
+
+esp_err_t servo_power_down(void) {
+    if (s_cmd_lock == NULL) return ESP_ERR_INVALID_STATE;
+
+    xSemaphoreTake(s_cmd_lock, portMAX_DELAY);
+    esp_err_t err = power_down_locked();
+    xSemaphoreGive(s_cmd_lock);
+    return err;
+}
+
+static esp_err_t power_up_locked(void) {
+    if (s_powered) return ESP_OK;
+
+#if CONFIG_PM_ENABLE
+    if (s_pm_lock) esp_pm_lock_acquire(s_pm_lock);
+#endif
+
+#if CONFIG_SERVO_POWER_GPIO >= 0
+    gpio_set_level(CONFIG_SERVO_POWER_GPIO, CONFIG_SERVO_POWER_ACTIVE_LEVEL);
+    vTaskDelay(pdMS_TO_TICKS(CONFIG_SERVO_POWER_SETTLE_MS));
+#endif
+
+    // Reanudar los pulsos en la última posición para que el servo no salte
+    for (int ch = 0; ch < LEDC_CHANNEL_MAX; ch++) {
+        if (!s_ready[ch] || s_duty[ch] == 0) continue;
+        esp_err_t err = ledc_set_duty(SERVO_MODE, (ledc_channel_t)ch, s_duty[ch]);
+        if (err == ESP_OK) err = ledc_update_duty(SERVO_MODE, (ledc_channel_t)ch);
+        if (err != ESP_OK) {
+#if CONFIG_PM_ENABLE
+            if (s_pm_lock) esp_pm_lock_release(s_pm_lock);
+#endif
+            return err;
+        }
+    }
+
+    s_powered = true;
+    return ESP_OK;
+}
+
+esp_err_t servo_power_up(void) {
+    if (s_cmd_lock == NULL) return ESP_ERR_INVALID_STATE;
+
+    xSemaphoreTake(s_cmd_lock, portMAX_DELAY);
+    esp_err_t err = power_up_locked();
+    xSemaphoreGive(s_cmd_lock);
+    return err;
+}
+
+bool servo_is_powered(void) {
+    return s_powered;
+}
+
+uint32_t servo_motion_ms(void) {
+    return s_motion_ms_total;
+}
+
+bool servo_was_moving_at(int64_t t_us) {
+    int64_t start = s_move_start_us, end = s_move_end_us;
+    if (start == 0) return false;
+    return t_us >= start && (end == 0 || t_us <= end);
+}
 
-    ESP_ERROR_CHECK(ledc_set_duty(SERVO_MODE, channel, duty));
-    ESP_ERROR_CHECK(ledc_update_duty(SERVO_MODE, channel));
+uint32_t servo_move_time_ms(float dist_deg) {
+    if (dist_deg <= 0.0f) return 0;
+    servo_profile_t prof;
+    return plan_profile(dist_deg, &prof);
 }
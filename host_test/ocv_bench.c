@@ -0,0 +1,76 @@
+/*
+ * Búsqueda OCV -> SoC de battery.c (binaria, sin saltos dependientes del dato)
+ * frente al recorrido lineal original sobre la misma tabla generada. Se
+ * compila una vez por tabla (CMakeLists.txt): química, celdas y puntos.
+ *
+ * Comprueba que las dos búsquedas dan el mismo SoC en todo el rango, fuera
+ * de él y justo en los puntos de la tabla, y mide el coste de cada una en
+ * nanosegundos del PC (shim de esp_cpu.h).
+ */
+#include <math.h>
+#include <stdio.h>
+
+#include "battery.h"
+#include "esp_cpu.h"
+#include "ocv_table.h"	// Generado por tools/gen_ocv_table.py (CMakeLists.txt)
+
+#define OCV_BENCH_N    100000
+#define OCV_MAX_DIFF   1e-3f	// % de SoC (redondeo float)
+
+// Búsqueda original: recorrido lineal de la tabla
+static float ocv_to_percent_scan(const float *t, int n, float volts)
+{
+	if (volts >= t[n - 1]) return 100.0f;
+	if (volts <= t[0]) return 0.0f;
+
+	for (int i = n - 2; i >= 0; i--) {
+		if (volts >= t[i]) {
+			float frac = (volts - t[i]) / (t[i + 1] - t[i]);
+			return (i + frac) * 100.0f / (n - 1);
+		}
+	}
+	return 0.0f;
+}
+
+static int s_failed = 0;
+
+static void check(float v)
+{
+	float lin = ocv_to_percent_scan(s_ocv_table, OCV_TABLE_POINTS, v);
+	float bin = battery_porcent_from_voltage(v);
+	if (fabsf(lin - bin) > OCV_MAX_DIFF) {
+		if (s_failed++ < 10) printf("FALLO: %.4f V -> lineal %.4f%%, binaria %.4f%%\n", v, lin, bin);
+	}
+}
+
+int main(void)
+{
+	const float v_lo = s_ocv_table[0], v_hi = s_ocv_table[OCV_TABLE_POINTS - 1];
+	const float v_span = v_hi - v_lo;
+
+	// Rejilla fina, puntos exactos de la tabla (y su vecino por arriba) y fuera de rango
+	for (int k = 0; k <= OCV_BENCH_N; k++) check(v_lo + v_span * k / OCV_BENCH_N);
+	for (int i = 0; i < OCV_TABLE_POINTS; i++) {
+		check(s_ocv_table[i]);
+		check(nextafterf(s_ocv_table[i], INFINITY));
+	}
+	check(v_lo - 1.0f);
+	check(v_hi + 1.0f);
+	check(0.0f);
+
+	volatile float sink = 0.0f;		// Evita que el compilador elimine los bucles
+	uint32_t c0 = esp_cpu_get_cycle_count();
+	for (int k = 0; k < OCV_BENCH_N; k++) {
+		sink = ocv_to_percent_scan(s_ocv_table, OCV_TABLE_POINTS, v_lo + v_span * k / OCV_BENCH_N);
+	}
+	uint32_t c1 = esp_cpu_get_cycle_count();
+	for (int k = 0; k < OCV_BENCH_N; k++) {
+		sink = battery_porcent_from_voltage(v_lo + v_span * k / OCV_BENCH_N);
+	}
+	uint32_t c2 = esp_cpu_get_cycle_count();
+	(void)sink;
+
+	printf("Tabla OCV de %d puntos (%.3f..%.3f V): lineal %.1f ns, binaria %.1f ns por búsqueda, %d discrepancias\n",
+	       OCV_TABLE_POINTS, v_lo, v_hi, (double)(c1 - c0) / OCV_BENCH_N, (double)(c2 - c1) / OCV_BENCH_N, s_failed);
+	return s_failed ? 1 : 0;
+}
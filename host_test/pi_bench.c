@@ -0,0 +1,115 @@
+/*
+ * Respuesta al escalón del lazo PI de pi_control.c frente al paso fijo
+ * original, con el modelo de los LDR (sombra diferencial del separador y
+ * ruido de lectura reproducible). Las ganancias son las de Kconfig.
+ *
+ * Falla si el PI no se asienta dentro de la banda o tarda más que el paso fijo.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pi_control.h"
+#include "sdkconfig.h"
+
+// Luz total del par de LDR y fracción máxima de sombra diferencial
+#define BENCH_LEVEL        2000
+#define BENCH_SHADE        0.8f
+#define BENCH_SHADE_DEG    20.0f	// Error angular que satura la sombra
+#define BENCH_NOISE        15		// Ruido de lectura (raw, pico)
+#define BENCH_SETTLE_DEG   1.5f
+#define BENCH_TIME_S       10.0f
+#define LEGACY_STEP_DEG    2.0f		// Paso del algoritmo original
+
+// Resultado de una respuesta al escalón simulada
+typedef struct {
+	uint32_t settle_cycles;		// Ciclos hasta quedar dentro de la banda definitivamente
+	uint32_t updates;			// Ciclos en los que se movió el servo
+	float final_error;			// Error final (grados)
+} pi_bench_t;
+
+/*
+ * Simula el par de LDR frente a un sol fijo en 'target' partiendo de 'start' y
+ * mide la respuesta del PI (legacy = false) o del paso fijo original (legacy = true,
+ * step_deg cuando |diff| > tolerance).
+ */
+static void pi_bench_step(const pi_gains_t *g, bool legacy, float step_deg, int tolerance,
+                          float start, float target, uint32_t cycles, float dt_s, pi_bench_t *out)
+{
+	pi_axis_t ax;
+	pi_axis_reset(&ax);
+
+	uint32_t seed = 12345;
+	float angle = start;
+	out->settle_cycles = cycles;
+	out->updates = 0;
+
+	for (uint32_t k = 0; k < cycles; k++) {
+		float s = (target - angle) / BENCH_SHADE_DEG;
+		if (s > 1.0f) s = 1.0f;
+		if (s < -1.0f) s = -1.0f;
+		s *= BENCH_SHADE;
+
+		// Ruido pseudoaleatorio reproducible (LCG)
+		seed = seed * 1664525u + 1013904223u;
+		int na = (int)(seed >> 16) % (2 * BENCH_NOISE + 1) - BENCH_NOISE;
+		seed = seed * 1664525u + 1013904223u;
+		int nb = (int)(seed >> 16) % (2 * BENCH_NOISE + 1) - BENCH_NOISE;
+
+		int a = (int)(BENCH_LEVEL / 2 * (1.0f + s)) + na;
+		int b = (int)(BENCH_LEVEL / 2 * (1.0f - s)) + nb;
+
+		float delta;
+		if (legacy) {
+			delta = (abs(a - b) > tolerance) ? ((a > b) ? step_deg : -step_deg) : 0.0f;
+		} else {
+			delta = pi_axis_update(&ax, g, pi_norm_error(a, b), pi_norm_threshold(tolerance, a, b), dt_s);
+		}
+
+		if (delta != 0.0f) {
+			angle += delta;
+			out->updates++;
+		}
+
+		// Asentado: desde aquí hasta el final dentro de la banda
+		if (fabsf(target - angle) > BENCH_SETTLE_DEG) out->settle_cycles = cycles;
+		else if (out->settle_cycles == cycles) out->settle_cycles = k + 1;
+	}
+
+	out->final_error = target - angle;
+}
+
+int main(void)
+{
+	const pi_gains_t g = {
+		.kp = strtof(CONFIG_TRACKER_PI_KP, NULL),
+		.ki = strtof(CONFIG_TRACKER_PI_KI, NULL),
+		.max_step = strtof(CONFIG_TRACKER_STEP_DEG, NULL),
+		.hyst_off = CONFIG_TRACKER_HYST_PCT / 100.0f,
+	};
+	const float dt = CONFIG_TRACKER_UPDATE_MS / 1000.0f;
+	const uint32_t cycles = (uint32_t)(BENCH_TIME_S / dt);
+	const float steps[] = { 5.0f, 20.0f, 45.0f };
+
+	printf("Kp=%.1f Ki=%.1f paso max=%.1f° histéresis=%.2f, %lu ciclos de %.0f ms\n",
+	       g.kp, g.ki, g.max_step, g.hyst_off, (unsigned long)cycles, dt * 1000.0f);
+
+	int rc = 0;
+	for (size_t i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+		pi_bench_t pi, legacy;
+		pi_bench_step(&g, false, g.max_step, CONFIG_TRACKER_TOLERANCE, 0.0f, steps[i], cycles, dt, &pi);
+		pi_bench_step(&g, true, LEGACY_STEP_DEG, CONFIG_TRACKER_TOLERANCE, 0.0f, steps[i], cycles, dt, &legacy);
+
+		printf("Escalón 0->%2.0f°: PI asentado en %3lu ciclos, %3lu movimientos, error %5.2f° | "
+		       "paso fijo %3lu ciclos, %3lu movimientos, error %5.2f°\n", steps[i],
+		       (unsigned long)pi.settle_cycles, (unsigned long)pi.updates, pi.final_error,
+		       (unsigned long)legacy.settle_cycles, (unsigned long)legacy.updates, legacy.final_error);
+
+		if (pi.settle_cycles >= cycles || fabsf(pi.final_error) > BENCH_SETTLE_DEG ||
+		    pi.settle_cycles > legacy.settle_cycles) {
+			printf("FALLO: el PI no se asienta en el escalón de %.0f°\n", steps[i]);
+			rc = 1;
+		}
+	}
+	return rc;
+}
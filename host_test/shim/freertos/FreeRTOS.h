@@ -0,0 +1,22 @@
+// FreeRTOS sobre pthreads: lo justo para los módulos de logic que se prueban en el PC
+#pragma once
+
+#include <stdint.h>
+#include <pthread.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+
+#define pdTRUE              1
+#define pdFALSE             0
+#define pdPASS              1
+#define portMAX_DELAY       0xffffffffu
+#define portTICK_PERIOD_MS  1
+#define pdMS_TO_TICKS(ms)   ((TickType_t)(ms))
+
+// Las secciones críticas pasan a ser un mutex
+typedef pthread_mutex_t portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED  PTHREAD_MUTEX_INITIALIZER
+#define portENTER_CRITICAL(m)         pthread_mutex_lock(m)
+#define portEXIT_CRITICAL(m)          pthread_mutex_unlock(m)
@@ -0,0 +1,27 @@
+// Configuración fija para las pruebas en el PC (valores por defecto de Kconfig)
+#pragma once
+
+#define CONFIG_LDR_MIN_OHM  4000
+#define CONFIG_LDR_MAX_OHM  1000000
+
+// Lazo del tracker (components/logic/Kconfig.projbuild)
+#define CONFIG_TRACKER_TOLERANCE      100
+#define CONFIG_TRACKER_TOLERANCE_CAL  40
+#define CONFIG_TRACKER_HYST_PCT       60
+#define CONFIG_TRACKER_PI_KP          "50.0"
+#define CONFIG_TRACKER_PI_KI          "45.0"
+#define CONFIG_TRACKER_STEP_DEG       "2.0"
+#define CONFIG_TRACKER_UPDATE_MS      100
+
+// Batería (components/sensors/Kconfig.projbuild): Li-ion de una celda
+#define CONFIG_BAT_CAPACITY_AH        "2.6"
+#define CONFIG_BAT_CELLS              1
+#define CONFIG_BAT_OCV_POINTS         101
+#define CONFIG_BAT_R0_OHM             "0.05"
+#define CONFIG_BAT_R1_OHM             "0.03"
+#define CONFIG_BAT_C1_F               "1000"
+
+// Lugar y calendario de sueño (logic y main/Kconfig.projbuild): Madrid, crepúsculo civil
+#define CONFIG_SUN_LATITUDE           "40.4168"
+#define CONFIG_SUN_LONGITUDE          "-3.7038"
+#define CONFIG_SLEEP_SUN_ELEV_DEG     "-6"
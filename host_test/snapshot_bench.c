@@ -0,0 +1,213 @@
+/*
+ * Contención del almacén de instantáneas en el PC: dos escritores publican la
+ * misma instantánea INA sin pausa mientras varios lectores la copian. Cada
+ * publicación lleva el mismo valor en todos los campos, así que una copia con
+ * valores mezclados es una lectura rota.
+ *
+ * Con la misma carga se mide también el camino anterior al seqlock: un mutex
+ * global que toman escritores y lectores, y se comparan las latencias.
+ *
+ * Uso: snapshot_bench [segundos por variante] [lectores]
+ */
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "snapshot.h"
+#include "esp_timer.h"
+#include "freertos/semphr.h"
+
+#define WRITERS      2
+#define MAX_READERS  8
+
+typedef struct {
+	uint64_t n, ok, empty, busy, torn;
+	int64_t total_us, max_us;
+} op_stats_t;
+
+// Forma de publicar y leer: el seqlock de snapshot.c o el mutex de referencia
+typedef struct {
+	const char *name;
+	void (*publish)(const ina_snapshot_t *snap);
+	snapshot_result_t (*read)(ina_snapshot_t *out);
+} variant_t;
+
+static atomic_bool s_stop;
+static const variant_t *s_variant;
+
+// Camino con mutex (como el antiguo g_data_mutex): lectores y escritores se excluyen
+static ina_snapshot_t s_mtx_data;
+static uint32_t s_mtx_seq;
+static StaticSemaphore_t s_mtx_buf;
+static SemaphoreHandle_t s_mtx;
+
+static void mutex_publish(const ina_snapshot_t *snap)
+{
+	xSemaphoreTake(s_mtx, portMAX_DELAY);
+	s_mtx_data = *snap;
+	s_mtx_data.timestamp_us = esp_timer_get_time();
+	s_mtx_data.seq = ++s_mtx_seq;
+	xSemaphoreGive(s_mtx);
+}
+
+static snapshot_result_t mutex_read(ina_snapshot_t *out)
+{
+	xSemaphoreTake(s_mtx, portMAX_DELAY);
+	*out = s_mtx_data;
+	xSemaphoreGive(s_mtx);
+	return (out->seq != 0) ? SNAPSHOT_OK : SNAPSHOT_EMPTY;
+}
+
+static const variant_t s_variants[] = {
+	{ "seqlock", snapshot_publish_ina, snapshot_try_read_ina },
+	{ "mutex",   mutex_publish,        mutex_read },
+};
+
+static void fill(ina_snapshot_t *s, float v)
+{
+	for (int r = 0; r < INA_ROLE_MAX; r++) {
+		s->ch[r].bus_voltage_V = v;
+		s->ch[r].current_A = v;
+		s->ch[r].power_W = v;
+		s->valid[r] = true;
+	}
+	s->battery_soc = v;
+	s->battery_soc_sigma = v;
+}
+
+static bool consistent(const ina_snapshot_t *s)
+{
+	float v = s->battery_soc;
+	if (s->battery_soc_sigma != v) return false;
+	for (int r = 0; r < INA_ROLE_MAX; r++) {
+		if (s->ch[r].bus_voltage_V != v || s->ch[r].current_A != v || s->ch[r].power_W != v) return false;
+	}
+	return true;
+}
+
+static void op_time(op_stats_t *st, int64_t dt)
+{
+	st->n++;
+	st->total_us += dt;
+	if (dt > st->max_us) st->max_us = dt;
+}
+
+typedef struct {
+	int id;
+	op_stats_t st;
+} writer_t;
+
+static void *writer(void *arg)
+{
+	writer_t *w = arg;
+	int id = w->id;
+	op_stats_t *st = &w->st;
+
+	ina_snapshot_t s = { 0 };
+	uint64_t k = 0;
+
+	// Valores distintos por escritor (enteros exactos en float)
+	while (!atomic_load(&s_stop)) {
+		fill(&s, (float)((k++ % 1000000) * WRITERS + id + 1));
+		int64_t t0 = esp_timer_get_time();
+		s_variant->publish(&s);
+		op_time(st, esp_timer_get_time() - t0);
+	}
+	return NULL;
+}
+
+static void *reader(void *arg)
+{
+	op_stats_t *st = arg;
+	ina_snapshot_t s;
+
+	while (!atomic_load(&s_stop)) {
+		int64_t t0 = esp_timer_get_time();
+		snapshot_result_t r = s_variant->read(&s);
+		op_time(st, esp_timer_get_time() - t0);
+
+		switch (r) {
+		case SNAPSHOT_OK:
+			st->ok++;
+			if (!consistent(&s)) st->torn++;
+			break;
+		case SNAPSHOT_EMPTY: st->empty++; break;
+		case SNAPSHOT_BUSY:  st->busy++; break;
+		}
+	}
+	return NULL;
+}
+
+static void sum(op_stats_t *t, const op_stats_t *st, int n)
+{
+	*t = (op_stats_t){ 0 };
+	for (int i = 0; i < n; i++) {
+		t->n += st[i].n;
+		t->ok += st[i].ok;
+		t->empty += st[i].empty;
+		t->busy += st[i].busy;
+		t->torn += st[i].torn;
+		t->total_us += st[i].total_us;
+		if (st[i].max_us > t->max_us) t->max_us = st[i].max_us;
+	}
+}
+
+// Una pasada con la variante indicada; devuelve las lecturas y escrituras acumuladas
+static void run(const variant_t *v, double secs, int readers, op_stats_t *rd, op_stats_t *wr)
+{
+	pthread_t w[WRITERS], r[MAX_READERS];
+	op_stats_t rst[MAX_READERS] = { 0 }, wst[WRITERS];
+	writer_t wa[WRITERS] = { 0 };
+
+	s_variant = v;
+	atomic_store(&s_stop, false);
+
+	for (int i = 0; i < readers; i++) pthread_create(&r[i], NULL, reader, &rst[i]);
+	for (int i = 0; i < WRITERS; i++) {
+		wa[i].id = i;
+		pthread_create(&w[i], NULL, writer, &wa[i]);
+	}
+
+	struct timespec ts = { .tv_sec = (time_t)secs, .tv_nsec = (long)((secs - (time_t)secs) * 1e9) };
+	nanosleep(&ts, NULL);
+	atomic_store(&s_stop, true);
+
+	for (int i = 0; i < WRITERS; i++) pthread_join(w[i], NULL);
+	for (int i = 0; i < readers; i++) pthread_join(r[i], NULL);
+
+	for (int i = 0; i < WRITERS; i++) wst[i] = wa[i].st;
+	sum(rd, rst, readers);
+	sum(wr, wst, WRITERS);
+}
+
+int main(int argc, char **argv)
+{
+	double secs = (argc > 1) ? atof(argv[1]) : 1.0;
+	int readers = (argc > 2) ? atoi(argv[2]) : 3;
+	if (readers < 1) readers = 1;
+	if (readers > MAX_READERS) readers = MAX_READERS;
+
+	s_mtx = xSemaphoreCreateMutexStatic(&s_mtx_buf);
+
+	printf("snapshot_bench: %.1f s por variante, %d escritores, %d lectores\n", secs, WRITERS, readers);
+	printf("  %-8s %12s %12s %10s %10s %8s %8s %8s\n", "", "lecturas/s", "escrit./s",
+	       "lect. us", "máx us", "escr. us", "máx us", "rotas");
+
+	int rc = 0;
+	for (size_t i = 0; i < sizeof(s_variants) / sizeof(s_variants[0]); i++) {
+		op_stats_t rd, wr;
+		run(&s_variants[i], secs, readers, &rd, &wr);
+
+		printf("  %-8s %12.0f %12.0f %10.3f %10" PRId64 " %8.3f %8" PRId64 " %8" PRIu64 "\n",
+		       s_variants[i].name, rd.n / secs, wr.n / secs,
+		       rd.n ? (double)rd.total_us / rd.n : 0.0, rd.max_us,
+		       wr.n ? (double)wr.total_us / wr.n : 0.0, wr.max_us, rd.torn);
+		if (rd.busy > 0) printf("  %-8s %" PRIu64 " lecturas abandonadas (ocupado)\n", "", rd.busy);
+
+		// Fallo sólo por copias inconsistentes o si ningún lector ha llegado a leer
+		if (rd.torn != 0 || rd.ok == 0) rc = 1;
+	}
+	return rc;
+}
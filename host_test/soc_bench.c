@@ -0,0 +1,146 @@
+/*
+ * Estimadores de SoC de battery.c con una traza sintética de 6 horas de
+ * carga y descarga: la batería "real" sigue el modelo Thevenin con
+ * resistencias y capacidad algo distintas de las configuradas, y las
+ * medidas llevan ruido y offset. El SoC inicial sale del voltaje bajo
+ * carga, como en el arranque. Se pasa por la mezcla Coulomb/voltaje
+ * original y por el EKF.
+ *
+ * Los ciclos por actualización son nanosegundos del PC (shim de esp_cpu.h):
+ * sirven para comparar los dos estimadores, no para el coste en el ESP32.
+ * Falla si el EKF no mejora el error de la mezcla o se sale de SOC_BENCH_MAX_RMS.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "battery.h"
+#include "esp_cpu.h"
+#include "ocv_table.h"	// Generado por tools/gen_ocv_table.py (CMakeLists.txt)
+
+#define BENCH_HOURS     6
+#define BENCH_SOC0      0.60f	// SoC real al empezar
+#define BENCH_V_NOISE   5		// mV pico
+#define BENCH_I_NOISE   5		// mA pico
+#define BENCH_I_BIAS    0.002f	// Offset del sensor de corriente (A)
+#define BENCH_MISMATCH  1.2f	// Resistencias reales respecto al modelo
+#define BENCH_CAP_REAL  0.95f	// Capacidad real respecto a la nominal
+#define SOC_BENCH_MAX_RMS  5.0f	// Error RMS máximo admitido al EKF (%)
+
+typedef struct {
+	float rms_err;		// Error RMS del SoC frente a la traza (%)
+	float max_err;
+	uint32_t cycles;	// "Ciclos" medios por actualización
+} battery_bench_t;
+
+// Ciclo de una hora: descarga, reposo, carga, reposo
+static float bench_current(uint32_t t)
+{
+	uint32_t s = t % 3600;
+	if (s < 1200) return 0.8f;
+	if (s < 1800) return 0.0f;
+	if (s < 3000) return -0.6f;
+	return 0.0f;
+}
+
+static int bench_noise(uint32_t *seed, int peak)
+{
+	*seed = *seed * 1664525u + 1013904223u;
+	return (int)((*seed >> 16) % (2 * peak + 1)) - peak;
+}
+
+static float clamp01(float x)
+{
+	return (x < 0.0f) ? 0.0f : (x > 1.0f) ? 1.0f : x;
+}
+
+// OCV de la batería "real": la misma tabla que usa el firmware, interpolada
+static float true_ocv(float soc)
+{
+	float pos = clamp01(soc) * (OCV_TABLE_POINTS - 1);
+	int i = (int)pos;
+	if (i > OCV_TABLE_POINTS - 2) i = OCV_TABLE_POINTS - 2;
+	return s_ocv_table[i] + (pos - i) * (s_ocv_table[i + 1] - s_ocv_table[i]);
+}
+
+static void battery_soc_benchmark(const battery_model_t *m, battery_bench_t *legacy, battery_bench_t *ekf)
+{
+	const float dt = 1.0f;
+	const float r0 = m->r0 * BENCH_MISMATCH, r1 = m->r1 * BENCH_MISMATCH;
+	const float cap = m->capacity_Ah * BENCH_CAP_REAL;
+	const float a = expf(-dt / (r1 * m->c1));
+	uint32_t seed = 777;
+
+	float soc = BENCH_SOC0, v_rc = 0.0f;
+	float soc_legacy = 0.0f;
+	battery_ekf_t k;
+	double sq_legacy = 0.0, sq_ekf = 0.0;
+	uint64_t cyc_legacy = 0, cyc_ekf = 0;
+	uint32_t n = BENCH_HOURS * 3600;
+
+	*legacy = (battery_bench_t){ 0 };
+	*ekf = (battery_bench_t){ 0 };
+
+	for (uint32_t t = 0; t < n; t++) {
+		// Batería "real" (con parámetros algo distintos de los del modelo)
+		float i = bench_current(t);
+		soc = clamp01(soc - i * dt / (3600.0f * cap));
+		v_rc = a * v_rc + r1 * (1.0f - a) * i;
+		float v = true_ocv(soc) - v_rc - r0 * i;
+
+		// Lo que miden los INA
+		float v_meas = v + bench_noise(&seed, BENCH_V_NOISE) / 1000.0f;
+		float i_meas = i + BENCH_I_BIAS + bench_noise(&seed, BENCH_I_NOISE) / 1000.0f;
+
+		if (t == 0) {
+			// Como en el arranque: SoC inicial por voltaje, aunque haya carga
+			soc_legacy = battery_porcent_from_voltage(v_meas);
+			battery_ekf_init(&k, soc_legacy, 20.0f);
+			continue;
+		}
+
+		uint32_t c0 = esp_cpu_get_cycle_count();
+		soc_legacy = battery_soc_update(soc_legacy, v_meas, i_meas, dt, m->capacity_Ah);
+		uint32_t c1 = esp_cpu_get_cycle_count();
+		float soc_ekf = battery_ekf_update(&k, m, v_meas, i_meas, dt);
+		uint32_t c2 = esp_cpu_get_cycle_count();
+
+		cyc_legacy += c1 - c0;
+		cyc_ekf += c2 - c1;
+
+		float e_legacy = fabsf(soc_legacy - soc * 100.0f);
+		float e_ekf = fabsf(soc_ekf - soc * 100.0f);
+		sq_legacy += (double)e_legacy * e_legacy;
+		sq_ekf += (double)e_ekf * e_ekf;
+		if (e_legacy > legacy->max_err) legacy->max_err = e_legacy;
+		if (e_ekf > ekf->max_err) ekf->max_err = e_ekf;
+	}
+
+	legacy->rms_err = (float)sqrt(sq_legacy / (n - 1));
+	ekf->rms_err = (float)sqrt(sq_ekf / (n - 1));
+	legacy->cycles = (uint32_t)(cyc_legacy / (n - 1));
+	ekf->cycles = (uint32_t)(cyc_ekf / (n - 1));
+}
+
+int main(void)
+{
+	const battery_model_t m = {
+		.r0 = strtof(CONFIG_BAT_R0_OHM, NULL),
+		.r1 = strtof(CONFIG_BAT_R1_OHM, NULL),
+		.c1 = strtof(CONFIG_BAT_C1_F, NULL),
+		.capacity_Ah = strtof(CONFIG_BAT_CAPACITY_AH, NULL),
+	};
+	battery_bench_t blend, ekf;
+	battery_soc_benchmark(&m, &blend, &ekf);
+
+	printf("SoC mezcla: error RMS %.2f%% (max %.2f%%), %lu ns/actualización\n",
+	       blend.rms_err, blend.max_err, (unsigned long)blend.cycles);
+	printf("SoC EKF:    error RMS %.2f%% (max %.2f%%), %lu ns/actualización\n",
+	       ekf.rms_err, ekf.max_err, (unsigned long)ekf.cycles);
+
+	if (!(ekf.rms_err < blend.rms_err) || !(ekf.rms_err < SOC_BENCH_MAX_RMS)) {
+		printf("FALLO: el EKF no mejora a la mezcla\n");
+		return 1;
+	}
+	return 0;
+}
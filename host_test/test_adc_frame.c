@@ -0,0 +1,146 @@
+/*
+ * Decodificación y diezmado de buffers DMA del ADC continuo (adc_frame.c)
+ * con buffers TYPE1 sintéticos.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "adc_frame.h"
+
+static int s_failed = 0;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		printf("FALLO %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+		s_failed++; \
+	} \
+} while (0)
+
+// Conversión TYPE1: bits 15:12 canal, 11:0 dato, little-endian
+static uint32_t put(uint8_t *buf, uint32_t off, uint8_t channel, uint16_t data)
+{
+	uint16_t word = (uint16_t)((channel << 12) | (data & 0x0FFF));
+	buf[off] = (uint8_t)(word & 0xFF);
+	buf[off + 1] = (uint8_t)(word >> 8);
+	return off + 2;
+}
+
+static void test_map(void)
+{
+	const uint8_t ch[] = { 6, 7, 4, 5 };
+	adc_frame_map_t map;
+	adc_frame_map_init(&map, ch, 4);
+
+	CHECK(map.nslots == 4);
+	CHECK(map.slot[6] == 0 && map.slot[7] == 1 && map.slot[4] == 2 && map.slot[5] == 3);
+	CHECK(map.slot[0] == ADC_FRAME_NO_SLOT && map.slot[15] == ADC_FRAME_NO_SLOT);
+
+	// Canales fuera del campo de 4 bits y más slots de los que caben
+	const uint8_t bad[ADC_FRAME_MAX_SLOTS + 2] = { 3, 16, 200, 0, 1, 2, 8, 9, 10, 11 };
+	adc_frame_map_init(&map, bad, sizeof(bad));
+	CHECK(map.nslots == ADC_FRAME_MAX_SLOTS);
+	CHECK(map.slot[3] == 0);
+	CHECK(map.slot[10] == ADC_FRAME_NO_SLOT);	// Noveno: no cabe
+}
+
+static void test_feed_average(void)
+{
+	const uint8_t ch[] = { 6, 7 };
+	adc_frame_map_t map;
+	adc_frame_map_init(&map, ch, 2);
+
+	adc_frame_acc_t acc;
+	adc_frame_acc_reset(&acc);
+
+	uint8_t buf[64];
+	uint32_t n = 0;
+	n = put(buf, n, 6, 100);
+	n = put(buf, n, 7, 4095);
+	n = put(buf, n, 3, 1234);	// Canal fuera del mapa
+	n = put(buf, n, 6, 101);
+	n = put(buf, n, 7, 4094);
+
+	adc_frame_acc_feed(&acc, &map, buf, n);
+	CHECK(acc.count[0] == 2 && acc.count[1] == 2);
+	CHECK(acc.sum[0] == 201 && acc.sum[1] == 8189);
+	CHECK(acc.discarded == 1);
+
+	CHECK(adc_frame_acc_ready(&acc, &map, 2));
+	CHECK(!adc_frame_acc_ready(&acc, &map, 3));
+
+	uint16_t avg[2];
+	adc_frame_acc_average(&acc, &map, avg);
+	CHECK(avg[0] == 101);	// 100.5 redondeado
+	CHECK(avg[1] == 4095);	// 4094.5 redondeado
+
+	// Un canal sin muestras: no está listo y su media es 0
+	adc_frame_acc_reset(&acc);
+	n = put(buf, 0, 6, 50);
+	adc_frame_acc_feed(&acc, &map, buf, n);
+	CHECK(!adc_frame_acc_ready(&acc, &map, 1));
+	adc_frame_acc_average(&acc, &map, avg);
+	CHECK(avg[0] == 50 && avg[1] == 0);
+}
+
+static void test_partial_buffer(void)
+{
+	const uint8_t ch[] = { 0 };
+	adc_frame_map_t map;
+	adc_frame_map_init(&map, ch, 1);
+
+	adc_frame_acc_t acc;
+	adc_frame_acc_reset(&acc);
+
+	// Byte suelto al final: se ignora, no se lee fuera del buffer
+	uint8_t buf[5];
+	uint32_t n = 0;
+	n = put(buf, n, 0, 10);
+	n = put(buf, n, 0, 20);
+	buf[n++] = 0xFF;
+	adc_frame_acc_feed(&acc, &map, buf, n);
+	CHECK(acc.count[0] == 2 && acc.sum[0] == 30);
+
+	adc_frame_acc_feed(&acc, &map, buf, 0);
+	CHECK(acc.count[0] == 2);
+}
+
+static void test_accumulate_across_buffers(void)
+{
+	const uint8_t ch[] = { 4, 5, 6, 7 };
+	adc_frame_map_t map;
+	adc_frame_map_init(&map, ch, 4);
+
+	adc_frame_acc_t acc;
+	adc_frame_acc_reset(&acc);
+
+	// 16 rondas de los 4 canales repartidas en buffers de 6 conversiones
+	uint8_t stream[16 * 4 * 2];
+	uint32_t n = 0;
+	for (int r = 0; r < 16; r++) {
+		for (int c = 0; c < 4; c++) n = put(stream, n, ch[c], (uint16_t)(1000 * c + r));
+	}
+	for (uint32_t off = 0; off < n; off += 12) {
+		uint32_t len = (n - off < 12) ? n - off : 12;
+		adc_frame_acc_feed(&acc, &map, stream + off, len);
+	}
+
+	CHECK(adc_frame_acc_ready(&acc, &map, 16));
+	uint16_t avg[4];
+	adc_frame_acc_average(&acc, &map, avg);
+	for (int c = 0; c < 4; c++) CHECK(avg[c] == 1000 * c + 8);	// media de 0..15 = 7.5 -> 8
+}
+
+int main(void)
+{
+	test_map();
+	test_feed_average();
+	test_partial_buffer();
+	test_accumulate_across_buffers();
+
+	if (s_failed) {
+		printf("test_adc_frame: %d comprobaciones fallidas\n", s_failed);
+		return 1;
+	}
+	printf("test_adc_frame: OK\n");
+	return 0;
+}
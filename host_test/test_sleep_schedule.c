@@ -0,0 +1,141 @@
+/*
+ * Calendario de deep sleep (sleep_schedule.c sobre sun_position.c) frente a
+ * una referencia: NOAA en doble precisión para los instantes UTC y la base de
+ * datos de zonas horarias para la hora local. Cubre los cambios de hora de
+ * Madrid y Sídney, orto y ocaso en San Francisco y la noche polar y el sol de
+ * medianoche en Tromsø.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "sleep_schedule.h"
+#include "sun_position.h"
+
+#define REF_TOL_S      60	// Error admitido en los instantes UTC
+#define REF_TOL_MIN    1	// Y en la hora local (minuto del día, redondeo)
+
+#define TZ_MADRID      "CET-1CEST,M3.5.0,M10.5.0/3"
+#define TZ_SYDNEY      "AEST-10AEDT,M10.1.0,M4.1.0/3"
+#define TZ_SF          "PST8PDT,M3.2.0,M11.1.0"
+
+typedef struct {
+	const char *name;
+	long long utc;			// Instante de la consulta
+	float lat, lon, elev;
+	const char *tz;			// Zona POSIX, como CONFIG_TIME_ZONE
+	sun_events_t result;
+	long long rise, set;	// UTC
+	int rise_min, set_min;	// Minuto del día en hora local
+} sched_ref_t;
+
+static const sched_ref_t s_sched_ref[] = {
+	{ "Madrid, solsticio de verano",        1718972088LL, 40.4168f, -3.7038f, -6.0f, TZ_MADRID, SUN_EVENTS_OK, 1718943099LL, 1719001309LL, 371, 1341 },
+	{ "Madrid, solsticio de invierno",      1734783288LL, 40.4168f, -3.7038f, -6.0f, TZ_MADRID, SUN_EVENTS_OK, 1734764626LL, 1734801751LL, 483, 1102 },
+	{ "Madrid, paso a horario de verano",   1743336888LL, 40.4168f, -3.7038f, -6.0f, TZ_MADRID, SUN_EVENTS_OK, 1743312853LL, 1743361493LL, 454, 1264 },
+	{ "Madrid, paso a horario de invierno", 1761480888LL, 40.4168f, -3.7038f, -6.0f, TZ_MADRID, SUN_EVENTS_OK, 1761458995LL, 1761500816LL, 429, 1126 },
+	{ "Sídney, fin del horario de verano",  1743904509LL, -33.8688f, 151.2093f, -6.0f, TZ_SYDNEY, SUN_EVENTS_OK, 1743882353LL, 1743926927LL, 345, 1088 },
+	{ "Sídney, inicio del horario de verano", 1759629309LL, -33.8688f, 151.2093f, -6.0f, TZ_SYDNEY, SUN_EVENTS_OK, 1759604519LL, 1759652753LL, 361, 1165 },
+	{ "San Francisco, orto y ocaso",        1762114180LL, 37.7749f, -122.4194f, -0.833f, TZ_SF, SUN_EVENTS_OK, 1762094190LL, 1762132165LL, 396, 1029 },
+	{ "Tromsø, crepúsculo en noche polar",  1766313850LL, 69.6492f, 18.9553f, -6.0f, TZ_MADRID, SUN_EVENTS_OK, 1766305882LL, 1766321600LL, 571, 833 },
+	{ "Tromsø, noche polar",                1766313850LL, 69.6492f, 18.9553f, -0.833f, TZ_MADRID, SUN_EVENTS_ALWAYS_DOWN, 1766313851LL, 1766313851LL, 704, 704 },
+	{ "Tromsø, sol de medianoche",          1750502650LL, 69.6492f, 18.9553f, -6.0f, TZ_MADRID, SUN_EVENTS_ALWAYS_UP, 1750459451LL, 1750545851LL, 44, 44 },
+};
+
+static int s_failed = 0;
+
+#define CHECK(name, cond) do { \
+	if (!(cond)) { \
+		printf("FALLO %s: %s\n", (name), #cond); \
+		s_failed++; \
+	} \
+} while (0)
+
+static int local_minute(time_t t)
+{
+	struct tm tm;
+	localtime_r(&t, &tm);
+	return tm.tm_hour * 60 + tm.tm_min;
+}
+
+static bool minute_ok(int got, int want)
+{
+	int d = abs(got - want);
+	if (d > 720) d = 1440 - d;
+	return d <= REF_TOL_MIN;
+}
+
+static void test_reference(const sched_ref_t *r)
+{
+	setenv("TZ", r->tz, 1);
+	tzset();
+
+	time_t rise, set;
+	sun_events_t res = sun_events_compute((time_t)r->utc, r->lat, r->lon, r->elev, &rise, &set);
+
+	printf("  %-38s orto %+4lld s (%02d:%02d), ocaso %+4lld s (%02d:%02d)\n", r->name,
+	       (long long)rise - r->rise, local_minute(rise) / 60, local_minute(rise) % 60,
+	       (long long)set - r->set, local_minute(set) / 60, local_minute(set) % 60);
+
+	CHECK(r->name, res == r->result);
+	CHECK(r->name, llabs((long long)rise - r->rise) <= REF_TOL_S);
+	CHECK(r->name, llabs((long long)set - r->set) <= REF_TOL_S);
+	CHECK(r->name, minute_ok(local_minute(rise), r->rise_min));
+	CHECK(r->name, minute_ok(local_minute(set), r->set_min));
+
+	sleep_schedule_t s;
+	switch (res) {
+	case SUN_EVENTS_OK:
+		// Antes del amanecer duerme justo hasta él; a mediodía no duerme hasta el anochecer
+		sleep_schedule_at(rise - 600, r->lat, r->lon, r->elev, &s);
+		CHECK(r->name, s.night && s.sleep_at == rise - 600 && s.wake_at == rise);
+		sleep_schedule_at(rise + (set - rise) / 2, r->lat, r->lon, r->elev, &s);
+		CHECK(r->name, !s.night && s.sleep_at == set && s.wake_at > set);
+		// Ya de noche: duerme ahora hasta el amanecer siguiente
+		sleep_schedule_at(set + 600, r->lat, r->lon, r->elev, &s);
+		CHECK(r->name, s.night && s.sleep_at == set + 600 && s.wake_at > set + 600);
+		CHECK(r->name, s.wake_at - rise > 86400 - 3600 && s.wake_at - rise < 86400 + 3600);
+		break;
+	case SUN_EVENTS_ALWAYS_DOWN:
+		// Noche polar: duerme hasta el mediodía solar para volver a comprobarlo
+		sleep_schedule_at((time_t)r->utc, r->lat, r->lon, r->elev, &s);
+		CHECK(r->name, s.night && s.wake_at == rise);
+		break;
+	case SUN_EVENTS_ALWAYS_UP:
+		// Sol de medianoche: nunca duerme y recalcula en la medianoche solar
+		sleep_schedule_at((time_t)r->utc, r->lat, r->lon, r->elev, &s);
+		CHECK(r->name, !s.night && s.sleep_at == set);
+		break;
+	}
+}
+
+// El calendario guardado usa el lugar de sdkconfig (shim: Madrid, crepúsculo civil)
+static void test_stored(void)
+{
+	const sched_ref_t *r = &s_sched_ref[0];
+	sleep_schedule_t s, got;
+
+	sleep_schedule_init();
+	CHECK("guardado", !sleep_schedule_get(&got));
+
+	sleep_schedule_compute((time_t)r->utc, &s);
+	CHECK("guardado", sleep_schedule_get(&got));
+	CHECK("guardado", got.dawn == s.dawn && got.dusk == s.dusk && got.wake_at == s.wake_at);
+	CHECK("guardado", llabs((long long)s.dawn - r->rise) <= REF_TOL_S);
+	CHECK("guardado", llabs((long long)s.dusk - r->set) <= REF_TOL_S);
+}
+
+int main(void)
+{
+	for (size_t i = 0; i < sizeof(s_sched_ref) / sizeof(s_sched_ref[0]); i++) {
+		test_reference(&s_sched_ref[i]);
+	}
+	test_stored();
+
+	if (s_failed) {
+		printf("test_sleep_schedule: %d comprobaciones fallidas\n", s_failed);
+		return 1;
+	}
+	printf("test_sleep_schedule: OK\n");
+	return 0;
+}
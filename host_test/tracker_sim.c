@@ -0,0 +1,376 @@
+/*
+ * Simulación de un día de seguimiento en el PC. El sol sale del modelo
+ * astronómico; los LDR responden a la sombra del separador con ruido, nubes
+ * aleatorias (misma semilla en todas las pasadas), y los servos tienen
+ * velocidad limitada y holgura. El PI y el modelo + PI ejecutan tracker_step(),
+ * la misma decisión por ciclo que tracker_task, con el reposo y el despertar
+ * por LDR del equipo; el paso fijo original queda como referencia.
+ *
+ * Registra el error de apuntado, la energía captada, el número de movimientos
+ * y el tiempo con los servos alimentados, así los cambios en el lazo se
+ * comparan con números. El lazo usa los valores por defecto de Kconfig.
+ * Sin argumentos (el caso de ctest) falla si el PI no apunta mejor que el
+ * paso fijo o tiene los servos alimentados más tiempo.
+ *
+ * Uso: tracker_sim [día del año] [% nubes] [holgura °] [error del montaje °]
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sdkconfig.h"
+#include "sun_position.h"
+#include "tracker_step.h"
+
+#define DEG2RAD(x)  ((x) * (float)M_PI / 180.0f)
+#define RAD2DEG(x)  ((x) * 180.0f / (float)M_PI)
+
+#define SIM_YEAR_START_UTC  1735689600LL	// 2025-01-01 00:00 UTC
+#define SIM_DAY_S        86400.0f
+#define SIM_SUN_UPDATE_S 10.0f		// El sol se mueve ~0.04° en este tiempo
+#define SIM_MIN_EL       2.0f		// Por debajo no se sigue (noche)
+#define SIM_ERR_MIN_EL   5.0f		// Elevación mínima para contar el error de apuntado
+
+// Modelo de los LDR (como en pi_bench.c): sombra diferencial del separador
+#define SIM_LEVEL        3000		// Luz total de un par a pleno sol (raw)
+#define SIM_SHADE        0.8f
+#define SIM_SHADE_DEG    20.0f
+#define SIM_NOISE        15
+
+// Cielo: difusa respecto al haz despejado y nubes con duración media fija
+#define SIM_DIFFUSE      0.1f
+#define SIM_CLOUD_DIFF   2.5f		// La nube dispersa el haz: más difusa
+#define SIM_CLOUD_ATT    0.2f		// Fracción del haz que atraviesa la nube
+#define SIM_CLOUD_MEAN_S 300.0f
+
+// Valores por defecto de Kconfig (el lazo sale de shim/sdkconfig.h)
+#define SIM_CYCLE_S      (CONFIG_TRACKER_UPDATE_MS / 1000.0f)
+#define SIM_IDLE_AFTER   20			// TRACKER_IDLE_AFTER_CYCLES
+#define SIM_RECHECK_S    60.0f		// TRACKER_RECHECK_S
+#define SIM_SLEW_DPS     90.0f		// SERVO_MAX_VEL_DPS
+#define SIM_LEGACY_STEP  2.0f		// Paso del algoritmo original
+#define SIM_PANEL_WP     10.0f
+
+typedef enum {
+	SIM_LEGACY = 0,		// Paso fijo cuando |a - b| > tolerancia (algoritmo original)
+	SIM_PI,				// tracker_step() sin modelo: lazo PI sobre el error de los LDR
+	SIM_PI_MODEL,		// tracker_step() con modelo solar + trim PI de los LDR
+	SIM_ALGO_MAX
+} sim_algo_t;
+
+// Montaje y cielo simulados
+typedef struct {
+	time_t day_utc;			// Medianoche UTC del día simulado
+	float backlash_deg;		// Holgura de la transmisión
+	float mount_err_deg;	// Error de orientación del montaje (el modelo no lo conoce)
+	float clouds_pct;		// Fracción del día con nubes
+} sim_cfg_t;
+
+typedef struct {
+	float err_rms_deg;		// Error de apuntado con sol directo y alcanzable por el eje H
+	float err_max_deg;
+	float energy_wh;		// Energía captada por el panel
+	float ideal_wh;			// Apuntado perfecto
+	uint32_t moves;			// Órdenes escritas a los servos
+	float servo_on_s;		// Tiempo con los servos alimentados
+} sim_result_t;
+
+typedef struct {
+	float cmd;		// Última orden escrita
+	float motor;	// Posición del eje del servo
+	float panel;	// Posición real del panel tras la holgura
+} sim_axis_t;
+
+typedef struct {
+	sim_axis_t h, v;
+} sim_servos_t;
+
+static const char *s_algo_names[SIM_ALGO_MAX] = {
+	"paso fijo", "PI", "modelo + PI",
+};
+
+static float clampf(float x, float lo, float hi)
+{
+	return (x < lo) ? lo : (x > hi) ? hi : x;
+}
+
+// Generador reproducible (LCG): misma secuencia de nubes y ruido para todos los algoritmos
+static uint32_t lcg(uint32_t *seed)
+{
+	*seed = *seed * 1664525u + 1013904223u;
+	return *seed >> 16;
+}
+
+static float rnd01(uint32_t *seed)
+{
+	return (float)lcg(seed) / 65536.0f;
+}
+
+static int noise(uint32_t *seed)
+{
+	return (int)(lcg(seed) % (2 * SIM_NOISE + 1)) - SIM_NOISE;
+}
+
+// Haz directo con cielo despejado, 1.0 = 1000 W/m2 (modelo de Meinel)
+static float clear_beam(float el_deg)
+{
+	if (el_deg <= 0.0f) return 0.0f;
+	float am = 1.0f / sinf(DEG2RAD(el_deg));
+	return 1.353f * powf(0.7f, powf(am, 0.678f));
+}
+
+static float wrap180(float a)
+{
+	a = fmodf(a + 180.0f, 360.0f);
+	return (a < 0.0f) ? a + 180.0f : a - 180.0f;
+}
+
+/*
+ * Par de LDR con el sol desplazado delta grados hacia el lado de 'a'.
+ * contrast: fracción directa de la luz (la difusa no hace sombra).
+ */
+static void ldr_pair(float level, float contrast, float delta, uint32_t *seed, int *a, int *b)
+{
+	float s = clampf(delta / SIM_SHADE_DEG, -1.0f, 1.0f) * SIM_SHADE * contrast;
+	*a = (int)(level / 2.0f * (1.0f + s)) + noise(seed);
+	*b = (int)(level / 2.0f * (1.0f - s)) + noise(seed);
+}
+
+// Servo con velocidad limitada; la transmisión arrastra al panel sólo al agotar la holgura
+static void axis_step(sim_axis_t *ax, float backlash, float dt)
+{
+	ax->motor += clampf(ax->cmd - ax->motor, -SIM_SLEW_DPS * dt, SIM_SLEW_DPS * dt);
+
+	float half = backlash / 2.0f;
+	ax->panel = clampf(ax->panel, ax->motor - half, ax->motor + half);
+}
+
+// E/S de tracker_step() sobre los servos simulados
+static bool sim_move(void *ctx, float h, float v)
+{
+	sim_servos_t *sv = ctx;
+	sv->h.cmd = h;
+	sv->v.cmd = v;
+	return true;
+}
+
+static bool sim_is_moving(void *ctx)
+{
+	sim_servos_t *sv = ctx;
+	return fabsf(sv->h.cmd - sv->h.motor) > 1e-3f || fabsf(sv->v.cmd - sv->v.motor) > 1e-3f;
+}
+
+// Lazo con los valores por defecto de Kconfig (TOLERANCE, TRIM_*, SUN_*)
+static void tracker_cfg_default(bool model, tracker_cfg_t *cfg, pi_gains_t *gains)
+{
+	*cfg = (tracker_cfg_t){
+		.tolerance = CONFIG_TRACKER_TOLERANCE,
+		.tolerance_cal = CONFIG_TRACKER_TOLERANCE_CAL,
+		.dt_s = SIM_CYCLE_S,
+		.ldr_drives = true,
+		.sun_model = model,
+		.lat = 40.4168f,
+		.lon = -3.7038f,
+		.az_center = 180.0f,
+		.min_elevation = 0.0f,
+		.trim_max = 15.0f,
+		.move_min = 0.5f,
+		.trim_min_raw = 500,
+	};
+	*gains = (pi_gains_t){
+		.kp = strtof(CONFIG_TRACKER_PI_KP, NULL),
+		.ki = strtof(CONFIG_TRACKER_PI_KI, NULL),
+		.max_step = strtof(CONFIG_TRACKER_STEP_DEG, NULL),
+		.hyst_off = CONFIG_TRACKER_HYST_PCT / 100.0f,
+	};
+}
+
+static void sim_run(sim_algo_t algo, const sim_cfg_t *cfg, sim_result_t *out)
+{
+	const float dt = SIM_CYCLE_S;
+
+	tracker_cfg_t tcfg;
+	tracker_inputs_t in = { 0 };
+	tracker_cfg_default(algo == SIM_PI_MODEL, &tcfg, &in.gains);
+
+	sim_servos_t sv = { { 90.0f, 90.0f, 90.0f }, { 45.0f, 45.0f, 45.0f } };
+	const tracker_io_t io = { .move = sim_move, .is_moving = sim_is_moving, .ctx = &sv };
+	tracker_state_t st;
+	tracker_state_init(&st, sv.h.cmd, sv.v.cmd);
+
+	// Reposo como en tracker_task: servos sin pulsos hasta que los LDR o la revisión lo despierten
+	tracker_wake_ref_t wake;
+	uint32_t still = 0;
+	bool idle = false;
+	float idle_t = 0.0f;
+
+	uint32_t seed = 2024;
+	bool acquired = false;
+	bool cloudy = false;
+	double err_sq = 0.0;
+	uint32_t err_n = 0;
+	double energy = 0.0, ideal = 0.0;
+
+	*out = (sim_result_t){ 0 };
+
+	sun_pos_t sun = { 0 };
+	float beam_clear = 0.0f;
+	float next_sun = 0.0f;
+
+	const uint32_t steps = (uint32_t)(SIM_DAY_S / dt);
+	for (uint32_t k = 0; k < steps; k++) {
+		float t = k * dt;
+		if (t >= next_sun) {
+			sun_position_compute(cfg->day_utc + (time_t)t, tcfg.lat, tcfg.lon, &sun);
+			beam_clear = clear_beam(sun.elevation_deg);
+			next_sun = t + SIM_SUN_UPDATE_S;
+		}
+		if (sun.elevation_deg < SIM_MIN_EL) {
+			// Noche: la tarea no mueve nada; se salta hasta la siguiente posición del sol
+			k = (uint32_t)(next_sun / dt) - 1;
+			continue;
+		}
+
+		if (!acquired) {
+			// Al salir el sol, como tras el barrido de adquisición: todos parten apuntando al sol
+			float h0 = clampf(90.0f + wrap180(sun.azimuth_deg - 180.0f), 0.0f, 180.0f);
+			float v0 = clampf(sun.elevation_deg, 0.0f, 180.0f);
+			sv.h = (sim_axis_t){ h0, h0, h0 };
+			sv.v = (sim_axis_t){ v0, v0, v0 };
+			tracker_state_init(&st, h0, v0);
+			tracker_command(&st, &io, h0, v0, 0.0f);
+			acquired = true;
+		}
+
+		// Nubes: cadena de dos estados con la fracción del día y la duración media configuradas
+		float frac = cfg->clouds_pct / 100.0f;
+		if (cloudy) {
+			if (rnd01(&seed) < dt / SIM_CLOUD_MEAN_S) cloudy = false;
+		} else if (frac > 0.0f && frac < 1.0f) {
+			if (rnd01(&seed) < dt * frac / ((1.0f - frac) * SIM_CLOUD_MEAN_S)) cloudy = true;
+		} else {
+			cloudy = frac >= 1.0f;
+		}
+
+		float beam = cloudy ? beam_clear * SIM_CLOUD_ATT : beam_clear;
+		float diffuse = beam_clear * SIM_DIFFUSE * (cloudy ? SIM_CLOUD_DIFF : 1.0f);
+
+		// Orientación real del panel (el montaje gira mount_err respecto a lo supuesto)
+		float pan_az = 180.0f + (sv.h.panel - 90.0f) + cfg->mount_err_deg;
+		float pan_el = sv.v.panel;
+		float cos_t = sinf(DEG2RAD(sun.elevation_deg)) * sinf(DEG2RAD(pan_el)) +
+		              cosf(DEG2RAD(sun.elevation_deg)) * cosf(DEG2RAD(pan_el)) *
+		              cosf(DEG2RAD(sun.azimuth_deg - pan_az));
+		cos_t = clampf(cos_t, -1.0f, 1.0f);
+
+		energy += SIM_PANEL_WP * (beam * fmaxf(cos_t, 0.0f) + diffuse) * dt / 3600.0f;
+		ideal += SIM_PANEL_WP * (beam + diffuse) * dt / 3600.0f;
+
+		// Error de seguimiento sólo con sol directo y dentro del recorrido del eje H
+		float reach_h = 90.0f + wrap180(sun.azimuth_deg - 180.0f - cfg->mount_err_deg);
+		if (!cloudy && sun.elevation_deg >= SIM_ERR_MIN_EL && reach_h >= 0.0f && reach_h <= 180.0f) {
+			float err = RAD2DEG(acosf(cos_t));
+			err_sq += (double)err * err;
+			err_n++;
+			if (err > out->err_max_deg) out->err_max_deg = err;
+		}
+
+		// Lecturas de los LDR en el marco del panel
+		float direct = beam * fmaxf(cos_t, 0.0f);
+		float level = SIM_LEVEL * (direct + diffuse);
+		float contrast = (direct + diffuse > 0.0f) ? direct / (direct + diffuse) : 0.0f;
+		float d_v = sun.elevation_deg - pan_el;
+		float d_h = wrap180(sun.azimuth_deg - pan_az) * cosf(DEG2RAD(sun.elevation_deg));
+
+		// Mismo reparto que tracker_task: Bot > Top sube V, Left > Right sube H
+		ldr_pair(level, contrast, d_v, &seed, &in.bot, &in.top);
+		ldr_pair(level, contrast, d_h, &seed, &in.left, &in.right);
+		in.utc = cfg->day_utc + (time_t)t;
+
+		if (idle) {
+			// El hook de LDR corre con cada instantánea; si no, hasta la revisión programada
+			if (tracker_wake_check(&wake, &tcfg, &in) || t - idle_t >= SIM_RECHECK_S) {
+				idle = false;
+				still = 0;
+			}
+		}
+
+		if (!idle) {
+			tracker_data_t td = { 0 };
+			tracker_step_result_t res;
+
+			if (algo == SIM_LEGACY) {
+				if (abs(in.bot - in.top) > tcfg.tolerance) st.angle_v += (in.bot > in.top) ? SIM_LEGACY_STEP : -SIM_LEGACY_STEP;
+				if (abs(in.left - in.right) > tcfg.tolerance) st.angle_h += (in.left > in.right) ? SIM_LEGACY_STEP : -SIM_LEGACY_STEP;
+				st.angle_h = clampf(st.angle_h, 0.0f, 180.0f);
+				st.angle_v = clampf(st.angle_v, 0.0f, 180.0f);
+
+				res.moved = tracker_command(&st, &io, st.angle_h, st.angle_v, 0.0f);
+				res.busy = res.moved || sim_is_moving(&sv);
+			} else {
+				tracker_step(&st, &tcfg, &in, &io, &td, &res);
+			}
+
+			if (res.busy) {
+				still = 0;
+			} else if (++still >= SIM_IDLE_AFTER) {
+				tracker_wake_ref(&st, &tcfg, &wake);
+				idle = true;
+				idle_t = t;
+			}
+			out->servo_on_s += dt;
+		}
+
+		axis_step(&sv.h, cfg->backlash_deg, dt);
+		axis_step(&sv.v, cfg->backlash_deg, dt);
+	}
+
+	out->err_rms_deg = (err_n > 0) ? (float)sqrt(err_sq / err_n) : 0.0f;
+	out->energy_wh = (float)energy;
+	out->ideal_wh = (float)ideal;
+	out->moves = st.moves;
+}
+
+int main(int argc, char **argv)
+{
+	int day = (argc > 1) ? atoi(argv[1]) : 172;
+	sim_cfg_t cfg = {
+		.clouds_pct = (argc > 2) ? strtof(argv[2], NULL) : 20.0f,
+		.backlash_deg = (argc > 3) ? strtof(argv[3], NULL) : 1.0f,
+		.mount_err_deg = (argc > 4) ? strtof(argv[4], NULL) : 3.0f,
+	};
+	if (day < 1 || day > 365 || cfg.clouds_pct < 0.0f || cfg.clouds_pct > 100.0f || cfg.backlash_deg < 0.0f) {
+		fprintf(stderr, "Uso: %s [día 1-365] [%% nubes 0-100] [holgura °] [error del montaje °]\n", argv[0]);
+		return 2;
+	}
+	cfg.day_utc = (time_t)(SIM_YEAR_START_UTC + (day - 1) * 86400LL);
+
+	printf("Día %d de 2025, %.0f%% nubes, holgura %.1f°, montaje desviado %.1f°\n",
+	       day, cfg.clouds_pct, cfg.backlash_deg, cfg.mount_err_deg);
+
+	int rc = 0;
+	sim_result_t res[SIM_ALGO_MAX];
+	for (int a = 0; a < SIM_ALGO_MAX; a++) {
+		sim_result_t r;
+		sim_run((sim_algo_t)a, &cfg, &r);
+		res[a] = r;
+
+		printf("%-12s error rms %5.2f° (max %5.1f°), %6.2f de %6.2f Wh (%5.1f%%), %6lu movimientos, servos %6.0f s\n",
+		       s_algo_names[a], r.err_rms_deg, r.err_max_deg, r.energy_wh, r.ideal_wh,
+		       (r.ideal_wh > 0.0f) ? 100.0f * r.energy_wh / r.ideal_wh : 0.0f,
+		       (unsigned long)r.moves, r.servo_on_s);
+
+		// Sin sol o con resultados no finitos la simulación está rota
+		if (!(r.ideal_wh > 0.0f) || !isfinite(r.err_rms_deg) || r.energy_wh > r.ideal_wh) rc = 1;
+	}
+
+	// Con el día de referencia, las ganancias por defecto deben mejorar al paso fijo
+	if (argc == 1 && (res[SIM_PI].err_rms_deg >= res[SIM_LEGACY].err_rms_deg ||
+	                  res[SIM_PI].servo_on_s >= res[SIM_LEGACY].servo_on_s)) {
+		printf("FALLO: el PI no mejora al paso fijo (error %.3f° frente a %.3f°, servos %.0f s frente a %.0f s)\n",
+		       res[SIM_PI].err_rms_deg, res[SIM_LEGACY].err_rms_deg,
+		       res[SIM_PI].servo_on_s, res[SIM_LEGACY].servo_on_s);
+		rc = 1;
+	}
+	return rc;
+}
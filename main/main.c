@@ -1,17 +1,22 @@
 #include "freertos/idf_additions.h"
 #include "freertos/projdefs.h"
-#include "driver/i2c.h"
+#include "driver/i2c_master.h"
 
 #include "ina.h"
 #include "adc.h"
-#include "protect.h"
-#include "battery.h"
+#include "snapshot.h"
+#include "battery_state.h"
+#include "pipeline.h"
+#include "sleep_schedule.h"
+#include "boot_profile.h"
+#include "energy_mode.h"
 #include "nvs_managment.h"
 #include "wifi_managment.h"
 #include "mqtt_protocol.h"
 #include "solar_tracker.h"
 #include "web_managment.h"
 #include "telegram_bot.h"
+#include "telemetry_batch.h"
 
 #include "esp_log.h"
 #include "esp_err.h"
@@ -20,92 +25,104 @@
 #include <sys/time.h>
 #include "esp_sntp.h"
 #include "esp_sleep.h"
+#include "esp_pm.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
 
-#define BAT_CAPACITY_AH  strtof(CONFIG_BAT_CAPACITY_AH, NULL)
-#define LOOP_PERIOD_S    ((float)CONFIG_MAIN_LOOP_PERIOD_S)
-
 // Deep Sleep
-#define SLEEP_START_HOUR    CONFIG_SLEEP_START_HOUR
-#define SLEEP_WAKE_HOUR     CONFIG_SLEEP_WAKE_HOUR
 #define TIME_ZONE           CONFIG_TIME_ZONE
+#define SLEEP_MIN_S         60	// Menos que esto hasta el amanecer: no compensa dormir
+#define RADIO_BURST_MS      20000	// Modo crítico: espera máxima a WiFi, broker y confirmación
 
 // Configuracion Pines I2C
 #define I2C_MASTER_NUM I2C_NUM_0
 #define I2C_MASTER_SCL CONFIG_I2C_SCL_PIN
 #define I2C_MASTER_SDA CONFIG_I2C_SDA_PIN
-#define I2C_MASTER_FREQ_HZ CONFIG_I2C_FREQ_HZ
-#define I2C_MASTER_TX_BUF_DISABLE 0  // Como el ESP32 es el maestro no necesita tener buffer de transmision ni buffer de recibir datos
-#define I2C_MASTER_RX_BUF_DISABLE 0  // Por eso se ponen a 0, si hubiera otro controlador mandandole datos se pondria el tamano del buffer
-
-SemaphoreHandle_t g_data_mutex = NULL;
 
 static const char *TAG = "MAIN";
 
-// Configurar Init I2C
+static i2c_master_bus_handle_t s_i2c_bus = NULL;
+
+// Configurar Init I2C (driver i2c_master). La frecuencia SCL se fija por dispositivo en ina.c
 static esp_err_t i2c_master_init(void)
 {
-	static bool initialized = false;
-	if (initialized) return ESP_OK;
+	if (s_i2c_bus != NULL) return ESP_OK;
 
-	i2c_config_t config = 
+	i2c_master_bus_config_t config = 
 	{
-		.mode = I2C_MODE_MASTER,
+		.i2c_port = I2C_MASTER_NUM,
 		.sda_io_num = I2C_MASTER_SDA,
-		// Cuando nadie esta hablando por el cable I2C, lo mantiene en 1 (3V3) para que el ESP32 no vea basura
-		.sda_pullup_en = GPIO_PULLUP_ENABLE,
 		.scl_io_num = I2C_MASTER_SCL,
-		.scl_pullup_en = GPIO_PULLUP_ENABLE,
-		.master.clk_speed = I2C_MASTER_FREQ_HZ,
+		.clk_source = I2C_CLK_SRC_DEFAULT,
+		.glitch_ignore_cnt = 7,
+#if CONFIG_I2C_ASYNC_BATCH
+		// Cola de transferencias > 0 -> el driver trabaja en modo asíncrono
+		.trans_queue_depth = CONFIG_I2C_TRANS_QUEUE_DEPTH,
+#endif
+		// Cuando nadie esta hablando por el cable I2C, lo mantiene en 1 (3V3) para que el ESP32 no vea basura
+		.flags.enable_internal_pullup = true,
 	};
 
-	esp_err_t err = i2c_param_config(I2C_MASTER_NUM, &config);
-	if (err != ESP_OK)
-		return err;
-	
-	// Inicia el i2c en modo master
-	err = i2c_driver_install(I2C_MASTER_NUM,
-							  config.mode,
-							  I2C_MASTER_RX_BUF_DISABLE,
-							  I2C_MASTER_TX_BUF_DISABLE,
- 							  0);	
+	return i2c_new_master_bus(&config, &s_i2c_bus);
+}
 
-	if (err == ESP_OK)
-		initialized = true;
+static void time_sync_cb(struct timeval *tv)
+{
+    boot_profile_mark(BOOT_PHASE_TIME);
 
-	return err;
+    struct tm timeinfo;
+    localtime_r(&tv->tv_sec, &timeinfo);
+    ESP_LOGI(TAG, "Hora sincronizada por SNTP: %02d:%02d:%02d", timeinfo.tm_hour, timeinfo.tm_min, timeinfo.tm_sec);
 }
 
-// Esta función configura el servidor NTP y espera a que la hora se sincronice.
-static void setup_time(void)
+// Zona horaria antes de arrancar nada: la hora del RTC sigue corriendo en deep sleep
+static void setup_timezone(void)
 {
-    ESP_LOGI(TAG, "Iniciando sincronización SNTP...");
-    esp_sntp_setoperatingmode(SNTP_OPMODE_POLL);
-    esp_sntp_setservername(0, "pool.ntp.org");
-    esp_sntp_init();
-
-    // Configurar Timezone
     setenv("TZ", TIME_ZONE, 1);
     tzset();
 
-    // Esperar sincronización (máximo 15 segundos)
-    int retry = 0;
-    const int retry_count = 15;
-    while (sntp_get_sync_status() == SNTP_SYNC_STATUS_RESET && ++retry < retry_count) {
-        ESP_LOGI(TAG, "Esperando hora del sistema... (%d/%d)", retry, retry_count);
-        vTaskDelay(pdMS_TO_TICKS(1000));
-    }
-
     time_t now;
     struct tm timeinfo;
     time(&now);
     localtime_r(&now, &timeinfo);
-    ESP_LOGI(TAG, "Hora actual: %02d:%02d:%02d", timeinfo.tm_hour, timeinfo.tm_min, timeinfo.tm_sec);
+    if (timeinfo.tm_year >= (2016 - 1900)) {
+        ESP_LOGI(TAG, "Hora del RTC: %02d:%02d:%02d", timeinfo.tm_hour, timeinfo.tm_min, timeinfo.tm_sec);
+    } else {
+        ESP_LOGI(TAG, "Sin hora válida hasta la primera sincronización SNTP");
+    }
+}
+
+// SNTP en segundo plano: no se espera a la sincronización, quien necesita la hora comprueba si es válida
+static void setup_time(void)
+{
+    ESP_LOGI(TAG, "Iniciando sincronización SNTP...");
+    esp_sntp_setoperatingmode(SNTP_OPMODE_POLL);
+    esp_sntp_setservername(0, "pool.ntp.org");
+    sntp_set_time_sync_notification_cb(time_sync_cb);
+    esp_sntp_init();
 }
 
+#if CONFIG_SLEEP_LIGHT_DAY
+// Light sleep automático entre ticks: las tareas que no pueden dormirse toman un cerrojo esp_pm
+static void setup_power_management(void)
+{
+    esp_pm_config_t pm_config = {
+        .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = CONFIG_XTAL_FREQ,
+        .light_sleep_enable = true,
+    };
+
+    esp_err_t err = esp_pm_configure(&pm_config);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "No se pudo activar el light sleep automático: %s", esp_err_to_name(err));
+    } else {
+        ESP_LOGI(TAG, "Light sleep automático activo (%d-%d MHz)", CONFIG_XTAL_FREQ, CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ);
+    }
+}
+#endif
+
 static void check_and_enter_sleep(void)
 {
     time_t now;
@@ -119,63 +136,136 @@ static void check_and_enter_sleep(void)
         return;
     }
 
-    int current_hour = timeinfo.tm_hour;
+    // Amanecer/anochecer del día en la ubicación configurada (cambia con la estación)
+    sleep_schedule_t sched;
+    sleep_schedule_compute(now, &sched);
+    if (!sched.night) return;
 
-    // Condición de Noche: 
-    // Si la hora actual es >= Hora Dormir (ej. 20) O es < Hora Despertar (ej. 7)
-    // Nota: El segundo caso cubre si reinicias el sistema a las 3 de la mañana.
-    bool is_night = (current_hour >= SLEEP_START_HOUR) || (current_hour < SLEEP_WAKE_HOUR);
+    // Noche polar o sol de medianoche a punto de terminar: se vuelve a comprobar en el siguiente ciclo
+    double seconds_to_sleep = difftime(sched.wake_at, now);
+    if (seconds_to_sleep < SLEEP_MIN_S) return;
 
-    if (is_night) {
-        ESP_LOGI(TAG, "Es de noche (%d:00). Preparando Deep Sleep...", current_hour);
+    struct tm wake_tm;
+    localtime_r(&sched.wake_at, &wake_tm);
 
-        // 1. Aparcar servos
-        solar_tracker_park();
+    ESP_LOGI(TAG, "Es de noche (%02d:%02d). Preparando Deep Sleep...", timeinfo.tm_hour, timeinfo.tm_min);
 
-        // 2. Calcular segundos hasta despertar
-        struct tm wake_tm = timeinfo;
-        wake_tm.tm_min = 0;
-        wake_tm.tm_sec = 0;
-        
-        if (current_hour >= SLEEP_START_HOUR) {
-            // Caso A: Son las 21:00, despertar mañana a las 07:00
-            wake_tm.tm_mday += 1; // Mañana
-            wake_tm.tm_hour = SLEEP_WAKE_HOUR;
-        } else {
-            // Caso B: Son las 03:00, despertar hoy a las 07:00
-            wake_tm.tm_hour = SLEEP_WAKE_HOUR;
-        }
+    // 1. Aparcar servos y guardar el estado de la batería y de la WiFi
+    solar_tracker_park();
+    battery_state_flush();
+    wifi_prepare_sleep();
 
-        time_t wake_time = mktime(&wake_tm);
-        double seconds_to_sleep = difftime(wake_time, now);
+    // 2. Dormir justo hasta el próximo amanecer
+    ESP_LOGI(TAG, "Durmiendo durante %.0f segundos hasta las %02d:%02d...",
+             seconds_to_sleep, wake_tm.tm_hour, wake_tm.tm_min);
 
-        if (seconds_to_sleep <= 0) {
-            seconds_to_sleep = 60; // Seguridad por si el cálculo falla
-        }
+    // Configurar Timer Wakeup
+    // Deep sleep usa microsegundos
+    esp_sleep_enable_timer_wakeup((uint64_t)seconds_to_sleep * 1000000ULL);
+
+    // Entrar en sueño profundo
+    esp_deep_sleep_start();
+    // El código nunca pasa de aquí, al despertar reinicia el ESP32
+}
+
+#if CONFIG_ENERGY_MODES
+// Supervivencia: todo apagado hasta que el panel vuelva a dar tensión (se comprueba al despertar)
+static void enter_survival_sleep(void)
+{
+    uint64_t sleep_s = CONFIG_ENERGY_SURVIVAL_CHECK_MIN * 60ULL;
+
+    // De noche no hay panel que comprobar: hasta el amanecer
+    time_t now;
+    struct tm timeinfo;
+    time(&now);
+    localtime_r(&now, &timeinfo);
+    if (timeinfo.tm_year >= (2016 - 1900)) {
+        sleep_schedule_t sched;
+        sleep_schedule_compute(now, &sched);
+        if (sched.night && difftime(sched.wake_at, now) > sleep_s) sleep_s = (uint64_t)difftime(sched.wake_at, now);
+    }
+
+    ESP_LOGW(TAG, "Modo supervivencia: deep sleep de %llu s", (unsigned long long)sleep_s);
 
-        ESP_LOGI(TAG, "Durmiendo durante %.0f segundos hasta las %02d:00...", seconds_to_sleep, SLEEP_WAKE_HOUR);
+    // El panel ya está en reposo (tracker detenido)
+    battery_state_flush();
+    wifi_prepare_sleep();
 
-        // Configurar Timer Wakeup
-        // Deep sleep usa microsegundos
-        esp_sleep_enable_timer_wakeup((uint64_t)seconds_to_sleep * 1000000ULL);
+    esp_sleep_enable_timer_wakeup(sleep_s * 1000000ULL);
+    esp_deep_sleep_start();
+}
 
-        // Entrar en sueño profundo
-        esp_deep_sleep_start();
-        // El código nunca pasa de aquí, al despertar reinicia el ESP32
+// Despertar en supervivencia: sólo los INA; sin tensión en el panel, a dormir sin encender la WiFi
+static void survival_check(void)
+{
+    ina_snapshot_t snap;
+    bool ok = false;
+    for (int waited = 0; !(ok = snapshot_read_ina(&snap)) && waited < 3 * CONFIG_TASK_INA_PERIOD_MS; waited += 100) {
+        vTaskDelay(pdMS_TO_TICKS(100));
     }
+
+    if (ok && energy_mode_power_returned(&snap)) return;
+    enter_survival_sleep();
 }
 
-void app_main(void)
-{	
-	// Creamos el Mutex
-    g_data_mutex = xSemaphoreCreateMutex();
-    if (g_data_mutex == NULL) {
-        ESP_LOGE(TAG, "No se pudo crear el Mutex");
-        return;
+// Evalúa el modo con el SoC y su tendencia. Avisa de los cambios por Telegram (si hay red).
+static energy_mode_t energy_step(void)
+{
+    battery_state_t bat;
+    battery_state_get(&bat);
+
+    energy_mode_t prev = energy_mode_get();
+    energy_mode_t mode = energy_mode_update(&bat);
+    if (mode == prev) return mode;
+
+    // telegram_send_text serializa el envío con las respuestas de la tarea del bot
+    if (xEventGroupGetBits(s_wifi_event_group) & WIFI_CONNECTED_BIT) {
+        telegram_send_text("⚡ Modo de energía: %s -> %s (SoC %.1f%%, previsto %.1f%%)",
+                           energy_mode_name(prev), energy_mode_name(mode), bat.soc, energy_mode_level());
     }
+#if !CONFIG_TELEMETRY_BATCH
+    // De vuelta a un modo con la radio siempre encendida (con lotes la gestiona la tarea de subida)
+    if (energy_mode_policy()->radio && !wifi_radio_is_on()) {
+        wifi_radio_on(0);
+        mqtt_app_resume();
+    }
+#endif
+    return mode;
+}
+
+#if !CONFIG_TELEMETRY_BATCH
+// Modo crítico: la radio se enciende sólo para publicar
+static bool radio_burst_begin(void)
+{
+    if (!wifi_radio_on(RADIO_BURST_MS)) return false;
+    mqtt_app_resume();
+    return mqtt_wait_connected(RADIO_BURST_MS);
+}
+
+static void radio_burst_end(void)
+{
+    // Sin hora válida se queda encendida: SNTP la necesita
+    time_t now;
+    struct tm timeinfo;
+    time(&now);
+    localtime_r(&now, &timeinfo);
+    if (timeinfo.tm_year < (2016 - 1900)) return;
+
+    mqtt_wait_delivered(RADIO_BURST_MS);
+    mqtt_app_suspend();
+    wifi_fast_ip_release();
+    wifi_radio_off();
+}
+#endif
+#endif
 
+void app_main(void)
+{	
 	init_nvs();
 
+	ldr_cal_t ldr_cal;
+	if (load_ldr_calibration(&ldr_cal)) adc_ldr_cal_set(&ldr_cal);
+
 	wifi_init_system();
 	
 	char ssid[33] = {0};
@@ -197,11 +287,33 @@ void app_main(void)
 	{
 		ESP_LOGI(TAG, "Credenciales encontradas. Conectando a %s...", ssid);
 		
-		i2c_master_init();
+		ESP_ERROR_CHECK(i2c_master_init());
+
+		setup_timezone();
+		sleep_schedule_init();
+#if CONFIG_SLEEP_LIGHT_DAY
+		setup_power_management();
+#endif
+
+		// Sensores y tracker primero: no dependen de la red y el SoC ya se está
+		// integrando mientras la WiFi se asocia. Ambas tareas se despiertan con el
+		// mismo tick (pipeline.c), con prioridad por periodo y fuera del núcleo de la pila WiFi.
+		pipeline_start();
+#if CONFIG_ENERGY_MODES
+		energy_mode_init();
+#endif
+		xTaskCreatePinnedToCore(ina_task, "ina_task", 4096, s_i2c_bus, PIPELINE_PRIO_INA, NULL, PIPELINE_CORE_APP);
+		xTaskCreatePinnedToCore(adc_task, "adc_task", 4096, NULL, PIPELINE_PRIO_ADC, NULL, PIPELINE_CORE_APP);
+		solar_tracker_start();
+		boot_profile_mark(BOOT_PHASE_SENSORS);
+
+#if CONFIG_ENERGY_MODES
+		if (energy_mode_get() == ENERGY_MODE_SURVIVAL) survival_check();
+#endif
 
 		wifi_start_sta(ssid, pass);
 
-		// Esperar a tener IP antes de lanzar tareas
+		// Esperar a tener IP antes de lanzar los servicios de red
         // Esperamos bits CONNECTED o FAIL
         EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group,
                                                WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
@@ -210,95 +322,99 @@ void app_main(void)
                                                portMAX_DELAY);
 
 		if (bits & WIFI_CONNECTED_BIT) {
-            ESP_LOGI(TAG, "WiFi Conectado. Iniciando Tareas de Sensores...");
-            
+            ESP_LOGI(TAG, "WiFi Conectado. Iniciando servicios de red...");
+
+            // MQTT lo primero: la primera telemetría es lo que mide el arranque
+            mqtt_app_start();
+            setup_time();
+
             httpd_handle_t server = start_webserver();
 
             if (server != NULL) {
                 register_ota_handlers(server);
+                register_ldr_cal_handlers(server);
             }
 
-			setup_time();
-
 			telegram_bot_start();
+        } else if (bits & WIFI_FAIL_BIT) {
+            ESP_LOGE(TAG, "Fallo al conectar WiFi. ¿Credenciales mal? ¿Resetear NVS?");
+            // Sin red los sensores, el tracker y el deep sleep nocturno siguen funcionando
+#if CONFIG_TELEMETRY_BATCH || CONFIG_ENERGY_MODES
+            setup_time();   // Cada subida reintenta la WiFi: SNTP sincronizará en la primera que conecte
+#endif
+        }
 
-            // Aquí lanzamos tus tareas
-            xTaskCreate(ina_task, "ina_task", 4096, NULL, 5, NULL);
-            xTaskCreate(adc_task, "adc_task", 4096, NULL, 5, NULL);
-			
-			mqtt_app_start();			
-				
-			solar_tracker_start();			
+#if CONFIG_TELEMETRY_BATCH
+        // Primera subida inmediata (lo guardado en RTC antes del deep sleep); después la radio se apaga
+        telemetry_batch_start();
+#endif
 
-			vTaskDelay(pdMS_TO_TICKS(1500));
+        vTaskPrioritySet(NULL, PIPELINE_PRIO_MAIN);
 
-			float soc = 50.0f;
-			float v_bat_init = 0.0f;
-		
-			if(xSemaphoreTake(g_data_mutex, portMAX_DELAY)) {
-				v_bat_init = g_ina219_data[INA219_DEVICE_BATTERY].bus_voltage_V;
-				xSemaphoreGive(g_data_mutex);
-			}
-		
-		    if (v_bat_init > 1.0f) {
-		        soc = battery_porcent_from_voltage(v_bat_init);
-		        ESP_LOGI(TAG, "SoC inicial estimado: Vbat=%.3f V -> %.1f%%",
-		                 v_bat_init, soc);
-		    } else {
-		        ESP_LOGW(TAG, "No se pudo leer Vbat inicial; usando SoC=50%%");
-		    }
-            
-            // Loop principal (Monitorización, MQTT, etc)
-            while(1) {
-                ina219_data_t d_panel = {0};
-                ina219_data_t d_bat = {0};
-                ldr_data_t d_ldrs[LDR_COUNT]; // Array local
-				tracker_data_t d_tracker = {0};
-                bool data_ok = false;
-		
-				if (xSemaphoreTake(g_data_mutex, pdMS_TO_TICKS(200))) {
-					d_panel = g_ina219_data[INA219_DEVICE_PANEL];
-                    d_bat   = g_ina219_data[INA219_DEVICE_BATTERY];
-                    
-                    // Copia eficiente del array de LDRs
-                    memcpy(d_ldrs, g_ldr_data, sizeof(ldr_data_t) * LDR_COUNT);
-
-					d_tracker = g_tracker_data;
-                    
-                    data_ok = true;
-		            xSemaphoreGive(g_data_mutex);
-				} else {
-		            ESP_LOGW(TAG, "No se pudo obtener Mutex para leer datos");
-		        }
-
-				if (data_ok) {
-                    // Actualización del SoC (Coulomb Counting + Voltaje)
-                    soc = battery_soc_update(
-                        soc,
-                        d_bat.bus_voltage_V,
-                        d_bat.current_A,
-                        LOOP_PERIOD_S,
-                        BAT_CAPACITY_AH
-                    );
-                    
-                    // Loguear en consola
-                    ESP_LOGI(TAG, "Panel: %.2fW | Bat: %.2f%% | Voltage: %.2fV| Servos H:%.1f V:%.1f",
-                             d_panel.power_W, soc, d_panel.bus_voltage_V, d_tracker.angle_h, d_tracker.angle_v);
-            
-                    // Enviar Telemetría MQTT
-                    // Pasamos las direcciones de las estructuras locales
-                    mqtt_send_telemetry(&d_panel, &d_bat, soc, d_ldrs, &d_tracker);
-
-					check_and_enter_sleep();
+        // Loop principal (Monitorización, MQTT, etc): se activa con cada N-ésima muestra
+        // INA recién publicada, así los datos enviados tienen milisegundos y no segundos
+        while(1) {
+            int64_t release_us = pipeline_wait(PIPELINE_STAGE_MAIN);
+
+            ina_snapshot_t d_ina;
+            ldr_snapshot_t d_ldr;
+            tracker_snapshot_t d_tracker;
+	
+			// Lectura sin bloqueo: INA es imprescindible, LDR/tracker pueden no existir aún
+			bool data_ok = snapshot_read_ina(&d_ina);
+			if (!data_ok) {
+	            ESP_LOGW(TAG, "Aún no hay datos de los INA");
+	        } else if (snapshot_age_ms(d_ina.timestamp_us) > 3 * CONFIG_TASK_INA_PERIOD_MS) {
+	        	ESP_LOGW(TAG, "Datos INA con %lu ms de antigüedad", (unsigned long)snapshot_age_ms(d_ina.timestamp_us));
+	        }
+
+			if (!snapshot_read_ldr(&d_ldr)) memset(&d_ldr, 0, sizeof(d_ldr));
+			if (!snapshot_read_tracker(&d_tracker)) memset(&d_tracker, 0, sizeof(d_tracker));
+
+			if (data_ok) {
+				ina_data_t d_panel = d_ina.ch[INA_ROLE_PANEL];
+
+                // SoC del servicio de batería (lo integra la tarea de los INA)
+                float soc = d_ina.battery_soc;
+                
+                // Loguear en consola
+                ESP_LOGI(TAG, "Panel: %.2fW | Bat: %.2f%% | Voltage: %.2fV| Servos H:%.1f V:%.1f",
+                         d_panel.power_W, soc, d_panel.bus_voltage_V, d_tracker.tracker.angle_h, d_tracker.tracker.angle_v);
+        
+#if CONFIG_ENERGY_MODES
+                energy_mode_t mode = energy_step();
+#endif
+
+#if CONFIG_TELEMETRY_BATCH
+                // Se guarda la muestra; la tarea de subida enciende la radio cuando toca
+                telemetry_batch_add(&d_ina, &d_ldr, &d_tracker);
+#else
+#if CONFIG_ENERGY_MODES
+                bool burst = !energy_mode_policy()->radio;
+                bool online = !burst || radio_burst_begin();
+#else
+                bool online = true;
+#endif
+                // Enviar Telemetría MQTT
+                if (online && mqtt_send_telemetry(&d_ina, soc, d_ldr.ldr, &d_tracker.tracker) >= 0) {
+                    pipeline_record_latency(d_ina.sample_us);
+                    boot_profile_mark(BOOT_PHASE_PUBLISH);
+                    wifi_fast_ip_release();
                 }
+#if CONFIG_ENERGY_MODES
+                if (burst) radio_burst_end();
+#endif
+#endif
+
+#if CONFIG_ENERGY_MODES
+                // Después de publicar: el cambio de modo ya va en la telemetría
+                if (mode == ENERGY_MODE_SURVIVAL) enter_survival_sleep();
+#endif
 
-		    	vTaskDelay(pdMS_TO_TICKS(LOOP_PERIOD_S * 1000));
+				check_and_enter_sleep();
             }
 
-        } else if (bits & WIFI_FAIL_BIT) {
-            ESP_LOGE(TAG, "Fallo al conectar WiFi. ¿Credenciales mal? ¿Resetear NVS?");
-            // Aquí podrías decidir borrar NVS y reiniciar tras X fallos
-            // O arrancar las tareas en modo 'Offline'
+            pipeline_done(PIPELINE_STAGE_MAIN, release_us);
         }
 	}
 }